@@ -38,7 +38,7 @@ REM Modified TvText color palette
 REM
 REM Color index 0 sets the un-used background color
 REM
-dim TvText_palette() as byte = {
+const TvText_palette() as byte = {
     0x07,   0x03        // 0    white / black
     0x07,   0xBB        // 1    white / red
     0x9E,   0x9B        // 2   yellow / brown
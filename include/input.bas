@@ -3,104 +3,28 @@ include "string.bas"
 
 def lineMax = 128
 
-dim lineBuffer(lineMax + 1) as byte
-dim linePtr = 0
+// INPUT from the terminal uses the input traps directly
+// these handlers are called for INPUT #dev
 
 def inputGetLine(dev)
-    inputLine(dev, lineBuffer)
-    linePtr = 0
+    asm
+        trap 8
+    end asm
 end def
 
 def inputInt(dev)
-    dim ch = skipSpaces
-    dim value = 0
-    dim sign = 1
-    
-    // find the start of the token by skipping spaces
-    // read a new line if necessary
-    do while ch = NUL
-        inputGetLine(dev)
-        ch = skipSpaces
-    loop
-    
-    // check for a missing input
-    if ch = ',' then
-        return 0
-    end if
-    
-    // check for a minus sign
-    if ch = '-' then
-        sign = -1
-        ch = lineBuffer(linePtr)
-        linePtr = linePtr + 1
-    end if
-    
-    // build up the integer
-    do while isdigit(ch)
-        value = value * 10 + ch - '0'
-        linePtr = linePtr + 1
-        ch = lineBuffer(linePtr)
-    loop
-    
-    // look for the closing delimiter
-    do while ch <> NUL
-        linePtr = linePtr + 1
-        if ch = ',' then
-            return value
-        end if
-        ch = lineBuffer(linePtr)
-    loop
-    
-    // return the integer
-    return value
+    asm
+        trap 9
+        returnx
+    end asm
 end def
 
 def inputStr(dev, buf() as byte)
-    dim ch = skipSpaces
-    dim start, i
-    
-    // find the start of the token by skipping spaces
-    // read a new line if necessary
-    do while ch = NUL
-        inputGetLine(dev)
-        ch = skipSpaces
-    loop
-    
-    // remember the start of the token
-    start = linePtr
-    i = 0
-    
-    // copy the token to the buffer
-    do while ch <> NUL and ch <> ','
-        buf(i) = ch
-        linePtr = linePtr + 1
-        i = i + 1
-        ch = lineBuffer(linePtr)
-    loop
-    
-    // terminate the string
-    buf(i) = NUL
-
-    // look for the closing delimiter
-    do while ch <> NUL
-        linePtr = linePtr + 1
-        if ch = ',' then
-            return i
-        end if
-        ch = lineBuffer(linePtr)
-    loop
-    
-    // return the string length
-    return i
-end def
-
-def skipSpaces
-    dim ch = lineBuffer(linePtr)
-    do while ch <> NUL and isspace(ch)
-        linePtr = linePtr + 1
-        ch = lineBuffer(linePtr)
-    loop
-    return ch
+    asm
+        lref 1
+        trap 10
+        returnx
+    end asm
 end def
 
 def inputLine(dev, buf() as byte)
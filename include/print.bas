@@ -1,44 +1,46 @@
 /* based on some code by Steve Denson (jazzed) */
 
+// PRINT to the terminal uses the print traps directly
+// these handlers are called for PRINT #dev
+
 def printStr(dev, str() as byte)
-    dim n = 0
-    dim ch = str(n)
-    do while ch
-        uartTX(ch)
-        n = n + 1
-        ch = str(n)
-    loop
+    asm
+        lref 1
+        trap 2
+    end asm
 end def
 
 def printInt(dev, value)
-    dim n = value
-    dim length = 10
-    dim result = 0
-    if value < 0 then
-        value = -value
-        uartTX('-')
-    end if
-    n = 1000000000
-    do while length > 0
-        length = length - 1
-        if value >= n then
-            uartTX(value / n + '0')
-            value = value mod n
-            result = result + 1
-        else if result or n = 1 then
-            uartTX('0')
-        end if
-        n = n / 10
-    loop
+    asm
+        lref 1
+        trap 3
+    end asm
+end def
+
+def printHex(dev, value)
+    asm
+        lref 1
+        trap 4
+    end asm
+end def
+
+def printFixed(dev, value)
+    asm
+        lref 1
+        trap 5
+    end asm
 end def
 
 def printTab(dev)
-    uartTX(0x09)
+    asm
+        trap 6
+    end asm
 end def
 
 def printNL(dev)
-    uartTX(0x0d)
-    uartTX(0x0a)
+    asm
+        trap 7
+    end asm
 end def
 
 def uartTX(ch)
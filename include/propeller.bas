@@ -1,19 +1,3 @@
-def clkfreq
-  asm
-    dup                // make space for the return value
-    native rdlong tos, #0
-    returnx
-  end asm
-end def
-
-def cogid
-  asm
-    dup                // make space for the return value
-    native cogid tos
-    returnx
-  end asm
-end def
-
 def cognew(code, par)
   return coginit(0x8, code, par)
 end def
@@ -42,6 +26,15 @@ def coginit(id, code, par)
   end asm
 end def
 
+def cogrun(fcn, arg)
+  asm
+    lref 0              // get the function address
+    lref 1              // get its argument
+    trap 11             // start it on a free cog
+    returnx
+  end asm
+end def
+
 def cogstop(id)
   asm
     lref 0
@@ -63,7 +56,7 @@ end def
 def lockret(id)
   asm
     lref 0
-    native locknew tos
+    native lockret tos
     returnx
   end asm
 end def
@@ -88,14 +81,6 @@ def lockclr(id)
   end asm
 end def
 
-def waitcnt(n)
-  asm
-    lref 0
-    native waitcnt tos, #0
-    returnx
-  end asm
-end def
-
 def waitpeq(state, mask)
   asm
     lref 1                      // get mask
@@ -116,81 +101,3 @@ def waitpne(state, mask)
     returnx
   end asm
 end def
-
-def hubaddr(addr)
-  asm
-    lref 0
-    native add tos, base
-    returnx
-  end asm
-end def
-
-REM call as: value = PEEKB(ptr)
-def PEEKB(addr)
-    asm
-        lref 0              // get value tos
-        native add tos, base
-        native rdbyte tos, tos
-        returnx
-    end asm
-end def
-
-REM call as: POKEB(ptr, value)
-def POKEB(addr,value)
-    asm
-        lref 0              // get address tos
-        native add tos, base
-        native mov t4, tos
-        drop
-        lref 1              // get value tos
-        native wrbyte tos, t4
-        returnx             // need drop or returnx
-    end asm
-end def
-
-REM call as: value = PEEKW(ptr)
-def PEEKW(addr)
-   asm
-       lref 0              // get value tos
-       native add tos, base
-       native rdword tos, tos
-       returnx
-   end asm
-end def
-
-REM call as: POKEW(ptr, value)
-def POKEW(addr,value)
-   asm
-       lref 0              // get address tos
-       native add tos, base
-       native mov t4, tos
-       drop
-       lref 1              // get value tos
-       native wrword tos, t4
-       returnx             // need drop or returnx
-   end asm
-end def
-
-REM call as: value = PEEK(ptr)
-def PEEK(addr)
-    asm
-        lref 0              // get value tos
-        native add tos, base
-        native rdlong tos, tos
-        returnx
-    end asm
-end def
-
-REM call as: POKE(ptr, value)
-def POKE(addr,value)
-    asm
-        lref 0              // get address tos
-        native add tos, base
-        native mov t4, tos
-        drop
-        lref 1              // get value tos
-        native wrlong tos, t4
-        returnx             // need drop or returnx
-    end asm
-end def
-
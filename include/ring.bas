@@ -0,0 +1,110 @@
+rem ==================================================
+rem  single producer, single consumer rings
+rem
+rem  A ring is an INTEGER array in hub memory with
+rem  RING_HEADER elements of header followed by room
+rem  for a power of two values.  One cog puts values
+rem  into the ring and one other cog takes them out.
+rem  The producer only writes the head and the consumer
+rem  only writes the tail, so they don't need a lock.
+rem
+rem  ringput(ring, array, count), ringget(ring, array,
+rem  count) and ringpeek(ring, array, count) are built
+rem  in (see syntax.txt).
+rem ==================================================
+
+def RING_HEAD   = 0     // number of values put
+def RING_TAIL   = 1     // number of values taken
+def RING_MASK   = 2     // ring size - 1
+def RING_HEADER = 3
+
+rem ==================================================
+rem  empty a ring and return the number of values it
+rem  holds, the largest power of two that fits
+rem  @param ring - ring array
+rem  @param size - room in the array after the header
+rem ==================================================
+
+def ringinit(ring(), size)
+  dim n = 1
+  do while n + n <= size
+    n = n + n
+  loop
+  ring(RING_HEAD) = 0
+  ring(RING_TAIL) = 0
+  ring(RING_MASK) = n - 1
+  return n
+end def
+
+rem ==================================================
+rem  return the number of values waiting in a ring
+rem  @param ring - ring array
+rem ==================================================
+
+def ringcount(ring())
+  return ring(RING_HEAD) - ring(RING_TAIL)
+end def
+
+rem ==================================================
+rem  return the number of values that can be put into
+rem  a ring
+rem  @param ring - ring array
+rem ==================================================
+
+def ringspace(ring())
+  return ring(RING_MASK) + 1 - (ring(RING_HEAD) - ring(RING_TAIL))
+end def
+
+rem ==================================================
+rem  mailboxes
+rem
+rem  A mailbox is a ring that holds one value in an
+rem  INTEGER array of MAILBOX_SIZE elements.
+rem ==================================================
+
+def MAILBOX_SIZE = RING_HEADER + 1
+
+rem ==================================================
+rem  empty a mailbox
+rem  @param box - mailbox array
+rem ==================================================
+
+def mailinit(box())
+  ringinit(box, 1)
+end def
+
+rem ==================================================
+rem  return whether a mailbox holds a value
+rem  @param box - mailbox array
+rem ==================================================
+
+def mailready(box())
+  return box(RING_HEAD) <> box(RING_TAIL)
+end def
+
+rem ==================================================
+rem  wait for a mailbox to be empty and send a value
+rem  @param box - mailbox array
+rem  @param value - value to send
+rem ==================================================
+
+def mailsend(box(), value)
+  do while mailready(box)
+  loop
+  box(RING_HEADER) = value
+  box(RING_HEAD) = box(RING_HEAD) + 1
+end def
+
+rem ==================================================
+rem  wait for a value to arrive in a mailbox and take it
+rem  @param box - mailbox array
+rem ==================================================
+
+def mailrecv(box())
+  dim value
+  do while not mailready(box)
+  loop
+  value = box(RING_HEADER)
+  box(RING_TAIL) = box(RING_TAIL) + 1
+  return value
+end def
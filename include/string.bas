@@ -10,20 +10,8 @@ def CR  = 0x0d
 def DEL = 0x7f
 
 rem ==================================================
-rem  return length of string
-rem  @param str - string to measure
-rem ==================================================
-
-def strlen(str() as byte)
-    dim n, ch
-    n = 0
-    ch = str(n)
-    do while ch
-        n = n + 1
-        ch = str(n)
-    loop
-    return n
-end def
+rem  strlen(str) is built in (see syntax.txt)
+rem ==================================================
 
 rem ==================================================
 rem  copy string from str2 to str1
@@ -32,13 +20,7 @@ rem  @param str2 - src
 rem ==================================================
 
 def strcpy(str1() as byte, str2() as byte)
-  dim i = 0
-  dim ch
-  do
-    ch = str2(i)
-    str1(i) = ch
-    i = i + 1
-  loop until ch = 0
+  memcpy(str1, str2, strlen(str2) + 1)
 end def
 
 rem ==================================================
@@ -0,0 +1,33 @@
+rem ==================================================
+rem  cooperative tasks
+rem
+rem  A task runs a function of one argument on a slice
+rem  of the interpreter stack taken from the bottom of
+rem  the stack of the task that starts it.  The tasks
+rem  take turns at each YIELD statement, and a task
+rem  that reads the terminal lets the others run until
+rem  a character arrives.  A task ends when its
+rem  function returns and the program ends when the
+rem  code that started the first task halts.
+rem ==================================================
+
+def TASK_MAX       = 8      // tasks including the first
+def TASK_MIN_STACK = 8      // smallest task stack in longs
+
+rem ==================================================
+rem  start a function as a task and return the task id
+rem  or -1 if there is no room for another task
+rem  @param fcn - address of the function (@name)
+rem  @param arg - argument passed to the function
+rem  @param size - stack size of the task in longs
+rem ==================================================
+
+def taskrun(fcn, arg, size)
+  asm
+    lref 0              // get the function address
+    lref 1              // get its argument
+    lref 2              // get the stack size
+    trap 12             // start it as a task
+    returnx
+  end asm
+end def
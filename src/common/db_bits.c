@@ -0,0 +1,38 @@
+/* db_bits.c - bit manipulation operations
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * Shift counts and bit numbers use only their low bits the way the
+ * Propeller's shift instructions do, so the OP_SHRU, OP_ROL, OP_ROR and
+ * OP_BITxxx handlers in xbasic_vm.spin produce the same results.
+ */
+
+#include "db_bits.h"
+
+/* ShiftRightUnsigned - shift right filling with zeros */
+VMVALUE ShiftRightUnsigned(VMVALUE value, VMVALUE count)
+{
+    return (VMVALUE)((VMUVALUE)value >> (count & (VMVALUE_BITS - 1)));
+}
+
+/* RotateLeft - rotate left */
+VMVALUE RotateLeft(VMVALUE value, VMVALUE count)
+{
+    VMUVALUE u = (VMUVALUE)value;
+    count &= VMVALUE_BITS - 1;
+    return count == 0 ? value : (VMVALUE)((VMUVALUE)(u << count) | (u >> (VMVALUE_BITS - count)));
+}
+
+/* RotateRight - rotate right */
+VMVALUE RotateRight(VMVALUE value, VMVALUE count)
+{
+    VMUVALUE u = (VMUVALUE)value;
+    count &= VMVALUE_BITS - 1;
+    return count == 0 ? value : (VMVALUE)((u >> count) | (VMUVALUE)(u << (VMVALUE_BITS - count)));
+}
+
+/* BitMask - make a mask with a single bit set */
+VMVALUE BitMask(VMVALUE bit)
+{
+    return (VMVALUE)((VMUVALUE)1 << (bit & (VMVALUE_BITS - 1)));
+}
@@ -0,0 +1,21 @@
+/* db_bits.h - bit manipulation operations
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_BITS_H__
+#define __DB_BITS_H__
+
+#include "db_config.h"
+
+/* number of bits in a VMVALUE */
+#define VMVALUE_BITS    ((int)sizeof(VMVALUE) * 8)
+
+/* bit operations shared by the compiler constant folder and the vm */
+VMVALUE ShiftRightUnsigned(VMVALUE value, VMVALUE count);
+VMVALUE RotateLeft(VMVALUE value, VMVALUE count);
+VMVALUE RotateRight(VMVALUE value, VMVALUE count);
+VMVALUE BitMask(VMVALUE bit);
+
+#endif
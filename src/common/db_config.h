@@ -89,6 +89,7 @@ struct Section {
     VMUVALUE base;      // base address
     VMUVALUE size;      // maximum size
     VMUVALUE offset;    // next available offset
+    VMUVALUE zeroSize;  // size of the zero filled space following the data
     FILE *fp;           // image or scratch file pointer
     Section *next;      // next section
     char name[1];       // section name
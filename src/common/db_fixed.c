@@ -0,0 +1,80 @@
+/* db_fixed.c - 16.16 fixed point arithmetic
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * These follow the OP_FMUL, OP_FDIV and OP_RSHR handlers in xbasic_vm.spin
+ * step for step so that the compiler, xbint and the Propeller all produce
+ * the same bits.  Products and quotients are rounded to nearest with halves
+ * rounded away from zero.  Quotients that don't fit saturate.
+ */
+
+#include "db_fixed.h"
+
+/* FixedMul - multiply two fixed point values */
+VMVALUE FixedMul(VMVALUE a, VMVALUE b)
+{
+    uint32_t ua = (a < 0 ? -(uint32_t)a : (uint32_t)a);
+    uint32_t ub = (b < 0 ? -(uint32_t)b : (uint32_t)b);
+    uint32_t al = ua & 0xffff, ah = ua >> 16;
+    uint32_t bl = ub & 0xffff, bh = ub >> 16;
+    uint32_t r;
+
+    /* bits 16 through 47 of the 64 bit product rounded to nearest */
+    r = ((ah * bh) << 16) + ah * bl + al * bh + ((al * bl + 0x8000) >> 16);
+
+    /* apply the sign */
+    return (VMVALUE)((a ^ b) < 0 ? -r : r);
+}
+
+/* FixedDiv - divide two fixed point values */
+VMVALUE FixedDiv(VMVALUE a, VMVALUE b)
+{
+    uint32_t ua = (a < 0 ? -(uint32_t)a : (uint32_t)a);
+    uint32_t ub = (b < 0 ? -(uint32_t)b : (uint32_t)b);
+    uint32_t hi, lo, carry;
+    int i;
+
+    /* division by zero gives zero like OP_DIV */
+    if (ub == 0)
+        return 0;
+
+    /* hi:lo = (ua << 16) + ub / 2 */
+    hi = ua >> 16;
+    lo = ua << 16;
+    lo += ub >> 1;
+    if (lo < (ub >> 1))
+        ++hi;
+
+    /* saturate if the quotient won't fit in 32 bits */
+    if (hi >= ub)
+        lo = 0xffffffff;
+
+    /* shift the quotient into lo as the dividend is shifted out */
+    else {
+        for (i = 0; i < 32; ++i) {
+            carry = lo >> 31;
+            lo <<= 1;
+            hi = (hi << 1) | carry;
+            if (hi >= ub) {
+                hi -= ub;
+                lo |= 1;
+            }
+        }
+    }
+
+    /* saturate if the quotient won't fit in 31 bits */
+    if (lo > 0x7fffffff)
+        lo = 0x7fffffff;
+
+    /* apply the sign */
+    return (VMVALUE)((a ^ b) < 0 ? -lo : lo);
+}
+
+/* RoundingShift - arithmetic shift right rounding to nearest */
+VMVALUE RoundingShift(VMVALUE value, VMVALUE count)
+{
+    if (count == 0)
+        return value;
+    value >>= (count - 1) & 31;
+    return (value >> 1) + (value & 1);
+}
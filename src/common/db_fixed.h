@@ -0,0 +1,20 @@
+/* db_fixed.h - 16.16 fixed point arithmetic
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_FIXED_H__
+#define __DB_FIXED_H__
+
+#include "db_config.h"
+
+/* number of fraction bits in a fixed point value */
+#define FIXED_SHIFT     16
+
+/* fixed point operations shared by the compiler constant folder and the vm */
+VMVALUE FixedMul(VMVALUE a, VMVALUE b);
+VMVALUE FixedDiv(VMVALUE a, VMVALUE b);
+VMVALUE RoundingShift(VMVALUE value, VMVALUE count);
+
+#endif
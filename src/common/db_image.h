@@ -10,13 +10,14 @@
 #include "db_config.h"
 
 #define IMAGE_TAG       "XLOD"
-#define IMAGE_VERSION   0x0100
+#define IMAGE_VERSION   0x0200
 
 /* image file section */
 typedef struct {
     VMUVALUE base;
     VMUVALUE offset;
     VMUVALUE size;
+    VMUVALUE zeroSize;  /* bytes to clear following the section data */
 } ImageFileSection;
 
 /* image file header */
@@ -34,6 +35,10 @@ typedef struct {
 #define F_FP    -1
 #define F_SIZE  1
 
+/* the saved frame pointer also holds the number of arguments to remove on return */
+#define F_ARGC_SHIFT    24
+#define F_FP_MASK       ((1 << F_ARGC_SHIFT) - 1)
+
 /* opcodes */
 #define OP_HALT         0x00    /* halt */
 #define OP_BRT          0x01    /* branch on true */
@@ -79,11 +84,58 @@ typedef struct {
 #define OP_DUP          0x29    /* duplicate the top element of the stack */
 #define OP_NATIVE       0x2a    /* execute native code */
 #define OP_TRAP         0x2b    /* trap to handler */
+#define OP_SWITCH       0x2c    /* branch through a table of case offsets */
+#define OP_CALL         0x2d    /* call a function and remove its arguments on return */
+#define OP_LRETURN      0x2e    /* return from a leaf function that has no stack frame */
+#define OP_TCALL        0x2f    /* call a function reusing the current stack frame */
+#define OP_LOADW        0x30    /* load a word from memory */
+#define OP_STOREW       0x31    /* store a word into memory */
+#define OP_FMUL         0x32    /* multiply two fixed point values */
+#define OP_FDIV         0x33    /* divide two fixed point values */
+#define OP_RSHR         0x34    /* shift right rounding to nearest */
+#define OP_SHRU         0x35    /* shift right filling with zeros */
+#define OP_ROL          0x36    /* rotate left */
+#define OP_ROR          0x37    /* rotate right */
+#define OP_BITSET       0x38    /* set a bit */
+#define OP_BITCLR       0x39    /* clear a bit */
+#define OP_BITTST       0x3a    /* test a bit */
+#define OP_BITTGL       0x3b    /* toggle a bit */
+#define OP_MEMCPY       0x3c    /* copy a block of array elements */
+#define OP_MEMSET       0x3d    /* fill a block of array elements */
+#define OP_MEMCMP       0x3e    /* compare two blocks of array elements */
+#define OP_MEMCHR       0x3f    /* find a value in a block of array elements */
+#define OP_STRLEN       0x40    /* get the length of a zero terminated string */
+#define OP_HUBADDR      0x41    /* convert a vm address to a hub address */
+#define OP_COGID        0x42    /* push the id of the cog running the vm */
+#define OP_CLKFREQ      0x43    /* push the system clock frequency */
+#define OP_WAITCNT      0x44    /* wait for the system counter to reach a value */
+#define OP_RINGPUT      0x45    /* put array elements into a ring */
+#define OP_RINGGET      0x46    /* take elements from a ring into an array */
+#define OP_RINGPEEK     0x47    /* copy elements from a ring into an array leaving them in the ring */
+#define OP_LADDI        0x48    /* add a short literal to a local variable */
 
 /* OP_TRAP functions */
 enum {
-    TRAP_GETCHAR = 0x00,
-    TRAP_PUTCHAR
+    TRAP_GETCHAR = 0x00,    /* push a character read from the terminal */
+    TRAP_PUTCHAR,           /* pop a character and write it to the terminal */
+    TRAP_PRINTSTR,          /* pop the address of a zero terminated string and print it */
+    TRAP_PRINTINT,          /* pop an integer and print it in decimal */
+    TRAP_PRINTHEX,          /* pop an integer and print it in hex */
+    TRAP_PRINTFIXED,        /* pop a fixed point value and print it with four decimal places */
+    TRAP_PRINTTAB,          /* print a tab */
+    TRAP_PRINTNL,           /* end the output line */
+    TRAP_INPUTLINE,         /* read a new input line */
+    TRAP_INPUTINT,          /* push the next integer field of the input line */
+    TRAP_INPUTSTR,          /* copy the next input field into a byte array and replace its address with the length */
+    TRAP_COGRUN,            /* pop an argument and start the function below it on a free cog replacing it with the cog id or -1 */
+    TRAP_TASKRUN,           /* pop a stack size and an argument and start the function below them as a task replacing it with the task id or -1 */
+    TRAP_YIELD              /* switch to the next task */
 };
 
+/* ring layout (in VMVALUEs) used by OP_RINGPUT, OP_RINGGET and OP_RINGPEEK */
+#define RING_HEAD       0       /* number of elements put, written only by the producer */
+#define RING_TAIL       1       /* number of elements taken, written only by the consumer */
+#define RING_MASK       2       /* number of elements the ring holds minus one (a power of two) */
+#define RING_HEADER     3       /* the elements follow the header */
+
 #endif
@@ -0,0 +1,240 @@
+/* db_p1alu.c - propeller ALU instructions
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * These are the instructions that compute a result and a carry from the
+ * destination and source values and the incoming flags without touching
+ * the hub, the pins or the program counter.  The interpreter's OP_NATIVE
+ * emulation and the propeller emulator each handle the rest themselves.
+ */
+
+#include "db_p1alu.h"
+
+/* instruction fields changed by MOVS, MOVD and MOVI */
+#define DST_SHIFT       9
+#define INST_SHIFT      23
+#define FIELD_MASK      0x1ff
+
+/* prototypes */
+static int Parity(uint32_t value);
+static uint32_t Reverse(uint32_t value);
+
+/* P1Alu - execute an ALU instruction, returns FALSE if op isn't one
+ *
+ * The carry is left as cin by the instructions that don't change it.  For
+ * the extended instructions *pExtend is set to TRUE because they can only
+ * leave Z set if it was set before.
+ */
+int P1Alu(int op, uint32_t d, uint32_t s, int cin, int zin, uint32_t *pR, int *pC, int *pExtend)
+{
+    int c = cin, extend = FALSE, n = s & 0x1f;
+    uint32_t r;
+
+    switch (op) {
+    case 0x08:  /* ROR */
+        r = n ? (d >> n) | (d << (32 - n)) : d;
+        c = d & 1;
+        break;
+    case 0x09:  /* ROL */
+        r = n ? (d << n) | (d >> (32 - n)) : d;
+        c = d >> 31;
+        break;
+    case 0x0a:  /* SHR */
+        r = d >> n;
+        c = d & 1;
+        break;
+    case 0x0b:  /* SHL */
+        r = d << n;
+        c = d >> 31;
+        break;
+    case 0x0c:  /* RCR */
+        r = (d >> n) | (cin && n ? ~(0xffffffff >> n) : 0);
+        c = d & 1;
+        break;
+    case 0x0d:  /* RCL */
+        r = (d << n) | (cin ? (((uint32_t)1 << n) - 1) : 0);
+        c = d >> 31;
+        break;
+    case 0x0e:  /* SAR */
+        r = (uint32_t)((int32_t)d >> n);
+        c = d & 1;
+        break;
+    case 0x0f:  /* REV */
+        r = Reverse(d) >> n;
+        c = d & 1;
+        break;
+    case 0x10:  /* MINS */
+        c = (int32_t)d < (int32_t)s;
+        r = c ? s : d;
+        break;
+    case 0x11:  /* MAXS */
+        c = (int32_t)d < (int32_t)s;
+        r = c ? d : s;
+        break;
+    case 0x12:  /* MIN */
+        c = d < s;
+        r = c ? s : d;
+        break;
+    case 0x13:  /* MAX */
+        c = d < s;
+        r = c ? d : s;
+        break;
+    case 0x14:  /* MOVS */
+        r = (d & ~FIELD_MASK) | (s & FIELD_MASK);
+        break;
+    case 0x15:  /* MOVD */
+        r = (d & ~(FIELD_MASK << DST_SHIFT)) | ((s & FIELD_MASK) << DST_SHIFT);
+        break;
+    case 0x16:  /* MOVI */
+        r = (d & ~((uint32_t)FIELD_MASK << INST_SHIFT)) | ((s & FIELD_MASK) << INST_SHIFT);
+        break;
+    case 0x18:  /* AND, TEST */
+        r = d & s;
+        c = Parity(r);
+        break;
+    case 0x19:  /* ANDN, TESTN */
+        r = d & ~s;
+        c = Parity(r);
+        break;
+    case 0x1a:  /* OR */
+        r = d | s;
+        c = Parity(r);
+        break;
+    case 0x1b:  /* XOR */
+        r = d ^ s;
+        c = Parity(r);
+        break;
+    case 0x1c:  /* MUXC */
+    case 0x1d:  /* MUXNC */
+    case 0x1e:  /* MUXZ */
+    case 0x1f:  /* MUXNZ */
+        r = (d & ~s) | ((op & 2 ? zin : cin) ^ (op & 1) ? s : 0);
+        c = Parity(r);
+        break;
+    case 0x20:  /* ADD */
+        r = d + s;
+        c = r < d;
+        break;
+    case 0x21:  /* SUB, CMP */
+        r = d - s;
+        c = d < s;
+        break;
+    case 0x22:  /* ADDABS */
+        s = (int32_t)s < 0 ? -s : s;
+        r = d + s;
+        c = r < d;
+        break;
+    case 0x23:  /* SUBABS */
+        s = (int32_t)s < 0 ? -s : s;
+        r = d - s;
+        c = d < s;
+        break;
+    case 0x24:  /* SUMC */
+    case 0x25:  /* SUMNC */
+    case 0x26:  /* SUMZ */
+    case 0x27:  /* SUMNZ */
+        if ((op & 2 ? zin : cin) ^ (op & 1)) {
+            r = d - s;
+            c = (((d ^ s) & (d ^ r)) >> 31) & 1;
+        }
+        else {
+            r = d + s;
+            c = ((~(d ^ s) & (d ^ r)) >> 31) & 1;
+        }
+        break;
+    case 0x28:  /* MOV */
+        r = s;
+        c = s >> 31;
+        break;
+    case 0x29:  /* NEG */
+        r = -s;
+        c = s >> 31;
+        break;
+    case 0x2a:  /* ABS */
+        r = (int32_t)s < 0 ? -s : s;
+        c = s >> 31;
+        break;
+    case 0x2b:  /* ABSNEG */
+        r = (int32_t)s < 0 ? s : -s;
+        c = s >> 31;
+        break;
+    case 0x2c:  /* NEGC */
+    case 0x2d:  /* NEGNC */
+    case 0x2e:  /* NEGZ */
+    case 0x2f:  /* NEGNZ */
+        r = (op & 2 ? zin : cin) ^ (op & 1) ? -s : s;
+        c = s >> 31;
+        break;
+    case 0x30:  /* CMPS */
+        r = d - s;
+        c = (int32_t)d < (int32_t)s;
+        break;
+    case 0x31:  /* CMPSX */
+        r = d - s - cin;
+        c = (int64_t)(int32_t)d < (int64_t)(int32_t)s + cin;
+        extend = TRUE;
+        break;
+    case 0x32:  /* ADDX */
+        r = d + s + cin;
+        c = (uint64_t)d + s + cin > 0xffffffff;
+        extend = TRUE;
+        break;
+    case 0x33:  /* SUBX, CMPX */
+        r = d - s - cin;
+        c = (uint64_t)d < (uint64_t)s + cin;
+        extend = TRUE;
+        break;
+    case 0x34:  /* ADDS */
+        r = d + s;
+        c = ((~(d ^ s) & (d ^ r)) >> 31) & 1;
+        break;
+    case 0x35:  /* SUBS */
+        r = d - s;
+        c = (((d ^ s) & (d ^ r)) >> 31) & 1;
+        break;
+    case 0x36:  /* ADDSX */
+        r = d + s + cin;
+        c = (int64_t)(int32_t)d + (int32_t)s + cin != (int32_t)r;
+        extend = TRUE;
+        break;
+    case 0x37:  /* SUBSX */
+        r = d - s - cin;
+        c = (int64_t)(int32_t)d - (int32_t)s - cin != (int32_t)r;
+        extend = TRUE;
+        break;
+    case 0x38:  /* CMPSUB */
+        c = d >= s;
+        r = c ? d - s : d;
+        break;
+    default:    /* hub instructions, jumps, waits and undefined opcodes */
+        return FALSE;
+    }
+
+    *pR = r;
+    *pC = c;
+    *pExtend = extend;
+    return TRUE;
+}
+
+/* Parity - get the parity of a value */
+static int Parity(uint32_t value)
+{
+    value ^= value >> 16;
+    value ^= value >> 8;
+    value ^= value >> 4;
+    value ^= value >> 2;
+    value ^= value >> 1;
+    return value & 1;
+}
+
+/* Reverse - reverse the bits of a value */
+static uint32_t Reverse(uint32_t value)
+{
+    uint32_t result = 0;
+    int i;
+    for (i = 0; i < 32; ++i) {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+    return result;
+}
@@ -0,0 +1,15 @@
+/* db_p1alu.h - propeller ALU instructions
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_P1ALU_H__
+#define __DB_P1ALU_H__
+
+#include "db_config.h"
+
+/* ALU instructions shared by the OP_NATIVE emulation in the vm and the propeller emulator */
+int P1Alu(int op, uint32_t d, uint32_t s, int cin, int zin, uint32_t *pR, int *pC, int *pExtend);
+
+#endif
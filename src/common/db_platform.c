@@ -16,7 +16,7 @@
 #define CURSOR	1
 #define DEL		0x7f
 
-void VM_getline(char *buf, int size)
+int VM_getline(char *buf, int size)
 {
 	int i = 0;
 	while (i < size - 1) {
@@ -40,13 +40,18 @@ void VM_getline(char *buf, int size)
 		}
 	}
 	buf[i] = '\0';
+	return 1;
 }
 
 #else // posix
 
-void VM_getline(char *buf, int size)
+int VM_getline(char *buf, int size)
 {
-	fgets(buf, size, stdin);
+	if (!fgets(buf, size, stdin)) {
+		buf[0] = '\0';
+		return 0;
+	}
+	return 1;
 }
 
 #endif
@@ -18,6 +18,7 @@
 static void GenerateDependencies(ParseContext *c);
 static void ApplyLocalFixups(ParseContext *c, VMUVALUE base);
 static void DumpLocalFixups(ParseContext *c);
+static void DumpFunctionSymbols(ParseContext *c);
 static void UpdateReferences(ParseContext *c);
 
 /* InitCompiler - initialize the compiler */
@@ -42,6 +43,16 @@ ParseContext *InitCompiler(System *sys, BoardConfig *config, size_t codeBufSize)
     c->byteArrayType.u.arrayInfo.elementType = &c->byteType;
     c->bytePointerType.id = TYPE_POINTER;
     c->bytePointerType.u.pointerInfo.targetType = &c->byteType;
+    c->wordType.id = TYPE_WORD;
+    c->wordArrayType.id = TYPE_ARRAY;
+    c->wordArrayType.u.arrayInfo.elementType = &c->wordType;
+    c->wordPointerType.id = TYPE_POINTER;
+    c->wordPointerType.u.pointerInfo.targetType = &c->wordType;
+    c->fixedType.id = TYPE_FIXED;
+    c->fixedArrayType.id = TYPE_ARRAY;
+    c->fixedArrayType.u.arrayInfo.elementType = &c->fixedType;
+    c->fixedPointerType.id = TYPE_POINTER;
+    c->fixedPointerType.u.pointerInfo.targetType = &c->fixedType;
     c->codeBuf = (uint8_t *)c + sizeof(ParseContext);
     c->ctop = c->codeBuf + codeBufSize;
     c->sys = sys;
@@ -67,13 +78,26 @@ int Compile(ParseContext *c, const char *name)
     /* setup an error target */
     if (setjmp(c->errorTarget) != 0) {
         CloseParseContext(c);
+        CloseMapFile(c);
         return FALSE;
     }
         
-    /* start the image and initialize the interpreter stack size */
+    /* start the image and size the interpreter stack automatically unless an option sets it */
     if (!StartImage(c, name))
         return FALSE;
-    c->stackSize = DEFAULT_STACK_SIZE;
+    c->stackSize = 0;
+    c->stackUsage = NULL;
+    c->dataUsage = NULL;
+
+    /* open the statement map and load the execution profile */
+    if (c->flags & COMPILER_MAP)
+        OpenMapFile(c, name);
+    if (c->profileName)
+        LoadProfile(c, c->profileName);
+
+    /* code executed through a cache is laid out after all of it is generated */
+    c->layoutCode = (c->config->cacheDriver && (c->flags & COMPILER_OPT_MASK) != COMPILER_OPT(0));
+    c->pendingCode = NULL;
 
     /* initialize block nesting stack */
     c->btop = (Block *)((char *)c->blockBuf + sizeof(c->blockBuf));
@@ -151,9 +175,24 @@ int Compile(ParseContext *c, const char *name)
         /* clear the list of included files for the next pass */
         ClearIncludedFiles(c);
     }
+
+    /* place the code in the order chosen by the function layout */
+    if (c->layoutCode)
+        LayoutFunctions(c);
     
-    /* close the input file */
+    /* close the input file and the statement map */
     CloseParseContext(c);
+    CloseMapFile(c);
+
+    /* show the optimization statistics */
+    if (c->flags & COMPILER_INFO)
+        ShowPassStatistics(c);
+
+    /* size the interpreter stack from the stack usage of the code */
+    SizeStack(c);
+
+    /* place the data in the hub or external ram now that the stack size is known */
+    PlaceData(c);
 
     /* update all global variable references */
     UpdateReferences(c);
@@ -232,17 +271,41 @@ static void GenerateDependencies(ParseContext *c)
 /* StoreCode - store the function or method under construction */
 void StoreCode(ParseContext *c)
 {
-    int codeSize;
-
     /* initialize */
     c->symbolFixups = NULL;
 
-    /* generate code for the function */
+    /* optimize and generate code for the function */
+    NumberStatements(c, c->function);
+    CountDataReferences(c, c->function);
+    RunTreePasses(c, c->function);
     Generate(c, c->function);
+    RunCodePasses(c, c->function);
+    AnalyzeStack(c, c->function->u.functionDefinition.symbol);
     
+    /* place the code now or after the function layout is known */
+    if (c->layoutCode) {
+        if (c->flags & COMPILER_DEBUG) {
+            Symbol *symbol = c->function->u.functionDefinition.symbol;
+            xbInfo(c->sys, "\n%s: (placed after function layout)\n", symbol ? symbol->name : "[main]");
+            DumpFunctionSymbols(c);
+        }
+        DeferCode(c, c->function->u.functionDefinition.symbol);
+    }
+    else
+        PlaceCode(c, c->function->u.functionDefinition.symbol);
+
+    /* reset to compile the next code */
+    c->cptr = c->codeBuf;
+}
+
+/* PlaceCode - place the code in the code buffer at the end of the text section */
+void PlaceCode(ParseContext *c, Symbol *symbol)
+{
+    int codeSize;
+
     /* store the function or main offset */
-    if (c->functionType)
-        c->function->u.functionDefinition.symbol->v.variable.offset = c->textTarget->offset;
+    if (symbol)
+        symbol->v.variable.offset = c->textTarget->offset;
     else
         c->mainCode = c->textTarget->base + c->textTarget->offset;
 
@@ -252,23 +315,30 @@ void StoreCode(ParseContext *c)
     /* determine the code size */
     codeSize = c->cptr - c->codeBuf;
 
+    /* add the function statements to the statement map */
+    if (c->mapFile)
+        WriteMapFunction(c, symbol ? symbol->name : "[main]", c->textTarget->base + c->textTarget->offset, codeSize);
+
     /* show the function disassembly */
     if (c->flags & COMPILER_DEBUG) {
-        Symbol *symbol = c->function->u.functionDefinition.symbol;
         xbInfo(c->sys, "\n%s:\n", symbol ? symbol->name : "[main]");
         DecodeFunction(c->sys, c->textTarget->base + c->textTarget->offset, c->codeBuf, codeSize);
-        if (c->functionType)
-            DumpSymbols(c, &c->function->type->u.functionInfo.arguments, "arguments");
-        DumpSymbols(c, &c->function->u.functionDefinition.locals, "locals");
-        DumpLabels(c);
+        if (c->function)
+            DumpFunctionSymbols(c);
         DumpLocalFixups(c);
     }
     
     /* store the code */
     c->textTarget->offset += WriteSection(c, c->textTarget, c->codeBuf, codeSize);
+}
 
-    /* reset to compile the next code */
-    c->cptr = c->codeBuf;
+/* DumpFunctionSymbols - dump the arguments, locals and labels of the current function */
+static void DumpFunctionSymbols(ParseContext *c)
+{
+    if (c->functionType)
+        DumpSymbols(c, &c->function->type->u.functionInfo.arguments, "arguments");
+    DumpSymbols(c, &c->function->u.functionDefinition.locals, "locals");
+    DumpLabels(c);
 }
 
 /* AddString - add a string to the string table */
@@ -369,6 +439,8 @@ static void UpdateReferences(ParseContext *c)
             case SC_CONSTANT: // function text offset
             case SC_GLOBAL:
                 addr = sym->section->base + sym->v.variable.offset;
+                if (sym->zeroFilled)
+                    addr += sym->section->offset;
                 break;
             default:
                 ParseError(c, "unexpected storage class");
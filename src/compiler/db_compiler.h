@@ -9,8 +9,11 @@
 
 #include <stdio.h>
 #include <setjmp.h>
+#include <time.h>
 #include "db_config.h"
 #include "db_image.h"
+#include "db_fixed.h"
+#include "db_bits.h"
 #include "db_system.h"
 #include "xb_api.h"
 
@@ -22,6 +25,7 @@
 #define MAXLINE             128
 #define MAXTOKEN            32
 #define DEFAULT_STACK_SIZE  (64 * sizeof(VMVALUE))
+#define MAX_PASSES          16
 
 /* forward type declarations */
 typedef struct Type Type;
@@ -33,6 +37,11 @@ typedef struct String String;
 typedef struct ParseTreeNode ParseTreeNode;
 typedef struct NodeListEntry NodeListEntry;
 typedef struct CaseListEntry CaseListEntry;
+typedef struct IRFunction IRFunction;
+typedef struct FunctionProfile FunctionProfile;
+typedef struct PendingCode PendingCode;
+typedef struct StackUsage StackUsage;
+typedef struct DataUsage DataUsage;
 
 /* lexical tokens */
 enum {
@@ -42,6 +51,7 @@ enum {
     T_OPTION,
     T_DEF,
     T_DIM,
+    T_CONST,
     T_AS,
     T_IN,
     T_LET,
@@ -70,6 +80,8 @@ enum {
     T_INPUT,
     T_PRINT,
     T_ASM,
+    T_YIELD,
+    T_HEX,
     T_ELSE_IF,  /* compound keywords */
     T_END_DEF,
     T_END_IF,
@@ -84,8 +96,10 @@ enum {
     T_GE,
     T_SHL,
     T_SHR,
+    T_SHRU,
     T_IDENTIFIER,
     T_NUMBER,
+    T_FIXED_NUMBER,
     T_STRING,
     T_EOL,
     T_EOF
@@ -122,6 +136,12 @@ typedef struct {
     } u;
 } GenBlock;
 
+/* optimization pass statistics */
+typedef struct {
+    long changes;               /* number of changes made by the pass */
+    clock_t time;               /* time spent running the pass */
+} PassStats;
+
 struct String {
     String *next;
     int placed;
@@ -169,6 +189,9 @@ struct Symbol {
     Symbol *next;
     StorageClass storageClass;
     Section *section;
+    int zeroFilled;
+    uint8_t *constData;
+    VMUVALUE constSize;
     Type *type;
     union {
         struct {
@@ -185,6 +208,8 @@ struct Symbol {
 typedef enum {
     TYPE_INTEGER,
     TYPE_BYTE,
+    TYPE_WORD,
+    TYPE_FIXED,
     TYPE_STRING,
     TYPE_ARRAY,
     TYPE_POINTER,
@@ -205,6 +230,7 @@ struct Type {
             Type *returnType;
             SymbolTable arguments;
             Dependency *dependencies;
+            ParseTreeNode *inlineBody;  /* expression to substitute for a call */
         } functionInfo;
     } u;
 };
@@ -276,6 +302,7 @@ typedef struct {
     IncludedFile *currentInclude;   /* scan - file currently being included */
     char lineBuf[MAXLINE];          /* scan - line buffer */
     char *linePtr;                  /* scan - pointer to the current character */
+    VMUVALUE lineHash;              /* scan - hash of the current line ignoring white space */
     int savedToken;                 /* scan - lookahead token */
     int tokenOffset;                /* scan - offset to the start of the current token */
     char token[MAXTOKEN];           /* scan - current token string */
@@ -288,6 +315,12 @@ typedef struct {
     Type byteType;                  /* parse - byte type */
     Type byteArrayType;             /* parse - byte array type */
     Type bytePointerType;           /* parse - byte pointer type */
+    Type wordType;                  /* parse - word type */
+    Type wordArrayType;             /* parse - word array type */
+    Type wordPointerType;           /* parse - word pointer type */
+    Type fixedType;                 /* parse - fixed point type */
+    Type fixedArrayType;            /* parse - fixed point array type */
+    Type fixedPointerType;          /* parse - fixed point pointer type */
     SymbolTable globals;            /* parse - global variables and constants */
     String *strings;                /* parse - string constants */
     Type *functionType;             /* parse - in a function definition */
@@ -301,7 +334,7 @@ typedef struct {
     Block blockBuf[10];             /* parse - stack of nested blocks */
     Block *bptr;                    /* parse - current block */
     Block *btop;                    /* parse - top of block stack */
-    int stackSize;                  /* parse - interpreter stack size */
+    int stackSize;                  /* parse - interpreter stack size in words or zero to size it automatically */
     int pass;                       /* parse - compiler pass in progress */
     GenBlock genBlockBuf[10];       /* generate - stack of nested generator blocks */
     GenBlock *gptr;                 /* generate - current generator block */
@@ -311,6 +344,18 @@ typedef struct {
     uint8_t *cptr;                  /* generate - next available code staging buffer position */
     uint8_t *ctop;                  /* generate - top of code staging buffer */
     uint8_t *codeBuf;               /* generate - code staging buffer */
+    int layoutCode;                 /* generate - defer code placement until the function layout is known */
+    PendingCode *pendingCode;       /* generate - code waiting to be placed */
+    StackUsage *stackUsage;         /* generate - stack usage of each function stored */
+    DataUsage *dataUsage;           /* generate - accesses to each zero filled variable */
+    PassStats passStats[MAX_PASSES];/* optimize - statistics for each optimization pass */
+    VMUVALUE *statementAddrs;       /* optimize - code offset of each statement of the current function */
+    int statementCount;             /* optimize - number of statements in the current function */
+    VMUVALUE *statementHashes;      /* profile - source line hash of each statement of the current function */
+    char *profileName;              /* profile - name of the execution profile file */
+    FunctionProfile *profiles;      /* profile - execution profiles of the functions */
+    FunctionProfile *profile;       /* profile - execution profile of the current function */
+    FILE *mapFile;                  /* profile - statement map for the profiler */
 } ParseContext;
 
 /* partial value */
@@ -356,6 +401,7 @@ typedef enum {
     NodeTypeGotoStatement,
     NodeTypeEndStatement,
     NodeTypeAsmStatement,
+    NodeTypeTrapStatement,
     NodeTypeGlobalRef,
     NodeTypeLocalRef,
     NodeTypeFunctionLit,
@@ -368,19 +414,24 @@ typedef enum {
     NodeTypeFunctionCall,
     NodeTypeDisjunction,
     NodeTypeConjunction,
-    NodeTypeAddressOf
+    NodeTypeAddressOf,
+    NodeTypeIntrinsicCall
 } NodeType;
 
 /* parse tree node structure */
 struct ParseTreeNode {
     NodeType nodeType;
     Type *type;
+    int index;          /* statement number within the function (zero if hidden) */
+    VMUVALUE lineHash;  /* hash of the source line the node was parsed from */
     union {
         struct {
             Symbol *symbol;
             SymbolTable locals;
             Label *labels;
             int localOffset;
+            int hasCalls;       /* function calls other functions or contains assembly code */
+            int hasAsm;         /* function contains assembly code */
             NodeListEntry *bodyStatements;
         } functionDefinition;
         struct {
@@ -418,6 +469,10 @@ struct ParseTreeNode {
         struct {
             ParseTreeNode *expr;
         } callStatement;
+        struct {
+            int trap;
+            ParseTreeNode *expr;    /* argument or NULL if none */
+        } trapStatement;
         struct {
             Label *label;
         } labelDefinition;
@@ -470,6 +525,11 @@ struct ParseTreeNode {
         struct {
             ParseTreeNode *expr;
         } addressOf;
+        struct {
+            int op;
+            int operand;        /* element size or trap function or zero if none */
+            NodeListEntry *args;
+        } intrinsicCall;
     } u;
 };
 
@@ -495,6 +555,7 @@ uint8_t *HeapAlloc(size_t size);
 ParseContext *InitCompiler(System *sys, BoardConfig *config, size_t codeBufSize);
 int Compile(ParseContext *c, const char *name);
 void StoreCode(ParseContext *c);
+void PlaceCode(ParseContext *c, Symbol *symbol);
 void AddIntrinsic(ParseContext *c, char *name, char *argTypes, char *retType, int index);
 void AddRegister(ParseContext *c, char *name, VMUVALUE addr);
 String *AddString(ParseContext *c, char *value);
@@ -507,6 +568,7 @@ void ParseStatement(ParseContext *c, int tkn);
 void EndFunction(ParseContext *c);
 void CheckLabels(ParseContext *c);
 void DumpLabels(ParseContext *c);
+void CheckWritable(ParseContext *c, ParseTreeNode *expr);
 
 /* db_expr.c */
 ParseTreeNode *ParseExpr(ParseContext *c);
@@ -516,6 +578,7 @@ ParseTreeNode *NewParseTreeNode(ParseContext *c, int type);
 void AddNodeToList(ParseContext *c, NodeListEntry ***ppNextEntry, ParseTreeNode *node);
 void PrintNode(ParseTreeNode *node, int indent);
 int IsIntegerLit(ParseTreeNode *node);
+ParseTreeNode *ConvertExpr(ParseContext *c, ParseTreeNode *expr, Type *type);
 int IsStringLit(ParseTreeNode *node);
 
 /* db_scan.c */
@@ -547,6 +610,7 @@ void InitSymbolTable(SymbolTable *table);
 void AddDependency(ParseContext *c, Symbol *symbol);
 Symbol *AddGlobalSymbol(ParseContext *c, const char *name, StorageClass storageClass, Type *type, Section *section);
 Symbol *AddGlobalOffset(ParseContext *c, const char *name, StorageClass storageClass, Type *type, VMUVALUE offset);
+Symbol *AddZeroFilledSymbol(ParseContext *c, const char *name, StorageClass storageClass, Type *type, Section *section, VMUVALUE size);
 Symbol *AddGlobalConstantInteger(ParseContext *c, const char *name, VMVALUE value);
 Symbol *AddGlobalConstantString(ParseContext *c, const char *name, String *string);
 Symbol *AddFormalArgument(ParseContext *c, SymbolTable *table, const char *name, Type *type, VMUVALUE offset);
@@ -561,6 +625,7 @@ Type *ArrayTypeToPointerType(ParseContext *c, Type *type);
 int CompareTypes(Type *type1, Type *type2);
 VMUVALUE ValueSize(Type *type, VMUVALUE size);
 int IsIntegerType(Type *type);
+int IsNumericType(Type *type);
 
 /* db_generate.c */
 void Generate(ParseContext *c, ParseTreeNode *expr);
@@ -576,6 +641,55 @@ int merge(ParseContext *c, VMUVALUE chn, VMUVALUE chn2);
 void fixup(ParseContext *c, VMUVALUE chn, VMUVALUE val);
 void fixupbranch(ParseContext *c, VMUVALUE chn, VMUVALUE val);
 
+/* db_optimize.c */
+int HoistLoopInvariants(ParseContext *c, ParseTreeNode *node);
+int ReuseCommonSubexpressions(ParseContext *c, ParseTreeNode *node);
+int InlineHotCalls(ParseContext *c, ParseTreeNode *node);
+int LayoutHotBranches(ParseContext *c, ParseTreeNode *node);
+void SaveInlineBody(ParseContext *c, ParseTreeNode *node);
+
+/* db_ir.c */
+IRFunction *BuildIR(ParseContext *c);
+int CodeSize(ParseContext *c, VMUVALUE addr, VMUVALUE length);
+void EmitIR(ParseContext *c, IRFunction *fn);
+void MapStatementAddresses(ParseContext *c, IRFunction *fn);
+int FoldBranches(ParseContext *c, IRFunction *fn);
+int CombineInstructions(ParseContext *c, IRFunction *fn);
+int FuseLocalUpdates(ParseContext *c, IRFunction *fn);
+int ThreadJumps(ParseContext *c, IRFunction *fn);
+int RemoveUnreachableCode(ParseContext *c, IRFunction *fn);
+int RemoveBranchesToNext(ParseContext *c, IRFunction *fn);
+
+/* db_passes.c */
+void RunTreePasses(ParseContext *c, ParseTreeNode *node);
+void RunCodePasses(ParseContext *c, ParseTreeNode *node);
+void ShowPassStatistics(ParseContext *c);
+
+/* db_profile.c */
+void NumberStatements(ParseContext *c, ParseTreeNode *node);
+void OpenMapFile(ParseContext *c, const char *name);
+void WriteMapFunction(ParseContext *c, const char *name, VMUVALUE addr, VMUVALUE size);
+void CloseMapFile(ParseContext *c);
+void LoadProfile(ParseContext *c, const char *name);
+FunctionProfile *FindFunctionProfile(ParseContext *c, const char *name);
+unsigned long GetStatementCount(ParseContext *c, int index);
+unsigned long GetCallCount(ParseContext *c, int index, const char *callee);
+unsigned long GetFunctionCount(ParseContext *c);
+unsigned long GetCallsTo(ParseContext *c, const char *callee);
+
+/* db_layout.c */
+void DeferCode(ParseContext *c, Symbol *symbol);
+void LayoutFunctions(ParseContext *c);
+
+/* db_stack.c */
+void AnalyzeStack(ParseContext *c, Symbol *symbol);
+void SizeStack(ParseContext *c);
+
+/* db_placement.c */
+void AddDataUsage(ParseContext *c, Symbol *symbol, VMUVALUE size, int movable);
+void CountDataReferences(ParseContext *c, ParseTreeNode *node);
+void PlaceData(ParseContext *c);
+
 /* db_wrimage.c */
 int StartImage(ParseContext *c, const char *name);
 int BuildImage(ParseContext *c, const char *name);
@@ -19,11 +19,24 @@ static ParseTreeNode *ParseExpr8(ParseContext *c);
 static ParseTreeNode *ParseExpr9(ParseContext *c);
 static ParseTreeNode *ParseExpr10(ParseContext *c);
 static ParseTreeNode *ParseExpr11(ParseContext *c);
+static ParseTreeNode *ParsePrimaryValue(ParseContext *c);
 static ParseTreeNode *ParseSimplePrimary(ParseContext *c);
+static ParseTreeNode *ParseReference(ParseContext *c, ParseTreeNode *node);
 static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayNode);
 static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode);
 static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *expr);
 static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right);
+static int FixedBinaryOp(ParseContext *c, int op, ParseTreeNode **pLeft, ParseTreeNode **pRight, Type **pType);
+static int FindIntrinsic(ParseContext *c, char *name);
+static ParseTreeNode *ParseIntrinsic(ParseContext *c, int index);
+static ParseTreeNode *NewIntrinsicCall(ParseContext *c, int index);
+static ParseTreeNode *ParseNumericExpr(ParseContext *c, Type *type);
+static int BlockElementSize(ParseContext *c, ParseTreeNode *array);
+static int MatchBitIdiom(int op, ParseTreeNode **pLeft, ParseTreeNode **pRight);
+static ParseTreeNode *SingleBit(ParseTreeNode *expr);
+static int IsRotate(ParseTreeNode *expr, ParseTreeNode *other);
+static int IsOrderFree(ParseTreeNode *expr);
+static int IsSameVariable(ParseTreeNode *expr, ParseTreeNode *other);
 
 /* ParseExpr - handle the OR operator */
 ParseTreeNode *ParseExpr(ParseContext *c)
@@ -181,7 +194,7 @@ static ParseTreeNode *ParseExpr8(ParseContext *c)
     ParseTreeNode *expr, *expr2;
     int tkn;
     expr = ParseExpr9(c);
-    while ((tkn = GetToken(c)) == T_SHL || tkn == T_SHR) {
+    while ((tkn = GetToken(c)) == T_SHL || tkn == T_SHR || tkn == T_SHRU) {
         int op;
         expr2 = ParseExpr9(c);
         switch (tkn) {
@@ -191,6 +204,9 @@ static ParseTreeNode *ParseExpr8(ParseContext *c)
         case T_SHR:
             op = OP_SHR;
             break;
+        case T_SHRU:
+            op = OP_SHRU;
+            break;
         default:
             /* not reached */
             op = 0;
@@ -266,36 +282,78 @@ static ParseTreeNode *ParseExpr11(ParseContext *c)
     int tkn;
     switch (tkn = GetToken(c)) {
     case '+':
-        node = ParsePrimary(c);
+        node = ParsePrimaryValue(c);
         break;
     case '-':
-        node = MakeUnaryOpNode(c, OP_NEG, ParsePrimary(c));
+        node = MakeUnaryOpNode(c, OP_NEG, ParsePrimaryValue(c));
         break;
     case T_NOT:
-        node = MakeUnaryOpNode(c, OP_NOT, ParsePrimary(c));
+        node = MakeUnaryOpNode(c, OP_NOT, ParsePrimaryValue(c));
         break;
     case '~':
-        node = MakeUnaryOpNode(c, OP_BNOT, ParsePrimary(c));
+        node = MakeUnaryOpNode(c, OP_BNOT, ParsePrimaryValue(c));
         break;
     case '@':
         node = NewParseTreeNode(c, NodeTypeAddressOf);
-        node->u.addressOf.expr = ParsePrimary(c);
+        node->u.addressOf.expr = ParseSimplePrimary(c);
+        /* the address of a function is the address of its code */
+        if (node->u.addressOf.expr->type->id != TYPE_FUNCTION)
+            node->u.addressOf.expr = ParseReference(c, node->u.addressOf.expr);
         node->type = &c->integerType;
         break;
     default:
         SaveToken(c,tkn);
-        node = ParsePrimary(c);
+        node = ParsePrimaryValue(c);
         break;
     }
     return node;
 }
 
+/* ParsePrimaryValue - parse a primary expression whose value is used */
+static ParseTreeNode *ParsePrimaryValue(ParseContext *c)
+{
+    ParseTreeNode *node = ParsePrimary(c);
+    ParseTreeNode *array, *index;
+    Symbol *symbol;
+    VMVALUE i;
+
+    /* fold references to elements of CONST arrays with constant indices */
+    if (node->nodeType == NodeTypeArrayRef
+    &&  (array = node->u.arrayRef.array)->nodeType == NodeTypeArrayLit
+    &&  (symbol = array->u.arrayLit.symbol)->constData
+    &&  IsIntegerLit(index = node->u.arrayRef.index)) {
+        i = index->u.integerLit.value;
+        if (i < 0 || i >= (VMVALUE)symbol->constSize)
+            ParseError(c, "index %d is out of range for CONST array '%s'", i, symbol->name);
+        switch (node->type->id) {
+        case TYPE_BYTE:
+            index->u.integerLit.value = symbol->constData[i];
+            break;
+        case TYPE_WORD:
+            index->u.integerLit.value = ((uint16_t *)symbol->constData)[i];
+            break;
+        default:
+            index->u.integerLit.value = ((VMVALUE *)symbol->constData)[i];
+            break;
+        }
+        if (node->type->id == TYPE_FIXED)
+            index->type = &c->fixedType;
+        node = index;
+    }
+    
+    return node;
+}
+
 /* ParsePrimary - parse function calls and array references */
 ParseTreeNode *ParsePrimary(ParseContext *c)
 {
-    ParseTreeNode *node;
+    return ParseReference(c, ParseSimplePrimary(c));
+}
+
+/* ParseReference - parse a function call or array reference following a simple primary expression */
+static ParseTreeNode *ParseReference(ParseContext *c, ParseTreeNode *node)
+{
     int tkn;
-    node = ParseSimplePrimary(c);
     switch (node->type->id) {
     case TYPE_FUNCTION:
         node = ParseCall(c, node);
@@ -320,7 +378,7 @@ static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayN
     ParseTreeNode *node = NewParseTreeNode(c, NodeTypeArrayRef);
     node->type = arrayNode->type->u.arrayInfo.elementType;
     node->u.arrayRef.array = arrayNode;
-    node->u.arrayRef.index = ParseExpr(c);
+    node->u.arrayRef.index = ConvertExpr(c, ParseExpr(c), &c->integerType);
     FRequire(c, ')');
     return node;
 }
@@ -332,6 +390,10 @@ static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode)
     Symbol *arg;
     int tkn;
 
+    /* remember that the current function is not a leaf function */
+    if (c->function)
+        c->function->u.functionDefinition.hasCalls = TRUE;
+
     /* intialize the function call node */
     node->type = functionNode->type->u.functionInfo.returnType;
     node->u.functionCall.fcn = functionNode;
@@ -354,6 +416,8 @@ static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode)
                 ParseError(c, "too many arguments");
             else if (!CompareTypes(actual->node->type, arg->type))
                 ParseError(c, "wrong argument type");
+            else
+                actual->node = ConvertExpr(c, actual->node, arg->type);
 
             /* move ahead to the next argument */
             ++node->u.functionCall.argc;
@@ -378,7 +442,7 @@ static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode)
 static ParseTreeNode *ParseSimplePrimary(ParseContext *c)
 {
     ParseTreeNode *node;
-    int tkn;
+    int tkn, index;
     switch (tkn = GetToken(c)) {
     case '(':
         node = ParseExpr(c);
@@ -389,13 +453,21 @@ static ParseTreeNode *ParseSimplePrimary(ParseContext *c)
         node->type = &c->integerType;
         node->u.integerLit.value = c->value;
         break;
+    case T_FIXED_NUMBER:
+        node = NewParseTreeNode(c, NodeTypeIntegerLit);
+        node->type = &c->fixedType;
+        node->u.integerLit.value = c->value;
+        break;
     case T_STRING:
         node = NewParseTreeNode(c, NodeTypeStringLit);
         node->type = &c->byteArrayType;
         node->u.stringLit.string = AddString(c, c->token);
         break;
     case T_IDENTIFIER:
-        node = GetSymbolRef(c, c->token);
+        if ((index = FindIntrinsic(c, c->token)) >= 0)
+            node = ParseIntrinsic(c, index);
+        else
+            node = GetSymbolRef(c, c->token);
         break;
     default:
         ParseError(c, "Expecting a primary expression");
@@ -447,6 +519,7 @@ ParseTreeNode *GetSymbolRef(ParseContext *c, char *name)
                 AddDependency(c, symbol);
                 break;
             case TYPE_INTEGER:
+            case TYPE_FIXED:
                 node = NewParseTreeNode(c, NodeTypeIntegerLit);
                 node->type = symbol->type;
                 node->u.integerLit.value = symbol->v.value;
@@ -471,12 +544,11 @@ ParseTreeNode *GetSymbolRef(ParseContext *c, char *name)
         if (c->pass == 1)
             node->type = &c->integerType;
         else {
-            VMVALUE value = 0;
-            symbol = AddGlobalSymbol(c, name, SC_GLOBAL, &c->integerType, c->dataTarget);
+            symbol = AddZeroFilledSymbol(c, name, SC_GLOBAL, &c->integerType, c->dataTarget, sizeof(VMVALUE));
+            AddDataUsage(c, symbol, sizeof(VMVALUE), TRUE);
             node->type = symbol->type;
             node->u.globalRef.symbol = symbol;
             AddDependency(c, symbol);
-            c->dataTarget->offset += WriteSection(c, c->dataTarget, (uint8_t *)&value, sizeof(VMVALUE));
         }
     }
 
@@ -496,15 +568,16 @@ static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *ex
             break;
         case OP_NOT:
             node->u.integerLit.value = !expr->u.integerLit.value;
+            node->type = &c->integerType;
             break;
         case OP_BNOT:
             node->u.integerLit.value = ~expr->u.integerLit.value;
             break;
         }
     }
-    else if (expr->type->id == TYPE_INTEGER) {
+    else if (IsNumericType(expr->type)) {
         node = NewParseTreeNode(c, NodeTypeUnaryOp);
-        node->type = &c->integerType;
+        node->type = expr->type->id == TYPE_FIXED && op != OP_NOT ? &c->fixedType : &c->integerType;
         node->u.unaryOp.op = op;
         node->u.unaryOp.expr = expr;
     }
@@ -518,9 +591,21 @@ static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *ex
 /* MakeBinaryOpNode - allocate a binary operation parse tree node */
 static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right)
 {
+    Type *type = &c->integerType;
     ParseTreeNode *node;
+    
+    /* handle operations on fixed point values */
+    if (IsNumericType(left->type) && IsNumericType(right->type)
+    &&  (left->type->id == TYPE_FIXED || right->type->id == TYPE_FIXED))
+        op = FixedBinaryOp(c, op, &left, &right, &type);
+    
+    /* replace hand written bit manipulation idioms with single opcodes */
+    else if (IsIntegerType(left->type) && IsIntegerType(right->type))
+        op = MatchBitIdiom(op, &left, &right);
+    
     if (IsIntegerLit(left) && IsIntegerLit(right)) {
         node = left;
+        node->type = type;
         switch (op) {
         case OP_BXOR:
             node->u.integerLit.value = left->u.integerLit.value ^ right->u.integerLit.value;
@@ -555,6 +640,27 @@ static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *l
         case OP_SHR:
             node->u.integerLit.value = left->u.integerLit.value >> right->u.integerLit.value;
             break;
+        case OP_SHRU:
+            node->u.integerLit.value = ShiftRightUnsigned(left->u.integerLit.value, right->u.integerLit.value);
+            break;
+        case OP_ROL:
+            node->u.integerLit.value = RotateLeft(left->u.integerLit.value, right->u.integerLit.value);
+            break;
+        case OP_ROR:
+            node->u.integerLit.value = RotateRight(left->u.integerLit.value, right->u.integerLit.value);
+            break;
+        case OP_BITSET:
+            node->u.integerLit.value = left->u.integerLit.value | BitMask(right->u.integerLit.value);
+            break;
+        case OP_BITCLR:
+            node->u.integerLit.value = left->u.integerLit.value & ~BitMask(right->u.integerLit.value);
+            break;
+        case OP_BITTST:
+            node->u.integerLit.value = ShiftRightUnsigned(left->u.integerLit.value, right->u.integerLit.value) & 1;
+            break;
+        case OP_BITTGL:
+            node->u.integerLit.value = left->u.integerLit.value ^ BitMask(right->u.integerLit.value);
+            break;
         case OP_ADD:
             node->u.integerLit.value = left->u.integerLit.value + right->u.integerLit.value;
             break;
@@ -574,14 +680,22 @@ static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *l
                 ParseError(c, "division by zero in constant expression");
             node->u.integerLit.value = left->u.integerLit.value % right->u.integerLit.value;
             break;
+        case OP_FMUL:
+            node->u.integerLit.value = FixedMul(left->u.integerLit.value, right->u.integerLit.value);
+            break;
+        case OP_FDIV:
+            if (right->u.integerLit.value == 0)
+                ParseError(c, "division by zero in constant expression");
+            node->u.integerLit.value = FixedDiv(left->u.integerLit.value, right->u.integerLit.value);
+            break;
         default:
             goto integerOp;
         }
     }
-    else if (IsIntegerType(left->type) && IsIntegerType(right->type)) {
+    else if (IsNumericType(left->type) && IsNumericType(right->type)) {
 integerOp:
         node = NewParseTreeNode(c, NodeTypeBinaryOp);
-        node->type = &c->integerType;
+        node->type = type;
         node->u.binaryOp.op = op;
         node->u.binaryOp.left = left;
         node->u.binaryOp.right = right;
@@ -593,12 +707,407 @@ integerOp:
     return node;
 }
 
+/* FixedBinaryOp - scale the operands of an operation on fixed point values */
+static int FixedBinaryOp(ParseContext *c, int op, ParseTreeNode **pLeft, ParseTreeNode **pRight, Type **pType)
+{
+    switch (op) {
+    case OP_SHL:
+    case OP_SHR:
+    case OP_SHRU:
+    case OP_ROL:
+    case OP_ROR:
+    case OP_BITSET:
+    case OP_BITCLR:
+    case OP_BITTGL:
+        /* the shift count or bit number is always an integer */
+        *pRight = ConvertExpr(c, *pRight, &c->integerType);
+        if ((*pLeft)->type->id == TYPE_FIXED)
+            *pType = &c->fixedType;
+        break;
+    case OP_BITTST:
+        /* bit tests have integer results */
+        *pRight = ConvertExpr(c, *pRight, &c->integerType);
+        break;
+    case OP_MUL:
+        /* only the product of two fixed point values needs to be scaled */
+        if ((*pLeft)->type->id == TYPE_FIXED && (*pRight)->type->id == TYPE_FIXED)
+            op = OP_FMUL;
+        *pType = &c->fixedType;
+        break;
+    case OP_DIV:
+        /* a fixed point value divided by an integer needs no scaling */
+        if ((*pRight)->type->id == TYPE_FIXED) {
+            *pLeft = ConvertExpr(c, *pLeft, &c->fixedType);
+            op = OP_FDIV;
+        }
+        *pType = &c->fixedType;
+        break;
+    case OP_EQ:
+    case OP_NE:
+    case OP_LT:
+    case OP_LE:
+    case OP_GE:
+    case OP_GT:
+        /* comparisons have integer results */
+        *pLeft = ConvertExpr(c, *pLeft, &c->fixedType);
+        *pRight = ConvertExpr(c, *pRight, &c->fixedType);
+        break;
+    default:
+        *pLeft = ConvertExpr(c, *pLeft, &c->fixedType);
+        *pRight = ConvertExpr(c, *pRight, &c->fixedType);
+        *pType = &c->fixedType;
+        break;
+    }
+    return op;
+}
+
+/* intrinsic function argument lists */
+enum {
+    INTRINSIC_VALUE,    /* value, count */
+    INTRINSIC_COPY,     /* array, array, count */
+    INTRINSIC_FILL,     /* array, value, count */
+    INTRINSIC_STRING,   /* byte array */
+    INTRINSIC_NONE,     /* no arguments */
+    INTRINSIC_UNARY,    /* value */
+    INTRINSIC_STORE,    /* address, value */
+    INTRINSIC_RING      /* ring, array, count */
+};
+
+/* intrinsic functions that compile into a single opcode */
+static struct {
+    char *name;
+    int op;
+    int args;
+} intrinsics[] = {
+{   "ROL",      OP_ROL,     INTRINSIC_VALUE     },
+{   "ROR",      OP_ROR,     INTRINSIC_VALUE     },
+{   "SHRU",     OP_SHRU,    INTRINSIC_VALUE     },
+{   "BITSET",   OP_BITSET,  INTRINSIC_VALUE     },
+{   "BITCLR",   OP_BITCLR,  INTRINSIC_VALUE     },
+{   "BITTST",   OP_BITTST,  INTRINSIC_VALUE     },
+{   "BITTGL",   OP_BITTGL,  INTRINSIC_VALUE     },
+{   "MEMCPY",   OP_MEMCPY,  INTRINSIC_COPY      },
+{   "MEMCMP",   OP_MEMCMP,  INTRINSIC_COPY      },
+{   "MEMSET",   OP_MEMSET,  INTRINSIC_FILL      },
+{   "MEMCHR",   OP_MEMCHR,  INTRINSIC_FILL      },
+{   "STRLEN",   OP_STRLEN,  INTRINSIC_STRING    },
+{   "PEEK",     OP_LOAD,    INTRINSIC_UNARY     },
+{   "PEEKB",    OP_LOADB,   INTRINSIC_UNARY     },
+{   "PEEKW",    OP_LOADW,   INTRINSIC_UNARY     },
+{   "POKE",     OP_STORE,   INTRINSIC_STORE     },
+{   "POKEB",    OP_STOREB,  INTRINSIC_STORE     },
+{   "POKEW",    OP_STOREW,  INTRINSIC_STORE     },
+{   "HUBADDR",  OP_HUBADDR, INTRINSIC_UNARY     },
+{   "COGID",    OP_COGID,   INTRINSIC_NONE      },
+{   "CLKFREQ",  OP_CLKFREQ, INTRINSIC_NONE      },
+{   "WAITCNT",  OP_WAITCNT, INTRINSIC_UNARY     },
+{   "RINGPUT",  OP_RINGPUT, INTRINSIC_RING      },
+{   "RINGGET",  OP_RINGGET, INTRINSIC_RING      },
+{   "RINGPEEK", OP_RINGPEEK, INTRINSIC_RING     },
+{   NULL,       0,          0                   }
+};
+
+/* FindIntrinsic - find an intrinsic function that hasn't been hidden by a symbol */
+static int FindIntrinsic(ParseContext *c, char *name)
+{
+    int i;
+    if ((c->function && FindSymbol(&c->function->u.functionDefinition.locals, name))
+    ||  (c->functionType && FindSymbol(&c->functionType->u.functionInfo.arguments, name))
+    ||  FindSymbol(&c->globals, name))
+        return -1;
+    for (i = 0; intrinsics[i].name != NULL; ++i)
+        if (strcasecmp(intrinsics[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+/* ParseIntrinsic - parse a call to an intrinsic function */
+static ParseTreeNode *ParseIntrinsic(ParseContext *c, int index)
+{
+    ParseTreeNode *node, *expr;
+    NodeListEntry **pNext;
+    int size, tkn;
+
+    /* the hardware queries don't need an argument list */
+    if (intrinsics[index].args == INTRINSIC_NONE) {
+        if ((tkn = GetToken(c)) == '(')
+            FRequire(c, ')');
+        else
+            SaveToken(c, tkn);
+        return NewIntrinsicCall(c, index);
+    }
+
+    FRequire(c, '(');
+
+    /* operations on a value are binary operators */
+    if (intrinsics[index].args == INTRINSIC_VALUE) {
+        expr = ParseExpr(c);
+        FRequire(c, ',');
+        node = MakeBinaryOpNode(c, intrinsics[index].op, expr, ParseExpr(c));
+        FRequire(c, ')');
+        return node;
+    }
+
+    node = NewIntrinsicCall(c, index);
+    pNext = &node->u.intrinsicCall.args;
+
+    /* memory and counter operations take an address or a value */
+    if (intrinsics[index].args == INTRINSIC_UNARY) {
+        AddNodeToList(c, &pNext, ParseNumericExpr(c, &c->integerType));
+        FRequire(c, ')');
+        return node;
+    }
+
+    /* stores evaluate the value first like an assignment so that the address ends up on top */
+    if (intrinsics[index].args == INTRINSIC_STORE) {
+        expr = ParseNumericExpr(c, &c->integerType);
+        FRequire(c, ',');
+        AddNodeToList(c, &pNext, ParseNumericExpr(c, &c->integerType));
+        AddNodeToList(c, &pNext, expr);
+        FRequire(c, ')');
+        return node;
+    }
+
+    /* ring operations move INTEGER or FIXED elements between a ring and an array */
+    if (intrinsics[index].args == INTRINSIC_RING) {
+        expr = ParseExpr(c);
+        if (BlockElementSize(c, expr) != sizeof(VMVALUE) || expr->type->u.arrayInfo.elementType->id != TYPE_INTEGER)
+            ParseError(c, "Expecting an INTEGER array");
+        CheckWritable(c, expr);
+        AddNodeToList(c, &pNext, expr);
+        FRequire(c, ',');
+        expr = ParseExpr(c);
+        if (BlockElementSize(c, expr) != sizeof(VMVALUE))
+            ParseError(c, "Expecting an INTEGER or FIXED array");
+        if (node->u.intrinsicCall.op != OP_RINGPUT)
+            CheckWritable(c, expr);
+        AddNodeToList(c, &pNext, expr);
+        FRequire(c, ',');
+        AddNodeToList(c, &pNext, ParseNumericExpr(c, &c->integerType));
+        FRequire(c, ')');
+        return node;
+    }
+
+    /* operations on arrays start with the array */
+    expr = ParseExpr(c);
+    size = BlockElementSize(c, expr);
+    if (node->u.intrinsicCall.op == OP_MEMCPY || node->u.intrinsicCall.op == OP_MEMSET)
+        CheckWritable(c, expr);
+    AddNodeToList(c, &pNext, expr);
+
+    /* get the second array or the value */
+    switch (intrinsics[index].args) {
+    case INTRINSIC_COPY:
+        FRequire(c, ',');
+        expr = ParseExpr(c);
+        if (BlockElementSize(c, expr) != size)
+            ParseError(c, "arrays must have the same element size");
+        AddNodeToList(c, &pNext, expr);
+        break;
+    case INTRINSIC_FILL:
+        FRequire(c, ',');
+        AddNodeToList(c, &pNext, ParseNumericExpr(c, expr->type->u.arrayInfo.elementType->id == TYPE_FIXED ? &c->fixedType : &c->integerType));
+        break;
+    case INTRINSIC_STRING:
+        if (size != 1)
+            ParseError(c, "Expecting a BYTE array");
+        break;
+    }
+
+    /* get the element count */
+    if (intrinsics[index].args != INTRINSIC_STRING) {
+        FRequire(c, ',');
+        AddNodeToList(c, &pNext, ParseNumericExpr(c, &c->integerType));
+        node->u.intrinsicCall.operand = size;
+    }
+    FRequire(c, ')');
+
+    /* return the intrinsic function call node */
+    return node;
+}
+
+/* NewIntrinsicCall - make an intrinsic function call node without its arguments */
+static ParseTreeNode *NewIntrinsicCall(ParseContext *c, int index)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeIntrinsicCall);
+    node->type = &c->integerType;
+    node->u.intrinsicCall.op = intrinsics[index].op;
+    return node;
+}
+
+/* ParseNumericExpr - parse a numeric expression and convert it to a type */
+static ParseTreeNode *ParseNumericExpr(ParseContext *c, Type *type)
+{
+    ParseTreeNode *expr = ParseExpr(c);
+    if (!IsNumericType(expr->type))
+        ParseError(c, "Expecting a numeric expression");
+    return ConvertExpr(c, expr, type);
+}
+
+/* BlockElementSize - get the size of the elements of an array passed to an intrinsic function */
+static int BlockElementSize(ParseContext *c, ParseTreeNode *array)
+{
+    if (array->type->id != TYPE_ARRAY && array->type->id != TYPE_POINTER)
+        ParseError(c, "Expecting an array");
+    switch (array->type->u.arrayInfo.elementType->id) {
+    case TYPE_BYTE:
+        return 1;
+    case TYPE_INTEGER:
+    case TYPE_FIXED:
+        return sizeof(VMVALUE);
+    default:
+        ParseError(c, "Expecting a BYTE, INTEGER or FIXED array");
+        return 0; /* not reached */
+    }
+}
+
+/* MatchBitIdiom - find bit manipulations written with shifts and masks */
+static int MatchBitIdiom(int op, ParseTreeNode **pLeft, ParseTreeNode **pRight)
+{
+    ParseTreeNode *left = *pLeft, *right = *pRight, *shift, *bit;
+    switch (op) {
+    case OP_BOR:
+        /* (x << n) | (x >>> (32 - n)) and (x >>> n) | (x << (32 - n)) */
+        if ((shift = IsRotate(left, right) ? left : IsRotate(right, left) ? right : NULL) != NULL) {
+            *pLeft = shift->u.binaryOp.left;
+            *pRight = shift->u.binaryOp.right;
+            return shift->u.binaryOp.op == OP_SHL ? OP_ROL : OP_ROR;
+        }
+        /* fall through */
+    case OP_BXOR:
+        /* x | (1 << n) and x ^ (1 << n), swapping the operands only if neither has side effects */
+        if ((bit = SingleBit(right)) != NULL)
+            *pRight = bit;
+        else if ((bit = SingleBit(left)) != NULL && IsOrderFree(bit) && IsOrderFree(right)) {
+            *pLeft = right;
+            *pRight = bit;
+        }
+        else
+            break;
+        return op == OP_BOR ? OP_BITSET : OP_BITTGL;
+    case OP_BAND:
+        /* x & ~(1 << n) */
+        if (right->nodeType == NodeTypeUnaryOp && right->u.unaryOp.op == OP_BNOT
+        &&  (bit = SingleBit(right->u.unaryOp.expr)) != NULL) {
+            *pRight = bit;
+            return OP_BITCLR;
+        }
+        if (left->nodeType == NodeTypeUnaryOp && left->u.unaryOp.op == OP_BNOT
+        &&  (bit = SingleBit(left->u.unaryOp.expr)) != NULL && IsOrderFree(bit) && IsOrderFree(right)) {
+            *pLeft = right;
+            *pRight = bit;
+            return OP_BITCLR;
+        }
+        /* (x >> n) & 1 */
+        if (IsIntegerLit(left) && !IsIntegerLit(right)) {
+            left = right;
+            right = *pLeft;
+        }
+        if (IsIntegerLit(right) && right->u.integerLit.value == 1
+        &&  left->nodeType == NodeTypeBinaryOp
+        &&  (left->u.binaryOp.op == OP_SHR || left->u.binaryOp.op == OP_SHRU)) {
+            *pLeft = left->u.binaryOp.left;
+            *pRight = left->u.binaryOp.right;
+            return OP_BITTST;
+        }
+        break;
+    }
+    return op;
+}
+
+/* SingleBit - get the bit number of an expression of the form (1 << n) */
+static ParseTreeNode *SingleBit(ParseTreeNode *expr)
+{
+    if (expr->nodeType == NodeTypeBinaryOp && expr->u.binaryOp.op == OP_SHL
+    &&  IsIntegerLit(expr->u.binaryOp.left) && expr->u.binaryOp.left->u.integerLit.value == 1)
+        return expr->u.binaryOp.right;
+    return NULL;
+}
+
+/* IsRotate - check for a shift of a variable that combines with another shift into a rotate */
+static int IsRotate(ParseTreeNode *expr, ParseTreeNode *other)
+{
+    ParseTreeNode *count, *otherCount;
+    if (expr->nodeType != NodeTypeBinaryOp || other->nodeType != NodeTypeBinaryOp
+    ||  !((expr->u.binaryOp.op == OP_SHL && other->u.binaryOp.op == OP_SHRU)
+    ||    (expr->u.binaryOp.op == OP_SHRU && other->u.binaryOp.op == OP_SHL)))
+        return FALSE;
+    count = expr->u.binaryOp.right;
+    otherCount = other->u.binaryOp.right;
+    return IsIntegerLit(count) && IsIntegerLit(otherCount)
+        && count->u.integerLit.value > 0 && count->u.integerLit.value < VMVALUE_BITS
+        && count->u.integerLit.value + otherCount->u.integerLit.value == VMVALUE_BITS
+        && IsSameVariable(expr->u.binaryOp.left, other->u.binaryOp.left);
+}
+
+/* IsOrderFree - check to see if an expression can be evaluated out of order */
+static int IsOrderFree(ParseTreeNode *expr)
+{
+    switch (expr->nodeType) {
+    case NodeTypeIntegerLit:
+    case NodeTypeLocalRef:
+    case NodeTypeGlobalRef:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* IsSameVariable - check to see if two expressions reference the same scalar variable */
+static int IsSameVariable(ParseTreeNode *expr, ParseTreeNode *other)
+{
+    if (expr->nodeType != other->nodeType)
+        return FALSE;
+    switch (expr->nodeType) {
+    case NodeTypeLocalRef:
+        return expr->u.localRef.offset == other->u.localRef.offset;
+    case NodeTypeGlobalRef:
+        return expr->u.globalRef.symbol != NULL && expr->u.globalRef.symbol == other->u.globalRef.symbol;
+    default:
+        return FALSE;
+    }
+}
+
+/* ConvertExpr - convert a numeric expression between integer and fixed point */
+ParseTreeNode *ConvertExpr(ParseContext *c, ParseTreeNode *expr, Type *type)
+{
+    ParseTreeNode *node, *shift;
+    int toFixed;
+    
+    /* only conversions between integer and fixed point values need code */
+    if (!IsNumericType(expr->type) || !IsNumericType(type)
+    ||  (expr->type->id == TYPE_FIXED) == (type->id == TYPE_FIXED))
+        return expr;
+    toFixed = (type->id == TYPE_FIXED);
+        
+    /* scale integers up and round fixed point values to the nearest integer */
+    if (IsIntegerLit(expr)) {
+        node = NewParseTreeNode(c, NodeTypeIntegerLit);
+        node->u.integerLit.value = toFixed
+            ? (VMVALUE)((VMUVALUE)expr->u.integerLit.value << FIXED_SHIFT)
+            : RoundingShift(expr->u.integerLit.value, FIXED_SHIFT);
+    }
+    else {
+        shift = NewParseTreeNode(c, NodeTypeIntegerLit);
+        shift->type = &c->integerType;
+        shift->u.integerLit.value = FIXED_SHIFT;
+        node = NewParseTreeNode(c, NodeTypeBinaryOp);
+        node->u.binaryOp.op = toFixed ? OP_SHL : OP_RSHR;
+        node->u.binaryOp.left = expr;
+        node->u.binaryOp.right = shift;
+    }
+    node->type = toFixed ? &c->fixedType : &c->integerType;
+    
+    return node;
+}
+
 /* NewParseTreeNode - allocate a new parse tree node */
 ParseTreeNode *NewParseTreeNode(ParseContext *c, int type)
 {
     ParseTreeNode *node = (ParseTreeNode *)xbLocalAlloc(c->sys, sizeof(ParseTreeNode));
     memset(node, 0, sizeof(ParseTreeNode));
     node->nodeType = type;
+    node->lineHash = c->lineHash;
     return node;
 }
 
@@ -735,6 +1244,13 @@ void PrintNode(ParseTreeNode *node, int indent)
     case NodeTypeAsmStatement:
         printf("Asm\n");
         break;
+    case NodeTypeTrapStatement:
+        printf("Trap: %d\n", node->u.trapStatement.trap);
+        if (node->u.trapStatement.expr) {
+            printf("%*sexpr\n", indent + 2, "");
+            PrintNode(node->u.trapStatement.expr, indent + 4);
+        }
+        break;
     case NodeTypeGlobalRef:
         printf("GlobalRef: %s\n", node->u.globalRef.symbol->name);
         break;
@@ -791,6 +1307,10 @@ void PrintNode(ParseTreeNode *node, int indent)
         printf("%*sexpr\n", indent + 2, "");
         PrintNode(node->u.addressOf.expr, indent + 4);
         break;
+    case NodeTypeIntrinsicCall:
+        printf("IntrinsicCall: %02x %d\n", node->u.intrinsicCall.op, node->u.intrinsicCall.operand);
+        PrintNodeList(node->u.intrinsicCall.args, indent + 2);
+        break;
     default:
         printf("<unknown node type: %d>\n", node->nodeType);
         break;
@@ -4,16 +4,45 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "db_compiler.h"
 
+/* SELECT dispatch thresholds */
+#define CASE_DISPATCH_MIN   4   /* minimum number of constant ranges for a table or search */
+#define CASE_TABLE_DENSITY  3   /* maximum table entries per constant range */
+#define CASE_TABLE_MAX      256 /* maximum number of jump table entries */
+
+/* constant CASE range */
+typedef struct {
+    VMVALUE from;
+    VMVALUE to;
+    int index;          /* index of the CASE clause */
+} CaseRange;
+
+/* SELECT dispatch information */
+typedef struct {
+    CaseRange *ranges;  /* constant ranges sorted by their lower bounds */
+    int count;          /* number of ranges */
+    VMUVALUE *bodies;   /* branch chains to each CASE clause body */
+    VMUVALUE dflt;      /* branch chain to the CASE ELSE clause */
+} CaseDispatch;
+
 /* local function prototypes */
 static void code_lvalue(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
 static Type *code_rvalue(ParseContext *c, ParseTreeNode *expr);
 static void code_function_definition(ParseContext *c, ParseTreeNode *node);
+static int IsLeafFunction(ParseTreeNode *node);
 static void code_if_statement(ParseContext *c, ParseTreeNode *node);
 static void code_select_statement(ParseContext *c, ParseTreeNode *node);
 static void code_case_statement(ParseContext *c, ParseTreeNode *node);
+static int code_select_dispatch(ParseContext *c, ParseTreeNode *node);
+static int GetCaseRanges(ParseContext *c, ParseTreeNode *node, CaseDispatch *d);
+static int CompareCaseRanges(const void *p1, const void *p2);
+static void code_case_table(ParseContext *c, CaseDispatch *d);
+static void code_case_search(ParseContext *c, CaseDispatch *d, int first, int last, VMVALUE min, VMVALUE max);
+static void code_case_compare(ParseContext *c, int op, VMVALUE value, VMUVALUE *pchain);
+static void code_lit(ParseContext *c, VMVALUE value);
 static void code_for_statement(ParseContext *c, ParseTreeNode *node);
 static void code_do_while_statement(ParseContext *c, ParseTreeNode *node);
 static void code_do_until_statement(ParseContext *c, ParseTreeNode *node);
@@ -21,6 +50,8 @@ static void code_loop_statement(ParseContext *c, ParseTreeNode *node);
 static void code_loop_while_statement(ParseContext *c, ParseTreeNode *node);
 static void code_loop_until_statement(ParseContext *c, ParseTreeNode *node);
 static void code_return_statement(ParseContext *c, ParseTreeNode *node);
+static int IsTailCall(ParseContext *c, ParseTreeNode *expr);
+static void code_tail_call(ParseContext *c, ParseTreeNode *expr);
 static void code_label_definition(ParseContext *c, ParseTreeNode *node);
 static void code_goto_statement(ParseContext *c, ParseTreeNode *node);
 static void code_asm_statement(ParseContext *c, ParseTreeNode *node);
@@ -28,7 +59,9 @@ static void code_statement_list(ParseContext *c, NodeListEntry *entry);
 static void code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr);
 static void code_addressof(ParseContext *c, ParseTreeNode *expr);
 static void code_call(ParseContext *c, ParseTreeNode *expr);
+static void code_intrinsic_call(ParseContext *c, ParseTreeNode *expr, int needValue);
 static void code_globalref(ParseContext *c, Symbol *sym);
+static void code_globaladdr(ParseContext *c, Symbol *sym);
 static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
 static void code_index(ParseContext *c, PValOp fcn, PVAL *pv);
 static void PushGenBlock(ParseContext *c, GenBlockType type);
@@ -72,7 +105,6 @@ static Type *code_rvalue(ParseContext *c, ParseTreeNode *expr)
 /* code_expr - generate code for an expression parse tree */
 void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
 {
-    VMVALUE ival;
     pv->type = expr->type;
     switch (expr->nodeType) {
     case NodeTypeFunctionDefinition:
@@ -114,8 +146,12 @@ void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
         code_return_statement(c, expr);
         break;
     case NodeTypeCallStatement:
-        code_rvalue(c, expr->u.callStatement.expr);
-        putcbyte(c, OP_DROP);
+        if (expr->u.callStatement.expr->nodeType == NodeTypeIntrinsicCall)
+            code_intrinsic_call(c, expr->u.callStatement.expr, FALSE);
+        else {
+            code_rvalue(c, expr->u.callStatement.expr);
+            putcbyte(c, OP_DROP);
+        }
         break;
     case NodeTypeLabelDefinition:
         code_label_definition(c, expr);
@@ -129,6 +165,12 @@ void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
     case NodeTypeAsmStatement:
         code_asm_statement(c, expr);
         break;
+    case NodeTypeTrapStatement:
+        if (expr->u.trapStatement.expr)
+            code_rvalue(c, expr->u.trapStatement.expr);
+        putcbyte(c, OP_TRAP);
+        putcbyte(c, expr->u.trapStatement.trap);
+        break;
     case NodeTypeGlobalRef:
         pv->fcn = code_global;
         pv->u.sym = expr->u.globalRef.symbol;
@@ -152,15 +194,7 @@ void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
         pv->fcn = GEN_NULL;
         break;
     case NodeTypeIntegerLit:
-        ival = expr->u.integerLit.value;
-        if (ival >= -128 && ival <= 127) {
-            putcbyte(c, OP_SLIT);
-            putcbyte(c, ival);
-        }
-        else {
-            putcbyte(c, OP_LIT);
-            putcword(c, ival);
-        }
+        code_lit(c, expr->u.integerLit.value);
         pv->fcn = GEN_NULL;
         break;
     case NodeTypeUnaryOp:
@@ -193,21 +227,37 @@ void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
         code_addressof(c, expr);
         pv->fcn = GEN_NULL;
         break;
+    case NodeTypeIntrinsicCall:
+        code_intrinsic_call(c, expr, TRUE);
+        pv->fcn = GEN_NULL;
+        break;
     }
 }
 
 /* code_function_definition - generate code for a function definition */
 static void code_function_definition(ParseContext *c, ParseTreeNode *node)
 {
-    if (node->type) {
+    if (node->type && !IsLeafFunction(node)) {
         putcbyte(c, OP_FRAME);
         putcbyte(c, F_SIZE + node->u.functionDefinition.localOffset);
     }
     code_statement_list(c, node->u.functionDefinition.bodyStatements);
-    if (node->type)
-        putcbyte(c, OP_RETURNZ);
-    else
+    if (!node->type)
         putcbyte(c, OP_HALT);
+    else if (IsLeafFunction(node)) {
+        code_lit(c, 0);
+        putcbyte(c, OP_LRETURN);
+    }
+    else
+        putcbyte(c, OP_RETURNZ);
+}
+
+/* IsLeafFunction - check to see if a function can be called without a stack frame */
+static int IsLeafFunction(ParseTreeNode *node)
+{
+    return node->type
+        && !node->u.functionDefinition.hasCalls
+        && node->u.functionDefinition.localOffset == 0;
 }
 
 /* code_if_statement - generate code for an IF statement */
@@ -231,6 +281,10 @@ static void code_select_statement(ParseContext *c, ParseTreeNode *node)
     /* generate code for the select expression */
     code_rvalue(c, node->u.selectStatement.expr);
     
+    /* use a jump table or a binary search if all of the cases are constant */
+    if (code_select_dispatch(c, node))
+        return;
+    
     /* push a block to handle the select */
     PushGenBlock(c, GEN_BLOCK_SELECT);
     c->gptr->u.selectBlock.first = TRUE;
@@ -337,6 +391,180 @@ static void code_case_statement(ParseContext *c, ParseTreeNode *node)
     }
 }
 
+/* code_select_dispatch - generate a jump table or binary search for a SELECT with constant cases */
+static int code_select_dispatch(ParseContext *c, ParseTreeNode *node)
+{
+    NodeListEntry *entry;
+    CaseDispatch d;
+    VMUVALUE end;
+    VMUVALUE span;
+    int i;
+    
+    /* make sure all of the cases are constant and don't overlap */
+    if (!GetCaseRanges(c, node, &d))
+        return FALSE;
+    
+    /* generate the dispatch code leaving the select value on the stack */
+    span = (VMUVALUE)d.ranges[d.count - 1].to - (VMUVALUE)d.ranges[0].from;
+    if (span < CASE_TABLE_MAX && span < d.count * CASE_TABLE_DENSITY)
+        code_case_table(c, &d);
+    else
+        code_case_search(c, &d, 0, d.count - 1, 0, 0);
+    
+    /* generate code for each of the case bodies */
+    end = 0;
+    for (entry = node->u.selectStatement.caseStatements, i = 0; entry != NULL; entry = entry->next, ++i) {
+        fixupbranch(c, d.bodies[i], codeaddr(c));
+        putcbyte(c, OP_DROP);
+        code_statement_list(c, entry->node->u.caseStatement.bodyStatements);
+        putcbyte(c, OP_BR);
+        end = putcword(c, end);
+    }
+    
+    /* handle the case where none of the cases match */
+    fixupbranch(c, d.dflt, codeaddr(c));
+    putcbyte(c, OP_DROP);
+    if (node->u.selectStatement.elseStatements)
+        code_statement_list(c, node->u.selectStatement.elseStatements->u.caseStatement.bodyStatements);
+    
+    /* handle the branches after each case to the end of the statement */
+    fixupbranch(c, end, codeaddr(c));
+    
+    return TRUE;
+}
+
+/* GetCaseRanges - collect the sorted constant ranges of a SELECT statement */
+static int GetCaseRanges(ParseContext *c, ParseTreeNode *node, CaseDispatch *d)
+{
+    NodeListEntry *entry;
+    CaseListEntry *value;
+    int caseCount, i;
+    
+    /* count the ranges and make sure they are all constant */
+    d->count = caseCount = 0;
+    for (entry = node->u.selectStatement.caseStatements; entry != NULL; entry = entry->next) {
+        for (value = entry->node->u.caseStatement.cases; value != NULL; value = value->next) {
+            if (!IsIntegerLit(value->fromExpr) || (value->toExpr && !IsIntegerLit(value->toExpr)))
+                return FALSE;
+            ++d->count;
+        }
+        ++caseCount;
+    }
+    
+    /* small selects are better handled by a sequence of compares */
+    if (d->count < CASE_DISPATCH_MIN)
+        return FALSE;
+    
+    /* collect the ranges */
+    d->ranges = (CaseRange *)LocalAlloc(c, d->count * sizeof(CaseRange));
+    d->count = 0;
+    for (entry = node->u.selectStatement.caseStatements, i = 0; entry != NULL; entry = entry->next, ++i) {
+        for (value = entry->node->u.caseStatement.cases; value != NULL; value = value->next) {
+            CaseRange *range = &d->ranges[d->count];
+            range->from = value->fromExpr->u.integerLit.value;
+            range->to = value->toExpr ? value->toExpr->u.integerLit.value : range->from;
+            range->index = i;
+            
+            /* empty ranges can never match */
+            if (range->from <= range->to)
+                ++d->count;
+        }
+    }
+    if (d->count < CASE_DISPATCH_MIN)
+        return FALSE;
+    
+    /* sort the ranges and give up if any of them overlap since the first match must win */
+    qsort(d->ranges, d->count, sizeof(CaseRange), CompareCaseRanges);
+    for (i = 1; i < d->count; ++i)
+        if (d->ranges[i].from <= d->ranges[i - 1].to)
+            return FALSE;
+    
+    /* initialize the branch chains */
+    d->bodies = (VMUVALUE *)LocalAlloc(c, caseCount * sizeof(VMUVALUE));
+    memset(d->bodies, 0, caseCount * sizeof(VMUVALUE));
+    d->dflt = 0;
+    
+    return TRUE;
+}
+
+/* CompareCaseRanges - compare the lower bounds of two case ranges for qsort */
+static int CompareCaseRanges(const void *p1, const void *p2)
+{
+    const CaseRange *r1 = (const CaseRange *)p1;
+    const CaseRange *r2 = (const CaseRange *)p2;
+    return r1->from < r2->from ? -1 : r1->from > r2->from ? 1 : 0;
+}
+
+/* code_case_table - generate a jump table to dispatch a SELECT */
+static void code_case_table(ParseContext *c, CaseDispatch *d)
+{
+    VMVALUE from = d->ranges[0].from;
+    VMVALUE to = d->ranges[d->count - 1].to;
+    CaseRange *range = d->ranges;
+    VMVALUE value;
+    
+    putcbyte(c, OP_SWITCH);
+    putcword(c, from);
+    putcword(c, (VMUVALUE)to - (VMUVALUE)from + 1);
+    d->dflt = putcword(c, d->dflt);
+    for (value = from; ; ++value) {
+        if (value > range->to)
+            ++range;
+        if (value < range->from)
+            d->dflt = putcword(c, d->dflt);
+        else
+            d->bodies[range->index] = putcword(c, d->bodies[range->index]);
+        if (value == to)
+            break;
+    }
+}
+
+/* code_case_search - generate a binary search to dispatch a SELECT
+    min and max are the bounds known to hold for the select value with first > 0 meaning
+    that min is valid and last < d->count - 1 meaning that max is valid */
+static void code_case_search(ParseContext *c, CaseDispatch *d, int first, int last, VMVALUE min, VMVALUE max)
+{
+    CaseRange *range;
+    
+    /* split the ranges in half on the lower bound of the middle range */
+    if (first < last) {
+        int mid = (first + last + 1) / 2;
+        VMUVALUE left = 0;
+        code_case_compare(c, OP_LT, d->ranges[mid].from, &left);
+        code_case_search(c, d, mid, last, d->ranges[mid].from, max);
+        fixupbranch(c, left, codeaddr(c));
+        code_case_search(c, d, first, mid - 1, min, d->ranges[mid].from - 1);
+        return;
+    }
+    
+    /* check for a single value */
+    range = &d->ranges[first];
+    if (range->from == range->to && (first == 0 || min < range->from) && (first == d->count - 1 || max > range->to)) {
+        code_case_compare(c, OP_EQ, range->from, &d->bodies[range->index]);
+        putcbyte(c, OP_BR);
+        d->dflt = putcword(c, d->dflt);
+        return;
+    }
+    
+    /* check the bounds that aren't already known to hold */
+    if (first == 0 || min < range->from)
+        code_case_compare(c, OP_LT, range->from, &d->dflt);
+    if (first == d->count - 1 || max > range->to)
+        code_case_compare(c, OP_GT, range->to, &d->dflt);
+    putcbyte(c, OP_BR);
+    d->bodies[range->index] = putcword(c, d->bodies[range->index]);
+}
+
+/* code_case_compare - compare the select value with a constant and branch if the comparison is true */
+static void code_case_compare(ParseContext *c, int op, VMVALUE value, VMUVALUE *pchain)
+{
+    putcbyte(c, OP_DUP);
+    code_lit(c, value);
+    putcbyte(c, op);
+    putcbyte(c, OP_BRT);
+    *pchain = putcword(c, *pchain);
+}
+
 /* code_for_statement - generate code for a FOR statement */
 static void code_for_statement(ParseContext *c, ParseTreeNode *node)
 {
@@ -428,7 +656,16 @@ static void code_loop_until_statement(ParseContext *c, ParseTreeNode *node)
 /* code_return_statement - generate code for a RETURN statement */
 static void code_return_statement(ParseContext *c, ParseTreeNode *node)
 {
-    if (node->u.returnStatement.expr) {
+    if (IsTailCall(c, node->u.returnStatement.expr))
+        code_tail_call(c, node->u.returnStatement.expr);
+    else if (IsLeafFunction(c->function)) {
+        if (node->u.returnStatement.expr)
+            code_rvalue(c, node->u.returnStatement.expr);
+        else
+            code_lit(c, 0);
+        putcbyte(c, OP_LRETURN);
+    }
+    else if (node->u.returnStatement.expr) {
         code_rvalue(c, node->u.returnStatement.expr);
         putcbyte(c, OP_RETURN);
     }
@@ -436,6 +673,31 @@ static void code_return_statement(ParseContext *c, ParseTreeNode *node)
         putcbyte(c, OP_RETURNZ);
 }
 
+/* IsTailCall - check to see if a returned expression is a call that can reuse the current frame */
+static int IsTailCall(ParseContext *c, ParseTreeNode *expr)
+{
+    return expr
+        && c->function->type
+        && expr->nodeType == NodeTypeFunctionCall
+        && expr->u.functionCall.fcn->nodeType == NodeTypeFunctionLit
+        && expr->u.functionCall.argc <= c->function->type->u.functionInfo.arguments.count;
+}
+
+/* code_tail_call - generate code to replace the current function with a call to another */
+static void code_tail_call(ParseContext *c, ParseTreeNode *expr)
+{
+    NodeListEntry *arg;
+
+    /* code each argument expression */
+    for (arg = expr->u.functionCall.args; arg != NULL; arg = arg->next)
+        code_rvalue(c, arg->node);
+
+    /* move the arguments into the current frame and jump to the function */
+    putcbyte(c, OP_TCALL);
+    putcbyte(c, expr->u.functionCall.argc);
+    code_globaladdr(c, expr->u.functionCall.fcn->u.functionLit.symbol);
+}
+
 /* code_label_definition - generate code for a label definition */
 static void code_label_definition(ParseContext *c, ParseTreeNode *node)
 {
@@ -477,6 +739,8 @@ static void code_statement_list(ParseContext *c, NodeListEntry *entry)
 {
     while (entry) {
         PVAL pv;
+        if (c->statementAddrs && entry->node->index)
+            c->statementAddrs[entry->node->index] = codeaddr(c);
         code_expr(c, entry->node, &pv);
         entry = entry->next;
     }
@@ -509,21 +773,66 @@ static void code_call(ParseContext *c, ParseTreeNode *expr)
     for (arg = expr->u.functionCall.args; arg != NULL; arg = arg->next)
         code_rvalue(c, arg->node);
 
-    /* get the value of the function */
-    code_rvalue(c, expr->u.functionCall.fcn);
-
-    /* call the function */
-    putcbyte(c, OP_PUSHJ);
-    if (expr->u.functionCall.argc > 0) {
-        putcbyte(c, OP_CLEAN);
+    /* call the function directly and let it remove its arguments on return */
+    if (expr->u.functionCall.fcn->nodeType == NodeTypeFunctionLit) {
+        putcbyte(c, OP_CALL);
         putcbyte(c, expr->u.functionCall.argc);
+        code_globaladdr(c, expr->u.functionCall.fcn->u.functionLit.symbol);
+    }
+
+    /* call through a function pointer */
+    else {
+        code_rvalue(c, expr->u.functionCall.fcn);
+        putcbyte(c, OP_PUSHJ);
+        if (expr->u.functionCall.argc > 0) {
+            putcbyte(c, OP_CLEAN);
+            putcbyte(c, expr->u.functionCall.argc);
+        }
+    }
+}
+
+/* code_intrinsic_call - generate code for an intrinsic function that is a single opcode */
+static void code_intrinsic_call(ParseContext *c, ParseTreeNode *expr, int needValue)
+{
+    int op = expr->u.intrinsicCall.op;
+    int store = (op == OP_STORE || op == OP_STOREB || op == OP_STOREW);
+    NodeListEntry *arg;
+    
+    /* code each argument expression keeping a copy of a stored value that is used */
+    for (arg = expr->u.intrinsicCall.args; arg != NULL; arg = arg->next) {
+        code_rvalue(c, arg->node);
+        if (store && needValue && arg == expr->u.intrinsicCall.args)
+            putcbyte(c, OP_DUP);
+    }
+
+    /* code the opcode and its operand */
+    putcbyte(c, op);
+    if (expr->u.intrinsicCall.operand)
+        putcbyte(c, expr->u.intrinsicCall.operand);
+
+    /* stores leave nothing on the stack but everything else leaves a value */
+    if (!store && !needValue)
+        putcbyte(c, OP_DROP);
+}
+
+/* code_lit - code an integer literal */
+static void code_lit(ParseContext *c, VMVALUE value)
+{
+    if (value >= -128 && value <= 127) {
+        putcbyte(c, OP_SLIT);
+        putcbyte(c, value);
+    }
+    else {
+        putcbyte(c, OP_LIT);
+        putcword(c, value);
     }
 }
 
 /* code_addressof - get the address of a data object */
 static void code_addressof(ParseContext *c, ParseTreeNode *expr)
 {
-    if (expr->u.addressOf.expr->type->id == TYPE_POINTER)
+    if (expr->u.addressOf.expr->type->id == TYPE_POINTER
+    ||  expr->u.addressOf.expr->type->id == TYPE_FUNCTION)
         code_rvalue(c, expr->u.addressOf.expr);
     else {
         PVAL pv;
@@ -535,9 +844,17 @@ static void code_addressof(ParseContext *c, ParseTreeNode *expr)
 /* code_globalref - code a global reference */
 static void code_globalref(ParseContext *c, Symbol *sym)
 {
-    VMUVALUE offset = sym->v.variable.offset;
     putcbyte(c, OP_LIT);
-    if (offset == UNDEF_VALUE)
+    code_globaladdr(c, sym);
+}
+
+/* code_globaladdr - code the address of a global as an instruction operand */
+static void code_globaladdr(ParseContext *c, Symbol *sym)
+{
+    VMUVALUE offset = sym->v.variable.offset;
+    
+    /* zero filled space follows all of the section data so its address isn't known until the end */
+    if (offset == UNDEF_VALUE || sym->zeroFilled)
         putcword(c, AddLocalSymbolFixup(c, sym, codeaddr(c)));
     else {
         switch (sym->storageClass) {
@@ -560,11 +877,22 @@ static void code_globalref(ParseContext *c, Symbol *sym)
 static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
 {
     code_rvalue(c, expr->u.arrayRef.array);
-    code_rvalue(c, expr->u.arrayRef.index);
-    if (expr->u.arrayRef.array->type->u.arrayInfo.elementType->id == TYPE_BYTE)
-        putcbyte(c, OP_ADD);
-    else
-        putcbyte(c, OP_INDEX);
+    if (!IsIntegerLit(expr->u.arrayRef.index) || expr->u.arrayRef.index->u.integerLit.value != 0) {
+        code_rvalue(c, expr->u.arrayRef.index);
+        switch (expr->u.arrayRef.array->type->u.arrayInfo.elementType->id) {
+        case TYPE_BYTE:
+            putcbyte(c, OP_ADD);
+            break;
+        case TYPE_WORD:
+            putcbyte(c, OP_DUP);    // scale the index by two
+            putcbyte(c, OP_ADD);
+            putcbyte(c, OP_ADD);
+            break;
+        default:
+            putcbyte(c, OP_INDEX);
+            break;
+        }
+    }
     pv->fcn = code_index;
 }
 
@@ -610,12 +938,16 @@ static void code_index(ParseContext *c, PValOp fcn, PVAL *pv)
     case PV_LOAD:
         if (pv->type->id == TYPE_BYTE)
             putcbyte(c, OP_LOADB);
+        else if (pv->type->id == TYPE_WORD)
+            putcbyte(c, OP_LOADW);
         else
             putcbyte(c, OP_LOAD);
         break;
     case PV_STORE:
         if (pv->type->id == TYPE_BYTE)
             putcbyte(c, OP_STOREB);
+        else if (pv->type->id == TYPE_WORD)
+            putcbyte(c, OP_STOREW);
         else
             putcbyte(c, OP_STORE);
         break;
@@ -0,0 +1,721 @@
+/* db_ir.c - linear intermediate code for the optimizer
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <string.h>
+#include "db_compiler.h"
+#include "db_vmdebug.h"
+
+/* maximum number of branches followed when threading a jump */
+#define MAX_THREAD_HOPS 8
+
+typedef struct IRBlock IRBlock;
+
+/* intermediate code instruction */
+typedef struct {
+    int opcode;
+    int fmt;                    /* operand format from the opcode table */
+    int deleted;                /* instruction has been removed */
+    VMVALUE operand;            /* literal, frame offset, byte operand or call target */
+    VMVALUE literal;            /* short literal for LADDI */
+    int argc;                   /* argument count for CALL and TCALL */
+    VMVALUE count;              /* number of cases for SWITCH */
+    IRBlock *target;            /* branch target */
+    IRBlock **cases;            /* SWITCH default target followed by the case targets */
+    LocalFixup *fixup;          /* symbol fixup chain that includes the operand */
+    VMUVALUE addr;              /* code offset */
+} IRInstr;
+
+/* basic block */
+struct IRBlock {
+    IRInstr *first;             /* first instruction */
+    IRInstr *end;               /* end of the instructions */
+    IRBlock *next;              /* next block in code order */
+    int refs;                   /* number of branches to the block */
+    int reachable;              /* block can be reached from the function entry */
+    VMUVALUE addr;              /* code offset */
+};
+
+/* function */
+struct IRFunction {
+    IRInstr *instrs;
+    int instrCount;
+    IRBlock *blocks;
+    int blockCount;
+    int *instrAt;               /* instruction index at each original code offset */
+    VMUVALUE length;            /* original code length */
+};
+
+static int OpcodeFormat(int opcode);
+static int InstrSize(IRInstr *instr);
+static int AddLeader(uint8_t *leaders, int *instrAt, VMUVALUE length, VMUVALUE addr);
+static int FindFixups(ParseContext *c, IRFunction *fn, int *instrAt, VMUVALUE length);
+static int EndsBlock(IRInstr *instr);
+static int IsReturn(IRInstr *instr);
+static IRInstr *FirstLive(IRBlock *block);
+static IRInstr *FirstLiveInBlock(IRBlock *block);
+static IRInstr *LastLive(IRBlock *block);
+static IRInstr *PrevLive(IRBlock *block, IRInstr *instr);
+static IRInstr *NextLive(IRBlock *block, IRInstr *instr);
+static IRInstr *NextInLine(IRBlock *block, IRInstr *instr);
+static IRBlock *FinalTarget(IRBlock *block);
+static int FallsInto(IRBlock *block, IRBlock *target);
+static void MarkReachable(IRBlock *block, IRBlock ***pTop);
+static void CountRefs(IRFunction *fn);
+
+/* BuildIR - build the intermediate code for the function in the code buffer */
+IRFunction *BuildIR(ParseContext *c)
+{
+    VMUVALUE length = codeaddr(c), addr, target;
+    int *instrAt, *blockAt, size, i, j;
+    uint8_t *leaders;
+    IRFunction *fn;
+    IRInstr *instr;
+    IRBlock *block;
+
+    /* find the start of each instruction */
+    fn = (IRFunction *)LocalAlloc(c, sizeof(IRFunction));
+    instrAt = (int *)LocalAlloc(c, (length + 1) * sizeof(int));
+    for (addr = 0; addr <= length; ++addr)
+        instrAt[addr] = -1;
+    for (addr = 0, fn->instrCount = 0; addr < length; addr += size) {
+        if ((size = CodeSize(c, addr, length)) == 0)
+            return NULL;
+        instrAt[addr] = fn->instrCount++;
+    }
+    fn->instrAt = instrAt;
+    fn->length = length;
+
+    /* decode the instructions */
+    fn->instrs = (IRInstr *)LocalAlloc(c, fn->instrCount * sizeof(IRInstr));
+    memset(fn->instrs, 0, fn->instrCount * sizeof(IRInstr));
+    leaders = (uint8_t *)LocalAlloc(c, length + 1);
+    memset(leaders, 0, length + 1);
+    leaders[0] = TRUE;
+    for (i = 0, instr = fn->instrs; i < fn->instrCount; ++i, ++instr) {
+        addr = (instr == fn->instrs ? 0 : instr[-1].addr + InstrSize(&instr[-1]));
+        instr->addr = addr;
+        instr->opcode = c->codeBuf[addr];
+        instr->fmt = OpcodeFormat(instr->opcode);
+        switch (instr->fmt) {
+        case FMT_BYTE:
+            instr->operand = c->codeBuf[addr + 1];
+            break;
+        case FMT_SBYTE:
+            instr->operand = (int8_t)c->codeBuf[addr + 1];
+            break;
+        case FMT_WORD:
+        case FMT_NATIVE:
+            instr->operand = rd_cword(c, addr + 1);
+            break;
+        case FMT_BR:
+            target = addr + 1 + sizeof(VMVALUE) + rd_cword(c, addr + 1);
+            if (!AddLeader(leaders, instrAt, length, target))
+                return NULL;
+            instr->operand = target;
+            break;
+        case FMT_CALL:
+            instr->argc = c->codeBuf[addr + 1];
+            instr->operand = rd_cword(c, addr + 2);
+            break;
+        case FMT_LOCALI:
+            instr->operand = (int8_t)c->codeBuf[addr + 1];
+            instr->literal = (int8_t)c->codeBuf[addr + 2];
+            break;
+        case FMT_SWITCH:
+            instr->operand = rd_cword(c, addr + 1);
+            instr->count = rd_cword(c, addr + 1 + sizeof(VMVALUE));
+            instr->cases = (IRBlock **)LocalAlloc(c, (instr->count + 1) * sizeof(IRBlock *));
+            for (j = 0; j <= instr->count; ++j) {
+                VMUVALUE entry = addr + 1 + (j + 2) * sizeof(VMVALUE);
+                if (!AddLeader(leaders, instrAt, length, entry + sizeof(VMVALUE) + rd_cword(c, entry)))
+                    return NULL;
+            }
+            break;
+        }
+        if (EndsBlock(instr))
+            leaders[addr + InstrSize(instr)] = TRUE;
+    }
+
+    /* split the instructions into basic blocks */
+    blockAt = (int *)LocalAlloc(c, (length + 1) * sizeof(int));
+    for (i = 0, fn->blockCount = 0; i < fn->instrCount; ++i)
+        if (leaders[fn->instrs[i].addr])
+            blockAt[fn->instrs[i].addr] = fn->blockCount++;
+    fn->blocks = (IRBlock *)LocalAlloc(c, fn->blockCount * sizeof(IRBlock));
+    memset(fn->blocks, 0, fn->blockCount * sizeof(IRBlock));
+    for (i = 0, block = fn->blocks - 1, instr = fn->instrs; i < fn->instrCount; ++i, ++instr)
+        if (leaders[instr->addr]) {
+            if (block >= fn->blocks)
+                block->end = instr;
+            (++block)->first = instr;
+            block->next = (block - fn->blocks + 1 < fn->blockCount ? block + 1 : NULL);
+        }
+    if (block >= fn->blocks)
+        block->end = instr;
+
+    /* resolve the branch targets */
+    for (i = 0, instr = fn->instrs; i < fn->instrCount; ++i, ++instr) {
+        if (instr->fmt == FMT_BR) {
+            instr->target = &fn->blocks[blockAt[instr->operand]];
+            instr->operand = 0;
+        }
+        else if (instr->fmt == FMT_SWITCH) {
+            for (j = 0; j <= instr->count; ++j) {
+                VMUVALUE entry = instr->addr + 1 + (j + 2) * sizeof(VMVALUE);
+                instr->cases[j] = &fn->blocks[blockAt[entry + sizeof(VMVALUE) + rd_cword(c, entry)]];
+            }
+        }
+    }
+
+    /* find the operands that are part of symbol fixup chains */
+    if (!FindFixups(c, fn, instrAt, length))
+        return NULL;
+
+    /* return the intermediate code */
+    return fn;
+}
+
+/* EmitIR - replace the code in the code buffer with the code for the intermediate code */
+void EmitIR(ParseContext *c, IRFunction *fn)
+{
+    LocalFixup *fixup;
+    IRInstr *instr;
+    IRBlock *block;
+    VMUVALUE addr;
+    int i, j;
+
+    /* assign code offsets to the blocks and instructions */
+    for (i = 0, addr = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block) {
+        block->addr = addr;
+        for (instr = block->first; instr < block->end; ++instr)
+            if (!instr->deleted) {
+                instr->addr = addr;
+                addr += InstrSize(instr);
+            }
+    }
+
+    /* the symbol fixup chains are rebuilt as the operands are written */
+    for (fixup = c->symbolFixups; fixup != NULL; fixup = fixup->next)
+        fixup->chain = 0;
+
+    /* write the instructions */
+    c->cptr = c->codeBuf;
+    for (i = 0, instr = fn->instrs; i < fn->instrCount; ++i, ++instr) {
+        if (instr->deleted)
+            continue;
+        putcbyte(c, instr->opcode);
+        switch (instr->fmt) {
+        case FMT_BYTE:
+        case FMT_SBYTE:
+            putcbyte(c, instr->operand);
+            break;
+        case FMT_LOCALI:
+            putcbyte(c, instr->operand);
+            putcbyte(c, instr->literal);
+            break;
+        case FMT_CALL:
+            putcbyte(c, instr->argc);
+            // fall through
+        case FMT_WORD:
+        case FMT_NATIVE:
+            if ((fixup = instr->fixup) != NULL)
+                fixup->chain = putcword(c, fixup->chain);
+            else
+                putcword(c, instr->operand);
+            break;
+        case FMT_BR:
+            putcword(c, instr->target->addr - (codeaddr(c) + sizeof(VMVALUE)));
+            break;
+        case FMT_SWITCH:
+            putcword(c, instr->operand);
+            putcword(c, instr->count);
+            for (j = 0; j <= instr->count; ++j)
+                putcword(c, instr->cases[j]->addr - (codeaddr(c) + sizeof(VMVALUE)));
+            break;
+        }
+    }
+}
+
+/* MapStatementAddresses - map the original statement offsets to offsets in the emitted code */
+void MapStatementAddresses(ParseContext *c, IRFunction *fn)
+{
+    VMUVALUE addr;
+    int i, j;
+
+    for (i = 1; i <= c->statementCount; ++i) {
+        if ((addr = c->statementAddrs[i]) == UNDEF_VALUE)
+            continue;
+
+        /* a statement starts at the first instruction that survived */
+        j = (addr < fn->length ? fn->instrAt[addr] : fn->instrCount);
+        while (j >= 0 && j < fn->instrCount && fn->instrs[j].deleted)
+            ++j;
+        if (j < 0)
+            c->statementAddrs[i] = UNDEF_VALUE;
+        else
+            c->statementAddrs[i] = (j < fn->instrCount ? fn->instrs[j].addr : codeaddr(c));
+    }
+}
+
+/* FoldBranches - fold branches on constants and on negated conditions */
+int FoldBranches(ParseContext *c, IRFunction *fn)
+{
+    IRInstr *instr, *prev;
+    IRBlock *block;
+    int changes = 0;
+    int i;
+
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block) {
+        if (!(instr = LastLive(block)) || (instr->opcode != OP_BRT && instr->opcode != OP_BRF))
+            continue;
+        if (!(prev = PrevLive(block, instr)))
+            continue;
+
+        /* branch on the opposite condition instead of negating it */
+        if (prev->opcode == OP_NOT) {
+            prev->deleted = TRUE;
+            instr->opcode = (instr->opcode == OP_BRT ? OP_BRF : OP_BRT);
+            ++changes;
+        }
+
+        /* branch unconditionally or not at all on a constant condition */
+        else if ((prev->opcode == OP_SLIT || prev->opcode == OP_LIT) && !prev->fixup) {
+            prev->deleted = TRUE;
+            if ((prev->operand != 0) == (instr->opcode == OP_BRT))
+                instr->opcode = OP_BR;
+            else
+                instr->deleted = TRUE;
+            ++changes;
+        }
+    }
+
+    return changes;
+}
+
+/* CombineInstructions - replace a store to a local followed by a load of the same local */
+int CombineInstructions(ParseContext *c, IRFunction *fn)
+{
+    IRInstr *instr, *next;
+    IRBlock *block;
+    int changes = 0;
+    int i;
+
+    CountRefs(fn);
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block)
+        for (instr = block->first; instr < block->end; ++instr) {
+            if (instr->deleted || instr->opcode != OP_LSET)
+                continue;
+            if ((next = NextInLine(block, instr)) != NULL
+            &&  next->opcode == OP_LREF
+            &&  next->operand == instr->operand) {
+                instr->opcode = OP_DUP;
+                instr->fmt = FMT_NONE;
+                next->opcode = OP_LSET;
+                ++changes;
+            }
+        }
+
+    return changes;
+}
+
+/* FuseLocalUpdates - add a short literal to a local in place instead of through the stack */
+int FuseLocalUpdates(ParseContext *c, IRFunction *fn)
+{
+    IRInstr *instr, *lit, *op, *set;
+    VMVALUE value;
+    IRBlock *block;
+    int changes = 0;
+    int i;
+
+    CountRefs(fn);
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block)
+        for (instr = block->first; instr < block->end; ++instr) {
+            if (instr->deleted || instr->opcode != OP_LREF)
+                continue;
+
+            /* look for LREF n, SLIT k, ADD or SUB, LSET n */
+            if (!(lit = NextInLine(block, instr)) || lit->opcode != OP_SLIT
+            ||  !(op = NextInLine(block, lit)) || (op->opcode != OP_ADD && op->opcode != OP_SUB)
+            ||  !(set = NextInLine(block, op)) || set->opcode != OP_LSET || set->operand != instr->operand)
+                continue;
+            value = (op->opcode == OP_ADD ? lit->operand : -lit->operand);
+            if (value < -128 || value > 127)
+                continue;
+
+            instr->opcode = OP_LADDI;
+            instr->fmt = FMT_LOCALI;
+            instr->literal = value;
+            lit->deleted = op->deleted = set->deleted = TRUE;
+            ++changes;
+        }
+
+    return changes;
+}
+
+/* ThreadJumps - branch directly to the final target of a chain of branches */
+int ThreadJumps(ParseContext *c, IRFunction *fn)
+{
+    IRInstr *instr, *dest;
+    IRBlock *target;
+    int changes = 0;
+    int i, j;
+
+    for (i = 0, instr = fn->instrs; i < fn->instrCount; ++i, ++instr) {
+        if (instr->deleted)
+            continue;
+        if (instr->fmt == FMT_BR) {
+            if ((target = FinalTarget(instr->target)) != instr->target) {
+                instr->target = target;
+                ++changes;
+            }
+
+            /* return directly rather than branching to a return */
+            if (instr->opcode == OP_BR && (dest = FirstLive(instr->target)) != NULL && IsReturn(dest)) {
+                instr->opcode = dest->opcode;
+                instr->fmt = FMT_NONE;
+                instr->target = NULL;
+                ++changes;
+            }
+        }
+        else if (instr->fmt == FMT_SWITCH) {
+            for (j = 0; j <= instr->count; ++j)
+                if ((target = FinalTarget(instr->cases[j])) != instr->cases[j]) {
+                    instr->cases[j] = target;
+                    ++changes;
+                }
+        }
+    }
+
+    return changes;
+}
+
+/* RemoveUnreachableCode - remove the blocks that can't be reached from the function entry */
+int RemoveUnreachableCode(ParseContext *c, IRFunction *fn)
+{
+    IRBlock **stack, **top, *block;
+    IRInstr *instr, *last;
+    int changes = 0;
+    int i, j;
+
+    /* find the blocks that can be reached from the entry */
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block)
+        block->reachable = FALSE;
+    stack = top = (IRBlock **)LocalAlloc(c, fn->blockCount * sizeof(IRBlock *));
+    MarkReachable(fn->blocks, &top);
+    while (top > stack) {
+        block = *--top;
+        for (instr = block->first; instr < block->end; ++instr) {
+            if (instr->deleted)
+                continue;
+            if (instr->fmt == FMT_BR)
+                MarkReachable(instr->target, &top);
+            else if (instr->fmt == FMT_SWITCH) {
+                for (j = 0; j <= instr->count; ++j)
+                    MarkReachable(instr->cases[j], &top);
+            }
+        }
+        if (block->next && (!(last = LastLive(block)) || !EndsBlock(last) || (last->fmt == FMT_BR && last->opcode != OP_BR)))
+            MarkReachable(block->next, &top);
+    }
+
+    /* remove the instructions in the blocks that can't be reached */
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block)
+        if (!block->reachable) {
+            for (instr = block->first; instr < block->end; ++instr)
+                if (!instr->deleted) {
+                    instr->deleted = TRUE;
+                    ++changes;
+                }
+        }
+
+    return changes;
+}
+
+/* RemoveBranchesToNext - let control fall through to the next block instead of branching to it */
+int RemoveBranchesToNext(ParseContext *c, IRFunction *fn)
+{
+    IRInstr *last, *br;
+    IRBlock *block, *next;
+    int changes = 0;
+    int i;
+
+    CountRefs(fn);
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block) {
+        if (!(last = LastLive(block)))
+            continue;
+
+        /* remove a branch to the next instruction */
+        if (last->opcode == OP_BR && FallsInto(block, last->target)) {
+            last->deleted = TRUE;
+            ++changes;
+        }
+
+        /* invert a conditional branch around an unconditional branch */
+        else if (last->opcode == OP_BRT || last->opcode == OP_BRF) {
+            for (next = block->next; next && !FirstLiveInBlock(next); next = next->next)
+                ;
+            if (next
+            &&  next->refs == 0
+            &&  (br = FirstLiveInBlock(next)) != NULL
+            &&  br->opcode == OP_BR
+            &&  NextLive(next, br) == NULL
+            &&  FallsInto(next, last->target)) {
+                last->opcode = (last->opcode == OP_BRT ? OP_BRF : OP_BRT);
+                last->target = br->target;
+                ++last->target->refs;
+                br->deleted = TRUE;
+                ++changes;
+            }
+        }
+    }
+
+    return changes;
+}
+
+/* OpcodeFormat - get the operand format of an opcode */
+static int OpcodeFormat(int opcode)
+{
+    FLASH_SPACE OTDEF *op;
+    for (op = OpcodeTable; op->name; ++op)
+        if (op->code == opcode)
+            return op->fmt;
+    return -1;
+}
+
+/* CodeSize - get the size of an instruction in the code buffer or zero if it can't be decoded */
+int CodeSize(ParseContext *c, VMUVALUE addr, VMUVALUE length)
+{
+    VMUVALUE size;
+    switch (OpcodeFormat(c->codeBuf[addr])) {
+    case FMT_NONE:
+        size = 1;
+        break;
+    case FMT_BYTE:
+    case FMT_SBYTE:
+        size = 2;
+        break;
+    case FMT_WORD:
+    case FMT_NATIVE:
+    case FMT_BR:
+        size = 1 + sizeof(VMVALUE);
+        break;
+    case FMT_LOCALI:
+        size = 3;
+        break;
+    case FMT_CALL:
+        size = 2 + sizeof(VMVALUE);
+        break;
+    case FMT_SWITCH:
+        size = 1 + sizeof(VMVALUE) * 2;
+        if (addr + size > length)
+            return 0;
+        if ((VMUVALUE)rd_cword(c, addr + 1 + sizeof(VMVALUE)) >= (length - addr) / sizeof(VMVALUE))
+            return 0;
+        size += (rd_cword(c, addr + 1 + sizeof(VMVALUE)) + 1) * sizeof(VMVALUE);
+        break;
+    default:
+        return 0;
+    }
+    return addr + size <= length ? size : 0;
+}
+
+/* InstrSize - get the size of the code for an intermediate code instruction */
+static int InstrSize(IRInstr *instr)
+{
+    switch (instr->fmt) {
+    case FMT_BYTE:
+    case FMT_SBYTE:
+        return 2;
+    case FMT_WORD:
+    case FMT_NATIVE:
+    case FMT_BR:
+        return 1 + sizeof(VMVALUE);
+    case FMT_LOCALI:
+        return 3;
+    case FMT_CALL:
+        return 2 + sizeof(VMVALUE);
+    case FMT_SWITCH:
+        return 1 + sizeof(VMVALUE) * (instr->count + 3);
+    }
+    return 1;
+}
+
+/* AddLeader - mark a branch target as the start of a basic block */
+static int AddLeader(uint8_t *leaders, int *instrAt, VMUVALUE length, VMUVALUE addr)
+{
+    if (addr >= length || instrAt[addr] < 0)
+        return FALSE;
+    leaders[addr] = TRUE;
+    return TRUE;
+}
+
+/* FindFixups - find the instruction operands that are linked into symbol fixup chains */
+static int FindFixups(ParseContext *c, IRFunction *fn, int *instrAt, VMUVALUE length)
+{
+    LocalFixup *fixup;
+    VMUVALUE offset, next;
+    IRInstr *instr;
+
+    for (fixup = c->symbolFixups; fixup != NULL; fixup = fixup->next)
+        for (offset = fixup->chain; offset != 0; offset = next) {
+            if (offset >= length)
+                return FALSE;
+            next = rd_cword(c, offset);
+            if (offset >= 1 && instrAt[offset - 1] >= 0 && fn->instrs[instrAt[offset - 1]].fmt == FMT_WORD)
+                instr = &fn->instrs[instrAt[offset - 1]];
+            else if (offset >= 2 && instrAt[offset - 2] >= 0 && fn->instrs[instrAt[offset - 2]].fmt == FMT_CALL)
+                instr = &fn->instrs[instrAt[offset - 2]];
+            else
+                return FALSE;
+            instr->fixup = fixup;
+        }
+
+    return TRUE;
+}
+
+/* EndsBlock - check for an instruction that transfers control */
+static int EndsBlock(IRInstr *instr)
+{
+    switch (instr->opcode) {
+    case OP_HALT:
+    case OP_POPJ:
+    case OP_RETURN:
+    case OP_RETURNZ:
+    case OP_LRETURN:
+    case OP_TCALL:
+    case OP_SWITCH:
+        return TRUE;
+    }
+    return instr->fmt == FMT_BR;
+}
+
+/* IsReturn - check for an instruction that leaves the function without any operands */
+static int IsReturn(IRInstr *instr)
+{
+    switch (instr->opcode) {
+    case OP_HALT:
+    case OP_RETURN:
+    case OP_RETURNZ:
+    case OP_LRETURN:
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* FirstLive - get the first instruction executed when control reaches a block */
+static IRInstr *FirstLive(IRBlock *block)
+{
+    IRInstr *instr;
+    for (; block != NULL; block = block->next)
+        if ((instr = FirstLiveInBlock(block)) != NULL)
+            return instr;
+    return NULL;
+}
+
+/* FirstLiveInBlock - get the first instruction of a block that hasn't been removed */
+static IRInstr *FirstLiveInBlock(IRBlock *block)
+{
+    IRInstr *instr;
+    for (instr = block->first; instr < block->end; ++instr)
+        if (!instr->deleted)
+            return instr;
+    return NULL;
+}
+
+/* LastLive - get the last instruction of a block that hasn't been removed */
+static IRInstr *LastLive(IRBlock *block)
+{
+    IRInstr *instr;
+    for (instr = block->end; --instr >= block->first; )
+        if (!instr->deleted)
+            return instr;
+    return NULL;
+}
+
+/* PrevLive - get the previous instruction in a block that hasn't been removed */
+static IRInstr *PrevLive(IRBlock *block, IRInstr *instr)
+{
+    while (--instr >= block->first)
+        if (!instr->deleted)
+            return instr;
+    return NULL;
+}
+
+/* NextLive - get the next instruction in a block that hasn't been removed */
+static IRInstr *NextLive(IRBlock *block, IRInstr *instr)
+{
+    while (++instr < block->end)
+        if (!instr->deleted)
+            return instr;
+    return NULL;
+}
+
+/* NextInLine - get the next instruction if it can only be reached from the current one */
+static IRInstr *NextInLine(IRBlock *block, IRInstr *instr)
+{
+    IRInstr *next;
+    if ((next = NextLive(block, instr)) != NULL)
+        return next;
+    for (block = block->next; block != NULL && block->refs == 0; block = block->next)
+        if ((next = FirstLiveInBlock(block)) != NULL)
+            return next;
+    return NULL;
+}
+
+/* FinalTarget - follow a chain of unconditional branches */
+static IRBlock *FinalTarget(IRBlock *block)
+{
+    IRInstr *instr;
+    int hops;
+    for (hops = 0; hops < MAX_THREAD_HOPS; ++hops) {
+        if (!(instr = FirstLive(block)) || instr->opcode != OP_BR || instr->target == block)
+            break;
+        block = instr->target;
+    }
+    return block;
+}
+
+/* FallsInto - check to see if control falls through from the end of a block into a target block */
+static int FallsInto(IRBlock *block, IRBlock *target)
+{
+    for (block = block->next; block != NULL; block = block->next) {
+        if (block == target)
+            return TRUE;
+        if (FirstLiveInBlock(block))
+            return FALSE;
+    }
+    return FALSE;
+}
+
+/* MarkReachable - mark a block as reachable and add it to the list of blocks to visit */
+static void MarkReachable(IRBlock *block, IRBlock ***pTop)
+{
+    if (!block->reachable) {
+        block->reachable = TRUE;
+        *(*pTop)++ = block;
+    }
+}
+
+/* CountRefs - count the branches to each block */
+static void CountRefs(IRFunction *fn)
+{
+    IRInstr *instr;
+    IRBlock *block;
+    int i, j;
+
+    for (i = 0, block = fn->blocks; i < fn->blockCount; ++i, ++block)
+        block->refs = 0;
+    for (i = 0, instr = fn->instrs; i < fn->instrCount; ++i, ++instr) {
+        if (instr->deleted)
+            continue;
+        if (instr->fmt == FMT_BR)
+            ++instr->target->refs;
+        else if (instr->fmt == FMT_SWITCH) {
+            for (j = 0; j <= instr->count; ++j)
+                ++instr->cases[j]->refs;
+        }
+    }
+}
@@ -0,0 +1,283 @@
+/* db_layout.c - function layout for code executed through a cache
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * On boards that execute code from external memory through a cache, the
+ * code for each function is held until all of the code has been generated
+ * and is then placed so that functions that call each other share cache
+ * lines.  Functions are clustered greedily by call affinity, heaviest call
+ * edge first.  The edge weights are the profiled call counts when a profile
+ * is available and the number of static references otherwise.  With a
+ * profile, hot function entries are aligned to cache line boundaries when
+ * their first line would otherwise be split, and code that runs at most once
+ * per statement is moved to the end.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "db_compiler.h"
+
+/* default number of bits in the cache line offset (see c3_cache.spin and ssf_cache.spin) */
+#define DEFAULT_LINE_BITS   7
+
+/* a function is hot if it executes at least this fraction of the profiled statements */
+#define HOT_FRACTION        32
+
+typedef struct LayoutCall LayoutCall;
+
+/* reference from one function to another */
+struct LayoutCall {
+    LayoutCall *next;
+    Symbol *callee;
+    unsigned long weight;       /* profiled calls or static references */
+};
+
+/* call graph edge */
+typedef struct {
+    PendingCode *caller;
+    PendingCode *callee;
+    unsigned long weight;
+} LayoutEdge;
+
+/* code waiting to be placed */
+struct PendingCode {
+    PendingCode *next;          /* next code in source order */
+    Symbol *symbol;             /* function symbol or NULL for the main code */
+    uint8_t *code;
+    VMUVALUE size;
+    LocalFixup *fixups;         /* symbol fixups chained through the code */
+    VMUVALUE *statementAddrs;   /* statement offsets for the statement map */
+    VMUVALUE *statementHashes;  /* statement source line hashes for the statement map */
+    int statementCount;
+    LayoutCall *calls;          /* functions referenced by the code */
+    int profiled;               /* the profile has counts for the code */
+    unsigned long count;        /* profiled statement executions */
+    int order;                  /* position in source order */
+    PendingCode *cluster;       /* first code in the cluster */
+    PendingCode *nextInCluster; /* next code in the cluster */
+    PendingCode *lastInCluster; /* last code in the cluster (first code only) */
+    unsigned long clusterCount; /* profiled statement executions of the cluster (first code only) */
+};
+
+static int CountReferences(ParseContext *c, VMUVALUE chain);
+static PendingCode *FindPendingCode(ParseContext *c, Symbol *symbol);
+static int IsColdCode(PendingCode *code);
+static int CompareEdges(const void *p1, const void *p2);
+static int CompareClusters(const void *p1, const void *p2);
+static void PadToLine(ParseContext *c, VMUVALUE lineSize, VMUVALUE size);
+
+/* DeferCode - hold the code in the code buffer until the function layout is known */
+void DeferCode(ParseContext *c, Symbol *symbol)
+{
+    PendingCode *code, **pNext;
+    LocalFixup *fixup, *copy;
+    LayoutCall *call;
+    unsigned long weight;
+
+    /* save the code */
+    code = (PendingCode *)GlobalAlloc(c, sizeof(PendingCode));
+    memset(code, 0, sizeof(PendingCode));
+    code->symbol = symbol;
+    code->size = c->cptr - c->codeBuf;
+    code->code = (uint8_t *)GlobalAlloc(c, code->size);
+    memcpy(code->code, c->codeBuf, code->size);
+
+    /* save the symbol fixups and the references to other functions */
+    for (fixup = c->symbolFixups; fixup != NULL; fixup = fixup->next) {
+        copy = (LocalFixup *)GlobalAlloc(c, sizeof(LocalFixup));
+        *copy = *fixup;
+        copy->next = code->fixups;
+        code->fixups = copy;
+        if (fixup->symbol->type->id == TYPE_FUNCTION) {
+            weight = c->profile ? GetCallsTo(c, fixup->symbol->name) : CountReferences(c, fixup->chain);
+            if (weight > 0) {
+                call = (LayoutCall *)GlobalAlloc(c, sizeof(LayoutCall));
+                call->callee = fixup->symbol;
+                call->weight = weight;
+                call->next = code->calls;
+                code->calls = call;
+            }
+        }
+    }
+
+    /* save the statement offsets for the statement map */
+    code->statementCount = c->statementCount;
+    if (c->statementAddrs) {
+        code->statementAddrs = (VMUVALUE *)GlobalAlloc(c, (c->statementCount + 1) * sizeof(VMUVALUE));
+        memcpy(code->statementAddrs, c->statementAddrs, (c->statementCount + 1) * sizeof(VMUVALUE));
+        code->statementHashes = (VMUVALUE *)GlobalAlloc(c, (c->statementCount + 1) * sizeof(VMUVALUE));
+        memcpy(code->statementHashes, c->statementHashes, (c->statementCount + 1) * sizeof(VMUVALUE));
+    }
+
+    /* save the execution count */
+    code->profiled = (c->profile != NULL);
+    code->count = GetFunctionCount(c);
+
+    /* add the code to the end of the list */
+    for (pNext = &c->pendingCode; *pNext != NULL; pNext = &(*pNext)->next)
+        ;
+    *pNext = code;
+}
+
+/* LayoutFunctions - place the deferred code clustered by call affinity */
+void LayoutFunctions(ParseContext *c)
+{
+    PendingCode *code, *callee, **clusters;
+    LayoutEdge *edges;
+    LayoutCall *call;
+    VMUVALUE lineSize;
+    unsigned long total = 0;
+    int codeCount = 0, edgeCount = 0, clusterCount = 0, i;
+
+    /* each code starts out in a cluster by itself */
+    for (code = c->pendingCode; code != NULL; code = code->next) {
+        code->order = codeCount++;
+        code->cluster = code;
+        code->nextInCluster = NULL;
+        code->lastInCluster = code;
+        code->clusterCount = code->count;
+        total += code->count;
+        for (call = code->calls; call != NULL; call = call->next)
+            ++edgeCount;
+    }
+    if (codeCount == 0)
+        return;
+
+    /* build the call graph between code that isn't cold */
+    edges = (LayoutEdge *)LocalAlloc(c, (edgeCount + 1) * sizeof(LayoutEdge));
+    edgeCount = 0;
+    for (code = c->pendingCode; code != NULL; code = code->next)
+        for (call = code->calls; call != NULL; call = call->next)
+            if ((callee = FindPendingCode(c, call->callee)) != NULL && callee != code
+            &&  !IsColdCode(code) && !IsColdCode(callee)) {
+                edges[edgeCount].caller = code;
+                edges[edgeCount].callee = callee;
+                edges[edgeCount].weight = call->weight;
+                ++edgeCount;
+            }
+
+    /* merge the clusters at the ends of each edge starting with the heaviest */
+    qsort(edges, edgeCount, sizeof(LayoutEdge), CompareEdges);
+    for (i = 0; i < edgeCount; ++i) {
+        PendingCode *first = edges[i].caller->cluster;
+        PendingCode *second = edges[i].callee->cluster;
+        if (first != second) {
+            first->lastInCluster->nextInCluster = second;
+            first->lastInCluster = second->lastInCluster;
+            first->clusterCount += second->clusterCount;
+            for (code = second; code != NULL; code = code->nextInCluster)
+                code->cluster = first;
+        }
+    }
+
+    /* order the clusters by execution count with the cold code last */
+    clusters = (PendingCode **)LocalAlloc(c, codeCount * sizeof(PendingCode *));
+    for (code = c->pendingCode; code != NULL; code = code->next)
+        if (code->cluster == code && !IsColdCode(code))
+            clusters[clusterCount++] = code;
+    qsort(clusters, clusterCount, sizeof(PendingCode *), CompareClusters);
+    for (code = c->pendingCode; code != NULL; code = code->next)
+        if (IsColdCode(code))
+            clusters[clusterCount++] = code;
+
+    /* get the cache line size */
+    lineSize = (VMUVALUE)1 << (c->config->cacheParam2 ? c->config->cacheParam2 : DEFAULT_LINE_BITS);
+    if (c->flags & COMPILER_INFO)
+        xbInfo(c->sys, "function layout (%d byte cache lines)\n", lineSize);
+
+    /* place the code */
+    c->function = NULL;
+    c->functionType = NULL;
+    for (i = 0; i < clusterCount; ++i) {
+        for (code = clusters[i]; code != NULL; code = code->nextInCluster) {
+            int hot = code->profiled && total > 0 && code->count * HOT_FRACTION >= total;
+
+            /* start a hot function on a cache line boundary if its first line would be split */
+            if (hot)
+                PadToLine(c, lineSize, code->size);
+            if (c->flags & COMPILER_INFO)
+                xbInfo(c->sys, "  %08x %-16s %6d bytes%s\n",
+                       c->textTarget->base + c->textTarget->offset,
+                       code->symbol ? code->symbol->name : "[main]",
+                       code->size,
+                       hot ? " (hot)" : IsColdCode(code) ? " (cold)" : "");
+
+            /* restore the code and its fixups and place it */
+            memcpy(c->codeBuf, code->code, code->size);
+            c->cptr = c->codeBuf + code->size;
+            c->symbolFixups = code->fixups;
+            c->statementAddrs = code->statementAddrs;
+            c->statementHashes = code->statementHashes;
+            c->statementCount = code->statementCount;
+            PlaceCode(c, code->symbol);
+        }
+    }
+
+    /* reset the code buffer */
+    c->cptr = c->codeBuf;
+    c->symbolFixups = NULL;
+    c->statementAddrs = NULL;
+    c->pendingCode = NULL;
+}
+
+/* CountReferences - count the references in a symbol fixup chain */
+static int CountReferences(ParseContext *c, VMUVALUE chain)
+{
+    int count = 0;
+    for (; chain != 0; chain = rd_cword(c, chain))
+        ++count;
+    return count;
+}
+
+/* FindPendingCode - find the deferred code of a function */
+static PendingCode *FindPendingCode(ParseContext *c, Symbol *symbol)
+{
+    PendingCode *code;
+    for (code = c->pendingCode; code != NULL; code = code->next)
+        if (code->symbol == symbol)
+            return code;
+    return NULL;
+}
+
+/* IsColdCode - check to see if the profile shows that code ran at most once */
+static int IsColdCode(PendingCode *code)
+{
+    return code->profiled && code->count <= (unsigned long)code->statementCount;
+}
+
+/* CompareEdges - sort edges heaviest first keeping source order otherwise */
+static int CompareEdges(const void *p1, const void *p2)
+{
+    const LayoutEdge *e1 = (const LayoutEdge *)p1;
+    const LayoutEdge *e2 = (const LayoutEdge *)p2;
+    if (e1->weight != e2->weight)
+        return e1->weight > e2->weight ? -1 : 1;
+    if (e1->caller->order != e2->caller->order)
+        return e1->caller->order - e2->caller->order;
+    return e1->callee->order - e2->callee->order;
+}
+
+/* CompareClusters - sort clusters most executed first keeping source order otherwise */
+static int CompareClusters(const void *p1, const void *p2)
+{
+    const PendingCode *c1 = *(const PendingCode **)p1;
+    const PendingCode *c2 = *(const PendingCode **)p2;
+    if (c1->clusterCount != c2->clusterCount)
+        return c1->clusterCount > c2->clusterCount ? -1 : 1;
+    return c1->order - c2->order;
+}
+
+/* PadToLine - pad the text section to the next cache line if code of a given size would cross it */
+static void PadToLine(ParseContext *c, VMUVALUE lineSize, VMUVALUE size)
+{
+    static uint8_t padding[64];
+    VMUVALUE used = (c->textTarget->base + c->textTarget->offset) % lineSize;
+    VMUVALUE count = lineSize - used;
+    if (used == 0 || used + (size < lineSize ? size : lineSize) <= lineSize)
+        return;
+    while (count > 0) {
+        VMUVALUE size = count < sizeof(padding) ? count : sizeof(padding);
+        c->textTarget->offset += WriteSection(c, c->textTarget, padding, size);
+        count -= size;
+    }
+}
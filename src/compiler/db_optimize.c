@@ -0,0 +1,1160 @@
+/* db_optimize.c - parse tree optimizations
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <string.h>
+#include "db_compiler.h"
+
+/* optimizer limits */
+#define MAX_TRACKED_GLOBALS 8       /* globals tracked individually before assuming all of memory */
+#define MAX_HIDDEN_LOCALS   32      /* maximum number of hidden locals in each pool */
+#define MAX_CANDIDATES      128     /* maximum number of subexpressions considered in a run */
+#define MAX_RUN             64      /* maximum number of statements in a run */
+#define MIN_LOCAL_OFFSET    -128    /* most negative frame offset reachable by LREF and LSET */
+#define MAX_INLINE_NODES    16      /* largest expression substituted for a call */
+#define MAX_INLINE_ARGS     8       /* most arguments of a function that can be inlined */
+#define HOT_CALL_COUNT      64      /* fewest profiled calls from a statement worth inlining */
+
+/* optimizations performed by a walk over the parse tree */
+#define OPT_HOIST           (1 << 0)    /* hoist loop invariants */
+#define OPT_REUSE           (1 << 1)    /* reuse common subexpressions */
+
+/* ways an expression can be used */
+typedef enum {
+    USE_VALUE,
+    USE_STORE,
+    USE_ADDRESS
+} UseType;
+
+/* set of variables read or written */
+typedef struct {
+    uint32_t locals[8];                     /* locals and arguments indexed by frame offset */
+    Symbol *globals[MAX_TRACKED_GLOBALS];   /* global variables */
+    int globalCount;
+    int memory;                             /* any global variable or array element */
+} VarSet;
+
+/* pool of hidden locals */
+typedef struct {
+    int offsets[MAX_HIDDEN_LOCALS];
+    int count;                  /* number of hidden locals allocated to the pool */
+    int top;                    /* number of hidden locals in use */
+} LocalPool;
+
+/* optimizer state */
+typedef struct {
+    ParseContext *c;
+    ParseTreeNode *function;    /* function being optimized */
+    int optimizations;          /* optimizations to perform */
+    int changes;                /* number of expressions replaced */
+    VarSet escaped;             /* locals whose address is taken */
+    LocalPool loopLocals;       /* hidden locals holding loop invariants */
+    LocalPool cseLocals;        /* hidden locals holding common subexpressions */
+    int labelCount;             /* number of labels seen by WalkStatement */
+    int asmCount;               /* number of asm statements seen by WalkStatement */
+    int yieldCount;             /* number of YIELD statements seen by WalkStatement */
+    ParseTreeNode *statement;   /* statement being walked by WalkStatement */
+} Optimizer;
+
+/* expression hoisted out of a loop */
+typedef struct {
+    ParseTreeNode *expr;        /* copy of the expression or array reference */
+    int isAddress;              /* holds the address of the array element */
+    int offset;                 /* hidden local holding the value */
+} Hoisted;
+
+/* loop being optimized */
+typedef struct {
+    VarSet defs;                /* variables written by the loop */
+    int hoistGlobals;           /* global loads may be hoisted */
+    NodeListEntry **pInsert;    /* where to insert the next invariant computation */
+    Hoisted hoisted[MAX_HIDDEN_LOCALS];
+    int count;
+} Loop;
+
+/* common subexpression candidate */
+typedef struct {
+    ParseTreeNode *expr;        /* expression or array reference */
+    int isAddress;              /* use the address of the array element */
+    int stmt;                   /* index of the statement in the run */
+} Candidate;
+
+/* run of simple statements */
+typedef struct {
+    NodeListEntry **pLinks[MAX_RUN];
+    VarSet defs[MAX_RUN];
+    int hasCall[MAX_RUN];
+    Candidate candidates[MAX_CANDIDATES];
+    int candidateCount;
+    int stmt;                   /* statement being scanned for candidates */
+} Run;
+
+typedef void ExprFcn(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+
+static int OptimizeTree(ParseContext *c, ParseTreeNode *node, int optimizations);
+static void OptimizeStatementList(Optimizer *o, NodeListEntry **pEntry);
+static void OptimizeNestedStatements(Optimizer *o, ParseTreeNode *node);
+static NodeListEntry **HoistInvariants(Optimizer *o, NodeListEntry **pEntry, ParseTreeNode *node);
+static void HoistExpr(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static int HoistValue(Optimizer *o, Loop *loop, ParseTreeNode *expr, int isAddress);
+static void ReuseCommonExpressions(Optimizer *o, NodeListEntry **pEntry);
+static int ReuseExpression(Optimizer *o, NodeListEntry **pFirst, int count);
+static void CollectExpr(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static void AddCandidate(Run *run, ParseTreeNode *expr, int isAddress);
+static int IsSimpleStatement(ParseTreeNode *node);
+static int IsLoop(ParseTreeNode *node);
+static void WalkStatements(Optimizer *o, NodeListEntry *entry, ExprFcn *fcn, void *cookie);
+static void WalkStatement(Optimizer *o, ParseTreeNode *node, ExprFcn *fcn, void *cookie);
+static void VisitChildren(Optimizer *o, ParseTreeNode *expr, ExprFcn *fcn, void *cookie);
+static void FindEscapedLocals(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static void AddExprDefs(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static void FindCalls(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static int ExprUses(Optimizer *o, ParseTreeNode *expr, VarSet *uses);
+static int AddressUses(Optimizer *o, ParseTreeNode *ref, VarSet *uses);
+static int ExprCost(ParseTreeNode *expr);
+static int AddressCost(ParseTreeNode *ref);
+static int SameExpr(ParseTreeNode *a, ParseTreeNode *b);
+static int IsZeroLit(ParseTreeNode *node);
+static void AddLocalVar(VarSet *set, int offset);
+static void AddGlobalVar(VarSet *set, Symbol *symbol);
+static int ReadsMemory(VarSet *uses);
+static int Intersects(VarSet *defs, VarSet *uses);
+static int AllocLocal(Optimizer *o, LocalPool *pool, int *pOffset);
+static void ReplaceWithLocal(Optimizer *o, ParseTreeNode *expr, int isAddress, int offset);
+static ParseTreeNode *CopyValue(Optimizer *o, ParseTreeNode *expr, int isAddress);
+static ParseTreeNode *NewLocalRef(Optimizer *o, int offset, Type *type);
+static void InsertStatement(Optimizer *o, NodeListEntry ***ppInsert, ParseTreeNode *node);
+static void InlineCall(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static void LayoutBranch(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie);
+static int CanInline(ParseTreeNode *expr, int *pCount);
+static void CountArgUses(ParseTreeNode *expr, int *uses);
+static int IsLeafExpr(ParseTreeNode *expr);
+static int HasCall(ParseTreeNode *expr);
+static ParseTreeNode *CopyInlineExpr(ParseContext *c, ParseTreeNode *expr, ParseTreeNode **args);
+
+/* HoistLoopInvariants - move loop invariant expressions out of the loops of a function */
+int HoistLoopInvariants(ParseContext *c, ParseTreeNode *node)
+{
+    return OptimizeTree(c, node, OPT_HOIST);
+}
+
+/* ReuseCommonSubexpressions - compute common subexpressions of a function only once */
+int ReuseCommonSubexpressions(ParseContext *c, ParseTreeNode *node)
+{
+    return OptimizeTree(c, node, OPT_REUSE);
+}
+
+/* InlineHotCalls - replace frequently executed calls to simple functions with the function body */
+int InlineHotCalls(ParseContext *c, ParseTreeNode *node)
+{
+    Optimizer o;
+
+    /* only calls that the profile shows to be hot are worth the code */
+    if (!c->profile)
+        return 0;
+
+    /* inline the calls */
+    memset(&o, 0, sizeof(o));
+    o.c = c;
+    o.function = node;
+    WalkStatements(&o, node->u.functionDefinition.bodyStatements, InlineCall, NULL);
+    return o.changes;
+}
+
+/* LayoutHotBranches - make the more frequently executed arm of each IF statement the fall through path */
+int LayoutHotBranches(ParseContext *c, ParseTreeNode *node)
+{
+    Optimizer o;
+
+    /* the profile tells which arm is executed more often */
+    if (!c->profile)
+        return 0;
+
+    /* reorder the arms */
+    memset(&o, 0, sizeof(o));
+    o.c = c;
+    o.function = node;
+    WalkStatements(&o, node->u.functionDefinition.bodyStatements, LayoutBranch, NULL);
+    return o.changes;
+}
+
+/* SaveInlineBody - save the returned expression of a function simple enough to inline */
+void SaveInlineBody(ParseContext *c, ParseTreeNode *node)
+{
+    NodeListEntry *body = node->u.functionDefinition.bodyStatements;
+    Type *type = node->u.functionDefinition.symbol->type;
+    int count = 0;
+    Symbol *arg;
+
+    /* the body must be a single RETURN of an expression */
+    if (!body || body->next
+    ||  body->node->nodeType != NodeTypeReturnStatement
+    ||  !body->node->u.returnStatement.expr
+    ||  node->u.functionDefinition.locals.count > 0
+    ||  node->u.functionDefinition.hasAsm
+    ||  type->u.functionInfo.arguments.count > MAX_INLINE_ARGS)
+        return;
+
+    /* only integer arguments can be substituted */
+    for (arg = type->u.functionInfo.arguments.head; arg != NULL; arg = arg->next)
+        if (arg->type->id != TYPE_INTEGER)
+            return;
+
+    /* save a copy of the expression that outlives the function parse tree */
+    if (CanInline(body->node->u.returnStatement.expr, &count))
+        type->u.functionInfo.inlineBody = CopyInlineExpr(c, body->node->u.returnStatement.expr, NULL);
+}
+
+/* OptimizeTree - optimize the parse tree of a function before generating code */
+static int OptimizeTree(ParseContext *c, ParseTreeNode *node, int optimizations)
+{
+    Optimizer o;
+
+    /* only functions have a stack frame to hold hidden locals */
+    if (!node->type)
+        return 0;
+
+    /* initialize the optimizer state */
+    memset(&o, 0, sizeof(o));
+    o.c = c;
+    o.function = node;
+    o.optimizations = optimizations;
+
+    /* find locals that can be modified through a pointer */
+    WalkStatements(&o, node->u.functionDefinition.bodyStatements, FindEscapedLocals, NULL);
+
+    /* assembly code can access the stack frame directly and other tasks can change variables across a YIELD */
+    if (o.asmCount > 0 || o.yieldCount > 0)
+        return 0;
+
+    /* optimize the function body */
+    OptimizeStatementList(&o, &node->u.functionDefinition.bodyStatements);
+    return o.changes;
+}
+
+/* OptimizeStatementList - optimize a list of statements and the statements nested within them */
+static void OptimizeStatementList(Optimizer *o, NodeListEntry **pEntry)
+{
+    NodeListEntry **pFirst = pEntry;
+    int mark;
+
+    for (; *pEntry != NULL; pEntry = &(*pEntry)->next) {
+        ParseTreeNode *node = (*pEntry)->node;
+
+        /* hidden locals for loop invariants are free again after the loop */
+        mark = o->loopLocals.top;
+
+        /* hoist loop invariants before optimizing any inner loops */
+        if ((o->optimizations & OPT_HOIST) && IsLoop(node))
+            pEntry = HoistInvariants(o, pEntry, node);
+        OptimizeNestedStatements(o, node);
+
+        o->loopLocals.top = mark;
+    }
+
+    /* reuse common subexpressions in runs of simple statements */
+    if (o->optimizations & OPT_REUSE)
+        ReuseCommonExpressions(o, pFirst);
+}
+
+/* OptimizeNestedStatements - optimize the statement lists nested within a statement */
+static void OptimizeNestedStatements(Optimizer *o, ParseTreeNode *node)
+{
+    switch (node->nodeType) {
+    case NodeTypeIfStatement:
+        OptimizeStatementList(o, &node->u.ifStatement.thenStatements);
+        OptimizeStatementList(o, &node->u.ifStatement.elseStatements);
+        break;
+    case NodeTypeSelectStatement:
+        OptimizeStatementList(o, &node->u.selectStatement.caseStatements);
+        if (node->u.selectStatement.elseStatements)
+            OptimizeNestedStatements(o, node->u.selectStatement.elseStatements);
+        break;
+    case NodeTypeCaseStatement:
+        OptimizeStatementList(o, &node->u.caseStatement.bodyStatements);
+        break;
+    case NodeTypeForStatement:
+        OptimizeStatementList(o, &node->u.forStatement.bodyStatements);
+        break;
+    case NodeTypeDoWhileStatement:
+    case NodeTypeDoUntilStatement:
+    case NodeTypeLoopStatement:
+    case NodeTypeLoopWhileStatement:
+    case NodeTypeLoopUntilStatement:
+        OptimizeStatementList(o, &node->u.loopStatement.bodyStatements);
+        break;
+    default:
+        break;
+    }
+}
+
+/* HoistInvariants - move loop invariant expressions into hidden locals computed before the loop */
+static NodeListEntry **HoistInvariants(Optimizer *o, NodeListEntry **pEntry, ParseTreeNode *node)
+{
+    int labelCount = o->labelCount;
+    Loop loop;
+
+    /* find the variables written anywhere in the loop */
+    memset(&loop, 0, sizeof(loop));
+    WalkStatement(o, node, AddExprDefs, &loop.defs);
+
+    /* a label inside the loop could be the target of a GOTO that skips the invariant code */
+    if (o->labelCount != labelCount)
+        return pEntry;
+
+    /* DO and LOOP loops are used to wait for other cogs to change global variables */
+    loop.hoistGlobals = (node->nodeType == NodeTypeForStatement);
+    loop.pInsert = pEntry;
+
+    /* hoist invariants from the loop tests and body */
+    if (node->nodeType == NodeTypeForStatement) {
+        HoistExpr(o, node->u.forStatement.endExpr, USE_VALUE, &loop);
+        if (node->u.forStatement.stepExpr)
+            HoistExpr(o, node->u.forStatement.stepExpr, USE_VALUE, &loop);
+        WalkStatements(o, node->u.forStatement.bodyStatements, HoistExpr, &loop);
+    }
+    else {
+        if (node->u.loopStatement.test)
+            HoistExpr(o, node->u.loopStatement.test, USE_VALUE, &loop);
+        WalkStatements(o, node->u.loopStatement.bodyStatements, HoistExpr, &loop);
+    }
+
+    /* return the link to the loop statement that follows the invariant code */
+    return loop.pInsert;
+}
+
+/* HoistExpr - hoist the largest loop invariant parts of an expression */
+static void HoistExpr(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    Loop *loop = (Loop *)cookie;
+    int isAddress = (expr->nodeType == NodeTypeArrayRef);
+    VarSet uses;
+    int cost;
+
+    /* check for an invariant value or array element address */
+    if (isAddress || use == USE_VALUE) {
+        memset(&uses, 0, sizeof(uses));
+        if (isAddress ? AddressUses(o, expr, &uses) : ExprUses(o, expr, &uses)) {
+            cost = isAddress ? AddressCost(expr) : ExprCost(expr);
+            if (cost >= 2
+            &&  (loop->hoistGlobals || !ReadsMemory(&uses))
+            &&  !Intersects(&loop->defs, &uses)
+            &&  HoistValue(o, loop, expr, isAddress))
+                return;
+        }
+    }
+
+    /* look for invariants in the subexpressions */
+    VisitChildren(o, expr, HoistExpr, cookie);
+}
+
+/* HoistValue - replace an invariant expression with a hidden local computed before the loop */
+static int HoistValue(Optimizer *o, Loop *loop, ParseTreeNode *expr, int isAddress)
+{
+    Hoisted *h;
+    int i;
+
+    /* check for an expression that has already been hoisted */
+    for (i = 0, h = loop->hoisted; i < loop->count; ++i, ++h)
+        if (h->isAddress == isAddress && SameExpr(h->expr, expr))
+            break;
+
+    /* compute a new invariant before the loop */
+    if (i >= loop->count) {
+        ParseTreeNode *node;
+        if (loop->count >= MAX_HIDDEN_LOCALS || !AllocLocal(o, &o->loopLocals, &h->offset))
+            return FALSE;
+        node = NewParseTreeNode(o->c, NodeTypeLetStatement);
+        node->u.letStatement.rvalue = CopyValue(o, expr, isAddress);
+        node->u.letStatement.lvalue = NewLocalRef(o, h->offset, node->u.letStatement.rvalue->type);
+        h->expr = isAddress ? node->u.letStatement.rvalue->u.addressOf.expr : node->u.letStatement.rvalue;
+        h->isAddress = isAddress;
+        ++loop->count;
+        InsertStatement(o, &loop->pInsert, node);
+    }
+    ++o->changes;
+
+    /* use the hidden local in place of the expression */
+    ReplaceWithLocal(o, expr, isAddress, h->offset);
+    return TRUE;
+}
+
+/* ReuseCommonExpressions - compute subexpressions used by a run of simple statements only once */
+static void ReuseCommonExpressions(Optimizer *o, NodeListEntry **pEntry)
+{
+    NodeListEntry **pFirst;
+    int count;
+
+    while (*pEntry != NULL) {
+
+        /* find the next run of simple statements */
+        for (pFirst = pEntry, count = 0; *pEntry != NULL && count < MAX_RUN; pEntry = &(*pEntry)->next, ++count)
+            if (!IsSimpleStatement((*pEntry)->node))
+                break;
+
+        /* hidden locals for common subexpressions are only live within a run */
+        if (count > 1) {
+            o->cseLocals.top = 0;
+            while (count < MAX_RUN && ReuseExpression(o, pFirst, count))
+                ++count;
+            for (pEntry = pFirst; --count >= 0; )
+                pEntry = &(*pEntry)->next;
+        }
+
+        /* skip over the statement that ended the run */
+        if (*pEntry != NULL && !IsSimpleStatement((*pEntry)->node))
+            pEntry = &(*pEntry)->next;
+    }
+}
+
+/* ReuseExpression - replace the most profitable common subexpression in a run with a hidden local */
+static int ReuseExpression(Optimizer *o, NodeListEntry **pFirst, int count)
+{
+    Run run;
+    Candidate *cand, *best = NULL;
+    int bestBenefit = 0, bestOffset;
+    VarSet uses;
+    int i, j, s, last, useCount, cost, benefit;
+    ParseTreeNode *node;
+    NodeListEntry **pEntry;
+
+    /* find the variables written by each statement and the candidate subexpressions */
+    memset(&run, 0, sizeof(run));
+    for (pEntry = pFirst, s = 0; s < count; pEntry = &(*pEntry)->next, ++s) {
+        run.pLinks[s] = pEntry;
+        WalkStatement(o, (*pEntry)->node, AddExprDefs, &run.defs[s]);
+        WalkStatement(o, (*pEntry)->node, FindCalls, &run.hasCall[s]);
+        run.stmt = s;
+        WalkStatement(o, (*pEntry)->node, CollectExpr, &run);
+    }
+
+    /* find the candidate that saves the most instructions */
+    for (i = 0, cand = run.candidates; i < run.candidateCount; ++i, ++cand) {
+
+        /* only consider the first occurrence of each expression */
+        for (j = 0; j < i; ++j)
+            if (run.candidates[j].isAddress == cand->isAddress && SameExpr(run.candidates[j].expr, cand->expr))
+                break;
+        if (j < i)
+            continue;
+
+        /* a call could change a global before the expression is evaluated */
+        memset(&uses, 0, sizeof(uses));
+        if (cand->isAddress)
+            AddressUses(o, cand->expr, &uses);
+        else
+            ExprUses(o, cand->expr, &uses);
+        if (ReadsMemory(&uses) && run.hasCall[cand->stmt])
+            continue;
+
+        /* find the last statement where the expression still has the same value */
+        for (last = cand->stmt; last < count - 1; ++last) {
+            if (Intersects(&run.defs[last], &uses))
+                break;
+            if (ReadsMemory(&uses) && run.hasCall[last + 1])
+                break;
+        }
+
+        /* count the occurrences */
+        for (j = i, useCount = 0; j < run.candidateCount && run.candidates[j].stmt <= last; ++j)
+            if (run.candidates[j].isAddress == cand->isAddress && SameExpr(run.candidates[j].expr, cand->expr))
+                ++useCount;
+
+        /* each use saves all but one instruction at the cost of a store and a load */
+        cost = cand->isAddress ? AddressCost(cand->expr) : ExprCost(cand->expr);
+        benefit = (useCount - 1) * (cost - 1) - 2;
+        if (benefit > bestBenefit) {
+            bestBenefit = benefit;
+            best = cand;
+        }
+    }
+
+    /* check for nothing worth reusing */
+    if (!best || !AllocLocal(o, &o->cseLocals, &bestOffset))
+        return FALSE;
+
+    /* compute the expression before the first statement that uses it */
+    node = NewParseTreeNode(o->c, NodeTypeLetStatement);
+    node->u.letStatement.rvalue = CopyValue(o, best->expr, best->isAddress);
+    node->u.letStatement.lvalue = NewLocalRef(o, bestOffset, node->u.letStatement.rvalue->type);
+    pEntry = run.pLinks[best->stmt];
+
+    /* replace the occurrences with the hidden local */
+    memset(&uses, 0, sizeof(uses));
+    if (best->isAddress)
+        AddressUses(o, best->expr, &uses);
+    else
+        ExprUses(o, best->expr, &uses);
+    for (last = best->stmt; last < count - 1; ++last) {
+        if (Intersects(&run.defs[last], &uses))
+            break;
+        if (ReadsMemory(&uses) && run.hasCall[last + 1])
+            break;
+    }
+    for (cand = best, i = best - run.candidates; i < run.candidateCount && cand->stmt <= last; ++i, ++cand)
+        if (cand != best && cand->isAddress == best->isAddress && SameExpr(cand->expr, best->expr))
+            ReplaceWithLocal(o, cand->expr, cand->isAddress, bestOffset);
+    ReplaceWithLocal(o, best->expr, best->isAddress, bestOffset);
+
+    InsertStatement(o, &pEntry, node);
+    ++o->changes;
+    return TRUE;
+}
+
+/* CollectExpr - collect the subexpressions of a statement that could be reused */
+static void CollectExpr(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    Run *run = (Run *)cookie;
+    VarSet uses;
+
+    memset(&uses, 0, sizeof(uses));
+    if (expr->nodeType == NodeTypeArrayRef) {
+        if (AddressUses(o, expr, &uses) && AddressCost(expr) >= 2)
+            AddCandidate(run, expr, TRUE);
+    }
+    else if (use == USE_VALUE && ExprUses(o, expr, &uses) && ExprCost(expr) >= 2)
+        AddCandidate(run, expr, FALSE);
+
+    VisitChildren(o, expr, CollectExpr, cookie);
+}
+
+/* AddCandidate - add a common subexpression candidate */
+static void AddCandidate(Run *run, ParseTreeNode *expr, int isAddress)
+{
+    Candidate *cand;
+    if (run->candidateCount < MAX_CANDIDATES) {
+        cand = &run->candidates[run->candidateCount++];
+        cand->expr = expr;
+        cand->isAddress = isAddress;
+        cand->stmt = run->stmt;
+    }
+}
+
+/* IsSimpleStatement - check for a statement that doesn't transfer control */
+static int IsSimpleStatement(ParseTreeNode *node)
+{
+    switch (node->nodeType) {
+    case NodeTypeLetStatement:
+    case NodeTypeCallStatement:
+    case NodeTypeTrapStatement:
+    case NodeTypeReturnStatement:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* IsLoop - check for a loop statement */
+static int IsLoop(ParseTreeNode *node)
+{
+    switch (node->nodeType) {
+    case NodeTypeForStatement:
+    case NodeTypeDoWhileStatement:
+    case NodeTypeDoUntilStatement:
+    case NodeTypeLoopStatement:
+    case NodeTypeLoopWhileStatement:
+    case NodeTypeLoopUntilStatement:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* WalkStatements - call a function for each expression in a list of statements */
+static void WalkStatements(Optimizer *o, NodeListEntry *entry, ExprFcn *fcn, void *cookie)
+{
+    for (; entry != NULL; entry = entry->next)
+        WalkStatement(o, entry->node, fcn, cookie);
+}
+
+/* WalkStatement - call a function for each expression in a statement */
+static void WalkStatement(Optimizer *o, ParseTreeNode *node, ExprFcn *fcn, void *cookie)
+{
+    ParseTreeNode *outer = o->statement;
+    CaseListEntry *entry;
+
+    o->statement = node;
+    switch (node->nodeType) {
+    case NodeTypeLetStatement:
+        (*fcn)(o, node->u.letStatement.rvalue, USE_VALUE, cookie);
+        (*fcn)(o, node->u.letStatement.lvalue, USE_STORE, cookie);
+        break;
+    case NodeTypeIfStatement:
+        (*fcn)(o, node->u.ifStatement.test, USE_VALUE, cookie);
+        WalkStatements(o, node->u.ifStatement.thenStatements, fcn, cookie);
+        WalkStatements(o, node->u.ifStatement.elseStatements, fcn, cookie);
+        break;
+    case NodeTypeSelectStatement:
+        (*fcn)(o, node->u.selectStatement.expr, USE_VALUE, cookie);
+        WalkStatements(o, node->u.selectStatement.caseStatements, fcn, cookie);
+        if (node->u.selectStatement.elseStatements)
+            WalkStatement(o, node->u.selectStatement.elseStatements, fcn, cookie);
+        break;
+    case NodeTypeCaseStatement:
+        for (entry = node->u.caseStatement.cases; entry != NULL; entry = entry->next) {
+            (*fcn)(o, entry->fromExpr, USE_VALUE, cookie);
+            if (entry->toExpr)
+                (*fcn)(o, entry->toExpr, USE_VALUE, cookie);
+        }
+        WalkStatements(o, node->u.caseStatement.bodyStatements, fcn, cookie);
+        break;
+    case NodeTypeForStatement:
+        (*fcn)(o, node->u.forStatement.var, USE_STORE, cookie);
+        (*fcn)(o, node->u.forStatement.startExpr, USE_VALUE, cookie);
+        (*fcn)(o, node->u.forStatement.endExpr, USE_VALUE, cookie);
+        if (node->u.forStatement.stepExpr)
+            (*fcn)(o, node->u.forStatement.stepExpr, USE_VALUE, cookie);
+        WalkStatements(o, node->u.forStatement.bodyStatements, fcn, cookie);
+        break;
+    case NodeTypeDoWhileStatement:
+    case NodeTypeDoUntilStatement:
+    case NodeTypeLoopStatement:
+    case NodeTypeLoopWhileStatement:
+    case NodeTypeLoopUntilStatement:
+        if (node->u.loopStatement.test)
+            (*fcn)(o, node->u.loopStatement.test, USE_VALUE, cookie);
+        WalkStatements(o, node->u.loopStatement.bodyStatements, fcn, cookie);
+        break;
+    case NodeTypeReturnStatement:
+        if (node->u.returnStatement.expr)
+            (*fcn)(o, node->u.returnStatement.expr, USE_VALUE, cookie);
+        break;
+    case NodeTypeCallStatement:
+        (*fcn)(o, node->u.callStatement.expr, USE_VALUE, cookie);
+        break;
+    case NodeTypeTrapStatement:
+        if (node->u.trapStatement.trap == TRAP_YIELD)
+            ++o->yieldCount;
+        if (node->u.trapStatement.expr)
+            (*fcn)(o, node->u.trapStatement.expr, USE_VALUE, cookie);
+        break;
+    case NodeTypeLabelDefinition:
+        ++o->labelCount;
+        break;
+    case NodeTypeAsmStatement:
+        ++o->asmCount;
+        break;
+    default:
+        break;
+    }
+    o->statement = outer;
+}
+
+/* VisitChildren - call a function for each operand of an expression */
+static void VisitChildren(Optimizer *o, ParseTreeNode *expr, ExprFcn *fcn, void *cookie)
+{
+    NodeListEntry *entry;
+
+    switch (expr->nodeType) {
+    case NodeTypeUnaryOp:
+        (*fcn)(o, expr->u.unaryOp.expr, USE_VALUE, cookie);
+        break;
+    case NodeTypeBinaryOp:
+        (*fcn)(o, expr->u.binaryOp.left, USE_VALUE, cookie);
+        (*fcn)(o, expr->u.binaryOp.right, USE_VALUE, cookie);
+        break;
+    case NodeTypeArrayRef:
+        (*fcn)(o, expr->u.arrayRef.array, USE_VALUE, cookie);
+        (*fcn)(o, expr->u.arrayRef.index, USE_VALUE, cookie);
+        break;
+    case NodeTypeFunctionCall:
+        for (entry = expr->u.functionCall.args; entry != NULL; entry = entry->next)
+            (*fcn)(o, entry->node, USE_VALUE, cookie);
+        (*fcn)(o, expr->u.functionCall.fcn, USE_VALUE, cookie);
+        break;
+    case NodeTypeDisjunction:
+    case NodeTypeConjunction:
+        for (entry = expr->u.exprList.exprs; entry != NULL; entry = entry->next)
+            (*fcn)(o, entry->node, USE_VALUE, cookie);
+        break;
+    case NodeTypeAddressOf:
+        if (expr->u.addressOf.expr->type->id == TYPE_POINTER)
+            (*fcn)(o, expr->u.addressOf.expr, USE_VALUE, cookie);
+        else
+            (*fcn)(o, expr->u.addressOf.expr, USE_ADDRESS, cookie);
+        break;
+    case NodeTypeIntrinsicCall:
+        for (entry = expr->u.intrinsicCall.args; entry != NULL; entry = entry->next)
+            (*fcn)(o, entry->node, USE_VALUE, cookie);
+        break;
+    default:
+        break;
+    }
+}
+
+/* FindEscapedLocals - find locals whose address is taken */
+static void FindEscapedLocals(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    if (use == USE_ADDRESS && expr->nodeType == NodeTypeLocalRef)
+        AddLocalVar(&o->escaped, expr->u.localRef.offset);
+    VisitChildren(o, expr, FindEscapedLocals, cookie);
+}
+
+/* AddExprDefs - add the variables written by an expression */
+static void AddExprDefs(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    VarSet *defs = (VarSet *)cookie;
+    if (use == USE_STORE) {
+        switch (expr->nodeType) {
+        case NodeTypeLocalRef:
+            AddLocalVar(defs, expr->u.localRef.offset);
+            break;
+        case NodeTypeGlobalRef:
+            AddGlobalVar(defs, expr->u.globalRef.symbol);
+            break;
+        case NodeTypeArrayRef:
+            /* elements of a named array can't overlap a global variable */
+            if (expr->u.arrayRef.array->nodeType != NodeTypeArrayLit)
+                defs->memory = TRUE;
+            break;
+        default:
+            defs->memory = TRUE;
+            break;
+        }
+    }
+    else if (expr->nodeType == NodeTypeFunctionCall)
+        defs->memory = TRUE;
+    else if (expr->nodeType == NodeTypeIntrinsicCall
+         &&  (expr->u.intrinsicCall.op == OP_MEMCPY
+          ||  expr->u.intrinsicCall.op == OP_MEMSET
+          ||  expr->u.intrinsicCall.op == OP_STORE
+          ||  expr->u.intrinsicCall.op == OP_STOREB
+          ||  expr->u.intrinsicCall.op == OP_STOREW
+          ||  expr->u.intrinsicCall.op == OP_RINGPUT
+          ||  expr->u.intrinsicCall.op == OP_RINGGET
+          ||  expr->u.intrinsicCall.op == OP_RINGPEEK
+          ||  expr->u.intrinsicCall.op == OP_TRAP))
+        defs->memory = TRUE;
+    VisitChildren(o, expr, AddExprDefs, cookie);
+}
+
+/* FindCalls - check for a function call */
+static void FindCalls(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    if (expr->nodeType == NodeTypeFunctionCall)
+        *(int *)cookie = TRUE;
+    VisitChildren(o, expr, FindCalls, cookie);
+}
+
+/* ExprUses - find the variables read by a side effect free expression that can't fault */
+static int ExprUses(Optimizer *o, ParseTreeNode *expr, VarSet *uses)
+{
+    ParseTreeNode *right;
+    int offset;
+
+    switch (expr->nodeType) {
+    case NodeTypeIntegerLit:
+    case NodeTypeStringLit:
+    case NodeTypeArrayLit:
+    case NodeTypeFunctionLit:
+        return TRUE;
+    case NodeTypeLocalRef:
+        offset = expr->u.localRef.offset & 0xff;
+        if (o->escaped.locals[offset >> 5] & ((uint32_t)1 << (offset & 0x1f)))
+            return FALSE;
+        AddLocalVar(uses, expr->u.localRef.offset);
+        return TRUE;
+    case NodeTypeGlobalRef:
+        if (expr->u.globalRef.symbol->storageClass != SC_GLOBAL)
+            return FALSE;
+        AddGlobalVar(uses, expr->u.globalRef.symbol);
+        return TRUE;
+    case NodeTypeUnaryOp:
+        return ExprUses(o, expr->u.unaryOp.expr, uses);
+    case NodeTypeBinaryOp:
+        right = expr->u.binaryOp.right;
+        if (expr->u.binaryOp.op == OP_DIV || expr->u.binaryOp.op == OP_REM || expr->u.binaryOp.op == OP_FDIV) {
+            if (right->nodeType != NodeTypeIntegerLit || right->u.integerLit.value == 0 || right->u.integerLit.value == -1)
+                return FALSE;
+        }
+        return ExprUses(o, expr->u.binaryOp.left, uses) && ExprUses(o, right, uses);
+    case NodeTypeAddressOf:
+        if (expr->u.addressOf.expr->nodeType == NodeTypeArrayRef)
+            return AddressUses(o, expr->u.addressOf.expr, uses);
+        else if (expr->u.addressOf.expr->type->id == TYPE_POINTER)
+            return ExprUses(o, expr->u.addressOf.expr, uses);
+        return expr->u.addressOf.expr->nodeType == NodeTypeGlobalRef;
+    default:
+        return FALSE;
+    }
+}
+
+/* AddressUses - find the variables read to compute the address of an array element */
+static int AddressUses(Optimizer *o, ParseTreeNode *ref, VarSet *uses)
+{
+    return ExprUses(o, ref->u.arrayRef.array, uses) && ExprUses(o, ref->u.arrayRef.index, uses);
+}
+
+/* ExprCost - estimate the number of instructions needed to evaluate an expression */
+static int ExprCost(ParseTreeNode *expr)
+{
+    switch (expr->nodeType) {
+    case NodeTypeGlobalRef:
+        return 2;
+    case NodeTypeUnaryOp:
+        return ExprCost(expr->u.unaryOp.expr) + 1;
+    case NodeTypeBinaryOp:
+        return ExprCost(expr->u.binaryOp.left) + ExprCost(expr->u.binaryOp.right) + 1;
+    case NodeTypeAddressOf:
+        if (expr->u.addressOf.expr->nodeType == NodeTypeArrayRef)
+            return AddressCost(expr->u.addressOf.expr);
+        else if (expr->u.addressOf.expr->type->id == TYPE_POINTER)
+            return ExprCost(expr->u.addressOf.expr);
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+/* AddressCost - estimate the number of instructions needed to compute the address of an array element */
+static int AddressCost(ParseTreeNode *ref)
+{
+    int cost = ExprCost(ref->u.arrayRef.array);
+    if (!IsZeroLit(ref->u.arrayRef.index))
+        cost += ExprCost(ref->u.arrayRef.index) + 1;
+    return cost;
+}
+
+/* SameExpr - check to see if two expressions always compute the same value */
+static int SameExpr(ParseTreeNode *a, ParseTreeNode *b)
+{
+    if (a->nodeType != b->nodeType)
+        return FALSE;
+    switch (a->nodeType) {
+    case NodeTypeIntegerLit:
+        return a->u.integerLit.value == b->u.integerLit.value;
+    case NodeTypeStringLit:
+        return a->u.stringLit.string == b->u.stringLit.string;
+    case NodeTypeArrayLit:
+        return a->u.arrayLit.symbol == b->u.arrayLit.symbol;
+    case NodeTypeFunctionLit:
+        return a->u.functionLit.symbol == b->u.functionLit.symbol;
+    case NodeTypeLocalRef:
+        return a->u.localRef.offset == b->u.localRef.offset;
+    case NodeTypeGlobalRef:
+        return a->u.globalRef.symbol == b->u.globalRef.symbol;
+    case NodeTypeUnaryOp:
+        return a->u.unaryOp.op == b->u.unaryOp.op
+            && SameExpr(a->u.unaryOp.expr, b->u.unaryOp.expr);
+    case NodeTypeBinaryOp:
+        return a->u.binaryOp.op == b->u.binaryOp.op
+            && SameExpr(a->u.binaryOp.left, b->u.binaryOp.left)
+            && SameExpr(a->u.binaryOp.right, b->u.binaryOp.right);
+    case NodeTypeArrayRef:
+        return a->type->id == b->type->id
+            && SameExpr(a->u.arrayRef.array, b->u.arrayRef.array)
+            && SameExpr(a->u.arrayRef.index, b->u.arrayRef.index);
+    case NodeTypeAddressOf:
+        return SameExpr(a->u.addressOf.expr, b->u.addressOf.expr);
+    default:
+        return FALSE;
+    }
+}
+
+/* IsZeroLit - check for an integer literal with a value of zero */
+static int IsZeroLit(ParseTreeNode *node)
+{
+    return node->nodeType == NodeTypeIntegerLit && node->u.integerLit.value == 0;
+}
+
+/* AddLocalVar - add a local variable or argument to a set */
+static void AddLocalVar(VarSet *set, int offset)
+{
+    offset &= 0xff;
+    set->locals[offset >> 5] |= (uint32_t)1 << (offset & 0x1f);
+}
+
+/* AddGlobalVar - add a global variable to a set */
+static void AddGlobalVar(VarSet *set, Symbol *symbol)
+{
+    int i;
+    for (i = 0; i < set->globalCount; ++i)
+        if (set->globals[i] == symbol)
+            return;
+    if (set->globalCount < MAX_TRACKED_GLOBALS)
+        set->globals[set->globalCount++] = symbol;
+    else
+        set->memory = TRUE;
+}
+
+/* ReadsMemory - check to see if a set of variables includes global variables */
+static int ReadsMemory(VarSet *uses)
+{
+    return uses->globalCount > 0 || uses->memory;
+}
+
+/* Intersects - check to see if writing one set of variables could change any of another */
+static int Intersects(VarSet *defs, VarSet *uses)
+{
+    int i, j;
+
+    /* check the locals */
+    for (i = 0; i < 8; ++i)
+        if (defs->locals[i] & uses->locals[i])
+            return TRUE;
+
+    /* check the globals */
+    if (ReadsMemory(uses)) {
+        if (defs->memory || (uses->memory && defs->globalCount > 0))
+            return TRUE;
+        for (i = 0; i < defs->globalCount; ++i)
+            for (j = 0; j < uses->globalCount; ++j)
+                if (defs->globals[i] == uses->globals[j])
+                    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* AllocLocal - allocate a hidden local from a pool */
+static int AllocLocal(Optimizer *o, LocalPool *pool, int *pOffset)
+{
+    ParseTreeNode *function = o->function;
+    int offset;
+
+    /* reuse a hidden local that is no longer in use */
+    if (pool->top < pool->count) {
+        *pOffset = pool->offsets[pool->top++];
+        return TRUE;
+    }
+
+    /* add a new local to the stack frame */
+    offset = -F_SIZE - function->u.functionDefinition.localOffset - 1;
+    if (pool->count >= MAX_HIDDEN_LOCALS || offset < MIN_LOCAL_OFFSET)
+        return FALSE;
+    ++function->u.functionDefinition.localOffset;
+    pool->offsets[pool->count++] = offset;
+    pool->top = pool->count;
+    *pOffset = offset;
+    return TRUE;
+}
+
+/* ReplaceWithLocal - replace an expression or array element address with a hidden local */
+static void ReplaceWithLocal(Optimizer *o, ParseTreeNode *expr, int isAddress, int offset)
+{
+    if (isAddress) {
+        ParseTreeNode *index = NewParseTreeNode(o->c, NodeTypeIntegerLit);
+        index->type = &o->c->integerType;
+        index->u.integerLit.value = 0;
+        expr->u.arrayRef.array = NewLocalRef(o, offset, expr->u.arrayRef.array->type);
+        expr->u.arrayRef.index = index;
+    }
+    else {
+        expr->nodeType = NodeTypeLocalRef;
+        expr->u.localRef.offset = offset;
+    }
+}
+
+/* CopyValue - make an expression that computes a value or array element address */
+static ParseTreeNode *CopyValue(Optimizer *o, ParseTreeNode *expr, int isAddress)
+{
+    ParseTreeNode *node = NewParseTreeNode(o->c, expr->nodeType);
+    *node = *expr;
+    if (isAddress) {
+        ParseTreeNode *ref = node;
+        node = NewParseTreeNode(o->c, NodeTypeAddressOf);
+        node->type = ref->u.arrayRef.array->type;
+        node->u.addressOf.expr = ref;
+    }
+    return node;
+}
+
+/* NewLocalRef - make a reference to a hidden local */
+static ParseTreeNode *NewLocalRef(Optimizer *o, int offset, Type *type)
+{
+    ParseTreeNode *node = NewParseTreeNode(o->c, NodeTypeLocalRef);
+    node->type = type;
+    node->u.localRef.offset = offset;
+    return node;
+}
+
+/* InsertStatement - insert a statement into a statement list */
+static void InsertStatement(Optimizer *o, NodeListEntry ***ppInsert, ParseTreeNode *node)
+{
+    NodeListEntry *entry = (NodeListEntry *)xbLocalAlloc(o->c->sys, sizeof(NodeListEntry));
+    entry->node = node;
+    entry->next = **ppInsert;
+    **ppInsert = entry;
+    *ppInsert = &entry->next;
+}
+
+/* InlineCall - replace a hot call to a simple function with the function body */
+static void InlineCall(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    ParseTreeNode *args[MAX_INLINE_ARGS], *body;
+    int uses[MAX_INLINE_ARGS], argc, i;
+    NodeListEntry *entry;
+    Symbol *symbol;
+
+    /* inline calls in the arguments first so they become candidates too */
+    VisitChildren(o, expr, InlineCall, cookie);
+
+    /* only direct calls to functions with a saved body can be inlined */
+    if (expr->nodeType != NodeTypeFunctionCall
+    ||  expr->u.functionCall.fcn->nodeType != NodeTypeFunctionLit)
+        return;
+    symbol = expr->u.functionCall.fcn->u.functionLit.symbol;
+    if (!(body = symbol->type->u.functionInfo.inlineBody)
+    ||  (argc = expr->u.functionCall.argc) > MAX_INLINE_ARGS
+    ||  GetCallCount(o->c, o->statement->index, symbol->name) < HOT_CALL_COUNT)
+        return;
+
+    /* the argument list is in reverse order */
+    for (entry = expr->u.functionCall.args, i = argc; entry != NULL; entry = entry->next)
+        args[--i] = entry->node;
+
+    /* arguments must not have side effects and only simple ones can be duplicated */
+    memset(uses, 0, sizeof(uses));
+    CountArgUses(body, uses);
+    for (i = 0; i < argc; ++i)
+        if (HasCall(args[i]) || (uses[i] > 1 && !IsLeafExpr(args[i])))
+            return;
+
+    /* replace the call with the body */
+    *expr = *CopyInlineExpr(o->c, body, args);
+    ++o->changes;
+}
+
+/* LayoutBranch - put the more frequently executed arm of an IF statement first */
+static void LayoutBranch(Optimizer *o, ParseTreeNode *expr, UseType use, void *cookie)
+{
+    ParseTreeNode *node = o->statement, *test;
+    NodeListEntry *thenStatements, *elseStatements;
+
+    /* only look at the test of an IF statement with two arms */
+    if (node->nodeType != NodeTypeIfStatement || expr != node->u.ifStatement.test)
+        return;
+    thenStatements = node->u.ifStatement.thenStatements;
+    elseStatements = node->u.ifStatement.elseStatements;
+    if (!thenStatements || !elseStatements)
+        return;
+
+    /* swap the arms and negate the test if the ELSE arm is hotter */
+    if (GetStatementCount(o->c, elseStatements->node->index) > GetStatementCount(o->c, thenStatements->node->index)) {
+        test = NewParseTreeNode(o->c, NodeTypeUnaryOp);
+        test->type = &o->c->integerType;
+        test->u.unaryOp.op = OP_NOT;
+        test->u.unaryOp.expr = expr;
+        node->u.ifStatement.test = test;
+        node->u.ifStatement.thenStatements = elseStatements;
+        node->u.ifStatement.elseStatements = thenStatements;
+        ++o->changes;
+    }
+}
+
+/* CanInline - check to see if an expression can be substituted for a call */
+static int CanInline(ParseTreeNode *expr, int *pCount)
+{
+    if (++*pCount > MAX_INLINE_NODES)
+        return FALSE;
+    switch (expr->nodeType) {
+    case NodeTypeIntegerLit:
+        return TRUE;
+    case NodeTypeLocalRef:
+        return expr->u.localRef.offset >= 0 && expr->u.localRef.offset < MAX_INLINE_ARGS;
+    case NodeTypeGlobalRef:
+        return IsNumericType(expr->type);
+    case NodeTypeUnaryOp:
+        return CanInline(expr->u.unaryOp.expr, pCount);
+    case NodeTypeBinaryOp:
+        return CanInline(expr->u.binaryOp.left, pCount) && CanInline(expr->u.binaryOp.right, pCount);
+    default:
+        return FALSE;
+    }
+}
+
+/* CountArgUses - count the references to each argument in an inline body */
+static void CountArgUses(ParseTreeNode *expr, int *uses)
+{
+    switch (expr->nodeType) {
+    case NodeTypeLocalRef:
+        ++uses[expr->u.localRef.offset];
+        break;
+    case NodeTypeUnaryOp:
+        CountArgUses(expr->u.unaryOp.expr, uses);
+        break;
+    case NodeTypeBinaryOp:
+        CountArgUses(expr->u.binaryOp.left, uses);
+        CountArgUses(expr->u.binaryOp.right, uses);
+        break;
+    default:
+        break;
+    }
+}
+
+/* IsLeafExpr - check to see if an expression is a literal or a variable reference */
+static int IsLeafExpr(ParseTreeNode *expr)
+{
+    switch (expr->nodeType) {
+    case NodeTypeIntegerLit:
+    case NodeTypeLocalRef:
+    case NodeTypeGlobalRef:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* HasCall - check to see if an expression contains a function call */
+static int HasCall(ParseTreeNode *expr)
+{
+    NodeListEntry *entry;
+
+    switch (expr->nodeType) {
+    case NodeTypeFunctionCall:
+    case NodeTypeIntrinsicCall:
+        return TRUE;
+    case NodeTypeUnaryOp:
+        return HasCall(expr->u.unaryOp.expr);
+    case NodeTypeBinaryOp:
+        return HasCall(expr->u.binaryOp.left) || HasCall(expr->u.binaryOp.right);
+    case NodeTypeArrayRef:
+        return HasCall(expr->u.arrayRef.array) || HasCall(expr->u.arrayRef.index);
+    case NodeTypeDisjunction:
+    case NodeTypeConjunction:
+        for (entry = expr->u.exprList.exprs; entry != NULL; entry = entry->next)
+            if (HasCall(entry->node))
+                return TRUE;
+        return FALSE;
+    case NodeTypeAddressOf:
+        return HasCall(expr->u.addressOf.expr);
+    default:
+        return FALSE;
+    }
+}
+
+/* CopyInlineExpr - copy an inline body to the global heap or substitute arguments into it */
+static ParseTreeNode *CopyInlineExpr(ParseContext *c, ParseTreeNode *expr, ParseTreeNode **args)
+{
+    ParseTreeNode *node;
+
+    /* substitute the actual argument for a formal argument */
+    if (args && expr->nodeType == NodeTypeLocalRef) {
+        expr = args[expr->u.localRef.offset];
+        if (!IsLeafExpr(expr))
+            return expr;
+    }
+
+    /* the saved body must outlive the parse tree of its function */
+    if (args)
+        node = NewParseTreeNode(c, expr->nodeType);
+    else
+        node = (ParseTreeNode *)GlobalAlloc(c, sizeof(ParseTreeNode));
+    *node = *expr;
+
+    /* copy the operands */
+    switch (node->nodeType) {
+    case NodeTypeUnaryOp:
+        node->u.unaryOp.expr = CopyInlineExpr(c, expr->u.unaryOp.expr, args);
+        break;
+    case NodeTypeBinaryOp:
+        node->u.binaryOp.left = CopyInlineExpr(c, expr->u.binaryOp.left, args);
+        node->u.binaryOp.right = CopyInlineExpr(c, expr->u.binaryOp.right, args);
+        break;
+    default:
+        break;
+    }
+    return node;
+}
@@ -0,0 +1,114 @@
+/* db_passes.c - optimization pass manager
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include "db_compiler.h"
+
+/* maximum number of times the code passes are run over a function */
+#define MAX_ITERATIONS  4
+
+typedef int TreePassFcn(ParseContext *c, ParseTreeNode *node);
+typedef int CodePassFcn(ParseContext *c, IRFunction *fn);
+
+/* optimization pass */
+typedef struct {
+    char *name;
+    int level;                  /* lowest optimization level that runs the pass */
+    TreePassFcn *treeFcn;       /* pass over the parse tree of a function */
+    CodePassFcn *codeFcn;       /* pass over the intermediate code of a function */
+} Pass;
+
+/* optimization passes in the order they are run */
+static Pass passes[] = {
+{   "inline",       1,  InlineHotCalls,             NULL                    },
+{   "layout",       1,  LayoutHotBranches,          NULL                    },
+{   "licm",         2,  HoistLoopInvariants,        NULL                    },
+{   "cse",          2,  ReuseCommonSubexpressions,  NULL                    },
+{   "fold",         1,  NULL,                       FoldBranches            },
+{   "fuse",         1,  NULL,                       FuseLocalUpdates        },
+{   "combine",      1,  NULL,                       CombineInstructions     },
+{   "thread",       1,  NULL,                       ThreadJumps             },
+{   "unreachable",  1,  NULL,                       RemoveUnreachableCode   },
+{   "fallthrough",  1,  NULL,                       RemoveBranchesToNext    },
+{   NULL,           0,  NULL,                       NULL                    }
+};
+
+static int OptimizationLevel(ParseContext *c);
+
+/* RunTreePasses - run the parse tree passes over a function before generating code */
+void RunTreePasses(ParseContext *c, ParseTreeNode *node)
+{
+    int level = OptimizationLevel(c);
+    Pass *pass;
+
+    for (pass = passes; pass->name; ++pass)
+        if (pass->treeFcn && level >= pass->level) {
+            PassStats *stats = &c->passStats[pass - passes];
+            clock_t start = clock();
+            stats->changes += (*pass->treeFcn)(c, node);
+            stats->time += clock() - start;
+        }
+}
+
+/* RunCodePasses - run the intermediate code passes over the generated code of a function */
+void RunCodePasses(ParseContext *c, ParseTreeNode *node)
+{
+    int level = OptimizationLevel(c);
+    int changes, count, i;
+    IRFunction *fn;
+    Pass *pass;
+
+    /* assembly code can contain branches that can't be followed */
+    if (level < 1 || node->u.functionDefinition.hasAsm)
+        return;
+
+    /* build the intermediate code from the generated code */
+    if (!(fn = BuildIR(c)))
+        return;
+
+    /* run the passes until they stop finding anything to improve */
+    for (i = 0; i < MAX_ITERATIONS; ++i) {
+        changes = 0;
+        for (pass = passes; pass->name; ++pass)
+            if (pass->codeFcn && level >= pass->level) {
+                PassStats *stats = &c->passStats[pass - passes];
+                clock_t start = clock();
+                count = (*pass->codeFcn)(c, fn);
+                stats->time += clock() - start;
+                stats->changes += count;
+                changes += count;
+            }
+        if (changes == 0)
+            break;
+    }
+
+    /* replace the generated code with the optimized code */
+    EmitIR(c, fn);
+    if (c->statementAddrs)
+        MapStatementAddresses(c, fn);
+}
+
+/* ShowPassStatistics - show the changes made and the time taken by each optimization pass */
+void ShowPassStatistics(ParseContext *c)
+{
+    int level = OptimizationLevel(c);
+    Pass *pass;
+
+    xbInfo(c->sys, "optimization level %d\n", level);
+    for (pass = passes; pass->name; ++pass)
+        if (level >= pass->level) {
+            PassStats *stats = &c->passStats[pass - passes];
+            xbInfo(c->sys, "  %-12s %6ld changes %8.3f ms\n",
+                   pass->name,
+                   stats->changes,
+                   (double)stats->time * 1000.0 / CLOCKS_PER_SEC);
+        }
+}
+
+/* OptimizationLevel - get the optimization level from the compiler flags */
+static int OptimizationLevel(ParseContext *c)
+{
+    return (c->flags & COMPILER_OPT_MASK) >> COMPILER_OPT_SHIFT;
+}
@@ -0,0 +1,363 @@
+/* db_placement.c - placement of data in the hub and external ram
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * When compiling with -a, each variable without an initializer that isn't
+ * placed with IN is put in the hub or in external ram after all of the code
+ * has been generated.  Its address is only known through the fixups that
+ * UpdateReferences resolves, so the choice can wait until the accesses to
+ * it have been counted.  The count of each reference is the execution count
+ * of its statement when the function has a profile and an estimate from the
+ * loop nesting otherwise: a FOR loop with constant bounds runs its trip count
+ * and any other loop LOOP_WEIGHT times.  Functions are weighed as if they
+ * were called once.
+ *
+ * Scalars always stay in the hub.  Arrays accessed fewer times than they
+ * have words are cold and go to external ram unless their address is used
+ * for anything but indexing, since the accesses through a pointer can't be
+ * counted.  The rest keep the hub in
+ * order of accesses per byte as long as the hub has room for them, the
+ * initialized data and the stack.  The hub headroom that is left over is
+ * reported along with the placement.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "db_compiler.h"
+
+/* times the body of a loop without constant bounds is assumed to run */
+#define LOOP_WEIGHT         16
+
+/* hub memory used by the loader, the vm and the runtime (max_image_size in hub_loader.spin) */
+#define HUB_RUNTIME_SIZE    (HUB_SIZE - 18 * 1024)
+
+/* zero filled variable */
+struct DataUsage {
+    DataUsage *next;            /* next variable in the order defined */
+    Symbol *symbol;
+    VMUVALUE size;              /* size in bytes rounded to words */
+    int movable;                /* the variable wasn't placed with IN */
+    int escaped;                /* the address is used for more than indexing */
+    unsigned long count;        /* profiled or estimated accesses */
+};
+
+static void CountStatementList(ParseContext *c, NodeListEntry *entry, unsigned long weight);
+static void CountStatement(ParseContext *c, ParseTreeNode *node, unsigned long weight);
+static void CountExpr(ParseContext *c, ParseTreeNode *expr, unsigned long weight);
+static void CountExprList(ParseContext *c, NodeListEntry *entry, unsigned long weight);
+static unsigned long IterationCount(ParseContext *c, NodeListEntry *body, unsigned long weight, unsigned long count);
+static unsigned long TripCount(ParseTreeNode *node);
+static unsigned long Scale(unsigned long weight, unsigned long factor);
+static void AddAccesses(ParseContext *c, Symbol *symbol, unsigned long weight, int escaped);
+static DataUsage *FindDataUsage(ParseContext *c, Symbol *symbol);
+static int CompareDensity(const void *p1, const void *p2);
+static void ShowDataPlacement(ParseContext *c, Section *hub, VMUVALUE used, VMUVALUE limit);
+
+/* AddDataUsage - add a zero filled variable that may be placed after the code is generated */
+void AddDataUsage(ParseContext *c, Symbol *symbol, VMUVALUE size, int movable)
+{
+    DataUsage *usage, **pNext;
+
+    if (!(c->flags & COMPILER_PLACE))
+        return;
+
+    /* create the usage record */
+    usage = (DataUsage *)GlobalAlloc(c, sizeof(DataUsage));
+    memset(usage, 0, sizeof(DataUsage));
+    usage->symbol = symbol;
+    usage->size = ROUND_TO_WORDS(size);
+    usage->movable = movable;
+    for (pNext = &c->dataUsage; *pNext != NULL; pNext = &(*pNext)->next)
+        ;
+    *pNext = usage;
+}
+
+/* CountDataReferences - count the accesses to zero filled variables by a function */
+void CountDataReferences(ParseContext *c, ParseTreeNode *node)
+{
+    if (c->dataUsage)
+        CountStatementList(c, node->u.functionDefinition.bodyStatements, 1);
+}
+
+/* CountStatementList - count the accesses by a list of statements */
+static void CountStatementList(ParseContext *c, NodeListEntry *entry, unsigned long weight)
+{
+    for (; entry != NULL; entry = entry->next)
+        CountStatement(c, entry->node, weight);
+}
+
+/* CountStatement - count the accesses by a statement and the statements nested within it */
+static void CountStatement(ParseContext *c, ParseTreeNode *node, unsigned long weight)
+{
+    unsigned long count = c->profile ? GetStatementCount(c, node->index) : weight;
+    unsigned long bodyWeight;
+    CaseListEntry *entry;
+
+    switch (node->nodeType) {
+    case NodeTypeLetStatement:
+        CountExpr(c, node->u.letStatement.rvalue, count);
+        CountExpr(c, node->u.letStatement.lvalue, count);
+        break;
+    case NodeTypeIfStatement:
+        CountExpr(c, node->u.ifStatement.test, count);
+        CountStatementList(c, node->u.ifStatement.thenStatements, weight);
+        CountStatementList(c, node->u.ifStatement.elseStatements, weight);
+        break;
+    case NodeTypeSelectStatement:
+        CountExpr(c, node->u.selectStatement.expr, count);
+        CountStatementList(c, node->u.selectStatement.caseStatements, weight);
+        if (node->u.selectStatement.elseStatements)
+            CountStatement(c, node->u.selectStatement.elseStatements, weight);
+        break;
+    case NodeTypeCaseStatement:
+        for (entry = node->u.caseStatement.cases; entry != NULL; entry = entry->next) {
+            CountExpr(c, entry->fromExpr, count);
+            if (entry->toExpr)
+                CountExpr(c, entry->toExpr, count);
+        }
+        CountStatementList(c, node->u.caseStatement.bodyStatements, weight);
+        break;
+    case NodeTypeForStatement:
+        bodyWeight = Scale(weight, TripCount(node));
+        CountExpr(c, node->u.forStatement.startExpr, count);
+        count = IterationCount(c, node->u.forStatement.bodyStatements, bodyWeight, count);
+        CountExpr(c, node->u.forStatement.var, count);
+        CountExpr(c, node->u.forStatement.endExpr, count);
+        if (node->u.forStatement.stepExpr)
+            CountExpr(c, node->u.forStatement.stepExpr, count);
+        CountStatementList(c, node->u.forStatement.bodyStatements, bodyWeight);
+        break;
+    case NodeTypeDoWhileStatement:
+    case NodeTypeDoUntilStatement:
+    case NodeTypeLoopStatement:
+    case NodeTypeLoopWhileStatement:
+    case NodeTypeLoopUntilStatement:
+        bodyWeight = Scale(weight, LOOP_WEIGHT);
+        if (node->u.loopStatement.test)
+            CountExpr(c, node->u.loopStatement.test, IterationCount(c, node->u.loopStatement.bodyStatements, bodyWeight, count));
+        CountStatementList(c, node->u.loopStatement.bodyStatements, bodyWeight);
+        break;
+    case NodeTypeReturnStatement:
+        if (node->u.returnStatement.expr)
+            CountExpr(c, node->u.returnStatement.expr, count);
+        break;
+    case NodeTypeCallStatement:
+        CountExpr(c, node->u.callStatement.expr, count);
+        break;
+    case NodeTypeTrapStatement:
+        if (node->u.trapStatement.expr)
+            CountExpr(c, node->u.trapStatement.expr, count);
+        break;
+    default:
+        break;
+    }
+}
+
+/* CountExpr - count the accesses by an expression */
+static void CountExpr(ParseContext *c, ParseTreeNode *expr, unsigned long weight)
+{
+    switch (expr->nodeType) {
+    case NodeTypeGlobalRef:
+        AddAccesses(c, expr->u.globalRef.symbol, weight, FALSE);
+        break;
+    case NodeTypeArrayLit:
+        AddAccesses(c, expr->u.arrayLit.symbol, weight, TRUE);
+        break;
+    case NodeTypeUnaryOp:
+        CountExpr(c, expr->u.unaryOp.expr, weight);
+        break;
+    case NodeTypeBinaryOp:
+        CountExpr(c, expr->u.binaryOp.left, weight);
+        CountExpr(c, expr->u.binaryOp.right, weight);
+        break;
+    case NodeTypeArrayRef:
+        if (expr->u.arrayRef.array->nodeType == NodeTypeArrayLit)
+            AddAccesses(c, expr->u.arrayRef.array->u.arrayLit.symbol, weight, FALSE);
+        else
+            CountExpr(c, expr->u.arrayRef.array, weight);
+        CountExpr(c, expr->u.arrayRef.index, weight);
+        break;
+    case NodeTypeFunctionCall:
+        CountExprList(c, expr->u.functionCall.args, weight);
+        CountExpr(c, expr->u.functionCall.fcn, weight);
+        break;
+    case NodeTypeDisjunction:
+    case NodeTypeConjunction:
+        CountExprList(c, expr->u.exprList.exprs, weight);
+        break;
+    case NodeTypeAddressOf:
+        CountExpr(c, expr->u.addressOf.expr, weight);
+        break;
+    case NodeTypeIntrinsicCall:
+        CountExprList(c, expr->u.intrinsicCall.args, weight);
+        break;
+    default:
+        break;
+    }
+}
+
+/* CountExprList - count the accesses by a list of expressions */
+static void CountExprList(ParseContext *c, NodeListEntry *entry, unsigned long weight)
+{
+    for (; entry != NULL; entry = entry->next)
+        CountExpr(c, entry->node, weight);
+}
+
+/* IterationCount - find the number of times the test of a loop runs from its first statement */
+static unsigned long IterationCount(ParseContext *c, NodeListEntry *body, unsigned long weight, unsigned long count)
+{
+    if (!c->profile)
+        return weight;
+    return body ? GetStatementCount(c, body->node->index) : count;
+}
+
+/* TripCount - estimate the number of times the body of a FOR loop runs */
+static unsigned long TripCount(ParseTreeNode *node)
+{
+    ParseTreeNode *step = node->u.forStatement.stepExpr;
+    VMVALUE start, end, inc;
+
+    if (!IsIntegerLit(node->u.forStatement.startExpr)
+    ||  !IsIntegerLit(node->u.forStatement.endExpr)
+    ||  (step && !IsIntegerLit(step)))
+        return LOOP_WEIGHT;
+    start = node->u.forStatement.startExpr->u.integerLit.value;
+    end = node->u.forStatement.endExpr->u.integerLit.value;
+    if ((inc = step ? step->u.integerLit.value : 1) == 0)
+        return LOOP_WEIGHT;
+    if (inc > 0 ? end < start : end > start)
+        return 1;
+    return (unsigned long)((end - start) / inc) + 1;
+}
+
+/* Scale - multiply a weight by a factor without overflowing */
+static unsigned long Scale(unsigned long weight, unsigned long factor)
+{
+    if (factor != 0 && weight > ULONG_MAX / factor)
+        return ULONG_MAX;
+    return weight * factor;
+}
+
+/* AddAccesses - add to the accesses to a variable without overflowing */
+static void AddAccesses(ParseContext *c, Symbol *symbol, unsigned long weight, int escaped)
+{
+    DataUsage *usage;
+    if ((usage = FindDataUsage(c, symbol)) != NULL) {
+        usage->count = (usage->count > ULONG_MAX - weight ? ULONG_MAX : usage->count + weight);
+        if (escaped)
+            usage->escaped = TRUE;
+    }
+}
+
+/* FindDataUsage - find the usage record of a zero filled variable */
+static DataUsage *FindDataUsage(ParseContext *c, Symbol *symbol)
+{
+    DataUsage *usage;
+    for (usage = c->dataUsage; usage != NULL; usage = usage->next)
+        if (usage->symbol == symbol)
+            return usage;
+    return NULL;
+}
+
+/* PlaceData - place the movable variables and report the hub headroom */
+void PlaceData(ParseContext *c)
+{
+    Section *hub = GetSection(c->config, "hub");
+    Section *ram = GetSection(c->config, "ram");
+    DataUsage *usage, **sorted;
+    VMUVALUE used, ramUsed, limit;
+    int count, i;
+
+    /* find the hub space available to the data and the stack */
+    limit = hub->size - HUB_RUNTIME_SIZE;
+    if (c->config->cacheDriver)
+        limit = c->config->cacheSize < limit ? limit - c->config->cacheSize : 0;
+
+    /* the variables stay where they were defined unless the board has external ram */
+    if (c->dataUsage && ram && ram != hub) {
+
+        /* find the space used by everything except the movable variables */
+        used = hub->offset + c->stackSize * sizeof(VMVALUE);
+        ramUsed = ram->offset;
+        for (count = 0, usage = c->dataUsage; usage != NULL; usage = usage->next) {
+            if (usage->movable)
+                ++count;
+            else if (usage->symbol->section == hub)
+                used += usage->size;
+            else if (usage->symbol->section == ram)
+                ramUsed += usage->size;
+        }
+
+        /* choose a section for each movable variable, scalars first and then the densest arrays */
+        sorted = (DataUsage **)LocalAlloc(c, (count + 1) * sizeof(DataUsage *));
+        for (count = 0, usage = c->dataUsage; usage != NULL; usage = usage->next)
+            if (usage->movable)
+                sorted[count++] = usage;
+        qsort(sorted, count, sizeof(DataUsage *), CompareDensity);
+        for (i = 0; i < count; ++i) {
+            usage = sorted[i];
+            if (usage->symbol->type->id != TYPE_ARRAY
+            ||  ((usage->escaped || usage->count >= usage->size / sizeof(VMVALUE)) && used + usage->size <= limit)
+            ||  ramUsed + usage->size > ram->size) {
+                usage->symbol->section = hub;
+                used += usage->size;
+            }
+            else {
+                usage->symbol->section = ram;
+                ramUsed += usage->size;
+            }
+        }
+
+        /* lay out the zero filled space of both sections again in the order the variables were defined */
+        hub->zeroSize = ram->zeroSize = 0;
+        for (usage = c->dataUsage; usage != NULL; usage = usage->next) {
+            Section *section = usage->symbol->section;
+            if (section == hub || section == ram) {
+                usage->symbol->v.variable.offset = section->zeroSize;
+                section->zeroSize += usage->size;
+            }
+        }
+    }
+
+    /* show the placement and the hub headroom */
+    if (c->flags & (COMPILER_PLACE | COMPILER_INFO))
+        ShowDataPlacement(c, hub, hub->offset + hub->zeroSize + c->stackSize * sizeof(VMVALUE), limit);
+}
+
+/* CompareDensity - order scalars first and then arrays by decreasing accesses per byte */
+static int CompareDensity(const void *p1, const void *p2)
+{
+    DataUsage *u1 = *(DataUsage **)p1;
+    DataUsage *u2 = *(DataUsage **)p2;
+    int array1 = (u1->symbol->type->id == TYPE_ARRAY);
+    int array2 = (u2->symbol->type->id == TYPE_ARRAY);
+    double d1, d2;
+    if (array1 != array2)
+        return array1 - array2;
+    d1 = (double)u1->count / u1->size;
+    d2 = (double)u2->count / u2->size;
+    return d1 < d2 ? 1 : d1 > d2 ? -1 : 0;
+}
+
+/* ShowDataPlacement - show where each variable was placed and the hub space left over */
+static void ShowDataPlacement(ParseContext *c, Section *hub, VMUVALUE used, VMUVALUE limit)
+{
+    DataUsage *usage;
+
+    if (c->dataUsage) {
+        xbInfo(c->sys, "data placement (%s)\n", c->profiles ? "profiled accesses" : "estimated accesses");
+        for (usage = c->dataUsage; usage != NULL; usage = usage->next)
+            xbInfo(c->sys, "  %-16s %6d bytes %10lu accesses  %s%s%s\n",
+                   usage->symbol->name,
+                   usage->size,
+                   usage->count,
+                   usage->symbol->section->name,
+                   usage->movable ? "" : " (IN)",
+                   usage->escaped ? " (address used)" : "");
+    }
+    if (used <= limit)
+        xbInfo(c->sys, "hub headroom %d bytes (%d of %d bytes used including the stack)\n", limit - used, used, limit);
+    else
+        xbInfo(c->sys, "warning: hub data and stack need %d bytes, %d more than the %d available\n", used, used - limit, limit);
+}
@@ -0,0 +1,340 @@
+/* db_profile.c - statement maps and execution profiles
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The compiler writes a statement map when given -g and xbint writes an
+ * execution profile when given -p.  Both are text files that identify
+ * statements by function name and statement number so that a profile
+ * can be applied to the next compile of the same source.  Each statement
+ * also carries a hash of its source line.
+ *
+ * map file:
+ *      xbmap 2
+ *      function <name> <address> <size> <statement-count>
+ *      stmt <statement> <address> <hash>
+ *
+ * profile file:
+ *      xbprofile 2
+ *      function <name> <statement-count> <call-count>
+ *      stmt <statement> <execution-count> <hash>
+ *      call <statement> <callee> <call-count>
+ *
+ * Main code is named "[main]" and a statement without code has the
+ * address ffffffff.  When a function has been edited since it was
+ * profiled, the statements before and after the edit whose hashes still
+ * match keep their counts and the edited statements have none.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "db_compiler.h"
+
+/* map and profile format versions */
+#define MAP_VERSION     2
+#define PROFILE_VERSION 2
+
+/* call site profile */
+typedef struct CallProfile CallProfile;
+struct CallProfile {
+    CallProfile *next;
+    int index;                  /* statement containing the call */
+    unsigned long count;        /* number of calls */
+    char callee[1];
+};
+
+/* function profile */
+struct FunctionProfile {
+    FunctionProfile *next;
+    int statementCount;         /* number of statements in the function */
+    unsigned long calls;        /* number of times the function was called */
+    unsigned long *counts;      /* execution counts indexed by statement number */
+    VMUVALUE *hashes;           /* source line hashes indexed by statement number */
+    CallProfile *callSites;     /* calls made by the function */
+    char name[1];
+};
+
+static int NumberStatementList(NodeListEntry *entry, int index, VMUVALUE *hashes);
+static int NumberStatement(ParseTreeNode *node, int index, VMUVALUE *hashes);
+static int MatchStatements(ParseContext *c, FunctionProfile *profile);
+static const char *FunctionName(ParseContext *c);
+
+/* NumberStatements - number the statements of a function in source order */
+void NumberStatements(ParseContext *c, ParseTreeNode *node)
+{
+    VMUVALUE lineHash, prevHash = 0;
+    int i, n = 0;
+
+    /* number the statements and collect their source line hashes */
+    c->statementCount = NumberStatementList(node->u.functionDefinition.bodyStatements, 0, NULL);
+    c->statementHashes = (VMUVALUE *)LocalAlloc(c, (c->statementCount + 1) * sizeof(VMUVALUE));
+    c->statementHashes[0] = 0;
+    NumberStatementList(node->u.functionDefinition.bodyStatements, 0, c->statementHashes);
+
+    /* a line like PRINT makes several statements so add each one's position on the line to its hash */
+    for (i = 1; i <= c->statementCount; ++i) {
+        lineHash = c->statementHashes[i];
+        n = (i > 1 && lineHash == prevHash ? n + 1 : 0);
+        prevHash = lineHash;
+        if (n > 0)
+            c->statementHashes[i] = (lineHash ^ n) * 16777619u;
+    }
+
+    /* find the profile of the function */
+    c->profile = FindFunctionProfile(c, FunctionName(c));
+
+    /* the code generator records the code offset of each statement for the map */
+    if (c->mapFile) {
+        c->statementAddrs = (VMUVALUE *)LocalAlloc(c, (c->statementCount + 1) * sizeof(VMUVALUE));
+        for (i = 0; i <= c->statementCount; ++i)
+            c->statementAddrs[i] = UNDEF_VALUE;
+    }
+    else
+        c->statementAddrs = NULL;
+}
+
+/* NumberStatementList - number a list of statements and return the last number used */
+static int NumberStatementList(NodeListEntry *entry, int index, VMUVALUE *hashes)
+{
+    for (; entry != NULL; entry = entry->next)
+        index = NumberStatement(entry->node, index, hashes);
+    return index;
+}
+
+/* NumberStatement - number a statement and the statements nested within it */
+static int NumberStatement(ParseTreeNode *node, int index, VMUVALUE *hashes)
+{
+    node->index = ++index;
+    if (hashes)
+        hashes[index] = node->lineHash;
+    switch (node->nodeType) {
+    case NodeTypeIfStatement:
+        index = NumberStatementList(node->u.ifStatement.thenStatements, index, hashes);
+        index = NumberStatementList(node->u.ifStatement.elseStatements, index, hashes);
+        break;
+    case NodeTypeSelectStatement:
+        index = NumberStatementList(node->u.selectStatement.caseStatements, index, hashes);
+        if (node->u.selectStatement.elseStatements)
+            index = NumberStatement(node->u.selectStatement.elseStatements, index, hashes);
+        break;
+    case NodeTypeCaseStatement:
+        index = NumberStatementList(node->u.caseStatement.bodyStatements, index, hashes);
+        break;
+    case NodeTypeForStatement:
+        index = NumberStatementList(node->u.forStatement.bodyStatements, index, hashes);
+        break;
+    case NodeTypeDoWhileStatement:
+    case NodeTypeDoUntilStatement:
+    case NodeTypeLoopStatement:
+    case NodeTypeLoopWhileStatement:
+    case NodeTypeLoopUntilStatement:
+        index = NumberStatementList(node->u.loopStatement.bodyStatements, index, hashes);
+        break;
+    default:
+        break;
+    }
+    return index;
+}
+
+/* OpenMapFile - open the statement map that goes with an image */
+void OpenMapFile(ParseContext *c, const char *name)
+{
+    char mapName[PATH_MAX], *p;
+
+    /* replace the image file extension with .map */
+    strncpy(mapName, name, sizeof(mapName) - 5);
+    mapName[sizeof(mapName) - 5] = '\0';
+    if ((p = strrchr(mapName, '.')) != NULL && !strpbrk(p, "/\\"))
+        *p = '\0';
+    strcat(mapName, ".map");
+
+    /* create the map file */
+    if (!(c->mapFile = fopen(mapName, "w")))
+        Fatal(c, "can't create map file '%s'\n", mapName);
+    fprintf(c->mapFile, "xbmap %d\n", MAP_VERSION);
+}
+
+/* WriteMapFunction - add the statements of the function just compiled to the map */
+void WriteMapFunction(ParseContext *c, const char *name, VMUVALUE addr, VMUVALUE size)
+{
+    int i;
+    fprintf(c->mapFile, "function %s %08x %d %d\n", name, addr, size, c->statementCount);
+    for (i = 1; i <= c->statementCount; ++i)
+        fprintf(c->mapFile, "stmt %d %08x %08x\n", i,
+                c->statementAddrs[i] != UNDEF_VALUE ? addr + c->statementAddrs[i] : UNDEF_VALUE,
+                c->statementHashes[i]);
+}
+
+/* CloseMapFile - close the statement map */
+void CloseMapFile(ParseContext *c)
+{
+    if (c->mapFile) {
+        fclose(c->mapFile);
+        c->mapFile = NULL;
+    }
+}
+
+/* LoadProfile - load an execution profile written by the interpreter */
+void LoadProfile(ParseContext *c, const char *name)
+{
+    FunctionProfile *profile = NULL;
+    char line[256], callee[MAXTOKEN], fname[MAXTOKEN];
+    unsigned long count;
+    VMUVALUE hash;
+    int version, index;
+    void *fp;
+
+    /* open the profile and check its version */
+    if (!(fp = xbOpenFile(c->sys, name, "r")))
+        Fatal(c, "can't open profile '%s'\n", name);
+    if (!xbGetLine(fp, line, sizeof(line))
+    ||  sscanf(line, "xbprofile %d", &version) != 1
+    ||  version != PROFILE_VERSION)
+        Fatal(c, "'%s' is not a version %d profile\n", name, PROFILE_VERSION);
+
+    /* read the function profiles */
+    c->profiles = NULL;
+    while (xbGetLine(fp, line, sizeof(line))) {
+        if (sscanf(line, "function %31s %d %lu", fname, &index, &count) == 3 && index >= 0) {
+            profile = (FunctionProfile *)GlobalAlloc(c, sizeof(FunctionProfile) + strlen(fname));
+            memset(profile, 0, sizeof(FunctionProfile));
+            strcpy(profile->name, fname);
+            profile->statementCount = index;
+            profile->calls = count;
+            profile->counts = (unsigned long *)GlobalAlloc(c, (index + 1) * sizeof(unsigned long));
+            memset(profile->counts, 0, (index + 1) * sizeof(unsigned long));
+            profile->hashes = (VMUVALUE *)GlobalAlloc(c, (index + 1) * sizeof(VMUVALUE));
+            memset(profile->hashes, 0, (index + 1) * sizeof(VMUVALUE));
+            profile->next = c->profiles;
+            c->profiles = profile;
+        }
+        else if (profile && sscanf(line, "stmt %d %lu %x", &index, &count, &hash) == 3) {
+            if (index > 0 && index <= profile->statementCount) {
+                profile->counts[index] = count;
+                profile->hashes[index] = hash;
+            }
+        }
+        else if (profile && sscanf(line, "call %d %31s %lu", &index, callee, &count) == 3) {
+            CallProfile *site = (CallProfile *)GlobalAlloc(c, sizeof(CallProfile) + strlen(callee));
+            strcpy(site->callee, callee);
+            site->index = index;
+            site->count = count;
+            site->next = profile->callSites;
+            profile->callSites = site;
+        }
+        else if (line[0] != '\n')
+            Fatal(c, "bad profile line: %s", line);
+    }
+    xbCloseFile(fp);
+}
+
+/* FindFunctionProfile - find the profile of a function or NULL if none of its statements are unchanged */
+FunctionProfile *FindFunctionProfile(ParseContext *c, const char *name)
+{
+    FunctionProfile *profile;
+    for (profile = c->profiles; profile != NULL; profile = profile->next)
+        if (strcmp(name, profile->name) == 0)
+            return MatchStatements(c, profile) > 0 || c->statementCount == 0 ? profile : NULL;
+    return NULL;
+}
+
+/* MatchStatements - renumber a profile for the statements of the current function and return the number matched */
+static int MatchStatements(ParseContext *c, FunctionProfile *profile)
+{
+    int oldCount = profile->statementCount, newCount = c->statementCount;
+    CallProfile *site, **pNext;
+    unsigned long *counts;
+    int head, tail, i;
+
+    /* find the statements before and after the edit */
+    for (head = 0; head < oldCount && head < newCount; ++head)
+        if (profile->hashes[head + 1] != c->statementHashes[head + 1])
+            break;
+    if (head == oldCount && head == newCount)
+        return head;
+    for (tail = 0; tail < oldCount - head && tail < newCount - head; ++tail)
+        if (profile->hashes[oldCount - tail] != c->statementHashes[newCount - tail])
+            break;
+    if (head + tail == 0)
+        return 0;
+
+    /* move their counts to their new statement numbers */
+    counts = (unsigned long *)GlobalAlloc(c, (newCount + 1) * sizeof(unsigned long));
+    memset(counts, 0, (newCount + 1) * sizeof(unsigned long));
+    for (i = 1; i <= head; ++i)
+        counts[i] = profile->counts[i];
+    for (i = 0; i < tail; ++i)
+        counts[newCount - i] = profile->counts[oldCount - i];
+
+    /* renumber their call sites and drop the call sites of the edited statements */
+    for (pNext = &profile->callSites; (site = *pNext) != NULL; ) {
+        if (site->index > oldCount - tail)
+            site->index += newCount - oldCount;
+        else if (site->index > head) {
+            *pNext = site->next;
+            continue;
+        }
+        pNext = &site->next;
+    }
+
+    /* the profile now matches the current function */
+    profile->statementCount = newCount;
+    profile->counts = counts;
+    profile->hashes = (VMUVALUE *)GlobalAlloc(c, (newCount + 1) * sizeof(VMUVALUE));
+    memcpy(profile->hashes, c->statementHashes, (newCount + 1) * sizeof(VMUVALUE));
+    return head + tail;
+}
+
+/* GetStatementCount - get the number of times a statement of the current function was executed */
+unsigned long GetStatementCount(ParseContext *c, int index)
+{
+    FunctionProfile *profile = c->profile;
+    if (!profile || index <= 0 || index > profile->statementCount)
+        return 0;
+    return profile->counts[index];
+}
+
+/* GetCallCount - get the number of calls a statement of the current function made to a function */
+unsigned long GetCallCount(ParseContext *c, int index, const char *callee)
+{
+    unsigned long count = 0;
+    CallProfile *site;
+    if (c->profile) {
+        for (site = c->profile->callSites; site != NULL; site = site->next)
+            if (site->index == index && strcmp(callee, site->callee) == 0)
+                count += site->count;
+    }
+    return count;
+}
+
+/* GetFunctionCount - get the total number of statements of the current function executed */
+unsigned long GetFunctionCount(ParseContext *c)
+{
+    unsigned long count = 0;
+    int i;
+    if (c->profile) {
+        for (i = 1; i <= c->profile->statementCount; ++i)
+            count += c->profile->counts[i];
+    }
+    return count;
+}
+
+/* GetCallsTo - get the number of calls the current function made to a function */
+unsigned long GetCallsTo(ParseContext *c, const char *callee)
+{
+    unsigned long count = 0;
+    CallProfile *site;
+    if (c->profile) {
+        for (site = c->profile->callSites; site != NULL; site = site->next)
+            if (strcmp(callee, site->callee) == 0)
+                count += site->count;
+    }
+    return count;
+}
+
+/* FunctionName - get the name of the function being compiled */
+static const char *FunctionName(ParseContext *c)
+{
+    Symbol *symbol = c->function->u.functionDefinition.symbol;
+    return symbol ? symbol->name : "[main]";
+}
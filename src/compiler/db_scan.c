@@ -24,6 +24,7 @@ static struct {
 {   "INCLUDE",  T_INCLUDE   },
 {   "DEF",      T_DEF       },
 {   "DIM",      T_DIM       },
+{   "CONST",    T_CONST     },
 {   "AS",       T_AS        },
 {   "IN",       T_IN        },
 {   "LET",      T_LET       },
@@ -52,6 +53,8 @@ static struct {
 {   "INPUT",    T_INPUT     },
 {   "PRINT",    T_PRINT     },
 {   "ASM",      T_ASM       },
+{   "YIELD",    T_YIELD     },
+{   "HEX",      T_HEX       },
 {   NULL,       0           }
 };
 
@@ -61,6 +64,7 @@ static int IdentifierToken(ParseContext *c, int ch);
 static int LiteralChar(ParseContext *c);
 static int SkipComment(ParseContext *c);
 static int XGetC(ParseContext *c);
+static VMUVALUE HashLine(const char *p);
 
 /* RewindInput - rewind the main input */
 void RewindInput(ParseContext *c)
@@ -195,6 +199,7 @@ int GetLine(ParseContext *c)
 
     /* initialize the input buffer */
     c->linePtr = c->lineBuf;
+    c->lineHash = HashLine(c->lineBuf);
     ++f->lineNumber;
 
     /* clear lookahead token */
@@ -258,6 +263,7 @@ char *TokenName(int token)
     case T_OPTION:
     case T_DEF:
     case T_DIM:
+    case T_CONST:
     case T_AS:
     case T_IN:
     case T_LET:
@@ -285,6 +291,8 @@ char *TokenName(int token)
     case T_INPUT:
     case T_PRINT:
     case T_ASM:
+    case T_YIELD:
+    case T_HEX:
         name = ktab[token - T_REM].keyword;
         break;
     case T_END_DEF:
@@ -326,12 +334,18 @@ char *TokenName(int token)
     case T_SHR:
         name = ">>";
         break;
+    case T_SHRU:
+        name = ">>>";
+        break;
     case T_IDENTIFIER:
         name = "<IDENTIFIER>";
         break;
     case T_NUMBER:
         name = "<NUMBER>";
         break;
+    case T_FIXED_NUMBER:
+        name = "<FIXED>";
+        break;
     case T_STRING:
         name = "<STRING>";
         break;
@@ -391,8 +405,14 @@ static int NextToken(ParseContext *c)
     case '>':
         if ((ch = GetChar(c)) == '=')
             tkn = T_GE;
-        else if (ch == '>')
-            tkn = T_SHR;
+        else if (ch == '>') {
+            if ((ch = GetChar(c)) == '>')
+                tkn = T_SHRU;
+            else {
+                UngetC(c);
+                tkn = T_SHR;
+            }
+        }
         else {
             UngetC(c);
             tkn = '>';
@@ -552,6 +572,27 @@ int NumberToken(ParseContext *c, int ch)
         else if (ch != '_')
             break;
     }
+    
+    /* check for a fixed point number */
+    if (ch == '.' && isdigit(*c->linePtr)) {
+        *p++ = ch;
+        while ((ch = GetChar(c)) != EOF) {
+            if (isdigit(ch))
+                *p++ = ch;
+            else if (ch != '_')
+                break;
+        }
+        UngetC(c);
+        *p = '\0';
+        
+        /* convert the string to 16.16 rounding the fraction to nearest */
+        if (atof(c->token) >= 32768.0)
+            ParseError(c, "fixed point number too large: %s", c->token);
+        c->value = (VMVALUE)(atof(c->token) * (1 << FIXED_SHIFT) + 0.5);
+        
+        /* return the token */
+        return T_FIXED_NUMBER;
+    }
     UngetC(c);
     *p = '\0';
     
@@ -756,6 +797,16 @@ void UngetC(ParseContext *c)
     --c->linePtr;
 }
 
+/* HashLine - hash a line ignoring white space so that a profile can recognize the statements that haven't changed */
+static VMUVALUE HashLine(const char *p)
+{
+    VMUVALUE hash = 2166136261u;
+    for (; *p != '\0'; ++p)
+        if (!isspace((unsigned char)*p))
+            hash = (hash ^ (uint8_t)*p) * 16777619u;
+    return hash;
+}
+
 /* ParseError - report a parsing error */
 void ParseError(ParseContext *c, char *fmt, ...)
 {
@@ -0,0 +1,491 @@
+/* db_stack.c - static stack depth analysis
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The code of each function is scanned as it is stored to find the deepest
+ * the interpreter stack gets below the function's frame pointer, counting
+ * the frame, the operands and the words pushed at each call.  When all of
+ * the code has been stored, the depths are propagated over the call graph
+ * from the main code to find the smallest stack that can't overflow.  The
+ * stack size is set to that unless it was set with OPTION stacksize or the
+ * depth can't be bounded because of recursion or a call the compiler can't
+ * follow.  Recursion through tail calls alone reuses the same frame and
+ * doesn't make the depth unbounded.  The depths are in words.
+ */
+
+#include <string.h>
+#include "db_compiler.h"
+
+/* depth that can't be bounded */
+#define UNBOUNDED   -1
+
+/* call from one function to another */
+typedef struct StackCall StackCall;
+struct StackCall {
+    StackCall *next;
+    Symbol *callee;
+    int depth;                  /* depth of the callee's frame pointer */
+    int tail;                   /* the callee reuses the caller's frame */
+};
+
+/* analysis state of a function */
+typedef enum {
+    SS_NEW,
+    SS_ACTIVE,
+    SS_PARTIAL,
+    SS_DONE
+} StackState;
+
+/* stack usage of a function */
+struct StackUsage {
+    StackUsage *next;           /* next function in the order stored */
+    Symbol *symbol;             /* function symbol or NULL for the main code */
+    int depth;                  /* deepest the function alone gets or UNBOUNDED */
+    int indirectDepth;          /* deepest call through a function pointer or -1 */
+    StackCall *calls;           /* functions called directly */
+    StackCall *refs;            /* functions whose addresses are taken */
+    int addressTaken;           /* the function can be called through a pointer */
+    int recursive;              /* the function calls itself directly or indirectly */
+    int reachable;              /* the function is called from the main code */
+    StackState state;
+    int frames;                 /* frames created on the way to the function while active */
+    int total;                  /* deepest including the functions called or UNBOUNDED */
+};
+
+static int FollowBranch(ParseContext *c, int *depthAt, VMUVALUE *work, int *pCount, VMUVALUE addr, int depth);
+static void AddStackCall(ParseContext *c, StackCall **pCalls, Symbol *callee, int depth, int tail);
+static Symbol *FunctionOperand(ParseContext *c, Symbol **symbolAt, VMUVALUE addr);
+static StackUsage *FindStackUsage(ParseContext *c, Symbol *symbol);
+static void ResetStackUsage(ParseContext *c);
+static int StackNeeded(ParseContext *c, StackUsage *usage, int frames, int *pPartial);
+static int AddDepth(int total, int depth, int needed);
+static void ShowStackUsage(ParseContext *c, int needed);
+
+/* AnalyzeStack - find the stack depth of the code in the code buffer */
+void AnalyzeStack(ParseContext *c, Symbol *symbol)
+{
+    VMUVALUE length = codeaddr(c), addr, next, *work;
+    int *depthAt, count, depth, size, j;
+    StackUsage *usage, **pNext;
+    LocalFixup *fixup;
+    Symbol **symbolAt, *callee;
+
+    /* create the stack usage record */
+    usage = (StackUsage *)GlobalAlloc(c, sizeof(StackUsage));
+    memset(usage, 0, sizeof(StackUsage));
+    usage->symbol = symbol;
+    usage->indirectDepth = -1;
+    for (pNext = &c->stackUsage; *pNext != NULL; pNext = &(*pNext)->next)
+        ;
+    *pNext = usage;
+
+    /* find the operands that refer to symbols that haven't been placed yet */
+    symbolAt = (Symbol **)LocalAlloc(c, (length + 1) * sizeof(Symbol *));
+    memset(symbolAt, 0, (length + 1) * sizeof(Symbol *));
+    for (fixup = c->symbolFixups; fixup != NULL; fixup = fixup->next)
+        for (addr = fixup->chain; addr != 0 && addr < length; addr = rd_cword(c, addr))
+            symbolAt[addr] = fixup->symbol;
+
+    /* the function starts with nothing below its frame pointer */
+    depthAt = (int *)LocalAlloc(c, (length + 1) * sizeof(int));
+    for (addr = 0; addr <= length; ++addr)
+        depthAt[addr] = -1;
+    work = (VMUVALUE *)LocalAlloc(c, (length + 1) * sizeof(VMUVALUE));
+    count = 0;
+    if (!FollowBranch(c, depthAt, work, &count, 0, 0)) {
+        usage->depth = UNBOUNDED;
+        return;
+    }
+
+    /* follow each path through the code */
+    while (count > 0) {
+        addr = work[--count];
+        depth = depthAt[addr];
+        if ((size = CodeSize(c, addr, length)) == 0) {
+            usage->depth = UNBOUNDED;
+            return;
+        }
+        next = addr + size;
+        switch (c->codeBuf[addr]) {
+        case OP_HALT:
+        case OP_POPJ:
+        case OP_RETURN:
+        case OP_LRETURN:
+            next = 0;
+            break;
+        case OP_RETURNZ:
+            ++depth;
+            next = 0;
+            break;
+        case OP_BR:
+            if (!FollowBranch(c, depthAt, work, &count, next + rd_cword(c, addr + 1), depth)) {
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            next = 0;
+            break;
+        case OP_BRT:
+        case OP_BRF:
+            if (!FollowBranch(c, depthAt, work, &count, next + rd_cword(c, addr + 1), depth - 1)) {
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            --depth;
+            break;
+        case OP_BRTSC:
+        case OP_BRFSC:
+            if (!FollowBranch(c, depthAt, work, &count, next + rd_cword(c, addr + 1), depth)) {
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            --depth;
+            break;
+        case OP_SWITCH:
+            for (j = 0; j <= rd_cword(c, addr + 1 + sizeof(VMVALUE)); ++j) {
+                VMUVALUE entry = addr + 1 + (j + 2) * sizeof(VMVALUE);
+                if (!FollowBranch(c, depthAt, work, &count, entry + sizeof(VMVALUE) + rd_cword(c, entry), depth)) {
+                    usage->depth = UNBOUNDED;
+                    return;
+                }
+            }
+            next = 0;
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_REM:
+        case OP_FMUL:
+        case OP_FDIV:
+        case OP_BAND:
+        case OP_BOR:
+        case OP_BXOR:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_RSHR:
+        case OP_SHRU:
+        case OP_ROL:
+        case OP_ROR:
+        case OP_BITSET:
+        case OP_BITCLR:
+        case OP_BITTST:
+        case OP_BITTGL:
+        case OP_LT:
+        case OP_LE:
+        case OP_EQ:
+        case OP_NE:
+        case OP_GE:
+        case OP_GT:
+        case OP_INDEX:
+        case OP_LSET:
+        case OP_DROP:
+            --depth;
+            break;
+        case OP_STORE:
+        case OP_STOREB:
+        case OP_STOREW:
+        case OP_MEMCPY:
+        case OP_MEMSET:
+        case OP_MEMCMP:
+        case OP_MEMCHR:
+        case OP_RINGPUT:
+        case OP_RINGGET:
+        case OP_RINGPEEK:
+            depth -= 2;
+            break;
+        case OP_LIT:
+            if ((callee = FunctionOperand(c, symbolAt, addr + 1)) != NULL)
+                AddStackCall(c, &usage->refs, callee, 0, FALSE);
+            ++depth;
+            break;
+        case OP_SLIT:
+        case OP_LREF:
+        case OP_DUP:
+        case OP_COGID:
+        case OP_CLKFREQ:
+            ++depth;
+            break;
+        case OP_FRAME:
+            depth += c->codeBuf[addr + 1];
+            break;
+        case OP_CLEAN:
+            depth -= c->codeBuf[addr + 1];
+            break;
+        case OP_TRAP:
+            switch (c->codeBuf[addr + 1]) {
+            case TRAP_GETCHAR:
+            case TRAP_INPUTINT:
+                ++depth;
+                break;
+            case TRAP_PUTCHAR:
+            case TRAP_PRINTSTR:
+            case TRAP_PRINTINT:
+            case TRAP_PRINTHEX:
+            case TRAP_PRINTFIXED:
+            case TRAP_COGRUN:
+                --depth;
+                break;
+            case TRAP_PRINTTAB:
+            case TRAP_PRINTNL:
+            case TRAP_INPUTLINE:
+            case TRAP_INPUTSTR:
+            case TRAP_YIELD:
+                break;
+            case TRAP_TASKRUN:
+                /* the task stacks are taken from the interpreter stack as the program runs */
+            default:
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            break;
+        case OP_PUSHJ:
+            /* the function address is replaced by the return address */
+            if (depth > usage->indirectDepth)
+                usage->indirectDepth = depth;
+            break;
+        case OP_CALL:
+            /* the caller's top of stack is pushed and the callee removes its arguments */
+            if (!(callee = FunctionOperand(c, symbolAt, addr + 2))) {
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            AddStackCall(c, &usage->calls, callee, depth + 1, FALSE);
+            depth += 1 - c->codeBuf[addr + 1];
+            break;
+        case OP_TCALL:
+            /* the callee reuses the frame */
+            if (!(callee = FunctionOperand(c, symbolAt, addr + 2))) {
+                usage->depth = UNBOUNDED;
+                return;
+            }
+            AddStackCall(c, &usage->calls, callee, 0, TRUE);
+            ++depth;
+            next = 0;
+            break;
+        default:
+            /* NOT, NEG, BNOT, LOAD, LOADB, LOADW, STRLEN, HUBADDR, WAITCNT and NATIVE leave the depth alone */
+            break;
+        }
+
+        /* check for popping more than was pushed */
+        if (depth < 0) {
+            usage->depth = UNBOUNDED;
+            return;
+        }
+        if (depth > usage->depth)
+            usage->depth = depth;
+
+        /* continue with the next instruction */
+        if (next != 0 && !FollowBranch(c, depthAt, work, &count, next, depth)) {
+            usage->depth = UNBOUNDED;
+            return;
+        }
+    }
+}
+
+/* SizeStack - set the stack size from the stack usage of the code reachable from the main code */
+void SizeStack(ParseContext *c)
+{
+    StackUsage *usage, *callee;
+    StackCall *ref;
+    int needed, partial;
+
+    /* find the functions that can be called through a pointer */
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next)
+        for (ref = usage->refs; ref != NULL; ref = ref->next)
+            if ((callee = FindStackUsage(c, ref->callee)) != NULL)
+                callee->addressTaken = TRUE;
+
+    /* find the stack needed by the main code */
+    ResetStackUsage(c);
+    partial = FALSE;
+    needed = (usage = FindStackUsage(c, NULL)) != NULL ? StackNeeded(c, usage, 0, &partial) : UNBOUNDED;
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next)
+        usage->reachable = (usage->state != SS_NEW);
+
+    /* show the stack usage of each function */
+    if (c->flags & COMPILER_INFO)
+        ShowStackUsage(c, needed);
+
+    /* use the stack size set by OPTION stacksize */
+    if (c->stackSize > 0) {
+        if (needed != UNBOUNDED && c->stackSize < needed)
+            xbInfo(c->sys, "warning: stack size %d is less than the %d words needed\n", c->stackSize, needed);
+    }
+
+    /* use the default stack size when the depth can't be bounded */
+    else if (needed == UNBOUNDED)
+        c->stackSize = DEFAULT_STACK_SIZE;
+
+    /* use the smallest stack that can't overflow */
+    else
+        c->stackSize = needed > 0 ? needed : 1;
+}
+
+/* FollowBranch - add code to be scanned at a given depth */
+static int FollowBranch(ParseContext *c, int *depthAt, VMUVALUE *work, int *pCount, VMUVALUE addr, int depth)
+{
+    if (addr >= codeaddr(c) || depth < 0)
+        return FALSE;
+
+    /* the code has already been reached by another path */
+    if (depthAt[addr] >= 0)
+        return depthAt[addr] == depth;
+
+    /* add the code to the work list */
+    depthAt[addr] = depth;
+    work[(*pCount)++] = addr;
+    return TRUE;
+}
+
+/* AddStackCall - add a call keeping only the deepest call to each function */
+static void AddStackCall(ParseContext *c, StackCall **pCalls, Symbol *callee, int depth, int tail)
+{
+    StackCall *call;
+    for (call = *pCalls; call != NULL; call = call->next)
+        if (call->callee == callee && call->tail == tail) {
+            if (depth > call->depth)
+                call->depth = depth;
+            return;
+        }
+    call = (StackCall *)GlobalAlloc(c, sizeof(StackCall));
+    call->callee = callee;
+    call->depth = depth;
+    call->tail = tail;
+    call->next = *pCalls;
+    *pCalls = call;
+}
+
+/* FunctionOperand - find the function an operand refers to */
+static Symbol *FunctionOperand(ParseContext *c, Symbol **symbolAt, VMUVALUE addr)
+{
+    VMUVALUE value = rd_cword(c, addr);
+    StackUsage *usage;
+    Symbol *symbol;
+
+    /* the operand is in the fixup chain of a symbol that hasn't been placed */
+    if ((symbol = symbolAt[addr]) != NULL)
+        return symbol->type->id == TYPE_FUNCTION ? symbol : NULL;
+
+    /* the operand is the address of a function that has been placed */
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next)
+        if ((symbol = usage->symbol) != NULL
+        &&  symbol->v.variable.offset != UNDEF_VALUE
+        &&  (symbol->section ? symbol->section->base : 0) + symbol->v.variable.offset == value)
+            return symbol;
+    return NULL;
+}
+
+/* FindStackUsage - find the stack usage of a function */
+static StackUsage *FindStackUsage(ParseContext *c, Symbol *symbol)
+{
+    StackUsage *usage;
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next)
+        if (usage->symbol == symbol)
+            return usage;
+    return NULL;
+}
+
+/* ResetStackUsage - prepare to walk the call graph */
+static void ResetStackUsage(ParseContext *c)
+{
+    StackUsage *usage;
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next)
+        usage->state = SS_NEW;
+}
+
+/* StackNeeded - find the stack needed by a function and the functions it calls
+ *
+ * A function that is reached again through tail calls alone adds nothing to
+ * the stack needed by the function already being analyzed.  The functions
+ * on the way back to it are only partially analyzed and are analyzed again
+ * if they are reached another way.
+ */
+static int StackNeeded(ParseContext *c, StackUsage *usage, int frames, int *pPartial)
+{
+    int total, found, partial = FALSE;
+    StackUsage *callee;
+    StackCall *call;
+
+    /* check for a function that has already been analyzed or that calls itself */
+    switch (usage->state) {
+    case SS_NEW:
+    case SS_PARTIAL:
+        break;
+    case SS_ACTIVE:
+        if (frames == usage->frames) {
+            *pPartial = TRUE;
+            return 0;
+        }
+        usage->recursive = TRUE;
+        return UNBOUNDED;
+    case SS_DONE:
+        return usage->total;
+    }
+    usage->state = SS_ACTIVE;
+    usage->frames = frames;
+
+    /* add the stack needed by each function called directly */
+    total = usage->depth;
+    for (call = usage->calls; call != NULL; call = call->next) {
+        callee = FindStackUsage(c, call->callee);
+        total = AddDepth(total, call->depth, callee ? StackNeeded(c, callee, call->tail ? frames : frames + 1, &partial) : UNBOUNDED);
+    }
+
+    /* a call through a pointer can call any function whose address is taken */
+    if (usage->indirectDepth >= 0) {
+        found = FALSE;
+        for (callee = c->stackUsage; callee != NULL; callee = callee->next)
+            if (callee->addressTaken) {
+                total = AddDepth(total, usage->indirectDepth, StackNeeded(c, callee, frames + 1, &partial));
+                found = TRUE;
+            }
+        if (!found)
+            total = UNBOUNDED;
+    }
+
+    /* return the stack needed */
+    if (partial && total != UNBOUNDED) {
+        usage->state = SS_PARTIAL;
+        *pPartial = TRUE;
+    }
+    else
+        usage->state = SS_DONE;
+    usage->total = total;
+    return total;
+}
+
+/* AddDepth - combine the stack needed so far with the stack needed by a call at a given depth */
+static int AddDepth(int total, int depth, int needed)
+{
+    if (total == UNBOUNDED || needed == UNBOUNDED)
+        return UNBOUNDED;
+    return depth + needed > total ? depth + needed : total;
+}
+
+/* ShowStackUsage - show the stack used by each function */
+static void ShowStackUsage(ParseContext *c, int needed)
+{
+    StackUsage *usage;
+    int total, partial;
+
+    xbInfo(c->sys, "stack usage (words)\n");
+    for (usage = c->stackUsage; usage != NULL; usage = usage->next) {
+        const char *name = usage->symbol ? usage->symbol->name : "[main]";
+        ResetStackUsage(c);
+        partial = FALSE;
+        total = StackNeeded(c, usage, 0, &partial);
+        if (usage->depth == UNBOUNDED)
+            xbInfo(c->sys, "  %-16s unknown\n", name);
+        else if (total == UNBOUNDED)
+            xbInfo(c->sys, "  %-16s %6d unbounded%s%s\n", name, usage->depth, usage->recursive ? " (recursive)" : "", usage->reachable ? "" : " (not called)");
+        else
+            xbInfo(c->sys, "  %-16s %6d %6d%s\n", name, usage->depth, total, usage->reachable ? "" : " (not called)");
+    }
+    if (c->stackSize > 0)
+        xbInfo(c->sys, "stack size %d words (OPTION stacksize)\n", c->stackSize);
+    else if (needed == UNBOUNDED)
+        xbInfo(c->sys, "stack size %d words (default, depth is unbounded)\n", (int)DEFAULT_STACK_SIZE);
+    else
+        xbInfo(c->sys, "stack size %d words\n", needed > 0 ? needed : 1);
+}
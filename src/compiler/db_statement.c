@@ -21,8 +21,10 @@ static void ParseFunctionDef_pass1(ParseContext *c, char *name);
 static void ParseFunctionDef_pass23(ParseContext *c, char *name);
 static void ParseEndDef(ParseContext *c);
 static void ParseDim(ParseContext *c);
+static void ParseConst(ParseContext *c);
 static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize);
-static VMVALUE ParseScalarInitializer(ParseContext *c);
+static Type *ParseTypeName(ParseContext *c);
+static VMVALUE ParseScalarInitializer(ParseContext *c, Type *type);
 static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE size);
 static void ClearArrayInitializers(ParseContext *c, VMVALUE size);
 static void ParseImpliedLetOrFunctionCall(ParseContext *c);
@@ -46,11 +48,14 @@ static void ParseLoopUntil(ParseContext *c);
 static void ParseAsm(ParseContext *c);
 static void ParseGoto(ParseContext *c);
 static void ParseReturn(ParseContext *c);
+static void ParseYield(ParseContext *c);
 static void ParseInput(ParseContext *c);
 static void ParsePrint(ParseContext *c);
 
 /* prototypes */
 static void StartFunction(ParseContext *c, Symbol *sym);
+static ParseTreeNode *BuildIOCall(ParseContext *c, int trap, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr);
+static ParseTreeNode *BuildIOFunctionCall(ParseContext *c, int trap, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr);
 static ParseTreeNode *BuildHandlerCall(ParseContext *c, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr);
 static ParseTreeNode *BuildHandlerFunctionCall(ParseContext *c, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr);
 static void DefineLabel(ParseContext *c, char *name);
@@ -89,6 +94,9 @@ again:
     case T_DIM:
         ParseDim(c);
         break;
+    case T_CONST:
+        ParseConst(c);
+        break;
     default:
         if (c->pass > 1) {
             if (!c->functionType) {
@@ -167,6 +175,9 @@ again:
             case T_RETURN:
                 ParseReturn(c);
                 break;
+            case T_YIELD:
+                ParseYield(c);
+                break;
             case T_INPUT:
                 ParseInput(c);
                 break;
@@ -259,8 +270,11 @@ static void ParseConstantDef(ParseContext *c, char *name)
         expr = ParseExpr(c);
 
         /* make sure it's a constant */
-        if (IsIntegerLit(expr))
-            AddGlobalConstantInteger(c, name, expr->u.integerLit.value);
+        if (IsIntegerLit(expr)) {
+            Symbol *sym = AddGlobalConstantInteger(c, name, expr->u.integerLit.value);
+            if (expr->type->id == TYPE_FIXED)
+                sym->type = &c->fixedType;
+        }
         else if (IsStringLit(expr))
             AddGlobalConstantString(c, name, expr->u.stringLit.string);
         else
@@ -321,7 +335,12 @@ static void ParseFunctionDef_pass1(ParseContext *c, char *name)
             } while ((tkn = GetToken(c)) == ',');
         }
         Require(c, tkn, ')');
+        tkn = GetToken(c);
     }
+    
+    /* check for a return type */
+    if (tkn == T_AS)
+        c->functionType->u.functionInfo.returnType = ParseTypeName(c);
     else
         SaveToken(c, tkn);
         
@@ -349,6 +368,8 @@ static void StartFunction(ParseContext *c, Symbol *sym)
     InitSymbolTable(&node->u.functionDefinition.locals);
     node->u.functionDefinition.labels = NULL;
     node->u.functionDefinition.localOffset = 0;
+    node->u.functionDefinition.hasCalls = FALSE;
+    node->u.functionDefinition.hasAsm = FALSE;
     c->dependencies = NULL;
     c->pNextDependency = &c->dependencies;
     
@@ -386,9 +407,11 @@ void EndFunction(ParseContext *c)
     /* store the dependencies on pass 2 */
     if (c->pass == 2) {
     
-        /* store dependencies */
-        if (c->functionType)
+        /* store dependencies and save a body for inlining */
+        if (c->functionType) {
             c->function->u.functionDefinition.symbol->type->u.functionInfo.dependencies = c->dependencies;
+            SaveInlineBody(c, c->function);
+        }
         else
             c->mainDependencies = c->dependencies;
             
@@ -449,7 +472,7 @@ static void ParseDim(ParseContext *c)
     char name[MAXTOKEN];
     VMVALUE value = 0;
     VMUVALUE size;
-    int isArray;
+    int isArray, zeroFilled, movable;
     int tkn;
 
     /* parse variable declarations */
@@ -468,13 +491,13 @@ static void ParseDim(ParseContext *c)
             if (isArray)
                 ParseError(c, "local arrays are not supported");
             
-            /* only integer locals are currently supported */
-            if (type != &c->integerType)
-                ParseError(c, "only integer locals are currently supported");
+            /* only integer and fixed point locals are currently supported */
+            if (type != &c->integerType && type != &c->fixedType)
+                ParseError(c, "only integer and fixed point locals are currently supported");
                 
             /* check for an initializer */
             if ((tkn = GetToken(c)) == '=')
-                expr = ParseExpr(c);
+                expr = ConvertExpr(c, ParseExpr(c), type);
         
             /* no initializers */
             else {
@@ -503,6 +526,7 @@ static void ParseDim(ParseContext *c)
             Section *target;
         
             /* check for target section */
+            movable = FALSE;
             if ((tkn = GetToken(c)) == T_IN) {
                 FRequire(c, T_STRING);
                 if (strcasecmp(c->token, "text") == 0)
@@ -517,6 +541,7 @@ static void ParseDim(ParseContext *c)
             else {
                 SaveToken(c, tkn);
                 target = c->dataTarget;
+                movable = TRUE;
             }
             
             /* check for initializers */
@@ -524,24 +549,35 @@ static void ParseDim(ParseContext *c)
                 if (isArray)
                     size = ParseArrayInitializers(c, type->u.arrayInfo.elementType, size);
                 else
-                    value = ParseScalarInitializer(c);
+                    value = ParseScalarInitializer(c, type);
+                zeroFilled = FALSE;
             }
             
             /* no initializers */
             else {
                 SaveToken(c, tkn);
-                if (isArray) {
-                    if (size == 0)
-                        ParseError(c, "no array size specified and no initializers");
+                if (isArray && size == 0)
+                    ParseError(c, "no array size specified and no initializers");
+                    
+                /* variables without initializers are cleared at load time unless they are in flash */
+                zeroFilled = (target != c->textTarget || target == c->dataTarget);
+                if (isArray && !zeroFilled)
                     ClearArrayInitializers(c, ValueSize(type, size));
-                }
+                value = 0;
             }
 
             /* add the symbol on pass 1 */
             if (c->pass == 1) {
             
+                /* handle variables in the zero filled space */
+                if (zeroFilled) {
+                    VMUVALUE byteSize = ValueSize(type, size) * sizeof(VMVALUE);
+                    Symbol *sym = AddZeroFilledSymbol(c, name, isArray ? SC_CONSTANT : SC_GLOBAL, type, target, byteSize);
+                    AddDataUsage(c, sym, byteSize, movable);
+                }
+                
                 /* handle arrays */
-                if (isArray) {
+                else if (isArray) {
                     AddGlobalSymbol(c, name, SC_CONSTANT, type, target);
                     target->offset += WriteSection(c, target, c->cptr, ValueSize(type, size) * sizeof(VMVALUE));
                 }
@@ -558,6 +594,45 @@ static void ParseDim(ParseContext *c)
     Require(c, tkn, T_EOL);
 }
 
+/* ParseConst - parse the 'CONST' statement */
+static void ParseConst(ParseContext *c)
+{
+    char name[MAXTOKEN];
+    VMUVALUE size, byteSize;
+    Symbol *sym;
+    Type *type;
+
+    /* constant arrays are global */
+    if (c->functionType)
+        ParseError(c, "CONST arrays must be defined outside of functions");
+        
+    /* get the array name and type */
+    type = ParseVariableDecl(c, name, &size);
+    if (type->id != TYPE_ARRAY)
+        ParseError(c, "expecting a CONST array (use DEF for scalar constants)");
+        
+    /* get the initializers */
+    FRequire(c, '=');
+    size = ParseArrayInitializers(c, type->u.arrayInfo.elementType, size);
+    if (size == 0)
+        ParseError(c, "no initializers for CONST array");
+    FRequire(c, T_EOL);
+    
+    /* add the symbol on pass 1 */
+    if (c->pass == 1) {
+        byteSize = ValueSize(type, size) * sizeof(VMVALUE);
+        
+        /* place the array in the text section */
+        sym = AddGlobalSymbol(c, name, SC_CONSTANT, type, c->textTarget);
+        c->textTarget->offset += WriteSection(c, c->textTarget, c->cptr, byteSize);
+        
+        /* keep the contents so that references with constant indices can be folded */
+        sym->constData = (uint8_t *)GlobalAlloc(c, byteSize);
+        memcpy(sym->constData, c->cptr, byteSize);
+        sym->constSize = size;
+    }
+}
+
 /* ParseVariableDecl - parse a variable declaration */
 static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize)
 {
@@ -585,7 +660,7 @@ static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize)
             SaveToken(c, tkn);
 
             /* get the array size */
-            expr = ParseExpr(c);
+            expr = ConvertExpr(c, ParseExpr(c), &c->integerType);
 
             /* make sure it's a constant */
             if (!IsIntegerLit(expr) || expr->u.integerLit.value <= 0)
@@ -601,15 +676,8 @@ static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize)
     }
 
     /* check for a type specification */
-    if (tkn == T_AS) {
-        FRequire(c, T_IDENTIFIER);
-        if (strcasecmp(c->token, "INTEGER") == 0)
-            type = &c->integerType;
-        else if (strcasecmp(c->token, "BYTE") == 0)
-            type = &c->byteType;
-        else
-            ParseError(c, "unknown type: %s", c->token);
-    }
+    if (tkn == T_AS)
+        type = ParseTypeName(c);
 
     /* just use the default type */
     else
@@ -624,6 +692,12 @@ static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize)
         case TYPE_BYTE:
             type = &c->byteArrayType;
             break;
+        case TYPE_WORD:
+            type = &c->wordArrayType;
+            break;
+        case TYPE_FIXED:
+            type = &c->fixedArrayType;
+            break;
         default:
             ParseError(c, "unknown type: %d", type->id);
             break;                
@@ -634,10 +708,30 @@ static Type *ParseVariableDecl(ParseContext *c, char *name, VMUVALUE *pSize)
     return type;
 }
 
+/* ParseTypeName - parse the type name following 'AS' */
+static Type *ParseTypeName(ParseContext *c)
+{
+    Type *type;
+    FRequire(c, T_IDENTIFIER);
+    if (strcasecmp(c->token, "INTEGER") == 0)
+        type = &c->integerType;
+    else if (strcasecmp(c->token, "BYTE") == 0)
+        type = &c->byteType;
+    else if (strcasecmp(c->token, "WORD") == 0)
+        type = &c->wordType;
+    else if (strcasecmp(c->token, "FIXED") == 0)
+        type = &c->fixedType;
+    else {
+        ParseError(c, "unknown type: %s", c->token);
+        type = NULL; // never reached
+    }
+    return type;
+}
+
 /* ParseScalarInitializer - parse a scalar initializer */
-static VMVALUE ParseScalarInitializer(ParseContext *c)
+static VMVALUE ParseScalarInitializer(ParseContext *c, Type *type)
 {
-    ParseTreeNode *expr = ParseExpr(c);
+    ParseTreeNode *expr = ConvertExpr(c, ParseExpr(c), type);
     VMVALUE value;
 
     if (IsIntegerLit(expr))
@@ -657,6 +751,7 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
 {
     VMVALUE *wp = (VMVALUE *)c->cptr;
     uint8_t *bp = (uint8_t *)c->cptr;
+    uint16_t *hp = (uint16_t *)c->cptr;
     VMUVALUE remaining = size;
     VMUVALUE count = 0;
     int tkn;
@@ -690,11 +785,12 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
                 --remaining;
         
                 /* get the initializer */
-                initializer = ParseScalarInitializer(c);
+                initializer = ParseScalarInitializer(c, type);
         
                 /* store the initial value */
                 switch (type->id) {
                 case TYPE_INTEGER:
+                case TYPE_FIXED:
                     *wp++ = initializer;
                     if (wp >= (VMVALUE *)c->ctop)
                         ParseError(c, "insufficient data space");
@@ -704,6 +800,11 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
                     if (bp >= (uint8_t *)c->ctop)
                         ParseError(c, "insufficient data space");
                     break;
+                case TYPE_WORD:
+                    *hp++ = initializer;
+                    if (hp >= (uint16_t *)c->ctop)
+                        ParseError(c, "insufficient data space");
+                    break;
                 default:
                     break;
                 }
@@ -755,11 +856,21 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
                 if (wp >= (VMVALUE *)c->ctop)
                     ParseError(c, "insufficient data space");
                 break;
+            case TYPE_FIXED:
+                *wp++ = (VMVALUE)*p++ << FIXED_SHIFT;
+                if (wp >= (VMVALUE *)c->ctop)
+                    ParseError(c, "insufficient data space");
+                break;
             case TYPE_BYTE:
                 *bp++ = *p++;
                 if (bp >= (uint8_t *)c->ctop)
                     ParseError(c, "insufficient data space");
                 break;
+            case TYPE_WORD:
+                *hp++ = *p++;
+                if (hp >= (uint16_t *)c->ctop)
+                    ParseError(c, "insufficient data space");
+                break;
             default:
                 break;
             }
@@ -772,6 +883,7 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
         while (remaining > 0) {
             switch (type->id) {
             case TYPE_INTEGER:
+            case TYPE_FIXED:
                 *wp++ = 0;
                 if (wp >= (VMVALUE *)c->ctop)
                     ParseError(c, "insufficient data space");
@@ -781,6 +893,11 @@ static VMUVALUE ParseArrayInitializers(ParseContext *c, Type *type, VMUVALUE siz
                 if (bp >= (uint8_t *)c->ctop)
                     ParseError(c, "insufficient data space");
                 break;
+            case TYPE_WORD:
+                *hp++ = 0;
+                if (hp >= (uint16_t *)c->ctop)
+                    ParseError(c, "insufficient data space");
+                break;
             default:
                 break;
             }
@@ -802,6 +919,15 @@ static void ClearArrayInitializers(ParseContext *c, VMVALUE size)
     memset(dataPtr, 0, size * sizeof(VMVALUE));
 }
 
+/* CheckWritable - make sure that a statement doesn't store into a CONST array */
+void CheckWritable(ParseContext *c, ParseTreeNode *expr)
+{
+    if (expr->nodeType == NodeTypeArrayRef)
+        expr = expr->u.arrayRef.array;
+    if (expr->nodeType == NodeTypeArrayLit && expr->u.arrayLit.symbol->constData)
+        ParseError(c, "can't store into CONST array '%s'", expr->u.arrayLit.symbol->name);
+}
+
 /* ParseImpliedLetOrFunctionCall - parse an implied let statement or a function call */
 static void ParseImpliedLetOrFunctionCall(ParseContext *c)
 {
@@ -810,9 +936,10 @@ static void ParseImpliedLetOrFunctionCall(ParseContext *c)
     expr = ParsePrimary(c);
     switch (tkn = GetToken(c)) {
     case '=':
+        CheckWritable(c, expr);
         node = NewParseTreeNode(c, NodeTypeLetStatement);
         node->u.letStatement.lvalue = expr;
-        node->u.letStatement.rvalue = ParseExpr(c);
+        node->u.letStatement.rvalue = ConvertExpr(c, ParseExpr(c), expr->type);
         break;
     default:
         SaveToken(c, tkn);
@@ -829,8 +956,9 @@ static void ParseLet(ParseContext *c)
 {
     ParseTreeNode *node = NewParseTreeNode(c, NodeTypeLetStatement);
     node->u.letStatement.lvalue = ParsePrimary(c);
+    CheckWritable(c, node->u.letStatement.lvalue);
     FRequire(c, '=');
-    node->u.letStatement.rvalue = ParseExpr(c);
+    node->u.letStatement.rvalue = ConvertExpr(c, ParseExpr(c), node->u.letStatement.lvalue->type);
     AddNodeToList(c, &c->bptr->pNextStatement, node);
     FRequire(c, T_EOL);
 }
@@ -951,14 +1079,14 @@ static void ParseCase(ParseContext *c)
 
             /* parse the single value or begining of a range */
             entry = (CaseListEntry *)xbLocalAlloc(c->sys, sizeof(CaseListEntry));
-            entry->fromExpr = ParseExpr(c);
+            entry->fromExpr = ConvertExpr(c, ParseExpr(c), c->bptr->node->u.selectStatement.expr->type);
             entry->next = NULL;
             *pNext = entry;
             pNext = &entry->next;
 
             /* handle an 'expr TO expr' range */
             if ((tkn = GetToken(c)) == T_TO) {
-                entry->toExpr = ParseExpr(c);
+                entry->toExpr = ConvertExpr(c, ParseExpr(c), c->bptr->node->u.selectStatement.expr->type);
             }
 
             /* handle a single expression */
@@ -1015,15 +1143,15 @@ static void ParseFor(ParseContext *c)
 
     /* parse the starting value expression */
     FRequire(c, '=');
-    node->u.forStatement.startExpr = ParseExpr(c);
+    node->u.forStatement.startExpr = ConvertExpr(c, ParseExpr(c), node->u.forStatement.var->type);
 
     /* parse the TO expression and generate the loop termination test */
     FRequire(c, T_TO);
-    node->u.forStatement.endExpr = ParseExpr(c);
+    node->u.forStatement.endExpr = ConvertExpr(c, ParseExpr(c), node->u.forStatement.var->type);
 
     /* get the STEP expression */
     if ((tkn = GetToken(c)) == T_STEP) {
-        node->u.forStatement.stepExpr = ParseExpr(c);
+        node->u.forStatement.stepExpr = ConvertExpr(c, ParseExpr(c), node->u.forStatement.var->type);
         tkn = GetToken(c);
     }
     Require(c, tkn, T_EOL);
@@ -1137,6 +1265,10 @@ static void ParseAsm(ParseContext *c)
     int length;
     int tkn;
     
+    /* assembly code may call functions or manipulate the stack frame */
+    c->function->u.functionDefinition.hasCalls = TRUE;
+    c->function->u.functionDefinition.hasAsm = TRUE;
+    
     /* check for the end of the 'ASM' statement */
     FRequire(c, T_EOL);
     
@@ -1194,6 +1326,11 @@ static void Assemble(ParseContext *c, char *name)
             case FMT_SBYTE:
                 putcbyte(c, ParseIntegerConstant(c));
                 break;
+            case FMT_LOCALI:
+                putcbyte(c, ParseIntegerConstant(c));
+                FRequire(c, ',');
+                putcbyte(c, ParseIntegerConstant(c));
+                break;
             case FMT_WORD:
                 putcword(c, ParseIntegerConstant(c));
                 break;
@@ -1306,6 +1443,8 @@ static void ParseReturn(ParseContext *c)
     else {
         SaveToken(c, tkn);
         node->u.returnStatement.expr = ParseExpr(c);
+        if (c->functionType)
+            node->u.returnStatement.expr = ConvertExpr(c, node->u.returnStatement.expr, c->functionType->u.functionInfo.returnType);
         FRequire(c, T_EOL);
     }
     
@@ -1313,6 +1452,21 @@ static void ParseReturn(ParseContext *c)
     AddNodeToList(c, &c->bptr->pNextStatement, node);
 }
 
+/* ParseYield - parse the 'YIELD' statement */
+static void ParseYield(ParseContext *c)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeTrapStatement);
+    
+    /* the other tasks change the link register of a function without a stack frame */
+    c->function->u.functionDefinition.hasCalls = TRUE;
+    
+    node->u.trapStatement.trap = TRAP_YIELD;
+    node->u.trapStatement.expr = NULL;
+    AddNodeToList(c, &c->bptr->pNextStatement, node);
+    
+    FRequire(c, T_EOL);
+}
+
 /* ParseInput - parse the 'INPUT' statement */
 static void ParseInput(ParseContext *c)
 {
@@ -1325,12 +1479,10 @@ static void ParseInput(ParseContext *c)
         FRequire(c, ',');
     }
     
-    /* handle terminal input */
+    /* handle terminal input with the input traps */
     else {
         SaveToken(c, tkn);
-        devExpr = NewParseTreeNode(c, NodeTypeIntegerLit);
-        devExpr->type = &c->integerType;
-        devExpr->u.integerLit.value = 0;
+        devExpr = NULL;
     }
     
     /* peek at the next token */
@@ -1340,12 +1492,12 @@ static void ParseInput(ParseContext *c)
     /* check for a prompt string */
     if (tkn == T_STRING) {
         expr = ParseExpr(c);
-        AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "printStr", devExpr, expr));
+        AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTSTR, "printStr", devExpr, expr));
         FRequire(c, ';');
     }
     
     /* force reading a new line */
-    AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "inputGetLine", devExpr, NULL));
+    AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_INPUTLINE, "inputGetLine", devExpr, NULL));
 
     /* parse each input variable */
     if ((tkn = GetToken(c)) == T_IDENTIFIER) {
@@ -1353,17 +1505,20 @@ static void ParseInput(ParseContext *c)
         do {
             ParseTreeNode *node;
             expr = ParsePrimary(c);
+            CheckWritable(c, expr);
             switch (expr->type->id) {
             case TYPE_INTEGER:
             case TYPE_BYTE:
+            case TYPE_WORD:
+            case TYPE_FIXED:
                 node = NewParseTreeNode(c, NodeTypeLetStatement);
                 node->u.letStatement.lvalue = expr;
-                node->u.letStatement.rvalue = BuildHandlerFunctionCall(c, "inputInt", devExpr, NULL);
+                node->u.letStatement.rvalue = ConvertExpr(c, BuildIOFunctionCall(c, TRAP_INPUTINT, "inputInt", devExpr, NULL), expr->type);
                 AddNodeToList(c, &c->bptr->pNextStatement, node);
                 break;
             case TYPE_ARRAY:
             case TYPE_POINTER:
-                AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "inputStr", devExpr, expr));
+                AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_INPUTSTR, "inputStr", devExpr, expr));
                 break;
             default:
                 ParseError(c, "invalid argument to INPUT");
@@ -1386,23 +1541,28 @@ static void ParsePrint(ParseContext *c)
         FRequire(c, ',');
     }
     
-    /* handle terminal output */
+    /* handle terminal output with the print traps */
     else {
         SaveToken(c, tkn);
-        devExpr = NewParseTreeNode(c, NodeTypeIntegerLit);
-        devExpr->type = &c->integerType;
-        devExpr->u.integerLit.value = 0;
+        devExpr = NULL;
     }
     
     while ((tkn = GetToken(c)) != T_EOL) {
         switch (tkn) {
         case ',':
             needNewline = FALSE;
-            AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "printTab", devExpr, NULL));
+            AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTTAB, "printTab", devExpr, NULL));
             break;
         case ';':
             needNewline = FALSE;
             break;
+        case T_HEX:
+            needNewline = TRUE;
+            FRequire(c, '(');
+            expr = ConvertExpr(c, ParseExpr(c), &c->integerType);
+            FRequire(c, ')');
+            AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTHEX, "printHex", devExpr, expr));
+            break;
         default:
             needNewline = TRUE;
             SaveToken(c, tkn);
@@ -1412,11 +1572,15 @@ static void ParsePrint(ParseContext *c)
             case TYPE_POINTER:
                 if (expr->type->u.pointerInfo.targetType->id != TYPE_BYTE)
                     ParseError(c, "invalid argument to PRINT");
-                AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "printStr", devExpr, expr));
+                AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTSTR, "printStr", devExpr, expr));
                 break;
             case TYPE_INTEGER:
             case TYPE_BYTE:
-                AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "printInt", devExpr, expr));
+            case TYPE_WORD:
+                AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTINT, "printInt", devExpr, expr));
+                break;
+            case TYPE_FIXED:
+                AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTFIXED, "printFixed", devExpr, expr));
                 break;
             default:
                 ParseError(c, "invalid argument to PRINT");
@@ -1427,7 +1591,54 @@ static void ParsePrint(ParseContext *c)
     }
 
     if (needNewline)
-        AddNodeToList(c, &c->bptr->pNextStatement, BuildHandlerCall(c, "printNL", devExpr, NULL));
+        AddNodeToList(c, &c->bptr->pNextStatement, BuildIOCall(c, TRAP_PRINTNL, "printNL", devExpr, NULL));
+}
+
+/* BuildIOCall - compile a terminal trap or a call to a runtime print function for a device */
+static ParseTreeNode *BuildIOCall(ParseContext *c, int trap, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr)
+{
+    ParseTreeNode *node;
+    
+    /* use the handler function for device i/o */
+    if (devExpr)
+        return BuildHandlerCall(c, name, devExpr, expr);
+        
+    /* the string input trap returns the field length */
+    if (trap == TRAP_INPUTSTR) {
+        node = NewParseTreeNode(c, NodeTypeCallStatement);
+        node->u.callStatement.expr = BuildIOFunctionCall(c, trap, name, devExpr, expr);
+    }
+    
+    /* the other traps leave nothing on the stack */
+    else {
+        node = NewParseTreeNode(c, NodeTypeTrapStatement);
+        node->u.trapStatement.trap = trap;
+        node->u.trapStatement.expr = expr;
+    }
+    
+    return node;
+}
+
+/* BuildIOFunctionCall - compile a terminal trap or a call to a runtime input function for a device */
+static ParseTreeNode *BuildIOFunctionCall(ParseContext *c, int trap, char *name, ParseTreeNode *devExpr, ParseTreeNode *expr)
+{
+    NodeListEntry **pNext;
+    ParseTreeNode *node;
+    
+    /* use the handler function for device i/o */
+    if (devExpr)
+        return BuildHandlerFunctionCall(c, name, devExpr, expr);
+        
+    /* build a trap that returns a value */
+    node = NewParseTreeNode(c, NodeTypeIntrinsicCall);
+    node->type = &c->integerType;
+    node->u.intrinsicCall.op = OP_TRAP;
+    node->u.intrinsicCall.operand = trap;
+    pNext = &node->u.intrinsicCall.args;
+    if (expr)
+        AddNodeToList(c, &pNext, expr);
+    
+    return node;
 }
 
 /* BuildHandlerCall - compile a call to a runtime print function */
@@ -1462,6 +1673,7 @@ static ParseTreeNode *BuildHandlerFunctionCall(ParseContext *c, char *name, Pars
     AddDependency(c, symbol);
   
     callNode = NewParseTreeNode(c, NodeTypeFunctionCall);
+    c->function->u.functionDefinition.hasCalls = TRUE;
 
     /* intialize the function call node */
     callNode->type = functionType->u.functionInfo.returnType;
@@ -28,6 +28,19 @@ Symbol *AddGlobalSymbol(ParseContext *c, const char *name, StorageClass storageC
     return sym;
 }
 
+/* AddZeroFilledSymbol - add a global symbol in the zero filled space at the end of a section */
+Symbol *AddZeroFilledSymbol(ParseContext *c, const char *name, StorageClass storageClass, Type *type, Section *section, VMUVALUE size)
+{
+    Symbol *sym;
+    if (ROUND_TO_WORDS(size) > section->size - section->offset - section->zeroSize)
+        ParseError(c, "insufficient %s section space", section->name);
+    sym = AddGlobal(c, &c->globals, name, storageClass, type, section->zeroSize);
+    sym->section = section;
+    sym->zeroFilled = TRUE;
+    section->zeroSize += ROUND_TO_WORDS(size);
+    return sym;
+}
+
 /* AddGlobalOffset - add a global symbol to the symbol table */
 Symbol *AddGlobalOffset(ParseContext *c, const char *name, StorageClass storageClass, Type *type, VMUVALUE offset)
 {
@@ -89,6 +102,9 @@ static Symbol *AddGlobal(ParseContext *c, SymbolTable *table, const char *name,
     strcpy(sym->name, name);
     sym->storageClass = storageClass;
     sym->section = NULL;
+    sym->zeroFilled = FALSE;
+    sym->constData = NULL;
+    sym->constSize = 0;
     sym->type = type;
     sym->v.variable.offset = offset;
     sym->v.variable.fixups = 0;
@@ -119,6 +135,9 @@ Symbol *AddLocal(ParseContext *c, const char *name, Type *type, VMUVALUE offset)
     strcpy(sym->name, name);
     sym->storageClass = SC_LOCAL;
     sym->section = NULL;
+    sym->zeroFilled = FALSE;
+    sym->constData = NULL;
+    sym->constSize = 0;
     sym->type = type;
     sym->v.variable.offset = offset;
     sym->next = NULL;
@@ -161,14 +180,17 @@ void DumpSymbols(ParseContext *c, SymbolTable *table, char *tag)
             switch (sym->storageClass) {
             case SC_CONSTANT:
             case SC_GLOBAL:
-                if (value != UNDEF_VALUE && sym->section)
+                if (value != UNDEF_VALUE && sym->section) {
                     value += sym->section->base;
+                    if (sym->zeroFilled)
+                        value += sym->section->offset;
+                }
                 break;
             default:
                 // no offset
                 break;
             }
-            xbInfo(c->sys, "  %c %c %08x %08x %s\n", "CLTDHR"[sym->storageClass], "IBSAPF"[sym->type->id], value, sym->v.variable.fixups, sym->name);
+            xbInfo(c->sys, "  %c %c %08x %08x %s\n", "CLTDHR"[sym->storageClass], "IBWXSAPF"[sym->type->id], value, sym->v.variable.fixups, sym->name);
         }
     }
 }
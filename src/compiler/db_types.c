@@ -15,6 +15,7 @@ static VMUVALUE ValueByteSize(Type *type);
 Type *NewGlobalType(ParseContext *c, TypeID id)
 {
     Type *type = (Type *)GlobalAlloc(c, sizeof(Type));
+    memset(type, 0, sizeof(Type));
     type->id = id;
     return type;
 }
@@ -30,6 +31,12 @@ Type *ArrayTypeToPointerType(ParseContext *c, Type *type)
     case TYPE_BYTE:
         pointerType = &c->bytePointerType;
         break;
+    case TYPE_WORD:
+        pointerType = &c->wordPointerType;
+        break;
+    case TYPE_FIXED:
+        pointerType = &c->fixedPointerType;
+        break;
     default:
         ParseError(c, "Internal error");
         pointerType = NULL; // never reached
@@ -74,8 +81,8 @@ int CompareTypes(Type *type1, Type *type2)
         }
     }
 
-    /* check for compatible integer types */
-    else if (IsIntegerType(type1) && IsIntegerType(type2))
+    /* check for compatible numeric types */
+    else if (IsNumericType(type1) && IsNumericType(type2))
          match = TRUE;
          
     /* no type id match */
@@ -92,6 +99,9 @@ VMUVALUE ValueSize(Type *type, VMUVALUE size)
 
     switch (type->id) {
     case TYPE_INTEGER:
+    case TYPE_BYTE:
+    case TYPE_WORD:
+    case TYPE_FIXED:
     case TYPE_STRING:
     case TYPE_POINTER:
         valueSize = 1;
@@ -115,6 +125,7 @@ static VMUVALUE ValueByteSize(Type *type)
 
     switch (type->id) {
     case TYPE_INTEGER:
+    case TYPE_FIXED:
     case TYPE_STRING:
     case TYPE_POINTER:
         size = sizeof(VMVALUE);
@@ -122,6 +133,9 @@ static VMUVALUE ValueByteSize(Type *type)
     case TYPE_BYTE:
         size = 1;
         break;
+    case TYPE_WORD:
+        size = 2;
+        break;
     default:
         size = 0;   // not reached
         break;
@@ -130,9 +144,15 @@ static VMUVALUE ValueByteSize(Type *type)
     return size;
 }
 
-/* IsIntegerType - verify that an expression has an integer type (integer or byte) */
+/* IsIntegerType - verify that an expression has an integer type (integer, byte or word) */
 int IsIntegerType(Type *type)
 {
-    return type->id == TYPE_INTEGER || type->id == TYPE_BYTE;
+    return type->id == TYPE_INTEGER || type->id == TYPE_BYTE || type->id == TYPE_WORD;
+}
+
+/* IsNumericType - verify that an expression has a numeric type (integer or fixed point) */
+int IsNumericType(Type *type)
+{
+    return IsIntegerType(type) || type->id == TYPE_FIXED;
 }
 
@@ -33,6 +33,7 @@ int StartImage(ParseContext *c, const char *name)
                 return FALSE;
             section->offset = 0;
         }
+        section->zeroSize = 0;
     }
     
     /* skip past the image header */
@@ -51,6 +52,11 @@ int BuildImage(ParseContext *c, const char *name)
     uint8_t buf[512];
     Section *section;
     
+    /* the data and the zero filled space after it must fit in each section */
+    for (section = c->config->sections; section != NULL; section = section->next)
+        if (section->offset > section->size || section->zeroSize > section->size - section->offset)
+            Fatal(c, "insufficient %s section space\n", section->name);
+
     /* initialize the image file header */
     memset(&fileHdr, 0, sizeof(fileHdr));
     memcpy(fileHdr.tag, IMAGE_TAG, sizeof(fileHdr.tag));
@@ -63,6 +69,7 @@ int BuildImage(ParseContext *c, const char *name)
     fileHdr.sections[0].base = c->textTarget->base;
     fileHdr.sections[0].offset = dataOffset;
     fileHdr.sections[0].size = c->textTarget->offset;
+    fileHdr.sections[0].zeroSize = c->textTarget->zeroSize;
     if (c->flags & COMPILER_INFO)
         ShowSectionInfo(c, &fileHdr.sections[0]);
     /* write the image file header */
@@ -78,6 +85,7 @@ int BuildImage(ParseContext *c, const char *name)
             fileSection.base = section->base;
             fileSection.offset = dataOffset;
             fileSection.size = section->offset;
+            fileSection.zeroSize = section->zeroSize;
             if (c->flags & COMPILER_INFO)
                 ShowSectionInfo(c, &fileSection);
             if (xbWriteFile(c->textTarget->fp, (uint8_t *)&fileSection, sizeof(fileSection)) != sizeof(fileSection))
@@ -118,6 +126,8 @@ static void ShowSectionInfo(ParseContext *c, ImageFileSection *section)
     xbInfo(c->sys, "%08x base\n", section->base);
     xbInfo(c->sys, "%08x file offset\n", section->offset);
     xbInfo(c->sys, "%08x size\n", section->size);
+    if (section->zeroSize > 0)
+        xbInfo(c->sys, "%08x zero filled\n", section->zeroSize);
 }
 
 /* WriteSection - write a block of memory to a section file */
@@ -48,6 +48,11 @@ int xbCompile(const char *infile, const char *outfile, int flags)
     return TRUE;
 }
 
+void xbSetProfile(const char *name)
+{
+    c->profileName = (char *)name;
+}
+
 static void SourceRewind(void *cookie)
 {
     xbSeekFile(cookie, 0, SEEK_SET);
@@ -4,8 +4,16 @@
 /* compiler flags */
 #define COMPILER_DEBUG  (1 << 0)
 #define COMPILER_INFO   (1 << 1)
+#define COMPILER_MAP    (1 << 4)    /* write a statement map for the profiler */
+#define COMPILER_PLACE  (1 << 5)    /* place data in the hub or external ram by access counts */
+
+/* optimization level (0-2) */
+#define COMPILER_OPT_SHIFT      2
+#define COMPILER_OPT_MASK       (3 << COMPILER_OPT_SHIFT)
+#define COMPILER_OPT(level)     ((level) << COMPILER_OPT_SHIFT)
 
 int xbInit(System *sys, BoardConfig *config, size_t maxCode);
 int xbCompile(const char *infile, const char *outfile, int flags);
+void xbSetProfile(const char *name);
 
 #endif
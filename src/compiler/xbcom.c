@@ -19,6 +19,7 @@
 #define DEF_PORT    "/dev/cu.usbserial-A8004ILf"
 #endif
 #define DEF_BOARD   "hub"
+#define DEF_OPT     2
 
 static void Usage(void);
 static char *ConstructOutputName(const char *infile, char *outfile, char *ext);
@@ -33,15 +34,15 @@ static SystemOps myOps = {
 int main(int argc, char *argv[])
 {
     char *infile = NULL, outfile[PATH_MAX];
-    char *port, *board, *p;
+    char *port, *board, *profile = NULL, *p;
     BoardConfig *config;
     int writeEepromLoader = FALSE;
     int runImage = FALSE;
     int terminalMode = FALSE;
-    int compilerFlags = 0;
+    int compilerFlags = COMPILER_OPT(DEF_OPT);
     int runFlags = 0;
     System *sys;
-    int i;
+    int level, i;
     
     /* get the environment settings */
     if (!(port = getenv("PORT")))
@@ -104,6 +105,26 @@ int main(int argc, char *argv[])
             case 'v':
                 compilerFlags |= COMPILER_INFO;
                 break;
+            case 'O':   // select an optimization level
+                level = argv[i][2] ? atoi(&argv[i][2]) : DEF_OPT;
+                if (level < 0 || level > 2)
+                    Usage();
+                compilerFlags = (compilerFlags & ~COMPILER_OPT_MASK) | COMPILER_OPT(level);
+                break;
+            case 'g':   // write a statement map for the profiler
+                compilerFlags |= COMPILER_MAP;
+                break;
+            case 'a':   // place data in the hub or external ram by access counts
+                compilerFlags |= COMPILER_PLACE;
+                break;
+            case 'P':   // optimize using an execution profile
+                if (argv[i][2])
+                    profile = &argv[i][2];
+                else if (++i < argc)
+                    profile = argv[i];
+                else
+                    Usage();
+                break;
             case 'I':
                 if(argv[i][2])
                     p = &argv[i][2];
@@ -164,6 +185,8 @@ int main(int argc, char *argv[])
         fprintf(stderr, "error: compiler initialization failed\n");
         return 1;
     }
+    if (profile)
+        xbSetProfile(profile);
         
     /* compile the source file */
     if (!xbCompile(infile, outfile, compilerFlags))
@@ -224,9 +247,13 @@ usage: xbcom\n\
          [ -d ]          add a delay to allow the terminal emulator to start\n\
          [ -D ]          display compiler debug information\n\
          [ -v ]          display verbose compiler statistics\n\
+         [ -O<n> ]       optimization level (0 | 1 | 2) (default is %d)\n\
+         [ -g ]          write a statement map for profiling with xbint -p\n\
+         [ -P <file> ]   optimize using a profile written by xbint -p\n\
+         [ -a ]          place data in the hub or external ram by access counts\n\
          [ -I <path> ]   set the path for include files\n\
          <name>          file to compile\n\
-", DEF_PORT);
+", DEF_PORT, DEF_OPT);
     exit(1);
 }
 
@@ -12,6 +12,9 @@
 /* maximum cog image size */
 #define COG_IMAGE_MAX           (496 * 4)
 
+/* maximum vm image size including the hub resident lmm code (see vm_code in hub_loader.spin and flash_loader.spin) */
+#define VM_IMAGE_MAX            (1024 * 4)
+
 /* spin object file header */
 typedef struct {
     uint32_t clkfreq;
@@ -105,6 +108,7 @@ int LoadImage(System *sys, BoardConfig *config, char *port, char *path)
     SpinObj *obj = (SpinObj *)(serial_helper_array + hdr->objstart);
     SerialHelperDatHdr *dat = (SerialHelperDatHdr *)((uint8_t *)obj + (obj->pubcnt + obj->objcnt) * sizeof(uint32_t));
     uint8_t cacheDriverImage[COG_IMAGE_MAX];
+    uint32_t vmSize = (xbasic_vm_size + 3) & ~3;
     int imageSize, chksum, i;
 	
     /* patch serial helper for clock mode and frequency */
@@ -144,11 +148,11 @@ int LoadImage(System *sys, BoardConfig *config, char *port, char *path)
             return Error("Loading cache driver failed");
     }
     
-    /* load the vm */
+    /* load the vm and tell the helper its size so the data starts after its hub resident code */
 	printf("Loading VM\n");
     if (!SendPacket(TYPE_HUB_WRITE, (uint8_t *)"", 0)
     ||  !WriteBuffer(xbasic_vm_array, xbasic_vm_size)
-    ||  !SendPacket(TYPE_VM_INIT, (uint8_t *)"", 0))
+    ||  !SendPacket(TYPE_VM_INIT, (uint8_t *)&vmSize, sizeof(vmSize)))
         return Error("Loading VM failed");
     
     /* write the image to memory */
@@ -179,6 +183,8 @@ int WriteHubLoaderToEEPROM(System *sys, BoardConfig *config, char *port, char *p
 	dat->txpin = config->txpin;
     
     /* copy the vm image to the binary file */
+    if (xbasic_vm_size > VM_IMAGE_MAX)
+        return Error("vm image too large");
     memcpy((uint8_t *)dat + dat->vm_code_off, xbasic_vm_array, xbasic_vm_size);
     
     /* open the image file */
@@ -198,6 +204,10 @@ int WriteHubLoaderToEEPROM(System *sys, BoardConfig *config, char *port, char *p
     if (fread((uint8_t *)dat + dat->image_off, 1, size, fp) != size)
         return Error("can't read image file");
         
+    /* make sure there is room for the zero filled space that follows the image */
+    if (size + ((ImageFileHdr *)((uint8_t *)dat + dat->image_off))->sections[0].zeroSize > dat->max_image_size)
+        return Error("image too large");
+        
     /* close the input file */
     fclose(fp);
 
@@ -234,6 +244,8 @@ int WriteFlashLoaderToEEPROM(System *sys, BoardConfig *config, char *port)
 	dat->txpin = config->txpin;
     
     /* copy the vm image to the binary file */
+    if (xbasic_vm_size > VM_IMAGE_MAX)
+        return Error("vm image too large");
     memcpy((uint8_t *)dat + dat->vm_code_off, xbasic_vm_array, xbasic_vm_size);
     
     /* copy the cache driver image to the binary file */
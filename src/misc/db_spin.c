@@ -76,6 +76,7 @@ void WriteSpinFile(BoardConfig *config, const char *imagefile, const char *spinf
         fprintf(ofp, "  loader_stack_size = 32 * 4\n");
     }
     else {
+        fprintf(ofp, "  zero_size = %d\n", hdr.sections[0].zeroSize);
         fprintf(ofp, "  stack_size = %d\n", hdr.stackSize);
         fprintf(ofp, "\n");
         fprintf(ofp, "  vm_mbox = hub_memory_size - vm_mbox_size\n");
@@ -121,6 +122,8 @@ void WriteSpinFile(BoardConfig *config, const char *imagefile, const char *spinf
         }
         if (cnt > 0)
             putc('\n', ofp);
+        fprintf(ofp, "\nzero_fill\n");
+        fprintf(ofp, "  byte 0[zero_size]\n");
         fprintf(ofp, "\nstack\n");
         fprintf(ofp, "  long 0[stack_size]\n");
     }
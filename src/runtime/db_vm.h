@@ -15,23 +15,91 @@
 
 /* forward type declarations */
 typedef struct Interpreter Interpreter;
+typedef struct Profile Profile;
+typedef struct Cache Cache;
+typedef struct VMIO VMIO;
+typedef struct Hub Hub;
+
+/* size of the line buffer used by the INPUT traps */
+#define INPUT_MAX   128
+
+/* clock frequency in the first long of the emulated hub */
+#define VM_CLKFREQ  80000000
+
+/* approximate number of cycles the cog takes to execute a VM instruction */
+#define VM_OP_CYCLES    48
+
+/* number of cog registers */
+#define COG_REGS    512
+
+/* number of cogs */
+#define COG_COUNT   8
+
+/* the interpreter loop returns this at the end of a time slice */
+#define VM_YIELD    2
+
+/* number of cooperative tasks in an interpreter including the one that starts the others */
+#define TASK_MAX        8
+
+/* smallest slice of the stack a task can run on (in VMVALUEs) */
+#define TASK_MIN_STACK  8
+
+/* task states */
+#define TASK_FREE       0       /* the task has ended and its stack can be reused */
+#define TASK_READY      1
+#define TASK_WAITING    2       /* the task is waiting for terminal input */
+
+/* cogs started by the program run on host threads unless the scheduler runs them */
+#if !defined(WIN32)
+#define VM_THREADS
+#endif
 
 /* intrinsic function handler type */
 typedef void IntrinsicFcn(Interpreter *i);
 
+/* registers of a task while another task runs */
+typedef struct {
+    int state;
+    uint8_t *pc;
+    VMVALUE *fp;
+    VMVALUE *sp;
+    VMVALUE tos;
+    VMVALUE link;
+    VMVALUE *stack;             /* bottom of the task's slice of the stack */
+    VMVALUE *stackTop;          /* top of the task's slice of the stack */
+} Task;
+
 /* interpreter state structure */
 struct Interpreter {
     System *sys;
     ImageHdr *image;
     jmp_buf errorTarget;
+    VMVALUE *stackBase;         /* the frame links are offsets from here */
     VMVALUE *stack;
     VMVALUE *stackTop;
     uint8_t *pc;
     VMVALUE *fp;
     VMVALUE *sp;
     VMVALUE tos;
-    int argc;
+    VMVALUE link;
     int linePos;
+    char inputLine[INPUT_MAX];  /* line read by TRAP_INPUTLINE */
+    char *inputPtr;             /* next input field */
+    VMIO *io;                   /* terminal i/o */
+    Profile *profile;
+    Cache *cache;               /* external memory cache simulator */
+    Hub *hub;                   /* emulated hub memory and locks */
+    VMVALUE cogRegs[COG_REGS];  /* emulated cog registers */
+    int cogId;                  /* id of the emulated cog */
+    int flags;                  /* z and c flags kept between native instructions */
+    VMUVALUE cnt;               /* virtual system counter */
+    int quantum;                /* instructions in a scheduler time slice or zero to use threads */
+    int slice;                  /* instructions left in the time slice or zero */
+    unsigned long limit;        /* instructions left before the program is stopped or zero */
+    int hubLocked;              /* nesting of LockHub calls */
+    Task tasks[TASK_MAX];       /* cooperative tasks */
+    int taskCount;              /* tasks started including the first or zero */
+    int task;                   /* index of the running task */
 };
 
 /* stack manipulation macros */
@@ -58,6 +126,15 @@ struct Interpreter {
 /* prototypes for xbint.c */
 void Fatal(System *sys, const char *fmt, ...);
 
+/* prototypes from db_vmcache.c */
+Cache *InitCache(System *sys, ImageHdr *image, const char *spec, int tune);
+void CacheInstruction(Cache *c, uint8_t *pc, VMVALUE tos);
+void CacheAccess(Cache *c, VMUVALUE addr, VMUVALUE size, int write);
+void CacheBlock(Cache *c, VMUVALUE addr, VMUVALUE count, int size, int write);
+void CacheCopy(Cache *c, VMUVALUE dst, VMUVALUE src, VMUVALUE count, int size, int write);
+int WriteCacheStats(Cache *c, const char *name);
+int WriteCacheTuning(Cache *c, const char *name);
+
 /* prototypes from db_vmimage.c */
 ImageHdr *LoadImage(System *sys, const char *name);
 
@@ -68,11 +145,48 @@ void Abort(Interpreter *i, const char *fmt, ...);
 void StackOverflow(Interpreter *i);
 void ShowStack(Interpreter *i);
 
+/* prototypes from db_vmio.c */
+VMIO *InitConsoleIO(System *sys);
+VMIO *InitFileIO(System *sys, FILE *in, FILE *out);
+void SetIOFlush(VMIO *io, int threshold, int flushOnNewline);
+void IOPutC(VMIO *io, int ch);
+int IOGetC(VMIO *io);
+int IOReady(VMIO *io);
+void IOWait(VMIO *io);
+int IOGetLine(VMIO *io, char *buf, int size);
+void FlushIO(VMIO *io);
+
+/* prototypes from db_vmnative.c */
+int InitHub(Interpreter *i);
+VMUVALUE HubAddress(Interpreter *i, VMUVALUE addr);
+VMVALUE ReadHub(Interpreter *i, VMUVALUE addr, int size);
+VMVALUE ReadCogRegister(Interpreter *i, int reg);
+void WriteCogRegister(Interpreter *i, int reg, VMVALUE value);
+void DoNative(Interpreter *i, VMUVALUE inst);
+Interpreter *NewCog(Interpreter *i);
+void StopCog(Interpreter *cog);
+void StopCogs(Interpreter *i);
+int StopRequested(Interpreter *cog);
+Interpreter *NextCog(Interpreter *i);
+void WaitCount(Interpreter *i, VMUVALUE target);
+void LockHub(Interpreter *i);
+void UnlockHub(Interpreter *i);
+void ReleaseHub(Interpreter *i);
+int WriteCogStats(Interpreter *i, const char *name);
+
+/* prototypes from db_vmprof.c */
+Profile *InitProfile(System *sys, ImageHdr *image, const char *imageName);
+void ProfileInstruction(Profile *p, uint8_t *pc);
+int WriteProfile(Profile *p, const char *name);
+
+/* prototypes from db_vmverify.c */
+int VerifyCode(Interpreter *i);
+
 /* prototypes and variables from db_vmfcn.c */
 extern IntrinsicFcn * FLASH_SPACE Intrinsics[];
 extern int IntrinsicCount;
 
-void VM_getline(char *buf, int size);
+int VM_getline(char *buf, int size);
 int VM_getchar(void);
 void VM_putchar(int ch);
 
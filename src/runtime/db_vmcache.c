@@ -0,0 +1,601 @@
+/* db_vmcache.c - external memory cache simulator
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * Boards that keep code or data in external memory reach it through a
+ * JCACHE driver (see cache_interface.spin).  The VM remembers the line it
+ * last asked the driver for and reads from it without asking again while
+ * the address stays in that line.  Every other read and every write is a
+ * request in the driver's mailbox.  The driver keeps a set of lines in hub
+ * memory and fills a line from the chips on a miss, first writing back
+ * the line it replaces if that line was written.  The simulator replays
+ * the accesses the interpreter makes to external sections through a model
+ * of both and counts the cycles the VM waits for the driver.  It can also
+ * replay them through caches of other sizes to recommend a cache-size.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "db_vm.h"
+#include "db_vmdebug.h"
+
+/* kinds of access */
+#define KIND_CODE       0
+#define KIND_DATA       1
+#define KIND_COUNT      2
+
+/* line tag of an empty line */
+#define NO_LINE         0xffffffff
+
+/* sizes and line sizes tried when tuning */
+#define TUNE_MIN_SIZE   1024
+#define TUNE_MAX_SIZE   (16 * 1024)
+#define TUNE_MIN_LINE   32
+#define TUNE_MAX_LINE   256
+
+/* a size is recommended when its stall cycles are within this percentage of the fewest */
+#define TUNE_SLACK      10
+
+/* defaults for a cache driver */
+typedef struct {
+    char *name;                 /* driver file named by cache-driver in xbasic.cfg */
+    int indexBits;              /* default index width (cache-param1) */
+    int offsetBits;             /* default offset width (cache-param2) */
+    int split;                  /* flash and ram addresses have separate sets of lines */
+    int requestCycles;          /* cycles for a request that hits */
+    int lineCycles;             /* cycles to start a line transfer */
+    int byteCycles;             /* cycles for each byte transferred */
+} CacheDriver;
+
+/* the timing comes from the SPI loops of the drivers */
+static CacheDriver drivers[] = {
+{   "C3_CACHE.DAT",     5,  7,  TRUE,   150,    800,    168 },
+{   "SSF_CACHE.DAT",    6,  7,  FALSE,  150,    300,    16  },
+{   NULL,               0,  0,  FALSE,  0,      0,      0   }
+};
+
+/* cache geometry and timing */
+typedef struct {
+    VMUVALUE size;              /* hub memory used by the lines */
+    VMUVALUE lineSize;          /* bytes in a line */
+    int lineBits;               /* log2 of lineSize */
+    VMUVALUE sets;              /* sets of lines for each kind of memory */
+    int ways;                   /* lines in a set */
+    int split;                  /* flash and ram addresses have separate sets of lines */
+    int requestCycles;
+    int lineCycles;
+    int byteCycles;
+} CacheModel;
+
+/* line in the driver's cache */
+typedef struct {
+    VMUVALUE tag;               /* line number or NO_LINE */
+    int dirty;                  /* the line was written and must be written back */
+    unsigned long used;         /* time of the last access for choosing a line to replace */
+} CacheLine;
+
+/* access counts */
+typedef struct {
+    unsigned long reads;        /* lines read by the VM */
+    unsigned long writes;       /* values written by the VM */
+    unsigned long buffered;     /* reads from the line the VM asked for last */
+    unsigned long requests;     /* requests made to the driver */
+    unsigned long misses;       /* lines filled from the chips */
+    unsigned long writebacks;   /* lines written back to the chips */
+} CacheCounts;
+
+/* simulated cache */
+typedef struct {
+    CacheModel model;
+    VMUVALUE vmLine;            /* line the VM asked the driver for last */
+    CacheLine *lines;
+    unsigned long time;
+    CacheCounts counts[KIND_COUNT];
+} SimCache;
+
+/* simulator state */
+struct Cache {
+    System *sys;
+    uint8_t *code;              /* text section data */
+    VMUVALUE base;              /* text section base address */
+    VMUVALUE size;              /* text section size */
+    uint8_t lengths[256];       /* instruction lengths indexed by opcode */
+    SimCache *caches;           /* the model followed by the sizes tried when tuning */
+    int cacheCount;
+};
+
+static void ParseModel(Cache *c, const char *spec, CacheModel *model);
+static VMUVALUE ParseSize(Cache *c, const char *value);
+static void SetGeometry(Cache *c, CacheModel *model, VMUVALUE size, VMUVALUE lineSize, int ways);
+static void InitSimCache(Cache *c, SimCache *cache, CacheModel *model);
+static void Access(Cache *c, VMUVALUE addr, VMUVALUE size, int write, int kind);
+static void Request(SimCache *cache, VMUVALUE addr, int write, CacheCounts *counts);
+static void SumCounts(SimCache *cache, CacheCounts *total);
+static unsigned long long StallCycles(CacheModel *model, CacheCounts *counts);
+static int Log2(VMUVALUE n);
+static void WriteSize(FILE *fp, VMUVALUE size);
+static void *CacheAlloc(Cache *c, size_t size);
+
+/* InitCache - start simulating the external memory cache described by a model */
+Cache *InitCache(System *sys, ImageHdr *image, const char *spec, int tune)
+{
+    VMUVALUE size, lineSize;
+    CacheModel model;
+    FLASH_SPACE OTDEF *op;
+    int n;
+    Cache *c;
+
+    /* allocate the simulator state */
+    if (!(c = (Cache *)xbGlobalAlloc(sys, sizeof(Cache))))
+        return NULL;
+    memset(c, 0, sizeof(Cache));
+    c->sys = sys;
+
+    /* the text section is always the first section */
+    c->code = image->sections[0].data;
+    c->base = image->sections[0].fileSection->base;
+    c->size = image->sections[0].fileSection->size;
+
+    /* the VM fetches each byte of an instruction */
+    for (op = OpcodeTable; op->name; ++op) {
+        switch (op->fmt) {
+        case FMT_NONE:      n = 1; break;
+        case FMT_BYTE:
+        case FMT_SBYTE:     n = 2; break;
+        case FMT_CALL:      n = 2 + sizeof(VMVALUE); break;
+        case FMT_LOCALI:    n = 3; break;
+        case FMT_SWITCH:    n = 1 + 2 * sizeof(VMVALUE); break;
+        default:            n = 1 + sizeof(VMVALUE); break;
+        }
+        c->lengths[op->code] = n;
+    }
+
+    /* the model is first and the tuning sizes follow */
+    ParseModel(c, spec, &model);
+    c->cacheCount = 1;
+    if (tune) {
+        for (size = TUNE_MIN_SIZE; size <= TUNE_MAX_SIZE; size <<= 1)
+            for (lineSize = TUNE_MIN_LINE; lineSize <= TUNE_MAX_LINE; lineSize <<= 1)
+                ++c->cacheCount;
+    }
+    c->caches = (SimCache *)CacheAlloc(c, c->cacheCount * sizeof(SimCache));
+    InitSimCache(c, &c->caches[0], &model);
+    if (tune) {
+        n = 1;
+        for (size = TUNE_MIN_SIZE; size <= TUNE_MAX_SIZE; size <<= 1)
+            for (lineSize = TUNE_MIN_LINE; lineSize <= TUNE_MAX_LINE; lineSize <<= 1) {
+                CacheModel tuneModel = model;
+                SetGeometry(c, &tuneModel, size, lineSize, model.ways);
+                InitSimCache(c, &c->caches[n++], &tuneModel);
+            }
+    }
+
+    /* return the simulator state */
+    return c;
+}
+
+/* CacheInstruction - replay the fetch of the instruction at pc */
+void CacheInstruction(Cache *c, uint8_t *pc, VMVALUE tos)
+{
+    VMUVALUE offset = (VMUVALUE)(pc - c->code), addr, low, count, index;
+    int n;
+
+    /* only code in external memory goes through the cache */
+    if (c->base < RAM_BASE || offset >= c->size)
+        return;
+    addr = c->base + offset;
+
+    /* a switch reads one entry of its table after the header */
+    if (VMCODEBYTE(pc) == OP_SWITCH) {
+        for (low = 0, n = 1; n <= sizeof(VMVALUE); ++n)
+            low = (low << 8) | VMCODEBYTE(pc + n);
+        for (count = 0; n <= 2 * sizeof(VMVALUE); ++n)
+            count = (count << 8) | VMCODEBYTE(pc + n);
+        index = (VMUVALUE)tos - low;
+        n = c->lengths[OP_SWITCH];
+        Access(c, addr, n, FALSE, KIND_CODE);
+        Access(c, addr + n + (index < count ? (index + 1) * sizeof(VMVALUE) : 0), sizeof(VMVALUE), FALSE, KIND_CODE);
+    }
+    else
+        Access(c, addr, c->lengths[VMCODEBYTE(pc)] ? c->lengths[VMCODEBYTE(pc)] : 1, FALSE, KIND_CODE);
+}
+
+/* CacheAccess - replay a read of size bytes or a write of a value */
+void CacheAccess(Cache *c, VMUVALUE addr, VMUVALUE size, int write)
+{
+    Access(c, addr, size, write, KIND_DATA);
+}
+
+/* CacheBlock - replay the reads or writes of the elements of a block */
+void CacheBlock(Cache *c, VMUVALUE addr, VMUVALUE count, int size, int write)
+{
+    if (!write)
+        Access(c, addr, count * size, FALSE, KIND_DATA);
+    else {
+        for (; count > 0; --count, addr += size)
+            Access(c, addr, size, TRUE, KIND_DATA);
+    }
+}
+
+/* CacheCopy - replay a read of each element of one block followed by a read or write of the same element of another */
+void CacheCopy(Cache *c, VMUVALUE dst, VMUVALUE src, VMUVALUE count, int size, int write)
+{
+    /* the elements only alternate between lines when both blocks are external */
+    if (dst < RAM_BASE || src < RAM_BASE) {
+        CacheBlock(c, src, count, size, FALSE);
+        CacheBlock(c, dst, count, size, write);
+    }
+    else {
+        for (; count > 0; --count, src += size, dst += size) {
+            Access(c, src, size, FALSE, KIND_DATA);
+            Access(c, dst, size, write, KIND_DATA);
+        }
+    }
+}
+
+/* WriteCacheStats - write the hit rates and stall cycles of the model */
+int WriteCacheStats(Cache *c, const char *name)
+{
+    static char *kindNames[KIND_COUNT] = { "code", "data" };
+    SimCache *cache = &c->caches[0];
+    CacheModel *model = &cache->model;
+    CacheCounts *counts, total;
+    unsigned long long stall;
+    int kind;
+    FILE *fp;
+
+    if (!(fp = fopen(name, "w")))
+        return FALSE;
+
+    fprintf(fp, "cache: ");
+    WriteSize(fp, model->size);
+    fprintf(fp, ", %lu byte lines, ", (unsigned long)model->lineSize);
+    if (model->ways == 1)
+        fprintf(fp, "direct mapped");
+    else
+        fprintf(fp, "%d way", model->ways);
+    fprintf(fp, "%s\n", model->split ? ", separate flash and ram lines" : "");
+    fprintf(fp, "timing: %d cycles a request, %d + %d a byte to transfer a line\n\n",
+            model->requestCycles, model->lineCycles, model->byteCycles);
+
+    fprintf(fp, "kind        reads     writes   buffered   requests     misses writebacks  hit rate     stall cycles\n");
+    SumCounts(cache, &total);
+    for (kind = 0; kind <= KIND_COUNT; ++kind) {
+        counts = (kind < KIND_COUNT ? &cache->counts[kind] : &total);
+        stall = StallCycles(model, counts);
+        fprintf(fp, "%-6s %10lu %10lu %10lu %10lu %10lu %10lu %8.2f%% %16llu\n",
+                kind < KIND_COUNT ? kindNames[kind] : "total",
+                counts->reads, counts->writes, counts->buffered, counts->requests, counts->misses, counts->writebacks,
+                counts->requests ? 100.0 * (counts->requests - counts->misses) / counts->requests : 100.0,
+                stall);
+    }
+    fprintf(fp, "\nstall time: %.3f ms at %d Hz\n", (double)StallCycles(model, &total) * 1000.0 / VM_CLKFREQ, VM_CLKFREQ);
+
+    fclose(fp);
+    return TRUE;
+}
+
+/* WriteCacheTuning - write the stall cycles of each size tried and recommend a cache-size */
+int WriteCacheTuning(Cache *c, const char *name)
+{
+    unsigned long long stall, fewest, bestStall = 0, modelStall;
+    SimCache *cache, *best = NULL;
+    CacheCounts total;
+    int n, indexBits;
+    FILE *fp;
+
+    if (c->cacheCount <= 1 || !(fp = fopen(name, "w")))
+        return FALSE;
+
+    /* find the fewest stall cycles */
+    fewest = ~0ULL;
+    for (n = 1; n < c->cacheCount; ++n) {
+        cache = &c->caches[n];
+        if (cache->lines) {
+            SumCounts(cache, &total);
+            if ((stall = StallCycles(&cache->model, &total)) < fewest)
+                fewest = stall;
+        }
+    }
+
+    /* recommend the smallest size that comes close and the best line size for it */
+    fprintf(fp, "cache-size  line  param1  param2   requests     misses  hit rate     stall cycles\n");
+    for (n = 1; n < c->cacheCount; ++n) {
+        cache = &c->caches[n];
+        if (!cache->lines)
+            continue;
+        SumCounts(cache, &total);
+        stall = StallCycles(&cache->model, &total);
+        indexBits = Log2(cache->model.sets);
+        fprintf(fp, "%9luK %5lu %7d %7d %10lu %10lu %8.2f%% %16llu\n",
+                (unsigned long)cache->model.size / 1024, (unsigned long)cache->model.lineSize,
+                indexBits, cache->model.lineBits, total.requests, total.misses,
+                total.requests ? 100.0 * (total.requests - total.misses) / total.requests : 100.0,
+                stall);
+        if (stall - fewest <= fewest / 100 * TUNE_SLACK
+        &&  (!best || (cache->model.size == best->model.size && stall < bestStall))) {
+            best = cache;
+            bestStall = stall;
+        }
+    }
+
+    /* compare the recommendation with the model */
+    SumCounts(&c->caches[0], &total);
+    modelStall = StallCycles(&c->caches[0].model, &total);
+    fprintf(fp, "\nmodel: ");
+    WriteSize(fp, c->caches[0].model.size);
+    fprintf(fp, " with %lu byte lines, %llu stall cycles\n", (unsigned long)c->caches[0].model.lineSize, modelStall);
+    if (best) {
+        fprintf(fp, "recommended (within %d%% of the fewest stall cycles): %llu stall cycles\n",
+                TUNE_SLACK, bestStall);
+        fprintf(fp, "    cache-size: %luK\n", (unsigned long)best->model.size / 1024);
+        if (best->model.ways == 1) {
+            fprintf(fp, "    cache-param1: %d\n", Log2(best->model.sets));
+            fprintf(fp, "    cache-param2: %d\n", best->model.lineBits);
+        }
+        else
+            fprintf(fp, "    (the cache drivers are direct mapped so there are no cache-params for %d way lines)\n", best->model.ways);
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
+/* ParseModel - parse a model given as a board name and key=value settings separated by commas */
+static void ParseModel(Cache *c, const char *spec, CacheModel *model)
+{
+    char buf[128], *item, *value, *next;
+    CacheDriver *driver = drivers;
+    int indexBits, offsetBits, ways = 1;
+    VMUVALUE size = 0, lineSize = 0;
+    BoardConfig *config;
+
+    if (strlen(spec) >= sizeof(buf))
+        Fatal(c->sys, "cache model too long");
+    strcpy(buf, spec);
+
+    /* start with the cache of a board from xbasic.cfg or with the first driver */
+    item = buf;
+    if ((next = strchr(item, ',')) != NULL)
+        *next++ = '\0';
+    if (*item != '\0' && !strchr(item, '=')) {
+        if (!(config = GetBoardConfig(item)))
+            Fatal(c->sys, "no board named '%s' in xbasic.cfg", item);
+        if (!config->cacheDriver)
+            Fatal(c->sys, "board '%s' has no cache", item);
+        for (driver = drivers; driver->name; ++driver)
+            if (strcasecmp(config->cacheDriver, driver->name) == 0)
+                break;
+        if (!driver->name)
+            Fatal(c->sys, "no model of cache driver '%s'", config->cacheDriver);
+        indexBits = config->cacheParam1 ? config->cacheParam1 : driver->indexBits;
+        offsetBits = config->cacheParam2 ? config->cacheParam2 : driver->offsetBits;
+        item = next;
+    }
+    else {
+        indexBits = driver->indexBits;
+        offsetBits = driver->offsetBits;
+        if (*item == '\0')
+            item = next;
+    }
+    model->split = driver->split;
+    model->requestCycles = driver->requestCycles;
+    model->lineCycles = driver->lineCycles;
+    model->byteCycles = driver->byteCycles;
+
+    /* apply the settings */
+    for (; item; item = next) {
+        if ((next = strchr(item, ',')) != NULL)
+            *next++ = '\0';
+        if (!(value = strchr(item, '=')))
+            Fatal(c->sys, "expecting key=value in cache model: %s", item);
+        *value++ = '\0';
+        if (strcasecmp(item, "size") == 0)
+            size = ParseSize(c, value);
+        else if (strcasecmp(item, "line") == 0)
+            lineSize = ParseSize(c, value);
+        else if (strcasecmp(item, "ways") == 0)
+            ways = (int)ParseSize(c, value);
+        else if (strcasecmp(item, "request") == 0)
+            model->requestCycles = (int)ParseSize(c, value);
+        else if (strcasecmp(item, "miss") == 0)
+            model->lineCycles = (int)ParseSize(c, value);
+        else if (strcasecmp(item, "byte") == 0)
+            model->byteCycles = (int)ParseSize(c, value);
+        else
+            Fatal(c->sys, "unknown cache model setting: %s", item);
+    }
+
+    /* the size and line size default to those of the driver's parameters */
+    if (!lineSize)
+        lineSize = (VMUVALUE)1 << offsetBits;
+    if (!size)
+        size = ((VMUVALUE)1 << (indexBits + offsetBits)) * (model->split ? 2 : 1);
+    SetGeometry(c, model, size, lineSize, ways);
+    if (!model->sets)
+        Fatal(c->sys, "cache of %lu bytes too small for %d lines of %lu bytes",
+              (unsigned long)size, ways * (model->split ? 2 : 1), (unsigned long)lineSize);
+}
+
+/* ParseSize - parse a number with an optional K or M suffix */
+static VMUVALUE ParseSize(Cache *c, const char *value)
+{
+    unsigned long n;
+    char *end;
+    n = strtoul(value, &end, 10);
+    switch (toupper((unsigned char)*end)) {
+    case 'K':
+        n *= 1024;
+        ++end;
+        break;
+    case 'M':
+        n *= 1024 * 1024;
+        ++end;
+        break;
+    }
+    if (end == value || *end != '\0')
+        Fatal(c->sys, "invalid number in cache model: %s", value);
+    return (VMUVALUE)n;
+}
+
+/* SetGeometry - set the size, line size and ways of a model or clear its sets if they don't fit */
+static void SetGeometry(Cache *c, CacheModel *model, VMUVALUE size, VMUVALUE lineSize, int ways)
+{
+    VMUVALUE lines;
+    if (Log2(lineSize) < 2 || ways <= 0 || (ways & (ways - 1)) != 0 || (size & (size - 1)) != 0)
+        Fatal(c->sys, "cache sizes, line sizes and ways must be powers of two");
+    model->size = size;
+    model->lineSize = lineSize;
+    model->lineBits = Log2(lineSize);
+    model->ways = ways;
+    lines = size / lineSize / (model->split ? 2 : 1);
+    model->sets = lines / ways;
+}
+
+/* InitSimCache - empty the lines of a cache */
+static void InitSimCache(Cache *c, SimCache *cache, CacheModel *model)
+{
+    VMUVALUE count, j;
+    memset(cache, 0, sizeof(SimCache));
+    cache->model = *model;
+    cache->vmLine = NO_LINE;
+    if (model->sets) {
+        count = model->sets * model->ways * (model->split ? 2 : 1);
+        cache->lines = (CacheLine *)CacheAlloc(c, count * sizeof(CacheLine));
+        memset(cache->lines, 0, count * sizeof(CacheLine));
+        for (j = 0; j < count; ++j)
+            cache->lines[j].tag = NO_LINE;
+    }
+}
+
+/* Access - replay a read of size bytes or a write of a value through each cache */
+static void Access(Cache *c, VMUVALUE addr, VMUVALUE size, int write, int kind)
+{
+    SimCache *cache, *end = c->caches + c->cacheCount;
+    VMUVALUE line, last;
+    CacheCounts *counts;
+
+    /* the hub and the cog registers are not cached */
+    if (addr < RAM_BASE || size == 0)
+        return;
+
+    for (cache = c->caches; cache < end; ++cache) {
+        if (!cache->lines)
+            continue;
+        counts = &cache->counts[kind];
+
+        /* every write is a request */
+        if (write) {
+            ++counts->writes;
+            cache->vmLine = addr >> cache->model.lineBits;
+            Request(cache, addr, TRUE, counts);
+            continue;
+        }
+
+        /* reads from the line the VM asked for last don't need a request */
+        last = (addr + size - 1) >> cache->model.lineBits;
+        for (line = addr >> cache->model.lineBits; line <= last; ++line) {
+            ++counts->reads;
+            if (line == cache->vmLine)
+                ++counts->buffered;
+            else {
+                cache->vmLine = line;
+                Request(cache, line << cache->model.lineBits, FALSE, counts);
+            }
+        }
+    }
+}
+
+/* Request - look up a line in the driver's cache filling it on a miss */
+static void Request(SimCache *cache, VMUVALUE addr, int write, CacheCounts *counts)
+{
+    CacheModel *model = &cache->model;
+    VMUVALUE tag = addr >> model->lineBits;
+    int flash = (addr >= FLASH_BASE);
+    CacheLine *set, *line, *victim;
+    int way;
+
+    /* the driver uses separate sets of lines for flash and ram when they are split */
+    set = &cache->lines[((tag & (model->sets - 1)) + (model->split && flash ? model->sets : 0)) * model->ways];
+    ++counts->requests;
+    ++cache->time;
+
+    /* look for the line in its set and choose the least recently used line to replace */
+    victim = set;
+    for (way = 0, line = set; way < model->ways; ++way, ++line) {
+        if (line->tag == tag)
+            break;
+        if (line->used < victim->used)
+            victim = line;
+    }
+
+    /* fill the line on a miss writing back the line it replaces */
+    if (way == model->ways) {
+        line = victim;
+        if (line->tag != NO_LINE && line->dirty)
+            ++counts->writebacks;
+        line->tag = tag;
+        line->dirty = FALSE;
+        ++counts->misses;
+    }
+
+    /* the driver never writes flash lines back */
+    if (write && !flash)
+        line->dirty = TRUE;
+    line->used = cache->time;
+}
+
+/* SumCounts - add up the counts of each kind of access */
+static void SumCounts(SimCache *cache, CacheCounts *total)
+{
+    CacheCounts *counts;
+    memset(total, 0, sizeof(CacheCounts));
+    for (counts = cache->counts; counts < &cache->counts[KIND_COUNT]; ++counts) {
+        total->reads += counts->reads;
+        total->writes += counts->writes;
+        total->buffered += counts->buffered;
+        total->requests += counts->requests;
+        total->misses += counts->misses;
+        total->writebacks += counts->writebacks;
+    }
+}
+
+/* StallCycles - get the cycles the VM waits for the driver */
+static unsigned long long StallCycles(CacheModel *model, CacheCounts *counts)
+{
+    unsigned long long transfer = model->lineCycles + (unsigned long long)model->byteCycles * model->lineSize;
+    return (unsigned long long)counts->requests * model->requestCycles
+         + (unsigned long long)(counts->misses + counts->writebacks) * transfer;
+}
+
+/* Log2 - get the log base 2 of a power of two or -1 */
+static int Log2(VMUVALUE n)
+{
+    int bits = 0;
+    if (n == 0 || (n & (n - 1)) != 0)
+        return -1;
+    while (n > 1) {
+        n >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
+/* WriteSize - write a size in bytes or K bytes */
+static void WriteSize(FILE *fp, VMUVALUE size)
+{
+    if (size >= 1024 && (size & 1023) == 0)
+        fprintf(fp, "%luK", (unsigned long)size / 1024);
+    else
+        fprintf(fp, "%lu bytes", (unsigned long)size);
+}
+
+/* CacheAlloc - allocate memory for the simulator */
+static void *CacheAlloc(Cache *c, size_t size)
+{
+    void *data;
+    if (!(data = xbGlobalAlloc(c->sys, size)))
+        Fatal(c->sys, "insufficient memory for the cache simulator");
+    return data;
+}
@@ -54,10 +54,49 @@ FLASH_SPACE OTDEF OpcodeTable[] = {
 { OP_DUP,       "DUP",      FMT_NONE    },
 { OP_NATIVE,    "NATIVE",   FMT_NATIVE  },
 { OP_TRAP,      "TRAP",     FMT_BYTE    },
+{ OP_SWITCH,    "SWITCH",   FMT_SWITCH  },
+{ OP_CALL,      "CALL",     FMT_CALL    },
+{ OP_LRETURN,   "LRETURN",  FMT_NONE    },
+{ OP_TCALL,     "TCALL",    FMT_CALL    },
+{ OP_LOADW,     "LOADW",    FMT_NONE    },
+{ OP_STOREW,    "STOREW",   FMT_NONE    },
+{ OP_FMUL,      "FMUL",     FMT_NONE    },
+{ OP_FDIV,      "FDIV",     FMT_NONE    },
+{ OP_RSHR,      "RSHR",     FMT_NONE    },
+{ OP_SHRU,      "SHRU",     FMT_NONE    },
+{ OP_ROL,       "ROL",      FMT_NONE    },
+{ OP_ROR,       "ROR",      FMT_NONE    },
+{ OP_BITSET,    "BITSET",   FMT_NONE    },
+{ OP_BITCLR,    "BITCLR",   FMT_NONE    },
+{ OP_BITTST,    "BITTST",   FMT_NONE    },
+{ OP_BITTGL,    "BITTGL",   FMT_NONE    },
+{ OP_MEMCPY,    "MEMCPY",   FMT_BYTE    },
+{ OP_MEMSET,    "MEMSET",   FMT_BYTE    },
+{ OP_MEMCMP,    "MEMCMP",   FMT_BYTE    },
+{ OP_MEMCHR,    "MEMCHR",   FMT_BYTE    },
+{ OP_STRLEN,    "STRLEN",   FMT_NONE    },
+{ OP_HUBADDR,   "HUBADDR",  FMT_NONE    },
+{ OP_COGID,     "COGID",    FMT_NONE    },
+{ OP_CLKFREQ,   "CLKFREQ",  FMT_NONE    },
+{ OP_WAITCNT,   "WAITCNT",  FMT_NONE    },
+{ OP_RINGPUT,   "RINGPUT",  FMT_NONE    },
+{ OP_RINGGET,   "RINGGET",  FMT_NONE    },
+{ OP_RINGPEEK,  "RINGPEEK", FMT_NONE    },
+{ OP_LADDI,     "LADDI",    FMT_LOCALI  },
 { OP_RETURN,    "RETURNX",  FMT_NONE    },  // RETURN is an xbasic keyword
 { 0,            NULL,       0           }
 };
 
+/* rd_word - get a word from a code buffer */
+static VMVALUE rd_word(const uint8_t *lc)
+{
+    VMVALUE w = 0;
+    int cnt;
+    for (cnt = sizeof(VMVALUE); --cnt >= 0; )
+        w = (w << 8) | VMCODEBYTE(lc++);
+    return w;
+}
+
 /* DecodeFunction - decode the instructions in a function code object */
 void DecodeFunction(System *sys, VMUVALUE base, const uint8_t *code, int len)
 {
@@ -74,7 +113,7 @@ int DecodeInstruction(System *sys, VMUVALUE addr, const uint8_t *lc)
 {
     uint8_t opcode, bytes[sizeof(VMVALUE)];
     FLASH_SPACE OTDEF *op;
-    VMVALUE offset = 0;
+    VMVALUE offset = 0, from, count;
     int8_t sbyte;
     int n, i;
 
@@ -134,6 +173,40 @@ int DecodeInstruction(System *sys, VMUVALUE addr, const uint8_t *lc)
                 xbInfo(sys, " # %04x\n", addr + 1 + sizeof(VMVALUE) + offset);
                 n += sizeof(VMVALUE);
                 break;
+            case FMT_CALL:
+                bytes[0] = VMCODEBYTE(lc + 1);
+                xbInfo(sys, "%02x ", bytes[0]);
+                for (i = 1; i < sizeof(VMVALUE); ++i)
+                    xbInfo(sys, "   ");
+                xbInfo(sys, "%s %d %08x\n", op->name, bytes[0], rd_word(lc + 2));
+                n += 1 + sizeof(VMVALUE);
+                break;
+            case FMT_LOCALI:
+                bytes[0] = VMCODEBYTE(lc + 1);
+                sbyte = (int8_t)VMCODEBYTE(lc + 2);
+                xbInfo(sys, "%02x %02x ", bytes[0], (uint8_t)sbyte);
+                for (i = 2; i < sizeof(VMVALUE); ++i)
+                    xbInfo(sys, "   ");
+                xbInfo(sys, "%s %02x %d\n", op->name, bytes[0], sbyte);
+                n += 2;
+                break;
+            case FMT_SWITCH:
+                for (i = 0; i < sizeof(VMVALUE); ++i)
+                    xbInfo(sys, "   ");
+                from = rd_word(lc + 1);
+                count = rd_word(lc + 1 + sizeof(VMVALUE));
+                xbInfo(sys, "%s %d %d\n", op->name, from, count);
+                n += sizeof(VMVALUE) * 2;
+                for (i = -1; i < count; ++i, n += sizeof(VMVALUE)) {
+                    offset = rd_word(lc + n);
+                    xbInfo(sys, "%0*x    ", sizeof(VMVALUE) * 2, addr + n);
+                    if (i < 0)
+                        xbInfo(sys, "    ELSE");
+                    else
+                        xbInfo(sys, "%8d", from + i);
+                    xbInfo(sys, " # %04x\n", addr + n + sizeof(VMVALUE) + offset);
+                }
+                break;
             }
             return n;
         }
@@ -11,6 +11,9 @@
 #define FMT_WORD        3
 #define FMT_NATIVE      4
 #define FMT_BR          5
+#define FMT_SWITCH      6
+#define FMT_CALL        7
+#define FMT_LOCALI      8       /* frame offset followed by a short literal */
 
 typedef struct {
     int code;
@@ -39,7 +39,8 @@ ImageHdr *LoadImage(System *sys, const char *name)
     image->mainCode = fileHdr.mainCode;
     image->stackSize = fileHdr.stackSize;
     image->sectionCount = count;
-    if (!(image->sections[0].data = (uint8_t *)xbGlobalAlloc(sys, fileHdr.sections[0].size)))
+    image->halt = OP_HALT;
+    if (!(image->sections[0].data = (uint8_t *)xbGlobalAlloc(sys, fileHdr.sections[0].size + fileHdr.sections[0].zeroSize)))
         Fatal(sys, "insufficient space for %08x section", fileHdr.sections[0].base);
     memcpy(image->sections[0].data, &fileHdr, sizeof(ImageFileHdr));
     
@@ -47,6 +48,7 @@ ImageHdr *LoadImage(System *sys, const char *name)
     size = fileHdr.sections[0].size - sizeof(ImageFileHdr);
     if (fread(image->sections[0].data + sizeof(ImageFileHdr), 1, size, fp) != size)
         Fatal(sys, "error reading %08x section", fileHdr.sections[0].base);
+    memset(image->sections[0].data + fileHdr.sections[0].size, 0, fileHdr.sections[0].zeroSize);
 
     /* initialize the first section header */
     src = ((ImageFileHdr *)image->sections[0].data)->sections;
@@ -57,10 +59,11 @@ ImageHdr *LoadImage(System *sys, const char *name)
     /* initialize the headers and read the data for the remaining sections */
     for (; --count >= 1; ++src, ++dst) {
         dst->fileSection = src;
-        if (!(dst->data = (uint8_t *)xbGlobalAlloc(sys, src->size)))
+        if (!(dst->data = (uint8_t *)xbGlobalAlloc(sys, src->size + src->zeroSize)))
             Fatal(sys, "insufficient space for %08x section", src->base);
         if (fread(dst->data, 1, src->size, fp) != src->size)
             Fatal(sys, "error reading %08x section", src->base);
+        memset(dst->data + src->size, 0, src->zeroSize);
     }
     
     fclose(fp);
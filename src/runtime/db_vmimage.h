@@ -21,6 +21,7 @@ typedef struct {
     VMUVALUE        mainCode;
     VMUVALUE        stackSize;
     VMUVALUE        sectionCount;
+    uint8_t         halt;       /* OP_HALT that cog functions and tasks return to */
     ImageSection    sections[1];
 } ImageHdr;
 
@@ -11,15 +11,57 @@
 #include <ctype.h>
 #include "db_vm.h"
 #include "db_vmdebug.h"
+#include "db_fixed.h"
+#include "db_bits.h"
+
+#ifdef VM_THREADS
+#include <pthread.h>
+#endif
+
+/* instructions a cog on a thread runs between checks for a request to stop */
+#define THREAD_SLICE    1000
+
+/* each side of a ring publishes its count after the elements it counts */
+#define LoadCount(p)        __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define StoreCount(p, v)    __atomic_store_n(p, v, __ATOMIC_RELEASE)
 
 /* prototypes for local functions */
 static uint8_t *MapAddress(Interpreter *i, VMUVALUE addr);
 static VMVALUE LoadValue(Interpreter *i, VMUVALUE addr);
 static VMVALUE LoadByteValue(Interpreter *i, VMUVALUE addr);
+static VMVALUE LoadWordValue(Interpreter *i, VMUVALUE addr);
 static void StoreValue(Interpreter *i, VMUVALUE addr, VMVALUE value);
 static void StoreByteValue(Interpreter *i, VMUVALUE addr, VMVALUE value);
+static void StoreWordValue(Interpreter *i, VMUVALUE addr, VMVALUE value);
+static uint8_t *MapBlock(Interpreter *i, VMUVALUE addr, VMUVALUE size);
+static void DoBlockOp(Interpreter *i, int op, int size);
+static void DoRingOp(Interpreter *i, int op);
+static VMVALUE StringLength(Interpreter *i, VMUVALUE addr);
 static void DoTrap(Interpreter *i, int op);
 static void PrintC(Interpreter *i, int ch);
+static void PrintS(Interpreter *i, const char *str, VMVALUE length);
+static void PrintFixed(Interpreter *i, VMVALUE value);
+static void WaitInput(Interpreter *i);
+static int InputLine(Interpreter *i);
+static char *InputField(Interpreter *i);
+static void EndInputField(Interpreter *i, char *p);
+static VMVALUE InputInt(Interpreter *i);
+static VMVALUE InputStr(Interpreter *i, VMUVALUE addr);
+static VMVALUE CogRun(Interpreter *i, VMUVALUE fcn, VMVALUE arg);
+static VMVALUE HaltAddress(Interpreter *i);
+static VMVALUE TaskRun(Interpreter *i, VMUVALUE fcn, VMVALUE arg, VMVALUE size);
+static int NextTask(Interpreter *i, int waiting);
+static void SwitchTask(Interpreter *i, int next);
+static void YieldTask(Interpreter *i);
+static int WaitTask(Interpreter *i);
+static void EndTask(Interpreter *i);
+static int RunCog(Interpreter *cog, int slice);
+static int RunScheduler(Interpreter *i);
+#ifdef VM_THREADS
+static void *CogThread(void *data);
+#endif
+static int CheckedLoop(Interpreter *i);
+static int UncheckedLoop(Interpreter *i);
 
 /* InitInterpreter - initialize the interpreter */
 Interpreter *InitInterpreter(System *sys, ImageHdr *image)
@@ -29,11 +71,24 @@ Interpreter *InitInterpreter(System *sys, ImageHdr *image)
     if (!(i = (Interpreter *)xbGlobalAlloc(sys, sizeof(Interpreter))))
         return NULL;
         
-    if (!(i->stack = (VMVALUE *)xbGlobalAlloc(sys, image->stackSize * sizeof(VMVALUE))))
+    if (!(i->stackBase = (VMVALUE *)xbGlobalAlloc(sys, image->stackSize * sizeof(VMVALUE))))
         return NULL;
         
+    i->sys = sys;
     i->image = image;
+    i->stack = i->stackBase;
     i->stackTop = i->stack + image->stackSize;
+    i->profile = NULL;
+    i->cache = NULL;
+    i->quantum = 0;
+    i->slice = 0;
+    i->limit = 0;
+    
+    if (!(i->io = InitConsoleIO(sys)))
+        return NULL;
+    
+    if (!InitHub(i))
+        return NULL;
     
     return i;
 }
@@ -41,10 +96,8 @@ Interpreter *InitInterpreter(System *sys, ImageHdr *image)
 /* Execute - execute the main code */
 int Execute(Interpreter *i, ImageHdr *image)
 {
-    VMVALUE tmp;
-    int8_t tmpb;
-    int cnt;
-
+    int result;
+    
 	/* setup the new image */
 	i->image = image;
 
@@ -52,214 +105,238 @@ int Execute(Interpreter *i, ImageHdr *image)
     i->pc = (uint8_t *)MapAddress(i, i->image->mainCode);
     i->sp = i->fp = i->stackTop;
     i->linePos = 0;
+    i->inputLine[0] = '\0';
+    i->inputPtr = i->inputLine;
+    i->taskCount = 0;
+    i->task = 0;
+
+    /* run the cogs in turn when the scheduler is used */
+    if (i->quantum > 0)
+        result = RunScheduler(i);
+
+    /* run an image that passes the verifier without the stack checks */
+    else if (setjmp(i->errorTarget))
+        result = FALSE;
+    else if (!i->profile && !i->cache && !i->limit && VerifyCode(i))
+        result = UncheckedLoop(i);
+    else
+        result = CheckedLoop(i);
+    
+    /* the program ends when the main code halts */
+    StopCogs(i);
+    
+    /* write any output that is still buffered */
+    FlushIO(i->io);
+    
+    return result;
+}
+
+/* the interpreter loop with the stack checks */
+#define VM_LOOP     CheckedLoop
+#define VM_CHECKED  1
+#include "db_vmloop.h"
+#undef VM_LOOP
+#undef VM_CHECKED
 
-    if (setjmp(i->errorTarget))
+/* the interpreter loop for verified images */
+#define VM_LOOP     UncheckedLoop
+#define VM_CHECKED  0
+#include "db_vmloop.h"
+#undef VM_LOOP
+#undef VM_CHECKED
+
+/* RunCog - run a cog until it halts, aborts or comes to the end of a time slice */
+static int RunCog(Interpreter *cog, int slice)
+{
+    if (setjmp(cog->errorTarget))
         return FALSE;
+    cog->slice = slice;
+    return CheckedLoop(cog);
+}
 
+/* RunScheduler - run the cogs in turn until the main code halts */
+static int RunScheduler(Interpreter *i)
+{
+    Interpreter *cog;
+    int result;
     for (;;) {
-#if 0
-        ShowStack(i);
-        DecodeInstruction(UnmapAddress(i, i->pc), i->pc);
+        cog = NextCog(i);
+        result = RunCog(cog, i->quantum);
+        if (cog == i) {
+            if (result != VM_YIELD)
+                return result;
+        }
+        else if (result != VM_YIELD || StopRequested(cog))
+            StopCog(cog);
+    }
+}
+
+/* CogRun - start a function with one argument on a free cog and return the cog id or -1 */
+static VMVALUE CogRun(Interpreter *i, VMUVALUE fcn, VMVALUE arg)
+{
+    uint8_t *pc = MapAddress(i, fcn);
+    Interpreter *cog;
+
+#ifndef VM_THREADS
+    /* without threads the other cogs can only be run by the scheduler */
+    if (!i->quantum)
+        return -1;
 #endif
-        switch (VMCODEBYTE(i->pc++)) {
-        case OP_HALT:
-            return TRUE;
-        case OP_BRT:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            if (i->tos)
-                i->pc += tmp;
-            i->tos = Pop(i);
-            break;
-        case OP_BRTSC:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            if (i->tos)
-                i->pc += tmp;
-            else
-                i->tos = Pop(i);
-            break;
-        case OP_BRF:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            if (!i->tos)
-                i->pc += tmp;
-            i->tos = Pop(i);
-            break;
-        case OP_BRFSC:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            if (!i->tos)
-                i->pc += tmp;
-            else
-                i->tos = Pop(i);
-            break;
-        case OP_BR:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            i->pc += tmp;
-            break;
-        case OP_NOT:
-            i->tos = (i->tos ? FALSE : TRUE);
-            break;
-        case OP_NEG:
-            i->tos = -i->tos;
-            break;
-        case OP_ADD:
-            tmp = Pop(i);
-            i->tos = tmp + i->tos;
-            break;
-        case OP_SUB:
-            tmp = Pop(i);
-            i->tos = tmp - i->tos;
-            break;
-        case OP_MUL:
-            tmp = Pop(i);
-            i->tos = tmp * i->tos;
-            break;
-        case OP_DIV:
-            tmp = Pop(i);
-            i->tos = (i->tos == 0 ? 0 : tmp / i->tos);
-            break;
-        case OP_REM:
-            tmp = Pop(i);
-            i->tos = (i->tos == 0 ? 0 : tmp % i->tos);
-            break;
-        case OP_BNOT:
-            i->tos = ~i->tos;
-            break;
-        case OP_BAND:
-            tmp = Pop(i);
-            i->tos = tmp & i->tos;
-            break;
-        case OP_BOR:
-            tmp = Pop(i);
-            i->tos = tmp | i->tos;
-            break;
-        case OP_BXOR:
-            tmp = Pop(i);
-            i->tos = tmp ^ i->tos;
-            break;
-        case OP_SHL:
-            tmp = Pop(i);
-            i->tos = tmp << i->tos;
-            break;
-        case OP_SHR:
-            tmp = Pop(i);
-            i->tos = tmp >> i->tos;
-            break;
-        case OP_LT:
-            tmp = Pop(i);
-            i->tos = (tmp < i->tos ? TRUE : FALSE);
-            break;
-        case OP_LE:
-            tmp = Pop(i);
-            i->tos = (tmp <= i->tos ? TRUE : FALSE);
-            break;
-        case OP_EQ:
-            tmp = Pop(i);
-            i->tos = (tmp == i->tos ? TRUE : FALSE);
-            break;
-        case OP_NE:
-            tmp = Pop(i);
-            i->tos = (tmp != i->tos ? TRUE : FALSE);
-            break;
-        case OP_GE:
-            tmp = Pop(i);
-            i->tos = (tmp >= i->tos ? TRUE : FALSE);
-            break;
-        case OP_GT:
-            tmp = Pop(i);
-            i->tos = (tmp > i->tos ? TRUE : FALSE);
-            break;
-        case OP_LIT:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = tmp;
-            break;
-        case OP_SLIT:
-            tmpb = (int8_t)VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = tmpb;
-            break;
-        case OP_LOAD:
-            i->tos = LoadValue(i, (VMUVALUE)i->tos);
-            break;
-        case OP_LOADB:
-            i->tos = LoadByteValue(i, (VMUVALUE)i->tos);
-            break;
-        case OP_STORE:
-            tmp = Pop(i);
-            StoreValue(i, (VMUVALUE)i->tos, tmp);
-            i->tos = Pop(i);
-            break;
-        case OP_STOREB:
-            tmp = Pop(i);
-            StoreByteValue(i, (VMUVALUE)i->tos, tmp);
-            i->tos = Pop(i);
-            break;
-        case OP_LREF:
-            tmpb = (int8_t)VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = i->fp[(int)tmpb];
-            break;
-        case OP_LSET:
-            tmpb = (int8_t)VMCODEBYTE(i->pc++);
-            i->fp[(int)tmpb] = i->tos;
-            i->tos = Pop(i);
-            break;
-        case OP_INDEX:
-            tmp = Pop(i);
-            i->tos = tmp + i->tos * sizeof (VMVALUE);
-            break;
-        case OP_PUSHJ:
-            tmp = (VMVALUE)(i->pc - (uint8_t *)i->image);
-            i->pc = (uint8_t *)MapAddress(i, i->tos);
-            i->tos = tmp;
-            break;
-        case OP_POPJ:
-            i->pc = (uint8_t *)i->image + i->tos;
-            i->tos = Pop(i);
-            break;
-        case OP_CLEAN:
-            cnt = VMCODEBYTE(i->pc++);
-            Drop(i, cnt);
-            break;
-        case OP_FRAME:
-            cnt = VMCODEBYTE(i->pc++);
-            tmp = (VMVALUE)(i->fp - i->stack);
-            i->fp = i->sp;
-            Reserve(i, cnt);
-            i->fp[F_FP] = tmp;
-            break;
-        case OP_RETURNZ:
-            CPush(i, i->tos);
-            i->tos = 0;
-            // fall through
-        case OP_RETURN:
-            i->pc = (uint8_t *)i->image + Top(i);
-            i->sp = i->fp;
-            i->fp = (VMVALUE *)(i->stack + i->fp[F_FP]);
-            break;
-        case OP_DROP:
-            i->tos = Pop(i);
-            break;
-        case OP_DUP:
-            CPush(i, i->tos);
-            break;
-        case OP_NATIVE:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            break;
-        case OP_TRAP:
-            DoTrap(i, VMCODEBYTE(i->pc++));
-            break;
-        default:
-            Abort(i, "undefined opcode 0x%02x", VMCODEBYTE(i->pc - 1));
-            break;
+
+    if (!(cog = NewCog(i)))
+        return -1;
+
+    /* call the function as OP_CALL would with a return to OP_HALT */
+    Push(cog, cog->tos);
+    Push(cog, arg);
+    cog->tos = HaltAddress(cog);
+    cog->pc = pc;
+    cog->link = (VMVALUE)(cog->fp - cog->stackBase) | (1 << F_ARGC_SHIFT);
+    cog->fp = cog->sp;
+
+#ifdef VM_THREADS
+    /* the scheduler picks up the new cog on its next turn */
+    if (!i->quantum) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        int sts;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        sts = pthread_create(&thread, &attr, CogThread, cog);
+        pthread_attr_destroy(&attr);
+        if (sts != 0) {
+            StopCog(cog);
+            return -1;
         }
     }
+#endif
+
+    return cog->cogId;
+}
+
+/* HaltAddress - get the return address of the OP_HALT in the image header that cog functions and tasks return to */
+static VMVALUE HaltAddress(Interpreter *i)
+{
+    return (VMVALUE)(&i->image->halt - (uint8_t *)i->image);
+}
+
+#ifdef VM_THREADS
+/* CogThread - run a cog on a thread of its own */
+static void *CogThread(void *data)
+{
+    Interpreter *cog = (Interpreter *)data;
+    while (RunCog(cog, THREAD_SLICE) == VM_YIELD && !StopRequested(cog))
+        ;
+    StopCog(cog);
+    return NULL;
+}
+#endif
+
+/* TaskRun - start a function with one argument as a task with a stack of size words and return the task id or -1 */
+static VMVALUE TaskRun(Interpreter *i, VMUVALUE fcn, VMVALUE arg, VMVALUE size)
+{
+    uint8_t *pc = MapAddress(i, fcn);
+    Task *task;
+    int id;
+
+    /* the code that starts the first task becomes task 0 */
+    if (i->taskCount == 0) {
+        i->tasks[0].state = TASK_READY;
+        i->task = 0;
+        i->taskCount = 1;
+    }
+
+    if (size < TASK_MIN_STACK)
+        return -1;
+
+    /* reuse the stack of a task that has ended or take a slice from the bottom of the current task's stack */
+    for (id = 1; id < i->taskCount; ++id)
+        if (i->tasks[id].state == TASK_FREE && i->tasks[id].stackTop - i->tasks[id].stack >= size)
+            break;
+    task = &i->tasks[id];
+    if (id == i->taskCount) {
+        if (id >= TASK_MAX || i->sp - i->stack < size)
+            return -1;
+        task->stack = i->stack;
+        task->stackTop = i->stack + size;
+        i->stack += size;
+        ++i->taskCount;
+    }
+
+    /* call the function as OP_CALL would with a return to OP_HALT */
+    task->state = TASK_READY;
+    task->sp = task->stackTop;
+    *--task->sp = 0;
+    *--task->sp = arg;
+    task->tos = HaltAddress(i);
+    task->pc = pc;
+    task->link = (VMVALUE)(task->stackTop - i->stackBase) | (1 << F_ARGC_SHIFT);
+    task->fp = task->sp;
+
+    return id;
+}
+
+/* NextTask - find the next task in turn that is ready or also waiting for input or return -1 */
+static int NextTask(Interpreter *i, int waiting)
+{
+    int id, n;
+    for (n = 1; n < i->taskCount; ++n) {
+        id = (i->task + n) % i->taskCount;
+        if (i->tasks[id].state == TASK_READY || (waiting && i->tasks[id].state == TASK_WAITING))
+            return id;
+    }
+    return -1;
+}
+
+/* SwitchTask - save the registers of the current task and load those of another */
+static void SwitchTask(Interpreter *i, int next)
+{
+    Task *task = &i->tasks[i->task];
+    task->pc = i->pc;
+    task->fp = i->fp;
+    task->sp = i->sp;
+    task->tos = i->tos;
+    task->link = i->link;
+    task->stack = i->stack;
+    task->stackTop = i->stackTop;
+    task = &i->tasks[i->task = next];
+    i->pc = task->pc;
+    i->fp = task->fp;
+    i->sp = task->sp;
+    i->tos = task->tos;
+    i->link = task->link;
+    i->stack = task->stack;
+    i->stackTop = task->stackTop;
+}
+
+/* YieldTask - let the next task run */
+static void YieldTask(Interpreter *i)
+{
+    int next;
+    if (i->taskCount > 0) {
+        i->tasks[i->task].state = TASK_READY;
+        if ((next = NextTask(i, TRUE)) >= 0)
+            SwitchTask(i, next);
+    }
+}
+
+/* WaitTask - let a task that isn't waiting for input run and retry the current trap when the task's turn comes again */
+static int WaitTask(Interpreter *i)
+{
+    int next;
+    if (i->taskCount == 0 || (next = NextTask(i, FALSE)) < 0)
+        return FALSE;
+    i->tasks[i->task].state = TASK_WAITING;
+    i->pc -= 2;
+    SwitchTask(i, next);
+    return TRUE;
+}
+
+/* EndTask - end a task whose function has returned and let the next task run */
+static void EndTask(Interpreter *i)
+{
+    i->tasks[i->task].state = TASK_FREE;
+    SwitchTask(i, NextTask(i, TRUE));
 }
 
 static uint8_t *MapAddress(Interpreter *i, VMUVALUE addr)
@@ -269,7 +346,7 @@ static uint8_t *MapAddress(Interpreter *i, VMUVALUE addr)
         ImageSection *section = &i->image->sections[j];
         VMUVALUE base = section->fileSection->base;
         if (addr >= base && addr < base + 0x10000000) {
-            if (addr > base + section->fileSection->size)
+            if (addr > base + section->fileSection->size + section->fileSection->zeroSize)
                 Abort(i, "address error");
             return (uint8_t *)(section->data + (addr - base));
         }
@@ -280,54 +357,441 @@ static uint8_t *MapAddress(Interpreter *i, VMUVALUE addr)
 
 static VMVALUE LoadValue(Interpreter *i, VMUVALUE addr)
 {
-    VMVALUE *p = (VMVALUE *)MapAddress(i, addr);
+    VMVALUE *p;
+    /* the cog registers are only accessed as longs */
+    if (addr - COG_BASE < COG_REGS * sizeof(VMVALUE))
+        return ReadCogRegister(i, (addr - COG_BASE) / sizeof(VMVALUE));
+    p = (VMVALUE *)MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, sizeof(VMVALUE), FALSE);
     return *p;
 }
 
 static VMVALUE LoadByteValue(Interpreter *i, VMUVALUE addr)
 {
     uint8_t *p = MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, 1, FALSE);
+    return *p;
+}
+
+static VMVALUE LoadWordValue(Interpreter *i, VMUVALUE addr)
+{
+    uint16_t *p = (uint16_t *)MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, sizeof(uint16_t), FALSE);
     return *p;
 }
 
 static void StoreValue(Interpreter *i, VMUVALUE addr, VMVALUE value)
 {
-    VMVALUE *p = (VMVALUE *)MapAddress(i, addr);
+    VMVALUE *p;
+    if (addr - COG_BASE < COG_REGS * sizeof(VMVALUE)) {
+        WriteCogRegister(i, (addr - COG_BASE) / sizeof(VMVALUE), value);
+        return;
+    }
+    p = (VMVALUE *)MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, sizeof(VMVALUE), TRUE);
     *p = value;
 }
 
 static void StoreByteValue(Interpreter *i, VMUVALUE addr, VMVALUE value)
 {
     uint8_t *p = MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, 1, TRUE);
+    *p = value;
+}
+
+static void StoreWordValue(Interpreter *i, VMUVALUE addr, VMVALUE value)
+{
+    uint16_t *p = (uint16_t *)MapAddress(i, addr);
+    if (i->cache)
+        CacheAccess(i->cache, addr, sizeof(uint16_t), TRUE);
     *p = value;
 }
 
+/* MapBlock - map a block of memory checking that all of it is within one section */
+static uint8_t *MapBlock(Interpreter *i, VMUVALUE addr, VMUVALUE size)
+{
+    int j;
+    for (j = 0; j < i->image->sectionCount; ++j) {
+        ImageSection *section = &i->image->sections[j];
+        VMUVALUE base = section->fileSection->base;
+        if (addr >= base && addr < base + 0x10000000) {
+            VMUVALUE offset = addr - base;
+            VMUVALUE limit = section->fileSection->size + section->fileSection->zeroSize;
+            if (offset > limit || size > limit - offset)
+                Abort(i, "address error");
+            return (uint8_t *)(section->data + offset);
+        }
+    }
+    Abort(i, "address error");
+    return NULL; // not reached
+}
+
+/* DoBlockOp - copy, fill, compare or search a block of byte or VMVALUE array elements */
+static void DoBlockOp(Interpreter *i, int op, int size)
+{
+    VMVALUE count = i->tos;
+    VMVALUE value = Pop(i);     /* source address or value */
+    VMUVALUE addr = (VMUVALUE)Pop(i);
+    VMUVALUE length;
+    VMVALUE *p, *q;
+    uint8_t *bp;
+    VMVALUE j;
+
+    /* the whole block is checked once instead of each element */
+    if (count < 0)
+        count = 0;
+    length = (VMUVALUE)count * size;
+    if (length / size != (VMUVALUE)count)
+        Abort(i, "address error");
+    bp = MapBlock(i, addr, length);
+    p = (VMVALUE *)bp;
+
+    switch (op) {
+    case OP_MEMCPY:
+        memmove(bp, MapBlock(i, (VMUVALUE)value, length), length);
+        i->tos = (VMVALUE)(addr + length);
+        break;
+    case OP_MEMSET:
+        if (size == 1)
+            memset(bp, value, length);
+        else {
+            for (j = 0; j < count; ++j)
+                p[j] = value;
+        }
+        i->tos = (VMVALUE)(addr + length);
+        break;
+    case OP_MEMCMP:
+        i->tos = 0;
+        if (size == 1) {
+            j = memcmp(bp, MapBlock(i, (VMUVALUE)value, length), length);
+            i->tos = (j < 0 ? -1 : j > 0 ? 1 : 0);
+        }
+        else {
+            q = (VMVALUE *)MapBlock(i, (VMUVALUE)value, length);
+            for (j = 0; j < count; ++j)
+                if (p[j] != q[j]) {
+                    i->tos = (p[j] < q[j] ? -1 : 1);
+                    break;
+                }
+        }
+        break;
+    case OP_MEMCHR:
+        i->tos = -1;
+        if (size == 1) {
+            uint8_t *found = (uint8_t *)memchr(bp, value & 0xff, length);
+            if (found)
+                i->tos = (VMVALUE)(found - bp);
+        }
+        else {
+            for (j = 0; j < count; ++j)
+                if (p[j] == value) {
+                    i->tos = j;
+                    break;
+                }
+        }
+        break;
+    }
+
+    /* the VM copies bytes and compares and searches elements one at a time */
+    if (i->cache) {
+        switch (op) {
+        case OP_MEMCPY:
+            CacheCopy(i->cache, addr, (VMUVALUE)value, length, 1, TRUE);
+            break;
+        case OP_MEMSET:
+            CacheBlock(i->cache, addr, count, size, TRUE);
+            break;
+        case OP_MEMCMP:
+            /* the comparison stops at the first difference but the whole block is counted */
+            CacheCopy(i->cache, (VMUVALUE)value, addr, count, size, FALSE);
+            break;
+        case OP_MEMCHR:
+            CacheBlock(i->cache, addr, i->tos < 0 ? count : i->tos + 1, size, FALSE);
+            break;
+        }
+    }
+}
+
+/* DoRingOp - move elements between an array and a single producer, single consumer ring */
+static void DoRingOp(Interpreter *i, int op)
+{
+    VMVALUE count = i->tos;
+    VMUVALUE addr = (VMUVALUE)Pop(i);
+    VMUVALUE ring = (VMUVALUE)Pop(i);
+    VMUVALUE head, tail, mask, n, j;
+    VMVALUE *hdr, *data, *p;
+
+    /* the ring holds a power of two elements */
+    hdr = (VMVALUE *)MapBlock(i, ring, RING_HEADER * sizeof(VMVALUE));
+    mask = (VMUVALUE)hdr[RING_MASK];
+    if ((mask & (mask + 1)) != 0 || mask >= 0x10000000 / sizeof(VMVALUE))
+        Abort(i, "bad ring");
+    data = (VMVALUE *)MapBlock(i, ring + RING_HEADER * sizeof(VMVALUE), (mask + 1) * sizeof(VMVALUE));
+    if (count < 0)
+        count = 0;
+
+    /* move as many elements as there are in the ring or as will fit */
+    if (op == OP_RINGPUT) {
+        head = (VMUVALUE)hdr[RING_HEAD];
+        tail = (VMUVALUE)LoadCount(&hdr[RING_TAIL]);
+        n = (head - tail <= mask ? mask + 1 - (head - tail) : 0);
+        if (n > (VMUVALUE)count)
+            n = (VMUVALUE)count;
+        p = (VMVALUE *)MapBlock(i, addr, n * sizeof(VMVALUE));
+        for (j = 0; j < n; ++j)
+            data[(head + j) & mask] = p[j];
+        StoreCount(&hdr[RING_HEAD], (VMVALUE)(head + n));
+    }
+    else {
+        head = (VMUVALUE)LoadCount(&hdr[RING_HEAD]);
+        tail = (VMUVALUE)hdr[RING_TAIL];
+        n = (head - tail <= mask + 1 ? head - tail : 0);
+        if (n > (VMUVALUE)count)
+            n = (VMUVALUE)count;
+        p = (VMVALUE *)MapBlock(i, addr, n * sizeof(VMVALUE));
+        for (j = 0; j < n; ++j)
+            p[j] = data[(tail + j) & mask];
+        if (op == OP_RINGGET)
+            StoreCount(&hdr[RING_TAIL], (VMVALUE)(tail + n));
+    }
+
+    /* the VM moves the elements one at a time and then updates the count */
+    if (i->cache) {
+        CacheBlock(i->cache, ring, RING_HEADER, sizeof(VMVALUE), FALSE);
+        for (j = 0; j < n; ++j) {
+            VMUVALUE slot = ring + (RING_HEADER + (((op == OP_RINGPUT ? head : tail) + j) & mask)) * sizeof(VMVALUE);
+            if (op == OP_RINGPUT)
+                CacheCopy(i->cache, slot, addr + j * sizeof(VMVALUE), 1, sizeof(VMVALUE), TRUE);
+            else
+                CacheCopy(i->cache, addr + j * sizeof(VMVALUE), slot, 1, sizeof(VMVALUE), TRUE);
+        }
+        if (op != OP_RINGPEEK)
+            CacheAccess(i->cache, ring + (op == OP_RINGPUT ? RING_HEAD : RING_TAIL) * sizeof(VMVALUE), sizeof(VMVALUE), TRUE);
+    }
+
+    i->tos = (VMVALUE)n;
+}
+
+/* StringLength - get the length of a zero terminated string */
+static VMVALUE StringLength(Interpreter *i, VMUVALUE addr)
+{
+    int j;
+    for (j = 0; j < i->image->sectionCount; ++j) {
+        ImageSection *section = &i->image->sections[j];
+        VMUVALUE base = section->fileSection->base;
+        if (addr >= base && addr < base + 0x10000000) {
+            VMUVALUE size = section->fileSection->size + section->fileSection->zeroSize;
+            uint8_t *p, *end;
+            if (addr - base < size) {
+                p = section->data + (addr - base);
+                if ((end = (uint8_t *)memchr(p, '\0', size - (addr - base))) != NULL) {
+                    if (i->cache)
+                        CacheAccess(i->cache, addr, (VMUVALUE)(end - p) + 1, FALSE);
+                    return (VMVALUE)(end - p);
+                }
+            }
+            break;
+        }
+    }
+    Abort(i, "address error");
+    return 0; // not reached
+}
+
 static void DoTrap(Interpreter *i, int op)
 {
+    VMVALUE length, arg;
+    char buf[32];
+    
+    /* tasks belong to the cog and don't need the hub lock */
+    switch (op) {
+    case TRAP_TASKRUN:
+        arg = Pop(i);
+        length = Pop(i);
+        i->tos = TaskRun(i, (VMUVALUE)length, arg, i->tos);
+        return;
+    case TRAP_YIELD:
+        YieldTask(i);
+        return;
+    }
+    
+    /* the cogs take turns with the terminal and starting cogs */
+    LockHub(i);
+    
     switch (op) {
     case TRAP_GETCHAR:
+        /* the other tasks run while a task waits for input */
+        if (!IOReady(i->io) && WaitTask(i))
+            break;
+        if (i->taskCount > 0)
+            i->tasks[i->task].state = TASK_READY;
+        WaitInput(i);
         Push(i, i->tos);
-        i->tos = VM_getchar();
+        i->tos = IOGetC(i->io);
         break;
     case TRAP_PUTCHAR:
         PrintC(i, i->tos);
         i->tos = Pop(i);
         break;
+    case TRAP_PRINTSTR:
+        length = StringLength(i, i->tos);
+        PrintS(i, (char *)MapBlock(i, i->tos, length), length);
+        i->tos = Pop(i);
+        break;
+    case TRAP_PRINTINT:
+        sprintf(buf, "%ld", (long)i->tos);
+        PrintS(i, buf, strlen(buf));
+        i->tos = Pop(i);
+        break;
+    case TRAP_PRINTHEX:
+        sprintf(buf, "%lX", (unsigned long)(VMUVALUE)i->tos);
+        PrintS(i, buf, strlen(buf));
+        i->tos = Pop(i);
+        break;
+    case TRAP_PRINTFIXED:
+        PrintFixed(i, i->tos);
+        i->tos = Pop(i);
+        break;
+    case TRAP_PRINTTAB:
+        PrintC(i, '\t');
+        break;
+    case TRAP_PRINTNL:
+        PrintC(i, '\r');
+        PrintC(i, '\n');
+        break;
+    case TRAP_INPUTLINE:
+        InputLine(i);
+        break;
+    case TRAP_INPUTINT:
+        Push(i, i->tos);
+        i->tos = InputInt(i);
+        break;
+    case TRAP_INPUTSTR:
+        i->tos = InputStr(i, i->tos);
+        break;
+    case TRAP_COGRUN:
+        length = Pop(i);
+        i->tos = CogRun(i, (VMUVALUE)length, i->tos);
+        break;
     default:
         Abort(i, "undefined print opcode 0x%02x", op);
         break;
     }
+    
+    UnlockHub(i);
 }
 
 static void PrintC(Interpreter *i, int ch)
 {
-    VM_putchar(ch);
+    IOPutC(i->io, ch);
     if (ch == '\n')
         i->linePos = 0;
     else
         ++i->linePos;
 }
 
+/* PrintS - print a string */
+static void PrintS(Interpreter *i, const char *str, VMVALUE length)
+{
+    while (--length >= 0)
+        PrintC(i, *str++);
+}
+
+/* PrintFixed - print a fixed point value rounded to four decimal places */
+static void PrintFixed(Interpreter *i, VMVALUE value)
+{
+    unsigned long whole, frac;
+    char buf[32];
+    if (value < 0) {
+        PrintC(i, '-');
+        value = -value;
+    }
+    whole = (VMUVALUE)value >> FIXED_SHIFT;
+    frac = ((unsigned long)(value & 0xffff) * 10000 + 0x8000) >> FIXED_SHIFT;
+    if (frac == 10000) {
+        ++whole;
+        frac = 0;
+    }
+    sprintf(buf, "%lu.%04lu", whole, frac);
+    PrintS(i, buf, strlen(buf));
+}
+
+/* WaitInput - wait for terminal input with the hub lock given back so that the other cogs keep running */
+static void WaitInput(Interpreter *i)
+{
+    while (!IOReady(i->io)) {
+        FlushIO(i->io);
+        UnlockHub(i);
+        IOWait(i->io);
+        LockHub(i);
+    }
+}
+
+/* InputLine - read a new input line */
+static int InputLine(Interpreter *i)
+{
+    int result;
+    WaitInput(i);
+    result = IOGetLine(i->io, i->inputLine, sizeof(i->inputLine));
+    i->inputPtr = i->inputLine;
+    return result;
+}
+
+/* InputField - find the next input field reading new lines until one is found */
+static char *InputField(Interpreter *i)
+{
+    char *p = i->inputPtr;
+    for (;;) {
+        while (*p != '\0' && isspace((unsigned char)*p))
+            ++p;
+        if (*p != '\0' || !InputLine(i))
+            break;
+        p = i->inputPtr;
+    }
+    return p;
+}
+
+/* EndInputField - skip past the comma that ends an input field */
+static void EndInputField(Interpreter *i, char *p)
+{
+    while (*p != '\0' && *p != ',')
+        ++p;
+    i->inputPtr = (*p == ',' ? p + 1 : p);
+}
+
+/* InputInt - get the next integer field of the input line */
+static VMVALUE InputInt(Interpreter *i)
+{
+    char *p = InputField(i);
+    VMVALUE value = 0, sign = 1;
+    if (*p == '-') {
+        sign = -1;
+        ++p;
+    }
+    while (isdigit((unsigned char)*p))
+        value = value * 10 + *p++ - '0';
+    EndInputField(i, p);
+    return value * sign;
+}
+
+/* InputStr - copy the next field of the input line into a byte array and return its length */
+static VMVALUE InputStr(Interpreter *i, VMUVALUE addr)
+{
+    char *p = InputField(i);
+    size_t length = strcspn(p, ",");
+    uint8_t *buf = MapBlock(i, addr, length + 1);
+    memcpy(buf, p, length);
+    buf[length] = '\0';
+    if (i->cache)
+        CacheBlock(i->cache, addr, (VMUVALUE)length + 1, 1, TRUE);
+    EndInputField(i, p + length);
+    return (VMVALUE)length;
+}
+
 void ShowStack(Interpreter *i)
 {
     VMVALUE *p;
@@ -350,13 +814,21 @@ void StackOverflow(Interpreter *i)
 void Abort(Interpreter *i, const char *fmt, ...)
 {
     va_list ap;
+    if (i) {
+        LockHub(i);
+        FlushIO(i->io);
+    }
     va_start(ap, fmt);
     xbError(i->sys, "abort: ");
+    if (i && i->cogId != 0)
+        xbError(i->sys, "cog %d: ", i->cogId);
     xbErrorV(i->sys, fmt, ap);
     xbError(i->sys, "\n");
     va_end(ap);
-    if (i)
+    if (i) {
+        ReleaseHub(i);
         longjmp(i->errorTarget, 1);
+    }
     else
         exit(1);
 }
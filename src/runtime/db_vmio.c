@@ -0,0 +1,241 @@
+/* db_vmio.c - buffered terminal i/o for the interpreter
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * Terminal output from the traps is collected in a buffer that is flushed
+ * at the end of each line, when it reaches a threshold, before input is
+ * read and when the program stops.  Input is read a line or a buffer at a
+ * time.  The buffers sit on top of a backend that reads and writes the
+ * console or a pair of files so that batch runs can redirect the terminal.  A task can check for input without waiting
+ * so that it only waits when no other task is ready to run, and a cog can
+ * wait for input before it takes the hub lock to read it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "db_vm.h"
+
+/* console input can be checked for without waiting */
+#if !defined(WIN32) && !defined(PROPELLER_CAT)
+#define IO_POLL
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/* size of the input and output buffers */
+#define IO_BUFFER_SIZE  1024
+
+/* i/o backend operations */
+typedef struct {
+    int (*read)(VMIO *io, char *buf, int size);     /* returns the number of bytes read or zero at the end */
+    void (*write)(VMIO *io, const char *buf, int size);
+    int (*ready)(VMIO *io, int wait);               /* returns nonzero if a read won't wait, waiting first if wait is set */
+} VMIOOps;
+
+/* buffered i/o state */
+struct VMIO {
+    VMIOOps *ops;
+    FILE *in;                   /* files for the file backend */
+    FILE *out;
+    int threshold;              /* flush when this many bytes are buffered */
+    int flushOnNewline;         /* flush at the end of each line */
+    char outBuf[IO_BUFFER_SIZE];
+    int outCount;
+    char inBuf[IO_BUFFER_SIZE];
+    int inCount;
+    int inPtr;
+};
+
+static VMIO *NewIO(System *sys, VMIOOps *ops);
+static int FillIO(VMIO *io);
+static int FileRead(VMIO *io, char *buf, int size);
+static void FileWrite(VMIO *io, const char *buf, int size);
+static int FileReady(VMIO *io, int wait);
+
+static VMIOOps fileOps = {
+    FileRead,
+    FileWrite,
+    FileReady
+};
+
+#if defined(PROPELLER_CAT)
+
+static int ConsoleRead(VMIO *io, char *buf, int size);
+static void ConsoleWrite(VMIO *io, const char *buf, int size);
+static int AlwaysReady(VMIO *io, int wait);
+
+static VMIOOps consoleOps = {
+    ConsoleRead,
+    ConsoleWrite,
+    AlwaysReady
+};
+
+/* InitConsoleIO - setup i/o to the console */
+VMIO *InitConsoleIO(System *sys)
+{
+    VMIO *io;
+    if ((io = NewIO(sys, &consoleOps)) != NULL)
+        io->flushOnNewline = TRUE;
+    return io;
+}
+
+/* ConsoleRead - read a line from the console */
+static int ConsoleRead(VMIO *io, char *buf, int size)
+{
+    return VM_getline(buf, size) ? strlen(buf) : 0;
+}
+
+/* ConsoleWrite - write to the console */
+static void ConsoleWrite(VMIO *io, const char *buf, int size)
+{
+    while (--size >= 0)
+        VM_putchar(*buf++);
+}
+
+/* AlwaysReady - console input that can't be checked for */
+static int AlwaysReady(VMIO *io, int wait)
+{
+    return TRUE;
+}
+
+#else // posix
+
+/* InitConsoleIO - setup i/o to the console */
+VMIO *InitConsoleIO(System *sys)
+{
+    VMIO *io;
+    if ((io = InitFileIO(sys, stdin, stdout)) != NULL)
+        io->flushOnNewline = TRUE;
+    return io;
+}
+
+#endif
+
+/* InitFileIO - setup i/o redirected to files */
+VMIO *InitFileIO(System *sys, FILE *in, FILE *out)
+{
+    VMIO *io;
+    if ((io = NewIO(sys, &fileOps)) != NULL) {
+        io->in = in;
+        io->out = out;
+    }
+    return io;
+}
+
+/* SetIOFlush - set when output is flushed */
+void SetIOFlush(VMIO *io, int threshold, int flushOnNewline)
+{
+    if (threshold < 1)
+        threshold = 1;
+    else if (threshold > IO_BUFFER_SIZE)
+        threshold = IO_BUFFER_SIZE;
+    io->threshold = threshold;
+    io->flushOnNewline = flushOnNewline;
+}
+
+/* IOPutC - write a character */
+void IOPutC(VMIO *io, int ch)
+{
+    io->outBuf[io->outCount++] = ch;
+    if (io->outCount >= io->threshold || (ch == '\n' && io->flushOnNewline))
+        FlushIO(io);
+}
+
+/* IOGetC - read a character */
+int IOGetC(VMIO *io)
+{
+    if (io->inPtr >= io->inCount && !FillIO(io))
+        return -1;
+    return (uint8_t)io->inBuf[io->inPtr++];
+}
+
+/* IOReady - check to see if a character can be read without waiting */
+int IOReady(VMIO *io)
+{
+    return io->inPtr < io->inCount || (*io->ops->ready)(io, FALSE);
+}
+
+/* IOWait - wait until a character can be read without waiting */
+void IOWait(VMIO *io)
+{
+    if (io->inPtr >= io->inCount)
+        (*io->ops->ready)(io, TRUE);
+}
+
+/* IOGetLine - read a line without its line ending */
+int IOGetLine(VMIO *io, char *buf, int size)
+{
+    int i = 0, ch;
+    if ((ch = IOGetC(io)) == -1) {
+        buf[0] = '\0';
+        return FALSE;
+    }
+    while (ch != '\n' && ch != -1) {
+        if (ch != '\r' && i < size - 1)
+            buf[i++] = ch;
+        ch = IOGetC(io);
+    }
+    buf[i] = '\0';
+    return TRUE;
+}
+
+/* FlushIO - write the buffered output */
+void FlushIO(VMIO *io)
+{
+    if (io->outCount > 0) {
+        (*io->ops->write)(io, io->outBuf, io->outCount);
+        io->outCount = 0;
+    }
+}
+
+/* NewIO - allocate buffered i/o state */
+static VMIO *NewIO(System *sys, VMIOOps *ops)
+{
+    VMIO *io;
+    if (!(io = (VMIO *)xbGlobalAlloc(sys, sizeof(VMIO))))
+        return NULL;
+    memset(io, 0, sizeof(VMIO));
+    io->ops = ops;
+    io->threshold = IO_BUFFER_SIZE;
+    return io;
+}
+
+/* FillIO - refill the input buffer flushing the output first */
+static int FillIO(VMIO *io)
+{
+    FlushIO(io);
+    io->inCount = (*io->ops->read)(io, io->inBuf, sizeof(io->inBuf));
+    io->inPtr = 0;
+    return io->inCount > 0;
+}
+
+/* FileRead - read a buffer from a file or a line from stdin */
+static int FileRead(VMIO *io, char *buf, int size)
+{
+    /* a full buffer could wait for more than one line of console input */
+    if (io->in == stdin)
+        return fgets(buf, size, io->in) ? strlen(buf) : 0;
+    return (int)fread(buf, 1, size, io->in);
+}
+
+/* FileWrite - write to a file */
+static void FileWrite(VMIO *io, const char *buf, int size)
+{
+    fwrite(buf, 1, size, io->out);
+    fflush(io->out);
+}
+
+/* FileReady - check for or wait for input from a terminal (a file never waits) */
+static int FileReady(VMIO *io, int wait)
+{
+#ifdef IO_POLL
+    struct pollfd fds;
+    if (isatty(fileno(io->in))) {
+        fds.fd = fileno(io->in);
+        fds.events = POLLIN;
+        fds.revents = 0;
+        return poll(&fds, 1, wait ? -1 : 0) > 0;
+    }
+#endif
+    return TRUE;
+}
@@ -0,0 +1,376 @@
+/* db_vmloop.h - the interpreter loop
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * This file is included by db_vmint.c once for each version of the
+ * interpreter loop.  Define VM_LOOP as the name of the function and
+ * VM_CHECKED as 1 for the version that checks for stack overflow on every
+ * push, profiles the code, simulates the external memory cache and runs
+ * cogs in time slices or as 0 for the version that runs images that have
+ * passed the verifier.
+ */
+
+#if VM_CHECKED
+#define VMPush(i, v)    CPush(i, v)
+#else
+#define VMPush(i, v)    Push(i, v)
+#endif
+
+static int VM_LOOP(Interpreter *i)
+{
+    VMVALUE tmp;
+    VMUVALUE utmp;
+    int8_t tmpb;
+    int cnt;
+
+    for (;;) {
+#if 0
+        ShowStack(i);
+        DecodeInstruction(UnmapAddress(i, i->pc), i->pc);
+#endif
+#if VM_CHECKED
+        if (i->profile)
+            ProfileInstruction(i->profile, i->pc);
+        if (i->cache)
+            CacheInstruction(i->cache, i->pc, i->tos);
+#endif
+        i->cnt += VM_OP_CYCLES;
+        switch (VMCODEBYTE(i->pc++)) {
+        case OP_HALT:
+            /* a task other than the first ends when its function returns */
+            if (i->task == 0)
+                return TRUE;
+            EndTask(i);
+            break;
+        case OP_BRT:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            if (i->tos)
+                i->pc += tmp;
+            i->tos = Pop(i);
+            break;
+        case OP_BRTSC:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            if (i->tos)
+                i->pc += tmp;
+            else
+                i->tos = Pop(i);
+            break;
+        case OP_BRF:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            if (!i->tos)
+                i->pc += tmp;
+            i->tos = Pop(i);
+            break;
+        case OP_BRFSC:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            if (!i->tos)
+                i->pc += tmp;
+            else
+                i->tos = Pop(i);
+            break;
+        case OP_BR:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            i->pc += tmp;
+            break;
+        case OP_NOT:
+            i->tos = (i->tos ? FALSE : TRUE);
+            break;
+        case OP_NEG:
+            i->tos = -i->tos;
+            break;
+        case OP_ADD:
+            tmp = Pop(i);
+            i->tos = tmp + i->tos;
+            break;
+        case OP_SUB:
+            tmp = Pop(i);
+            i->tos = tmp - i->tos;
+            break;
+        case OP_MUL:
+            tmp = Pop(i);
+            i->tos = tmp * i->tos;
+            break;
+        case OP_DIV:
+            tmp = Pop(i);
+            i->tos = (i->tos == 0 ? 0 : tmp / i->tos);
+            break;
+        case OP_REM:
+            tmp = Pop(i);
+            i->tos = (i->tos == 0 ? 0 : tmp % i->tos);
+            break;
+        case OP_FMUL:
+            tmp = Pop(i);
+            i->tos = FixedMul(tmp, i->tos);
+            break;
+        case OP_FDIV:
+            tmp = Pop(i);
+            i->tos = FixedDiv(tmp, i->tos);
+            break;
+        case OP_BNOT:
+            i->tos = ~i->tos;
+            break;
+        case OP_BAND:
+            tmp = Pop(i);
+            i->tos = tmp & i->tos;
+            break;
+        case OP_BOR:
+            tmp = Pop(i);
+            i->tos = tmp | i->tos;
+            break;
+        case OP_BXOR:
+            tmp = Pop(i);
+            i->tos = tmp ^ i->tos;
+            break;
+        case OP_SHL:
+            tmp = Pop(i);
+            i->tos = tmp << i->tos;
+            break;
+        case OP_SHR:
+            tmp = Pop(i);
+            i->tos = tmp >> i->tos;
+            break;
+        case OP_RSHR:
+            tmp = Pop(i);
+            i->tos = RoundingShift(tmp, i->tos);
+            break;
+        case OP_SHRU:
+            tmp = Pop(i);
+            i->tos = ShiftRightUnsigned(tmp, i->tos);
+            break;
+        case OP_ROL:
+            tmp = Pop(i);
+            i->tos = RotateLeft(tmp, i->tos);
+            break;
+        case OP_ROR:
+            tmp = Pop(i);
+            i->tos = RotateRight(tmp, i->tos);
+            break;
+        case OP_BITSET:
+            tmp = Pop(i);
+            i->tos = tmp | BitMask(i->tos);
+            break;
+        case OP_BITCLR:
+            tmp = Pop(i);
+            i->tos = tmp & ~BitMask(i->tos);
+            break;
+        case OP_BITTST:
+            tmp = Pop(i);
+            i->tos = ShiftRightUnsigned(tmp, i->tos) & 1;
+            break;
+        case OP_BITTGL:
+            tmp = Pop(i);
+            i->tos = tmp ^ BitMask(i->tos);
+            break;
+        case OP_LT:
+            tmp = Pop(i);
+            i->tos = (tmp < i->tos ? TRUE : FALSE);
+            break;
+        case OP_LE:
+            tmp = Pop(i);
+            i->tos = (tmp <= i->tos ? TRUE : FALSE);
+            break;
+        case OP_EQ:
+            tmp = Pop(i);
+            i->tos = (tmp == i->tos ? TRUE : FALSE);
+            break;
+        case OP_NE:
+            tmp = Pop(i);
+            i->tos = (tmp != i->tos ? TRUE : FALSE);
+            break;
+        case OP_GE:
+            tmp = Pop(i);
+            i->tos = (tmp >= i->tos ? TRUE : FALSE);
+            break;
+        case OP_GT:
+            tmp = Pop(i);
+            i->tos = (tmp > i->tos ? TRUE : FALSE);
+            break;
+        case OP_LIT:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            VMPush(i, i->tos);
+            i->tos = tmp;
+            break;
+        case OP_SLIT:
+            tmpb = (int8_t)VMCODEBYTE(i->pc++);
+            VMPush(i, i->tos);
+            i->tos = tmpb;
+            break;
+        case OP_LOAD:
+            i->tos = LoadValue(i, (VMUVALUE)i->tos);
+            break;
+        case OP_LOADB:
+            i->tos = LoadByteValue(i, (VMUVALUE)i->tos);
+            break;
+        case OP_LOADW:
+            i->tos = LoadWordValue(i, (VMUVALUE)i->tos);
+            break;
+        case OP_STORE:
+            tmp = Pop(i);
+            StoreValue(i, (VMUVALUE)i->tos, tmp);
+            i->tos = Pop(i);
+            break;
+        case OP_STOREB:
+            tmp = Pop(i);
+            StoreByteValue(i, (VMUVALUE)i->tos, tmp);
+            i->tos = Pop(i);
+            break;
+        case OP_STOREW:
+            tmp = Pop(i);
+            StoreWordValue(i, (VMUVALUE)i->tos, tmp);
+            i->tos = Pop(i);
+            break;
+        case OP_LREF:
+            tmpb = (int8_t)VMCODEBYTE(i->pc++);
+            VMPush(i, i->tos);
+            i->tos = i->fp[(int)tmpb];
+            break;
+        case OP_LSET:
+            tmpb = (int8_t)VMCODEBYTE(i->pc++);
+            i->fp[(int)tmpb] = i->tos;
+            i->tos = Pop(i);
+            break;
+        case OP_LADDI:
+            tmpb = (int8_t)VMCODEBYTE(i->pc++);
+            i->fp[(int)tmpb] += (int8_t)VMCODEBYTE(i->pc++);
+            break;
+        case OP_INDEX:
+            tmp = Pop(i);
+            i->tos = tmp + i->tos * sizeof (VMVALUE);
+            break;
+        case OP_PUSHJ:
+            tmp = (VMVALUE)(i->pc - (uint8_t *)i->image);
+            i->pc = (uint8_t *)MapAddress(i, i->tos);
+            i->tos = tmp;
+            i->link = (VMVALUE)(i->fp - i->stackBase);
+            i->fp = i->sp;
+            break;
+        case OP_POPJ:
+            i->pc = (uint8_t *)i->image + i->tos;
+            i->tos = Pop(i);
+            break;
+        case OP_CLEAN:
+            cnt = VMCODEBYTE(i->pc++);
+            Drop(i, cnt);
+            break;
+        case OP_FRAME:
+            cnt = VMCODEBYTE(i->pc++);
+#if VM_CHECKED
+            if (i->sp - cnt < i->stack)
+                StackOverflow(i);
+#endif
+            i->sp -= cnt;
+            memset(i->sp, 0, cnt * sizeof(VMVALUE));
+            i->fp[F_FP] = i->link;
+            break;
+        case OP_RETURNZ:
+            VMPush(i, i->tos);
+            i->tos = 0;
+            // fall through
+        case OP_RETURN:
+            i->link = i->fp[F_FP];
+            // fall through
+        case OP_LRETURN:
+            i->pc = (uint8_t *)i->image + Top(i);
+            i->sp = i->fp + ((VMUVALUE)i->link >> F_ARGC_SHIFT);
+            i->fp = (VMVALUE *)(i->stackBase + (i->link & F_FP_MASK));
+            break;
+        case OP_DROP:
+            i->tos = Pop(i);
+            break;
+        case OP_DUP:
+            VMPush(i, i->tos);
+            break;
+        case OP_NATIVE:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            DoNative(i, (VMUVALUE)tmp);
+            break;
+        case OP_TRAP:
+            DoTrap(i, VMCODEBYTE(i->pc++));
+            break;
+        case OP_MEMCPY:
+        case OP_MEMSET:
+        case OP_MEMCMP:
+        case OP_MEMCHR:
+            cnt = VMCODEBYTE(i->pc - 1);
+            DoBlockOp(i, cnt, VMCODEBYTE(i->pc++));
+            break;
+        case OP_RINGPUT:
+        case OP_RINGGET:
+        case OP_RINGPEEK:
+            DoRingOp(i, VMCODEBYTE(i->pc - 1));
+            break;
+        case OP_STRLEN:
+            i->tos = StringLength(i, (VMUVALUE)i->tos);
+            break;
+        case OP_HUBADDR:
+            i->tos = (VMVALUE)HubAddress(i, (VMUVALUE)i->tos);
+            break;
+        case OP_COGID:
+            VMPush(i, i->tos);
+            i->tos = i->cogId;
+            break;
+        case OP_CLKFREQ:
+            VMPush(i, i->tos);
+            i->tos = ReadHub(i, 0, sizeof(VMVALUE));
+            break;
+        case OP_WAITCNT:
+            /* the virtual counter jumps to the end of the wait */
+            WaitCount(i, (VMUVALUE)i->tos);
+            break;
+        case OP_CALL:
+            utmp = VMCODEBYTE(i->pc++);
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            VMPush(i, i->tos);
+            i->tos = (VMVALUE)(i->pc - (uint8_t *)i->image);
+            i->pc = (uint8_t *)MapAddress(i, tmp);
+            i->link = (VMVALUE)(i->fp - i->stackBase) | (utmp << F_ARGC_SHIFT);
+            i->fp = i->sp;
+            break;
+        case OP_TCALL:
+            utmp = VMCODEBYTE(i->pc++);
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            VMPush(i, i->tos);
+            i->tos = i->sp[utmp];
+            i->link = i->fp[F_FP];
+            memcpy(i->fp, i->sp, utmp * sizeof(VMVALUE));
+            i->sp = i->fp;
+            i->pc = (uint8_t *)MapAddress(i, tmp);
+            break;
+        case OP_SWITCH:
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            utmp = (VMUVALUE)i->tos - (VMUVALUE)tmp;
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            if (utmp < (VMUVALUE)tmp)
+                i->pc += (utmp + 1) * sizeof(VMVALUE);
+            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
+                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
+            i->pc += tmp;
+            break;
+        default:
+            Abort(i, "undefined opcode 0x%02x", VMCODEBYTE(i->pc - 1));
+            break;
+        }
+#if VM_CHECKED
+        /* stop the program when it has run out of instructions */
+        if (i->limit > 0 && --i->limit == 0)
+            return TRUE;
+
+        /* give the other cogs a turn at the end of a time slice */
+        if (i->slice > 0 && --i->slice == 0)
+            return VM_YIELD;
+#endif
+    }
+}
+
+#undef VMPush
@@ -0,0 +1,580 @@
+/* db_vmnative.c - emulation of the propeller hardware used through OP_NATIVE
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * On the propeller, OP_NATIVE executes a PASM instruction in the cog that
+ * runs the VM.  The interpreter decodes the same instructions against an
+ * emulated cog and hub: the ALU instructions with their conditions and
+ * flag effects, the hub reads and writes, the hub operations and the
+ * waits.  The cog registers t1-t4 live in the register block, tos and
+ * base are the interpreter's registers and CNT is a virtual counter that
+ * advances by VM_OP_CYCLES for each VM instruction.  Jumps only make sense
+ * within the cog code of the VM and stop the program.
+ *
+ * The hub sections of the image are moved into a 32K hub at HUB_IMAGE_BASE
+ * so that a vm address plus base is the hub address of the same memory as
+ * it is on the propeller.  The first long of the hub is CLKFREQ and the
+ * byte after it is CLKMODE.
+ *
+ * The program can start a function on each of the other seven cogs.  Each
+ * cog is an interpreter of its own that shares the hub with the others.
+ * The cogs run on host threads or, given a time slice, in turn on one
+ * thread with the cog furthest behind in virtual time going next so that
+ * a run can be repeated exactly.  The hub lock serializes the hub
+ * operations so that the hardware locks are atomic, and the cogs take it
+ * to use the terminal or start a cog, giving it back while they wait for
+ * input.  Hub accesses wait for the cog's slot in the hub rotation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "db_vm.h"
+#include "db_p1alu.h"
+
+#ifdef VM_THREADS
+#include <pthread.h>
+#endif
+
+/* hub address of vm address zero */
+#define HUB_IMAGE_BASE  0x0010
+
+/* clock mode for XTAL1+PLL16X */
+#define VM_CLKMODE      0x6f
+
+/* hub addresses are sixteen bits and the upper half is ROM */
+#define HUB_ADDR_MASK   0xffff
+
+/* instruction fields */
+#define OPCODE_SHIFT    26
+#define Z_BIT           (1 << 25)
+#define C_BIT           (1 << 24)
+#define R_BIT           (1 << 23)
+#define I_BIT           (1 << 22)
+#define COND_SHIFT      18
+#define DST_SHIFT       9
+#define FIELD_MASK      0x1ff
+
+/* flag bits in the interpreter (the same as save_zc in xbasic_vm.spin) */
+#define C_FLAG          1
+#define Z_FLAG          2
+
+/* cog registers */
+#define REG_TOS         0x005
+#define REG_BASE        0x006
+#define REG_PAR         0x1f0
+#define REG_CNT         0x1f1
+#define REG_INA         0x1f2
+#define REG_INB         0x1f3
+#define REG_OUTA        0x1f4
+#define REG_DIRA        0x1f6
+
+/* cycles taken by instructions and hub accesses */
+#define INST_CYCLES     4
+#define HUB_CYCLES      4
+
+/* cycles in a turn of the hub around all of the cogs */
+#define HUB_WINDOW      16
+
+/* number of hardware locks */
+#define LOCK_COUNT      8
+
+/* cog statistics */
+typedef struct {
+    unsigned long starts;       /* number of times the cog was started */
+    VMUVALUE start;             /* virtual counter when the cog was last started */
+    unsigned long cycles;       /* cycles run */
+    unsigned long hubWait;      /* cycles spent waiting for the hub */
+    unsigned long lockSets;     /* LOCKSET attempts */
+    unsigned long lockFails;    /* LOCKSET attempts that found the lock set */
+} CogStats;
+
+/* emulated hub */
+struct Hub {
+    uint8_t mem[HUB_SIZE];
+    VMUVALUE base;              /* hub address of vm address zero */
+    int mapped;                 /* the hub sections of the image are in the hub */
+    int locksUsed;              /* locks allocated by LOCKNEW */
+    int lockState;              /* locks set by LOCKSET */
+    Interpreter *cogs[COG_COUNT]; /* interpreters of the cogs that have been started */
+    volatile int running;       /* cogs that are running */
+    volatile int stopRequests;  /* cogs that COGSTOP has asked to stop */
+    volatile int stopping;      /* the program is over */
+    int lastCog;                /* cog run last by the scheduler */
+    CogStats stats[COG_COUNT];
+#ifdef VM_THREADS
+    pthread_mutex_t mutex;      /* hub lock */
+    pthread_cond_t stopped;     /* signaled when a cog stops */
+#endif
+};
+
+static uint8_t *MapHub(Interpreter *i, VMUVALUE addr, int size);
+static void WriteHub(Interpreter *i, VMUVALUE addr, int size, VMVALUE value);
+static int HubWait(Interpreter *i);
+static VMUVALUE HubOp(Interpreter *i, VMUVALUE d, int op, int *pC);
+
+/* InitHub - create the hub and move the hub sections of the image into it */
+int InitHub(Interpreter *i)
+{
+    ImageHdr *image = i->image;
+    VMUVALUE end, extent = 0;
+    VMVALUE clkfreq = VM_CLKFREQ;
+    Hub *hub;
+    int j;
+
+    /* allocate the hub */
+    if (!(hub = (Hub *)xbGlobalAlloc(i->sys, sizeof(Hub))))
+        return FALSE;
+    memset(hub, 0, sizeof(Hub));
+    hub->base = HUB_IMAGE_BASE;
+    memcpy(&hub->mem[0], &clkfreq, sizeof(VMVALUE));
+    hub->mem[sizeof(VMVALUE)] = VM_CLKMODE;
+#ifdef VM_THREADS
+    pthread_mutex_init(&hub->mutex, NULL);
+    pthread_cond_init(&hub->stopped, NULL);
+#endif
+
+    /* find the end of the hub sections */
+    for (j = 0; j < image->sectionCount; ++j) {
+        ImageFileSection *section = image->sections[j].fileSection;
+        if (section->base < COG_BASE) {
+            end = section->base + section->size + section->zeroSize;
+            if (end > extent)
+                extent = end;
+        }
+    }
+
+    /* move the sections into the hub if they fit as they would on the propeller */
+    if (extent <= HUB_SIZE - hub->base) {
+        for (j = 0; j < image->sectionCount; ++j) {
+            ImageSection *section = &image->sections[j];
+            VMUVALUE base = section->fileSection->base;
+            if (base < COG_BASE) {
+                memcpy(&hub->mem[hub->base + base], section->data, section->fileSection->size + section->fileSection->zeroSize);
+                section->data = &hub->mem[hub->base + base];
+            }
+        }
+        hub->mapped = TRUE;
+    }
+
+    /* start the cog that runs the interpreter */
+    i->hub = hub;
+    memset(i->cogRegs, 0, sizeof(i->cogRegs));
+    i->cogId = 0;
+    i->flags = 0;
+    i->cnt = 0;
+    i->hubLocked = 0;
+    hub->cogs[0] = i;
+    hub->running = 1;
+    hub->stats[0].starts = 1;
+
+    return TRUE;
+}
+
+/* NewCog - get the interpreter of a free cog ready to run or return NULL if all of the cogs are running */
+Interpreter *NewCog(Interpreter *i)
+{
+    Hub *hub = i->hub;
+    Interpreter *cog = NULL;
+    int id;
+
+    LockHub(i);
+    for (id = 1; id < COG_COUNT; ++id)
+        if (!(hub->running & (1 << id))) {
+
+            /* the interpreter of a cog is kept for the next time the cog is started */
+            if (!(cog = hub->cogs[id])) {
+                if (!(cog = (Interpreter *)xbGlobalAlloc(i->sys, sizeof(Interpreter)))
+                ||  !(cog->stackBase = (VMVALUE *)xbGlobalAlloc(i->sys, i->image->stackSize * sizeof(VMVALUE)))) {
+                    cog = NULL;
+                    break;
+                }
+                hub->cogs[id] = cog;
+            }
+
+            /* the new cog shares the image, the terminal and the hub */
+            cog->sys = i->sys;
+            cog->image = i->image;
+            cog->stack = cog->stackBase;
+            cog->stackTop = cog->stack + i->image->stackSize;
+            cog->sp = cog->fp = cog->stackTop;
+            cog->tos = 0;
+            cog->linePos = 0;
+            cog->inputLine[0] = '\0';
+            cog->inputPtr = cog->inputLine;
+            cog->io = i->io;
+            cog->profile = NULL;
+            cog->cache = NULL;
+            cog->hub = hub;
+            memset(cog->cogRegs, 0, sizeof(cog->cogRegs));
+            cog->cogId = id;
+            cog->flags = 0;
+            cog->cnt = i->cnt;
+            cog->quantum = i->quantum;
+            cog->slice = 0;
+            cog->limit = 0;
+            cog->hubLocked = 0;
+            cog->taskCount = 0;
+            cog->task = 0;
+
+            hub->running |= 1 << id;
+            hub->stopRequests &= ~(1 << id);
+            ++hub->stats[id].starts;
+            hub->stats[id].start = cog->cnt;
+            break;
+        }
+    UnlockHub(i);
+
+    return cog;
+}
+
+/* StopCog - free the cog of an interpreter that has halted or stopped */
+void StopCog(Interpreter *cog)
+{
+    Hub *hub = cog->hub;
+    LockHub(cog);
+    hub->stats[cog->cogId].cycles += cog->cnt - hub->stats[cog->cogId].start;
+    hub->running &= ~(1 << cog->cogId);
+#ifdef VM_THREADS
+    pthread_cond_broadcast(&hub->stopped);
+#endif
+    UnlockHub(cog);
+}
+
+/* StopCogs - stop the other cogs at the end of the program */
+void StopCogs(Interpreter *i)
+{
+    Hub *hub = i->hub;
+    int id;
+
+    LockHub(i);
+    hub->stopping = TRUE;
+
+#ifdef VM_THREADS
+    /* wait for the cogs on threads to finish their time slices */
+    if (!i->quantum)
+        while (hub->running & ~(1 << i->cogId))
+            pthread_cond_wait(&hub->stopped, &hub->mutex);
+#endif
+
+    /* stop the cogs left waiting for the scheduler */
+    for (id = 0; id < COG_COUNT; ++id)
+        if (hub->running & (1 << id)) {
+            hub->stats[id].cycles += hub->cogs[id]->cnt - hub->stats[id].start;
+            hub->running &= ~(1 << id);
+        }
+
+    UnlockHub(i);
+}
+
+/* StopRequested - check to see if a cog should stop at the end of its time slice */
+int StopRequested(Interpreter *cog)
+{
+    Hub *hub = cog->hub;
+    return hub->stopping || (hub->stopRequests & (1 << cog->cogId)) != 0;
+}
+
+/* NextCog - pick the running cog that is furthest behind in virtual time starting after the last cog run */
+Interpreter *NextCog(Interpreter *i)
+{
+    Hub *hub = i->hub;
+    Interpreter *next = NULL;
+    int id, n;
+    for (n = 1; n <= COG_COUNT; ++n) {
+        id = (hub->lastCog + n) % COG_COUNT;
+        if ((hub->running & (1 << id))
+        &&  (!next || (VMVALUE)(hub->cogs[id]->cnt - next->cnt) < 0))
+            next = hub->cogs[id];
+    }
+    hub->lastCog = next->cogId;
+    return next;
+}
+
+/* WaitCount - advance the virtual counter to the end of a WAITCNT */
+void WaitCount(Interpreter *i, VMUVALUE target)
+{
+    /* a target that has already passed would wait for the counter to wrap */
+    if ((VMVALUE)(target - i->cnt) > 0)
+        i->cnt = target;
+}
+
+/* LockHub - take the hub lock or add to the cog's hold on it */
+void LockHub(Interpreter *i)
+{
+    if (i->hubLocked++ == 0) {
+#ifdef VM_THREADS
+        pthread_mutex_lock(&i->hub->mutex);
+#endif
+    }
+}
+
+/* UnlockHub - give back the hub lock when the cog's outermost hold on it ends */
+void UnlockHub(Interpreter *i)
+{
+    if (--i->hubLocked == 0) {
+#ifdef VM_THREADS
+        pthread_mutex_unlock(&i->hub->mutex);
+#endif
+    }
+}
+
+/* ReleaseHub - give back the hub lock however deeply the cog holds it */
+void ReleaseHub(Interpreter *i)
+{
+    if (i->hubLocked > 0) {
+        i->hubLocked = 1;
+        UnlockHub(i);
+    }
+}
+
+/* WriteCogStats - write the cycle, hub and lock statistics of each cog that has run */
+int WriteCogStats(Interpreter *i, const char *name)
+{
+    Hub *hub = i->hub;
+    CogStats *stats;
+    FILE *fp;
+    int id;
+
+    if (!(fp = fopen(name, "w")))
+        return FALSE;
+
+    fprintf(fp, "cog  starts      cycles    hub wait  locksets lockfails\n");
+    for (id = 0; id < COG_COUNT; ++id) {
+        stats = &hub->stats[id];
+        if (stats->starts > 0)
+            fprintf(fp, "%3d %7lu %11lu %11lu %9lu %9lu\n",
+                    id,
+                    stats->starts,
+                    stats->cycles,
+                    stats->hubWait,
+                    stats->lockSets,
+                    stats->lockFails);
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
+/* HubAddress - convert a vm address to a hub address */
+VMUVALUE HubAddress(Interpreter *i, VMUVALUE addr)
+{
+    return addr + i->hub->base;
+}
+
+/* ReadHub - read a byte, word or long from the hub */
+VMVALUE ReadHub(Interpreter *i, VMUVALUE addr, int size)
+{
+    uint8_t *p;
+    if (!(p = MapHub(i, addr, size)))
+        return 0;
+    switch (size) {
+    case 1:
+        return *p;
+    case 2:
+        return *(uint16_t *)p;
+    default:
+        return *(VMVALUE *)p;
+    }
+}
+
+/* WriteHub - write a byte, word or long to the hub */
+static void WriteHub(Interpreter *i, VMUVALUE addr, int size, VMVALUE value)
+{
+    uint8_t *p;
+    if (!(p = MapHub(i, addr, size)))
+        return;
+    switch (size) {
+    case 1:
+        *p = value;
+        break;
+    case 2:
+        *(uint16_t *)p = value;
+        break;
+    default:
+        *(VMVALUE *)p = value;
+        break;
+    }
+}
+
+/* MapHub - map an aligned hub address or return NULL for ROM */
+static uint8_t *MapHub(Interpreter *i, VMUVALUE addr, int size)
+{
+    addr &= HUB_ADDR_MASK & ~(size - 1);
+    if (addr >= HUB_SIZE)
+        return NULL;
+    if (!i->hub->mapped && addr >= i->hub->base)
+        Abort(i, "image is too large for the hub");
+    return &i->hub->mem[addr];
+}
+
+/* ReadCogRegister - read a cog register */
+VMVALUE ReadCogRegister(Interpreter *i, int reg)
+{
+    switch (reg) {
+    case REG_TOS:
+        return i->tos;
+    case REG_BASE:
+        return (VMVALUE)i->hub->base;
+    case REG_CNT:
+        return (VMVALUE)i->cnt;
+    case REG_INA:
+        /* there are no pins so only the pins driven by the cog can be read */
+        return i->cogRegs[REG_OUTA] & i->cogRegs[REG_DIRA];
+    default:
+        return i->cogRegs[reg & FIELD_MASK];
+    }
+}
+
+/* WriteCogRegister - write a cog register */
+void WriteCogRegister(Interpreter *i, int reg, VMVALUE value)
+{
+    switch (reg) {
+    case REG_TOS:
+        i->tos = value;
+        break;
+    case REG_BASE:
+    case REG_PAR:
+    case REG_CNT:
+    case REG_INA:
+    case REG_INB:
+        /* base belongs to the vm and the rest are read-only */
+        break;
+    default:
+        i->cogRegs[reg & FIELD_MASK] = value;
+        break;
+    }
+}
+
+/* DoNative - execute a native instruction */
+void DoNative(Interpreter *i, VMUVALUE inst)
+{
+    int op = inst >> OPCODE_SHIFT;
+    int cond = (inst >> COND_SHIFT) & 0xf;
+    int dst = (inst >> DST_SHIFT) & FIELD_MASK;
+    int cin = (i->flags & C_FLAG) != 0;
+    int zin = (i->flags & Z_FLAG) != 0;
+    int write = (inst & R_BIT) != 0;
+    int c = cin, extend = FALSE;
+    uint32_t d, s, r;
+
+    /* skip the instruction if its condition isn't met */
+    i->cnt += INST_CYCLES;
+    if (!(cond & (1 << ((cin << 1) | zin))))
+        return;
+
+    /* get the operands */
+    d = (VMUVALUE)ReadCogRegister(i, dst);
+    s = (inst & I_BIT) ? (inst & FIELD_MASK) : (VMUVALUE)ReadCogRegister(i, inst & FIELD_MASK);
+
+    switch (op) {
+    case 0x00:  /* WRBYTE, RDBYTE */
+    case 0x01:  /* WRWORD, RDWORD */
+    case 0x02:  /* WRLONG, RDLONG */
+        if (write)
+            r = (VMUVALUE)ReadHub(i, s, 1 << op);
+        else {
+            WriteHub(i, s, 1 << op, (VMVALUE)d);
+            r = d;
+        }
+        c = 0;
+        i->cnt += HubWait(i);
+        break;
+    case 0x03:  /* CLKSET, COGID, COGINIT, COGSTOP, LOCKNEW, LOCKRET, LOCKSET, LOCKCLR */
+        i->cnt += HubWait(i);
+        LockHub(i);
+        r = HubOp(i, d, s & 7, &c);
+        UnlockHub(i);
+        break;
+    case 0x3c:  /* WAITPEQ */
+    case 0x3d:  /* WAITPNE */
+        /* nothing else drives the pins so a wait that isn't over never ends */
+        if (((ReadCogRegister(i, REG_INA) & s) == d) != (op == 0x3c))
+            Abort(i, "%s waits forever", op == 0x3c ? "WAITPEQ" : "WAITPNE");
+        r = d;
+        i->cnt += 2;
+        break;
+    case 0x3e:  /* WAITCNT */
+        WaitCount(i, d);
+        r = d + s;
+        c = r < d;
+        i->cnt += 2;
+        break;
+    case 0x3f:  /* WAITVID */
+        r = d;
+        break;
+    default:
+        /* anything that isn't an ALU instruction is JMPRET, DJNZ, TJNZ or TJZ */
+        if (!P1Alu(op, d, s, cin, zin, &r, &c, &extend))
+            Abort(i, "can't jump from a native instruction: %08x", inst);
+        break;
+    }
+
+    /* store the result and the flags */
+    if (write)
+        WriteCogRegister(i, dst, (VMVALUE)r);
+    if (inst & Z_BIT) {
+        if (r == 0 && (!extend || zin))
+            i->flags |= Z_FLAG;
+        else
+            i->flags &= ~Z_FLAG;
+    }
+    if (inst & C_BIT) {
+        if (c)
+            i->flags |= C_FLAG;
+        else
+            i->flags &= ~C_FLAG;
+    }
+}
+
+/* HubWait - get the cycles a hub access takes including the wait for the cog's turn */
+static int HubWait(Interpreter *i)
+{
+    int wait = (i->cogId * 2 - i->cnt) & (HUB_WINDOW - 1);
+    i->hub->stats[i->cogId].hubWait += wait;
+    return wait + HUB_CYCLES;
+}
+
+/* HubOp - execute a hub operation with the hub locked */
+static VMUVALUE HubOp(Interpreter *i, VMUVALUE d, int op, int *pC)
+{
+    Hub *hub = i->hub;
+    int id = d & (LOCK_COUNT - 1);
+    *pC = 0;
+    switch (op) {
+    case 0: /* CLKSET */
+        break;
+    case 1: /* COGID */
+        return i->cogId;
+    case 2: /* COGINIT */
+        /* only bytecode functions can be run on the other cogs */
+        *pC = 1;
+        return 7;
+    case 3: /* COGSTOP */
+        /* a cog running bytecode stops at the end of its time slice */
+        if ((d & 7) != 0 && (hub->running & (1 << (d & 7))))
+            hub->stopRequests |= 1 << (d & 7);
+        return d & 7;
+    case 4: /* LOCKNEW */
+        for (id = 0; id < LOCK_COUNT; ++id)
+            if (!(hub->locksUsed & (1 << id))) {
+                hub->locksUsed |= 1 << id;
+                return id;
+            }
+        *pC = 1;
+        return 7;
+    case 5: /* LOCKRET */
+        hub->locksUsed &= ~(1 << id);
+        return id;
+    case 6: /* LOCKSET */
+        *pC = (hub->lockState & (1 << id)) != 0;
+        hub->lockState |= 1 << id;
+        ++hub->stats[i->cogId].lockSets;
+        if (*pC)
+            ++hub->stats[i->cogId].lockFails;
+        return id;
+    case 7: /* LOCKCLR */
+        *pC = (hub->lockState & (1 << id)) != 0;
+        hub->lockState &= ~(1 << id);
+        return id;
+    }
+    return d;
+}
@@ -0,0 +1,284 @@
+/* db_vmprof.c - execution profiler
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The profiler counts the instructions executed at each offset of the
+ * text section and the calls made from each call site.  When the program
+ * ends, the counts are summarized by statement using the statement map
+ * written by xbcom -g and written as a profile for xbcom -P.  The file
+ * formats are described in db_profile.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "db_vm.h"
+
+/* map and profile format versions */
+#define MAP_VERSION     2
+#define PROFILE_VERSION 2
+
+/* statement that generated no code */
+#define NO_ADDRESS      0xffffffff
+
+/* initial size of the call edge hash table (must be a power of two) */
+#define INITIAL_EDGES   256
+
+/* function in the statement map */
+typedef struct MapFunction MapFunction;
+struct MapFunction {
+    MapFunction *next;
+    VMUVALUE addr;              /* address of the function code */
+    VMUVALUE size;              /* size of the function code */
+    int statementCount;         /* number of statements in the function */
+    VMUVALUE *statementAddrs;   /* statement addresses indexed by statement number */
+    VMUVALUE *statementHashes;  /* statement source line hashes indexed by statement number */
+    unsigned long calls;        /* number of calls to the function */
+    char name[1];
+};
+
+/* call edge */
+typedef struct {
+    VMUVALUE site;              /* text offset of the call instruction */
+    VMUVALUE target;            /* text offset of the function called */
+    unsigned long count;
+} CallEdge;
+
+/* profiler state */
+struct Profile {
+    System *sys;
+    uint8_t *code;              /* text section data */
+    VMUVALUE base;              /* text section base address */
+    VMUVALUE size;              /* text section size */
+    unsigned long *counts;      /* execution counts indexed by text offset */
+    CallEdge *edges;            /* hash table of call edges */
+    int edgeCount;
+    int edgeMax;
+    VMUVALUE site;              /* offset of the last instruction executed */
+    int inCall;                 /* last instruction executed was a call */
+    MapFunction *functions;     /* functions in the statement map */
+};
+
+static int ReadMap(Profile *p, const char *name);
+static void AddCallEdge(Profile *p, VMUVALUE site, VMUVALUE target);
+static CallEdge *FindCallEdge(CallEdge *edges, int max, VMUVALUE site, VMUVALUE target);
+static MapFunction *FindMapFunction(Profile *p, VMUVALUE addr);
+static int FindStatement(MapFunction *function, VMUVALUE addr);
+static void *ProfileAlloc(Profile *p, size_t size);
+
+/* InitProfile - start profiling the text section of an image */
+Profile *InitProfile(System *sys, ImageHdr *image, const char *imageName)
+{
+    char mapName[PATH_MAX], *end;
+    Profile *p;
+
+    /* allocate the profiler state */
+    if (!(p = (Profile *)xbGlobalAlloc(sys, sizeof(Profile))))
+        return NULL;
+    memset(p, 0, sizeof(Profile));
+    p->sys = sys;
+
+    /* the text section is always the first section */
+    p->code = image->sections[0].data;
+    p->base = image->sections[0].fileSection->base;
+    p->size = image->sections[0].fileSection->size;
+    p->counts = (unsigned long *)ProfileAlloc(p, p->size * sizeof(unsigned long));
+    memset(p->counts, 0, p->size * sizeof(unsigned long));
+    p->edgeMax = INITIAL_EDGES;
+    p->edges = (CallEdge *)ProfileAlloc(p, p->edgeMax * sizeof(CallEdge));
+    memset(p->edges, 0, p->edgeMax * sizeof(CallEdge));
+
+    /* read the statement map that xbcom -g wrote next to the image */
+    strncpy(mapName, imageName, sizeof(mapName) - 5);
+    mapName[sizeof(mapName) - 5] = '\0';
+    if ((end = strrchr(mapName, '.')) != NULL && !strpbrk(end, "/\\"))
+        *end = '\0';
+    strcat(mapName, ".map");
+    if (!ReadMap(p, mapName))
+        Fatal(sys, "can't read statement map '%s' (compile with xbcom -g)", mapName);
+
+    /* return the profiler state */
+    return p;
+}
+
+/* ProfileInstruction - count the execution of the instruction at pc */
+void ProfileInstruction(Profile *p, uint8_t *pc)
+{
+    VMUVALUE offset = (VMUVALUE)(pc - p->code);
+    int op;
+
+    /* instructions outside of the text section aren't counted */
+    if (offset >= p->size) {
+        p->inCall = FALSE;
+        return;
+    }
+
+    /* the instruction after a call is the entry to the function called */
+    if (p->inCall)
+        AddCallEdge(p, p->site, offset);
+    ++p->counts[offset];
+
+    /* remember calls to record the edge on the next instruction */
+    op = VMCODEBYTE(pc);
+    p->inCall = (op == OP_CALL || op == OP_TCALL || op == OP_PUSHJ);
+    p->site = offset;
+}
+
+/* WriteProfile - write the statement and call counts by function */
+int WriteProfile(Profile *p, const char *name)
+{
+    MapFunction *function, *callee;
+    CallEdge *edge;
+    FILE *fp;
+    int i;
+
+    /* count the calls to each function */
+    for (i = 0, edge = p->edges; i < p->edgeMax; ++i, ++edge)
+        if (edge->count > 0 && (callee = FindMapFunction(p, p->base + edge->target)) != NULL)
+            callee->calls += edge->count;
+
+    /* create the profile */
+    if (!(fp = fopen(name, "w")))
+        return FALSE;
+    fprintf(fp, "xbprofile %d\n", PROFILE_VERSION);
+
+    /* write each function */
+    for (function = p->functions; function != NULL; function = function->next) {
+        fprintf(fp, "function %s %d %lu\n", function->name, function->statementCount, function->calls);
+        for (i = 1; i <= function->statementCount; ++i) {
+            VMUVALUE addr = function->statementAddrs[i];
+            unsigned long count = 0;
+            if (addr != NO_ADDRESS && addr - p->base < p->size)
+                count = p->counts[addr - p->base];
+            fprintf(fp, "stmt %d %lu %08x\n", i, count, function->statementHashes[i]);
+        }
+        for (i = 0, edge = p->edges; i < p->edgeMax; ++i, ++edge)
+            if (edge->count > 0 && FindMapFunction(p, p->base + edge->site) == function) {
+                if ((callee = FindMapFunction(p, p->base + edge->target)) != NULL
+                &&  callee->addr == p->base + edge->target)
+                    fprintf(fp, "call %d %s %lu\n", FindStatement(function, p->base + edge->site), callee->name, edge->count);
+            }
+    }
+
+    /* close the profile */
+    fclose(fp);
+    return TRUE;
+}
+
+/* ReadMap - read the statement map */
+static int ReadMap(Profile *p, const char *name)
+{
+    MapFunction *function = NULL, **pNext = &p->functions;
+    char line[256], fname[32];
+    VMUVALUE addr, size, hash;
+    int version, index;
+    FILE *fp;
+
+    /* open the map and check its version */
+    if (!(fp = fopen(name, "r")))
+        return FALSE;
+    if (!fgets(line, sizeof(line), fp)
+    ||  sscanf(line, "xbmap %d", &version) != 1
+    ||  version != MAP_VERSION) {
+        fclose(fp);
+        return FALSE;
+    }
+
+    /* read the functions and their statement addresses */
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "function %31s %x %u %d", fname, &addr, &size, &index) == 4 && index >= 0) {
+            function = (MapFunction *)ProfileAlloc(p, sizeof(MapFunction) + strlen(fname));
+            memset(function, 0, sizeof(MapFunction));
+            strcpy(function->name, fname);
+            function->addr = addr;
+            function->size = size;
+            function->statementCount = index;
+            function->statementAddrs = (VMUVALUE *)ProfileAlloc(p, (index + 1) * sizeof(VMUVALUE));
+            memset(function->statementAddrs, 0xff, (index + 1) * sizeof(VMUVALUE));
+            function->statementHashes = (VMUVALUE *)ProfileAlloc(p, (index + 1) * sizeof(VMUVALUE));
+            memset(function->statementHashes, 0, (index + 1) * sizeof(VMUVALUE));
+            *pNext = function;
+            pNext = &function->next;
+        }
+        else if (function && sscanf(line, "stmt %d %x %x", &index, &addr, &hash) == 3) {
+            if (index > 0 && index <= function->statementCount) {
+                function->statementAddrs[index] = addr;
+                function->statementHashes[index] = hash;
+            }
+        }
+    }
+
+    /* close the map */
+    fclose(fp);
+    return TRUE;
+}
+
+/* AddCallEdge - count a call from a call site to a function */
+static void AddCallEdge(Profile *p, VMUVALUE site, VMUVALUE target)
+{
+    CallEdge *edge;
+
+    /* grow the hash table when it gets half full */
+    if (p->edgeCount * 2 >= p->edgeMax) {
+        CallEdge *edges = (CallEdge *)ProfileAlloc(p, p->edgeMax * 2 * sizeof(CallEdge));
+        int i;
+        memset(edges, 0, p->edgeMax * 2 * sizeof(CallEdge));
+        for (i = 0; i < p->edgeMax; ++i)
+            if (p->edges[i].count > 0)
+                *FindCallEdge(edges, p->edgeMax * 2, p->edges[i].site, p->edges[i].target) = p->edges[i];
+        p->edges = edges;
+        p->edgeMax *= 2;
+    }
+
+    /* count the call */
+    edge = FindCallEdge(p->edges, p->edgeMax, site, target);
+    if (edge->count == 0) {
+        edge->site = site;
+        edge->target = target;
+        ++p->edgeCount;
+    }
+    ++edge->count;
+}
+
+/* FindCallEdge - find a call edge or the empty slot where it belongs */
+static CallEdge *FindCallEdge(CallEdge *edges, int max, VMUVALUE site, VMUVALUE target)
+{
+    int i = (int)((site * 31 + target) & (max - 1));
+    while (edges[i].count > 0 && (edges[i].site != site || edges[i].target != target))
+        i = (i + 1) & (max - 1);
+    return &edges[i];
+}
+
+/* FindMapFunction - find the function containing an address */
+static MapFunction *FindMapFunction(Profile *p, VMUVALUE addr)
+{
+    MapFunction *function;
+    for (function = p->functions; function != NULL; function = function->next)
+        if (addr >= function->addr && addr < function->addr + function->size)
+            return function;
+    return NULL;
+}
+
+/* FindStatement - find the statement containing an address */
+static int FindStatement(MapFunction *function, VMUVALUE addr)
+{
+    VMUVALUE best = 0;
+    int index = 0, i;
+    for (i = 1; i <= function->statementCount; ++i) {
+        VMUVALUE start = function->statementAddrs[i];
+        if (start != NO_ADDRESS && start <= addr && start >= best) {
+            best = start;
+            index = i;
+        }
+    }
+    return index;
+}
+
+/* ProfileAlloc - allocate memory for the profiler */
+static void *ProfileAlloc(Profile *p, size_t size)
+{
+    void *data;
+    if (!(data = xbGlobalAlloc(p->sys, size)))
+        Fatal(p->sys, "insufficient memory for the profiler");
+    return data;
+}
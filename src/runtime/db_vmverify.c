@@ -0,0 +1,575 @@
+/* db_vmverify.c - bytecode verifier
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The verifier follows every path through the code that can be reached
+ * from the main code before an image is run.  It checks that every opcode
+ * is valid, that branches land on instructions of the same function, that
+ * the stack is the same height on every path into an instruction, that
+ * nothing pops more than was pushed and that frame references stay within
+ * the arguments and the words pushed by the function.  A FRAME must have
+ * room for the saved link, TCALL takes the link from the frame and LRETURN
+ * from a function that has no frame and calls nothing.  It then finds the
+ * deepest the stack can get over the call graph.  An image that passes
+ * can't overflow the stack or reach outside of its frames and is run
+ * without the stack checks.  Recursion through anything but tail calls,
+ * calls through function pointers, tasks and a stack too small for the
+ * depth found leave the image to the checked interpreter with a line
+ * saying why.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "db_vm.h"
+#include "db_vmdebug.h"
+
+/* what is at each code offset */
+#define VC_UNKNOWN      0
+#define VC_INSTRUCTION  1
+#define VC_OPERAND      2
+
+/* depth that can't be bounded */
+#define UNBOUNDED       -1
+
+/* offset for errors that aren't at an instruction */
+#define NO_OFFSET       ((VMUVALUE)~0)
+
+/* verification results */
+#define VERIFY_OK       0   /* the image can run without the stack checks */
+#define VERIFY_CHECKED  1   /* the image is valid but needs the stack checks */
+#define VERIFY_INVALID  2   /* the image is malformed */
+
+/* analysis state of a function */
+#define VS_NEW          0
+#define VS_ACTIVE       1
+#define VS_PARTIAL      2
+#define VS_DONE         3
+
+/* function */
+typedef struct {
+    VMUVALUE entry;             /* code offset of the function */
+    int argc;                   /* number of arguments */
+    int depth;                  /* deepest the function alone gets */
+    int state;
+    int frames;                 /* frames created on the way to the function while active */
+    int total;                  /* deepest including the functions called or UNBOUNDED */
+} VerifyFunction;
+
+/* call from one function to another */
+typedef struct {
+    int caller;
+    int callee;
+    int depth;                  /* depth of the callee's frame pointer */
+    int tail;                   /* the callee reuses the caller's frame */
+} VerifyCall;
+
+/* verifier state */
+typedef struct {
+    Interpreter *i;
+    uint8_t *code;              /* text section data */
+    VMUVALUE base;              /* text section base address */
+    VMUVALUE size;              /* text section size */
+    uint8_t *what;              /* what is at each code offset */
+    int *depthAt;               /* stack depth before each instruction */
+    int *functionAt;            /* function containing each instruction */
+    VMUVALUE *work;             /* instructions waiting to be checked */
+    int workCount;
+    VerifyFunction *functions;
+    int functionCount;
+    int functionMax;
+    VerifyCall *calls;
+    int callCount;
+    int callMax;
+    VMUVALUE recursion;         /* function that calls itself through a frame */
+    int result;
+    char reason[80];
+    jmp_buf errorTarget;
+} Verifier;
+
+static void VerifyFunctionCode(Verifier *v, int index);
+static void FollowCode(Verifier *v, int index, VMUVALUE offset, int depth);
+static int AddFunction(Verifier *v, VMUVALUE addr, int argc);
+static void AddCall(Verifier *v, int caller, int callee, int depth, int tail);
+static VMVALUE CodeWord(Verifier *v, VMUVALUE offset);
+static int OpcodeFormat(int opcode);
+static int StackNeeded(Verifier *v, int index, int frames, int *pPartial);
+static void *VerifyAlloc(Verifier *v, size_t size);
+static void VerifyError(Verifier *v, int result, const char *reason, VMUVALUE offset);
+
+/* VerifyCode - verify the code of the image before it is run */
+int VerifyCode(Interpreter *i)
+{
+    ImageSection *text = &i->image->sections[0];
+    VMUVALUE offset;
+    int needed, partial, j;
+    Verifier v;
+
+    /* the text section is always the first section */
+    memset(&v, 0, sizeof(v));
+    v.i = i;
+    v.code = text->data;
+    v.base = text->fileSection->base;
+    v.size = text->fileSection->size;
+    v.recursion = NO_OFFSET;
+    v.result = VERIFY_OK;
+
+    if (setjmp(v.errorTarget) == 0) {
+
+        /* there can't be more functions or calls than call instructions */
+        v.functionMax = v.size / (2 + sizeof(VMVALUE)) + 1;
+        v.callMax = v.functionMax;
+        v.what = (uint8_t *)VerifyAlloc(&v, v.size);
+        v.depthAt = (int *)VerifyAlloc(&v, v.size * sizeof(int));
+        v.functionAt = (int *)VerifyAlloc(&v, v.size * sizeof(int));
+        v.work = (VMUVALUE *)VerifyAlloc(&v, v.size * sizeof(VMUVALUE));
+        v.functions = (VerifyFunction *)VerifyAlloc(&v, v.functionMax * sizeof(VerifyFunction));
+        v.calls = (VerifyCall *)VerifyAlloc(&v, v.callMax * sizeof(VerifyCall));
+        memset(v.what, VC_UNKNOWN, v.size);
+        for (offset = 0; offset < v.size; ++offset)
+            v.depthAt[offset] = -1;
+
+        /* check the main code and every function it calls */
+        AddFunction(&v, i->image->mainCode, 0);
+        for (j = 0; j < v.functionCount; ++j)
+            VerifyFunctionCode(&v, j);
+
+        /* find the deepest the stack can get */
+        partial = FALSE;
+        if ((needed = StackNeeded(&v, 0, 0, &partial)) == UNBOUNDED)
+            VerifyError(&v, VERIFY_CHECKED, "recursive call to the function", v.recursion);
+        if (needed > i->stackTop - i->stack)
+            VerifyError(&v, VERIFY_CHECKED, "stack is too small", NO_OFFSET);
+    }
+
+    /* say why the image can't run without the stack checks */
+    if (v.result != VERIFY_OK)
+        xbError(i->sys, "verify: %s (running with stack checks)\n", v.reason);
+
+    /* free the verifier state */
+    xbLocalFreeAll(i->sys);
+
+    return v.result == VERIFY_OK;
+}
+
+/* VerifyFunctionCode - check every path through the code of a function */
+static void VerifyFunctionCode(Verifier *v, int index)
+{
+    VerifyFunction *function = &v->functions[index];
+    VMUVALUE offset, next, entry, target, lreturn = NO_OFFSET, tcall = NO_OFFSET;
+    int depth, size, callee, frame = FALSE, calls = FALSE, j;
+    VMVALUE count;
+
+    /* the function starts with nothing pushed below its frame pointer */
+    v->workCount = 0;
+    FollowCode(v, index, function->entry, 0);
+
+    while (v->workCount > 0) {
+        offset = v->work[--v->workCount];
+        depth = v->depthAt[offset];
+
+        /* find the size of the instruction */
+        switch (OpcodeFormat(v->code[offset])) {
+        case FMT_NONE:
+            size = 1;
+            break;
+        case FMT_BYTE:
+        case FMT_SBYTE:
+            size = 2;
+            break;
+        case FMT_WORD:
+        case FMT_NATIVE:
+        case FMT_BR:
+            size = 1 + sizeof(VMVALUE);
+            break;
+        case FMT_CALL:
+            size = 2 + sizeof(VMVALUE);
+            break;
+        case FMT_LOCALI:
+            size = 3;
+            break;
+        case FMT_SWITCH:
+            if (offset + 1 + 2 * sizeof(VMVALUE) > v->size)
+                VerifyError(v, VERIFY_INVALID, "truncated instruction", offset);
+            count = CodeWord(v, offset + 1 + sizeof(VMVALUE));
+            if (count < 0 || (VMUVALUE)count >= (v->size - offset) / sizeof(VMVALUE))
+                VerifyError(v, VERIFY_INVALID, "bad case count", offset);
+            size = 1 + (count + 3) * sizeof(VMVALUE);
+            break;
+        default:
+            VerifyError(v, VERIFY_INVALID, "undefined opcode", offset);
+            size = 0; // not reached
+            break;
+        }
+        if (offset + size > v->size)
+            VerifyError(v, VERIFY_INVALID, "truncated instruction", offset);
+
+        /* make sure the instruction doesn't overlap another */
+        for (j = 1; j < size; ++j) {
+            if (v->what[offset + j] == VC_INSTRUCTION)
+                VerifyError(v, VERIFY_INVALID, "overlapping instructions", offset);
+            v->what[offset + j] = VC_OPERAND;
+        }
+        next = offset + size;
+
+        /* check the instruction and find where it goes */
+        switch (v->code[offset]) {
+        case OP_HALT:
+            next = 0;
+            break;
+        case OP_RETURN:
+        case OP_LRETURN:
+            if (v->code[offset] == OP_LRETURN)
+                lreturn = offset;
+
+            /* the return address is on the top of the stack */
+            if (--depth < 0)
+                VerifyError(v, VERIFY_INVALID, "stack underflow", offset);
+            next = 0;
+            break;
+        case OP_RETURNZ:
+            next = 0;
+            break;
+        case OP_POPJ:
+            VerifyError(v, VERIFY_CHECKED, "return to a computed address", offset);
+            break;
+        case OP_PUSHJ:
+            VerifyError(v, VERIFY_CHECKED, "call through a function pointer", offset);
+            break;
+        case OP_BR:
+            FollowCode(v, index, next + CodeWord(v, offset + 1), depth);
+            next = 0;
+            break;
+        case OP_BRT:
+        case OP_BRF:
+            --depth;
+            FollowCode(v, index, next + CodeWord(v, offset + 1), depth);
+            break;
+        case OP_BRTSC:
+        case OP_BRFSC:
+            FollowCode(v, index, next + CodeWord(v, offset + 1), depth);
+            --depth;
+            break;
+        case OP_SWITCH:
+            count = CodeWord(v, offset + 1 + sizeof(VMVALUE));
+            for (j = 0; j <= count; ++j) {
+                entry = offset + 1 + (j + 2) * sizeof(VMVALUE);
+                FollowCode(v, index, entry + sizeof(VMVALUE) + CodeWord(v, entry), depth);
+            }
+            next = 0;
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_REM:
+        case OP_FMUL:
+        case OP_FDIV:
+        case OP_BAND:
+        case OP_BOR:
+        case OP_BXOR:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_RSHR:
+        case OP_SHRU:
+        case OP_ROL:
+        case OP_ROR:
+        case OP_BITSET:
+        case OP_BITCLR:
+        case OP_BITTST:
+        case OP_BITTGL:
+        case OP_LT:
+        case OP_LE:
+        case OP_EQ:
+        case OP_NE:
+        case OP_GE:
+        case OP_GT:
+        case OP_INDEX:
+        case OP_DROP:
+            --depth;
+            break;
+        case OP_STORE:
+        case OP_STOREB:
+        case OP_STOREW:
+            depth -= 2;
+            break;
+        case OP_MEMCPY:
+        case OP_MEMSET:
+        case OP_MEMCMP:
+        case OP_MEMCHR:
+            /* blocks are made of bytes or words */
+            if (v->code[offset + 1] != 1 && v->code[offset + 1] != sizeof(VMVALUE))
+                VerifyError(v, VERIFY_INVALID, "invalid element size", offset);
+            depth -= 2;
+            break;
+        case OP_RINGPUT:
+        case OP_RINGGET:
+        case OP_RINGPEEK:
+            depth -= 2;
+            break;
+        case OP_LIT:
+        case OP_SLIT:
+        case OP_DUP:
+        case OP_COGID:
+        case OP_CLKFREQ:
+            ++depth;
+            break;
+        case OP_LREF:
+        case OP_LSET:
+        case OP_LADDI:
+            /* the frame offset must be an argument or a word pushed by the function */
+            j = (int8_t)v->code[offset + 1];
+            if (j < -depth || j >= function->argc)
+                VerifyError(v, VERIFY_INVALID, "frame offset out of range", offset);
+            if (v->code[offset] == OP_LREF)
+                ++depth;
+            else if (v->code[offset] == OP_LSET)
+                --depth;
+            break;
+        case OP_FRAME:
+            /* the frame holds the caller's link */
+            if (v->code[offset + 1] < -F_FP)
+                VerifyError(v, VERIFY_INVALID, "frame too small", offset);
+            depth += v->code[offset + 1];
+            frame = TRUE;
+            break;
+        case OP_CLEAN:
+            depth -= v->code[offset + 1];
+            break;
+        case OP_TRAP:
+            switch (v->code[offset + 1]) {
+            case TRAP_GETCHAR:
+            case TRAP_INPUTINT:
+                ++depth;
+                break;
+            case TRAP_PUTCHAR:
+            case TRAP_PRINTSTR:
+            case TRAP_PRINTINT:
+            case TRAP_PRINTHEX:
+            case TRAP_PRINTFIXED:
+            case TRAP_COGRUN:
+                --depth;
+                break;
+            case TRAP_PRINTTAB:
+            case TRAP_PRINTNL:
+            case TRAP_INPUTLINE:
+            case TRAP_INPUTSTR:
+            case TRAP_YIELD:
+                break;
+            case TRAP_TASKRUN:
+                /* each task runs on a slice of the stack */
+                VerifyError(v, VERIFY_CHECKED, "task started", offset);
+                break;
+            default:
+                VerifyError(v, VERIFY_INVALID, "undefined trap", offset);
+                break;
+            }
+            break;
+        case OP_CALL:
+            /* the caller's top of stack is pushed and the callee removes its arguments */
+            j = v->code[offset + 1];
+            if (j > depth + 1)
+                VerifyError(v, VERIFY_INVALID, "too few arguments on the stack", offset);
+            target = CodeWord(v, offset + 2);
+            callee = AddFunction(v, target, j);
+            AddCall(v, index, callee, depth + 1, FALSE);
+            depth += 1 - j;
+            calls = TRUE;
+            break;
+        case OP_TCALL:
+            /* the arguments are moved into the caller's frame */
+            j = v->code[offset + 1];
+            if (j > depth || j > function->argc)
+                VerifyError(v, VERIFY_INVALID, "too few arguments on the stack", offset);
+            target = CodeWord(v, offset + 2);
+            callee = AddFunction(v, target, j);
+            AddCall(v, index, callee, 0, TRUE);
+            ++depth;
+            next = 0;
+            tcall = offset;
+            break;
+        default:
+            /* NOT, NEG, BNOT, LOAD, LOADB, LOADW, STRLEN, HUBADDR, WAITCNT and NATIVE leave the depth alone */
+            break;
+        }
+
+        /* check for popping more than was pushed */
+        if (depth < 0)
+            VerifyError(v, VERIFY_INVALID, "stack underflow", offset);
+        if (depth > function->depth)
+            function->depth = depth;
+
+        /* continue with the next instruction */
+        if (next != 0)
+            FollowCode(v, index, next, depth);
+    }
+
+    /* a call replaces the link that LRETURN uses and TCALL needs the link saved by FRAME */
+    if (lreturn != NO_OFFSET && frame)
+        VerifyError(v, VERIFY_INVALID, "LRETURN from a function with a frame", lreturn);
+    if (lreturn != NO_OFFSET && calls)
+        VerifyError(v, VERIFY_INVALID, "LRETURN from a function that makes calls", lreturn);
+    if (tcall != NO_OFFSET && !frame)
+        VerifyError(v, VERIFY_INVALID, "TCALL from a function without a frame", tcall);
+}
+
+/* FollowCode - add an instruction to be checked at a given depth */
+static void FollowCode(Verifier *v, int index, VMUVALUE offset, int depth)
+{
+    if (offset >= v->size)
+        VerifyError(v, VERIFY_INVALID, "branch outside of the code", offset);
+    switch (v->what[offset]) {
+    case VC_OPERAND:
+        VerifyError(v, VERIFY_INVALID, "branch into an instruction", offset);
+        break;
+    case VC_INSTRUCTION:
+        /* the instruction has already been reached by another path */
+        if (v->functionAt[offset] != index)
+            VerifyError(v, VERIFY_INVALID, "branch into another function", offset);
+        if (v->depthAt[offset] != depth)
+            VerifyError(v, VERIFY_INVALID, "stack height differs between paths", offset);
+        return;
+    }
+    v->what[offset] = VC_INSTRUCTION;
+    v->depthAt[offset] = depth;
+    v->functionAt[offset] = index;
+    v->work[v->workCount++] = offset;
+}
+
+/* AddFunction - add a function to be checked */
+static int AddFunction(Verifier *v, VMUVALUE addr, int argc)
+{
+    VerifyFunction *function;
+    int j;
+
+    /* the function must be in the text section */
+    if (addr < v->base || addr - v->base >= v->size)
+        VerifyError(v, VERIFY_INVALID, "call outside of the code", NO_OFFSET);
+
+    /* check for a function that has already been found */
+    for (j = 0; j < v->functionCount; ++j)
+        if (v->functions[j].entry == addr - v->base) {
+            if (v->functions[j].argc != argc)
+                VerifyError(v, VERIFY_INVALID, "inconsistent argument count", addr - v->base);
+            return j;
+        }
+
+    /* add the function */
+    if (v->functionCount >= v->functionMax)
+        VerifyError(v, VERIFY_INVALID, "too many functions", addr - v->base);
+    function = &v->functions[v->functionCount];
+    memset(function, 0, sizeof(VerifyFunction));
+    function->entry = addr - v->base;
+    function->argc = argc;
+    return v->functionCount++;
+}
+
+/* AddCall - add a call keeping only the deepest call from one function to another */
+static void AddCall(Verifier *v, int caller, int callee, int depth, int tail)
+{
+    VerifyCall *call;
+    int j;
+    for (j = 0, call = v->calls; j < v->callCount; ++j, ++call)
+        if (call->caller == caller && call->callee == callee && call->tail == tail) {
+            if (depth > call->depth)
+                call->depth = depth;
+            return;
+        }
+    if (v->callCount >= v->callMax)
+        VerifyError(v, VERIFY_INVALID, "too many calls", NO_OFFSET);
+    call->caller = caller;
+    call->callee = callee;
+    call->depth = depth;
+    call->tail = tail;
+    ++v->callCount;
+}
+
+/* CodeWord - get a word operand */
+static VMVALUE CodeWord(Verifier *v, VMUVALUE offset)
+{
+    VMVALUE value = 0;
+    int cnt;
+    for (cnt = sizeof(VMVALUE); --cnt >= 0; )
+        value = (value << 8) | v->code[offset++];
+    return value;
+}
+
+/* OpcodeFormat - get the operand format of an opcode */
+static int OpcodeFormat(int opcode)
+{
+    FLASH_SPACE OTDEF *op;
+    for (op = OpcodeTable; op->name; ++op)
+        if (op->code == opcode)
+            return op->fmt;
+    return -1;
+}
+
+/* StackNeeded - find the stack needed by a function and the functions it calls
+ *
+ * A function that is reached again through tail calls alone adds nothing to
+ * the stack needed by the function already being analyzed.  The functions
+ * on the way back to it are only partially analyzed and are analyzed again
+ * if they are reached another way.
+ */
+static int StackNeeded(Verifier *v, int index, int frames, int *pPartial)
+{
+    VerifyFunction *function = &v->functions[index];
+    int total, needed, partial = FALSE, j;
+    VerifyCall *call;
+
+    /* check for a function that has already been analyzed or that calls itself */
+    switch (function->state) {
+    case VS_ACTIVE:
+        if (frames == function->frames) {
+            *pPartial = TRUE;
+            return 0;
+        }
+        if (v->recursion == NO_OFFSET)
+            v->recursion = function->entry;
+        return UNBOUNDED;
+    case VS_DONE:
+        return function->total;
+    }
+    function->state = VS_ACTIVE;
+    function->frames = frames;
+
+    /* add the stack needed by each function called */
+    total = function->depth;
+    for (j = 0, call = v->calls; j < v->callCount && total != UNBOUNDED; ++j, ++call)
+        if (call->caller == index) {
+            needed = StackNeeded(v, call->callee, call->tail ? frames : frames + 1, &partial);
+            if (needed == UNBOUNDED)
+                total = UNBOUNDED;
+            else if (call->depth + needed > total)
+                total = call->depth + needed;
+        }
+
+    /* return the stack needed */
+    if (partial && total != UNBOUNDED) {
+        function->state = VS_PARTIAL;
+        *pPartial = TRUE;
+    }
+    else
+        function->state = VS_DONE;
+    function->total = total;
+    return total;
+}
+
+/* VerifyAlloc - allocate memory for the verifier */
+static void *VerifyAlloc(Verifier *v, size_t size)
+{
+    void *data;
+    if (!(data = xbLocalAlloc(v->i->sys, size)))
+        VerifyError(v, VERIFY_CHECKED, "insufficient memory", NO_OFFSET);
+    return data;
+}
+
+/* VerifyError - stop verifying the image */
+static void VerifyError(Verifier *v, int result, const char *reason, VMUVALUE offset)
+{
+    v->result = result;
+    if (offset == NO_OFFSET)
+        strcpy(v->reason, reason);
+    else
+        sprintf(v->reason, "%s at %08x", reason, v->base + offset);
+    longjmp(v->errorTarget, 1);
+}
@@ -5,6 +5,7 @@
 #include "mem_malloc.h"
 #include "db_vm.h"
 
+static void Usage(void);
 static void MyInfo(System *sys, const char *fmt, va_list ap);
 static void MyError(System *sys, const char *fmt, va_list ap);
 static SystemOps myOps = {
@@ -14,16 +15,65 @@ static SystemOps myOps = {
 
 int main(int argc, char *argv[])
 {
+    char *infile = NULL, *profile = NULL, *input = NULL, *output = NULL, *cogStats = NULL;
+    char *model = NULL, *cacheStats = NULL, *tuning = NULL;
+    FILE *in = stdin, *out = stdout;
+    int threshold = 0, quantum = 0, n;
+    unsigned long limit = 0;
     ImageHdr *image;
     Interpreter *i;
-    char *infile;
     System *sys;
     
-    if (argc != 2) {
-        fprintf(stderr, "usage: xbint <file>\n");
-        return 1;
+    for (n = 1; n < argc; ++n) {
+        if (argv[n][0] == '-') {
+            if (argv[n][2] != '\0' || n + 1 >= argc)
+                Usage();
+            switch (argv[n][1]) {
+            case 'p':
+                profile = argv[++n];
+                break;
+            case 'i':
+                input = argv[++n];
+                break;
+            case 'o':
+                output = argv[++n];
+                break;
+            case 'b':
+                if ((threshold = atoi(argv[++n])) <= 0)
+                    Usage();
+                break;
+            case 's':
+                if ((quantum = atoi(argv[++n])) <= 0)
+                    Usage();
+                break;
+            case 'n':
+                if ((limit = strtoul(argv[++n], NULL, 10)) == 0)
+                    Usage();
+                break;
+            case 'c':
+                cogStats = argv[++n];
+                break;
+            case 'm':
+                model = argv[++n];
+                break;
+            case 'k':
+                cacheStats = argv[++n];
+                break;
+            case 'a':
+                tuning = argv[++n];
+                break;
+            default:
+                Usage();
+                break;
+            }
+        }
+        else if (!infile)
+            infile = argv[n];
+        else
+            Usage();
     }
-    infile = argv[1];
+    if (!infile)
+        Usage();
     
     sys = MemInit();
     sys->ops = &myOps;
@@ -34,11 +84,82 @@ int main(int argc, char *argv[])
     if (!(i = (Interpreter *)InitInterpreter(sys, image)))
         Fatal(sys, "insufficient memory");
         
+    if (profile && !(i->profile = InitProfile(sys, image, infile)))
+        Fatal(sys, "insufficient memory");
+        
+    /* the cache model can name a board in xbasic.cfg */
+    if (cacheStats || tuning) {
+        if (model) {
+            xbAddEnvironmentPath();
+            ParseConfigurationFile(sys, "xbasic.cfg");
+        }
+        if (!(i->cache = InitCache(sys, image, model ? model : "", tuning != NULL)))
+            Fatal(sys, "insufficient memory");
+    }
+        
+    /* redirect the terminal */
+    if (input || output) {
+        if (input && !(in = fopen(input, "r")))
+            Fatal(sys, "can't open input file '%s'", input);
+        if (output && !(out = fopen(output, "w")))
+            Fatal(sys, "can't create output file '%s'", output);
+        if (!(i->io = InitFileIO(sys, in, out)))
+            Fatal(sys, "insufficient memory");
+    }
+    
+    /* buffer the output instead of writing each line */
+    if (threshold > 0)
+        SetIOFlush(i->io, threshold, FALSE);
+        
+    /* run the cogs in turn instead of on threads */
+    i->quantum = quantum;
+    
+    /* stop programs that never end after a number of instructions */
+    i->limit = limit;
+        
     Execute(i, image);
     
+    if (in != stdin)
+        fclose(in);
+    if (out != stdout)
+        fclose(out);
+    
+    if (profile && !WriteProfile(i->profile, profile))
+        Fatal(sys, "can't write profile '%s'", profile);
+    
+    if (cogStats && !WriteCogStats(i, cogStats))
+        Fatal(sys, "can't write cog statistics '%s'", cogStats);
+    
+    if (cacheStats && !WriteCacheStats(i->cache, cacheStats))
+        Fatal(sys, "can't write cache statistics '%s'", cacheStats);
+    
+    if (tuning && !WriteCacheTuning(i->cache, tuning))
+        Fatal(sys, "can't write cache tuning '%s'", tuning);
+    
     return 0;
 }
 
+/* Usage - display a usage message and exit */
+static void Usage(void)
+{
+    fprintf(stderr, "\
+usage: xbint\n\
+         [ -p <file> ]   write an execution profile\n\
+         [ -i <file> ]   read terminal input from a file\n\
+         [ -o <file> ]   write terminal output to a file\n\
+         [ -b <size> ]   buffer <size> bytes of terminal output instead of a line\n\
+         [ -s <count> ]  run the cogs in turn for <count> instructions at a time\n\
+         [ -n <count> ]  stop the program after <count> instructions\n\
+         [ -c <file> ]   write cycle, hub and lock statistics for each cog\n\
+         [ -m <model> ]  external memory cache: [<board>][,size=<n>][,line=<n>][,ways=<n>]\n\
+                         [,request=<cycles>][,miss=<cycles>][,byte=<cycles>]\n\
+         [ -k <file> ]   write cache hit rates and stall cycles\n\
+         [ -a <file> ]   try other cache sizes and recommend a cache-size\n\
+         <name>          image to run\n\
+");
+    exit(1);
+}
+
 static void MyInfo(System *sys, const char *fmt, va_list ap)
 {
     vfprintf(stdout, fmt, ap);
@@ -0,0 +1,502 @@
+/* db_p1.c - propeller emulator
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * Each cog executes PASM with the timing of the chip: four cycles for most
+ * instructions, eight for a DJNZ, TJNZ or TJZ that doesn't jump, six or more
+ * for the waits and eight to twenty-three for a hub instruction depending on
+ * where the hub is in its turn around the cogs.  The hub visits each cog
+ * once every sixteen cycles.  The cog that is furthest behind in time goes
+ * next so the cogs see each other's hub writes in the order the chip would
+ * make them.  The instruction after the current one is fetched before the
+ * result is written, so code that modifies the next instruction executes
+ * the old one as it does on the chip.
+ *
+ * The pins are the OR of the outputs of the running cogs and the devices
+ * connected to them see each change.  The counters accumulate their phase
+ * in the modes that don't depend on the pins but don't drive any pins, and
+ * there is no video generator and no ROM.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "db_p1.h"
+#include "db_p1alu.h"
+
+/* instruction fields */
+#define OPCODE_SHIFT    26
+#define Z_BIT           (1 << 25)
+#define C_BIT           (1 << 24)
+#define R_BIT           (1 << 23)
+#define I_BIT           (1 << 22)
+#define COND_SHIFT      18
+#define DST_SHIFT       9
+#define FIELD_MASK      0x1ff
+
+/* counter mode field */
+#define CTR_MODE_SHIFT  26
+#define CTR_MODE_MASK   0x1f
+#define CTR_MODE_DUTY   0x07    /* last of the PLL, NCO and DUTY modes */
+#define CTR_MODE_ALWAYS 0x1f    /* logic mode that accumulates on every cycle */
+
+/* cycles taken by instructions */
+#define INST_CYCLES     4
+#define NO_JUMP_CYCLES  8
+#define HUB_CYCLES      8
+#define WAIT_CYCLES     6
+
+/* cycles in a turn of the hub around all of the cogs */
+#define HUB_WINDOW      16
+
+/* cycles COGINIT takes to load a cog from the hub before it starts */
+#define LOAD_CYCLES     (P1_COG_SIZE * HUB_WINDOW + 8)
+
+static void Execute(P1 *p, P1Cog *cog);
+static int StartCog(P1 *p, int id, uint32_t code, uint32_t par, uint64_t now);
+static void StopCog(P1 *p, P1Cog *cog);
+static uint32_t HubOp(P1 *p, P1Cog *cog, uint32_t d, int op, int *pC);
+static int HubAccess(P1Cog *cog);
+static uint32_t ReadHub(P1 *p, uint32_t addr, int size);
+static void WriteHub(P1 *p, uint32_t addr, int size, uint32_t value);
+static uint32_t ReadRegister(P1 *p, P1Cog *cog, int reg);
+static void WriteRegister(P1 *p, P1Cog *cog, int reg, uint32_t value);
+static uint32_t UpdateCounter(P1Cog *cog, int n);
+static void UpdatePins(P1 *p);
+static int PinWait(P1 *p, P1Cog *cog);
+
+/* P1Init - reset the propeller with the clock settings in the first bytes of the hub */
+void P1Init(P1 *p, uint32_t clkfreq, uint8_t clkmode)
+{
+    int id;
+    memset(p, 0, sizeof(P1));
+    for (id = 0; id < P1_COG_COUNT; ++id) {
+        p->cogs[id].id = id;
+        p->cogs[id].fetchedAddr = -1;
+    }
+    P1WriteLong(p, 0, clkfreq);
+    p->hub[4] = clkmode;
+}
+
+/* P1AddDevice - connect a device to the pins */
+void P1AddDevice(P1 *p, P1Device *dev)
+{
+    dev->next = p->devices;
+    p->devices = dev;
+}
+
+/* P1CogInit - start a cog or the next free cog if id is negative and return its id or -1 */
+int P1CogInit(P1 *p, int id, uint32_t code, uint32_t par)
+{
+    return StartCog(p, id, code, par, P1Time(p));
+}
+
+/* P1CogStop - stop a cog */
+void P1CogStop(P1 *p, int id)
+{
+    StopCog(p, &p->cogs[id & 7]);
+}
+
+/* P1Step - execute an instruction on the cog that is furthest behind in time */
+int P1Step(P1 *p)
+{
+    P1Cog *cog, *next = NULL;
+    for (cog = p->cogs; cog < &p->cogs[P1_COG_COUNT]; ++cog)
+        if (cog->running && (!next || cog->time < next->time))
+            next = cog;
+    if (!next) {
+        strcpy(p->error, "no cogs are running");
+        return FALSE;
+    }
+    Execute(p, next);
+    return p->error[0] == '\0';
+}
+
+/* P1Time - get the cycle that the cog furthest behind has reached */
+uint64_t P1Time(P1 *p)
+{
+    uint64_t now = 0;
+    int found = FALSE;
+    P1Cog *cog;
+    for (cog = p->cogs; cog < &p->cogs[P1_COG_COUNT]; ++cog)
+        if (cog->running && (!found || cog->time < now)) {
+            now = cog->time;
+            found = TRUE;
+        }
+    if (!found) {
+        for (cog = p->cogs; cog < &p->cogs[P1_COG_COUNT]; ++cog)
+            if (cog->time > now)
+                now = cog->time;
+    }
+    return now;
+}
+
+/* P1ReadLong - read a long from the hub */
+uint32_t P1ReadLong(P1 *p, uint32_t addr)
+{
+    return ReadHub(p, addr, 4);
+}
+
+/* P1WriteLong - write a long to the hub */
+void P1WriteLong(P1 *p, uint32_t addr, uint32_t value)
+{
+    WriteHub(p, addr, 4, value);
+}
+
+/* P1Pins - get the state of the pins */
+uint32_t P1Pins(P1 *p)
+{
+    uint32_t pins = p->outputs;
+    P1Device *dev;
+    for (dev = p->devices; dev != NULL; dev = dev->next)
+        pins |= dev->drive & dev->value & ~p->dirs;
+    return pins;
+}
+
+/* Execute - execute the next instruction of a cog */
+static void Execute(P1 *p, P1Cog *cog)
+{
+    uint32_t inst, d, s, r;
+    int op, cond, dst, write, c, z, extend = FALSE;
+    int cycles = INST_CYCLES, next = (cog->pc + 1) & FIELD_MASK;
+    unsigned long starts = cog->starts;
+
+    /* let the watch function see the registers before the instruction executes */
+    if (cog->watch[cog->pc] && p->watchFcn && !cog->pinWait)
+        (*p->watchFcn)(p, cog, cog->pc, p->watchData);
+
+    /* get the instruction fetched while the last one executed */
+    inst = cog->fetchedAddr == cog->pc ? cog->fetched : cog->mem[cog->pc];
+    op = inst >> OPCODE_SHIFT;
+    cond = (inst >> COND_SHIFT) & 0xf;
+    dst = (inst >> DST_SHIFT) & FIELD_MASK;
+    write = (inst & R_BIT) != 0;
+
+    /* skip the instruction if its condition isn't met */
+    if (!(cond & (1 << ((cog->c << 1) | cog->z)))) {
+        cog->fetched = cog->mem[next];
+        cog->fetchedAddr = next;
+        cog->pc = next;
+        cog->time += cycles;
+        ++cog->instructions;
+        return;
+    }
+
+    /* get the operands */
+    d = cog->mem[dst];
+    s = (inst & I_BIT) ? (inst & FIELD_MASK) : ReadRegister(p, cog, inst & FIELD_MASK);
+    c = cog->c;
+    z = cog->z;
+
+    switch (op) {
+    case 0x00:  /* WRBYTE, RDBYTE */
+    case 0x01:  /* WRWORD, RDWORD */
+    case 0x02:  /* WRLONG, RDLONG */
+        cycles = HubAccess(cog);
+        if (write)
+            r = ReadHub(p, s, 1 << op);
+        else {
+            WriteHub(p, s, 1 << op, d);
+            r = d;
+        }
+        c = 0;
+        break;
+    case 0x03:  /* CLKSET, COGID, COGINIT, COGSTOP, LOCKNEW, LOCKRET, LOCKSET, LOCKCLR */
+        cycles = HubAccess(cog);
+        r = HubOp(p, cog, d, s & 7, &c);
+
+        /* the cog stopped or restarted itself */
+        if (!cog->running || cog->starts != starts)
+            return;
+        break;
+    case 0x17:  /* JMPRET, JMP, CALL, RET */
+        r = (d & ~FIELD_MASK) | next;
+        c = 0;
+        next = s & FIELD_MASK;
+        break;
+    case 0x39:  /* DJNZ */
+        r = d - 1;
+        c = d == 0;
+        if (r != 0)
+            next = s & FIELD_MASK;
+        else
+            cycles = NO_JUMP_CYCLES;
+        break;
+    case 0x3a:  /* TJNZ */
+    case 0x3b:  /* TJZ */
+        r = d;
+        c = 0;
+        if ((d != 0) == (op == 0x3a))
+            next = s & FIELD_MASK;
+        else
+            cycles = NO_JUMP_CYCLES;
+        break;
+    case 0x3c:  /* WAITPEQ */
+    case 0x3d:  /* WAITPNE */
+        if (((P1Pins(p) & s) == d) != (op == 0x3c)) {
+            PinWait(p, cog);
+            return;
+        }
+        cog->pinWait = FALSE;
+        r = d;
+        cycles = WAIT_CYCLES;
+        break;
+    case 0x3e:  /* WAITCNT */
+        cycles = WAIT_CYCLES + (uint32_t)(d - (uint32_t)(cog->time + WAIT_CYCLES));
+        r = d + s;
+        c = r < d;
+        break;
+    case 0x3f:  /* WAITVID */
+        r = d;
+        cycles = WAIT_CYCLES;
+        break;
+    default:
+        /* the ALU instructions, 0x04-0x07 aren't instructions */
+        if (!P1Alu(op, d, s, c, z, &r, &c, &extend)) {
+            sprintf(p->error, "cog %d: undefined instruction %08x at %03x", cog->id, inst, cog->pc);
+            return;
+        }
+        break;
+    }
+
+    /* fetch the next instruction before the result is stored */
+    cog->fetched = cog->mem[next];
+    cog->fetchedAddr = next;
+    cog->pc = next;
+    cog->time += cycles;
+    ++cog->instructions;
+
+    /* store the result and the flags */
+    if (write)
+        WriteRegister(p, cog, dst, r);
+    if (inst & Z_BIT)
+        cog->z = r == 0 && (!extend || z);
+    if (inst & C_BIT)
+        cog->c = c;
+}
+
+/* StartCog - load a cog from the hub and start it */
+static int StartCog(P1 *p, int id, uint32_t code, uint32_t par, uint64_t now)
+{
+    P1Cog *cog;
+    int i;
+
+    /* find a free cog */
+    if (id < 0) {
+        for (id = 0; id < P1_COG_COUNT; ++id)
+            if (!p->cogs[id].running)
+                break;
+        if (id >= P1_COG_COUNT)
+            return -1;
+    }
+    cog = &p->cogs[id];
+    StopCog(p, cog);
+
+    /* load the cog and clear the special registers */
+    for (i = 0; i < P1_COG_LOAD; ++i)
+        cog->mem[i] = ReadHub(p, code + i * 4, 4);
+    memset(&cog->mem[P1_COG_LOAD], 0, (P1_COG_SIZE - P1_COG_LOAD) * sizeof(uint32_t));
+    memset(cog->ctr, 0, sizeof(cog->ctr));
+    cog->par = par & 0xfffc;
+    cog->pc = 0;
+    cog->c = cog->z = 0;
+    cog->fetchedAddr = -1;
+    cog->pinWait = FALSE;
+    cog->time = now + LOAD_CYCLES;
+    cog->running = TRUE;
+    cog->start = now;
+    ++cog->starts;
+
+    return id;
+}
+
+/* StopCog - stop a cog and let go of its pins */
+static void StopCog(P1 *p, P1Cog *cog)
+{
+    if (cog->running) {
+        cog->cycles += cog->time - cog->start;
+        cog->running = FALSE;
+        cog->mem[P1_OUTA] = cog->mem[P1_DIRA] = 0;
+        UpdatePins(p);
+    }
+}
+
+/* HubOp - execute a hub operation */
+static uint32_t HubOp(P1 *p, P1Cog *cog, uint32_t d, int op, int *pC)
+{
+    int id, mask = 1 << (d & 7);
+    *pC = 0;
+    switch (op) {
+    case 0: /* CLKSET */
+        break;
+    case 1: /* COGID */
+        return cog->id;
+    case 2: /* COGINIT */
+        if ((id = StartCog(p, (d & 8) ? -1 : (int)(d & 7), (d >> 2) & 0xfffc, (d >> 16) & 0xfffc, cog->time)) < 0) {
+            *pC = 1;
+            return 7;
+        }
+        return id;
+    case 3: /* COGSTOP */
+        StopCog(p, &p->cogs[d & 7]);
+        break;
+    case 4: /* LOCKNEW */
+        for (id = 0; id < P1_LOCK_COUNT; ++id)
+            if (!(p->locksUsed & (1 << id))) {
+                p->locksUsed |= 1 << id;
+                return id;
+            }
+        *pC = 1;
+        return 7;
+    case 5: /* LOCKRET */
+        p->locksUsed &= ~mask;
+        break;
+    case 6: /* LOCKSET */
+        *pC = (p->lockState & mask) != 0;
+        p->lockState |= mask;
+        break;
+    case 7: /* LOCKCLR */
+        *pC = (p->lockState & mask) != 0;
+        p->lockState &= ~mask;
+        break;
+    }
+    return d;
+}
+
+/* HubAccess - get the cycles a hub instruction takes including the wait for the cog's turn */
+static int HubAccess(P1Cog *cog)
+{
+    int wait = (int)((cog->id * 2 - cog->time) & (HUB_WINDOW - 1));
+    ++cog->hubOps;
+    cog->hubWait += wait;
+    return HUB_CYCLES + wait;
+}
+
+/* ReadHub - read an aligned byte, word or long from the hub */
+static uint32_t ReadHub(P1 *p, uint32_t addr, int size)
+{
+    uint8_t *m;
+    addr &= P1_HUB_MASK & ~(size - 1);
+    if (addr >= P1_HUB_SIZE)
+        return 0;
+    m = &p->hub[addr];
+    switch (size) {
+    case 1:
+        return m[0];
+    case 2:
+        return m[0] | (m[1] << 8);
+    default:
+        return m[0] | (m[1] << 8) | (m[2] << 16) | ((uint32_t)m[3] << 24);
+    }
+}
+
+/* WriteHub - write an aligned byte, word or long to the hub */
+static void WriteHub(P1 *p, uint32_t addr, int size, uint32_t value)
+{
+    addr &= P1_HUB_MASK & ~(size - 1);
+    if (addr >= P1_HUB_SIZE)
+        return;
+    while (--size >= 0) {
+        p->hub[addr++] = value;
+        value >>= 8;
+    }
+}
+
+/* ReadRegister - read a register as the source of an instruction */
+static uint32_t ReadRegister(P1 *p, P1Cog *cog, int reg)
+{
+    switch (reg) {
+    case P1_PAR:
+        return cog->par;
+    case P1_CNT:
+        return (uint32_t)cog->time;
+    case P1_INA:
+        return P1Pins(p);
+    case P1_INB:
+        return 0;
+    case P1_PHSA:
+    case P1_PHSB:
+        return UpdateCounter(cog, reg - P1_PHSA);
+    default:
+        return cog->mem[reg];
+    }
+}
+
+/* WriteRegister - write a register (the read-only registers are only written in their shadows) */
+static void WriteRegister(P1 *p, P1Cog *cog, int reg, uint32_t value)
+{
+    switch (reg) {
+    case P1_CTRA:
+    case P1_CTRB:
+    case P1_FRQA:
+    case P1_FRQB:
+        UpdateCounter(cog, reg & 1);
+        cog->mem[reg] = value;
+        break;
+    case P1_PHSA:
+    case P1_PHSB:
+        UpdateCounter(cog, reg - P1_PHSA);
+        cog->ctr[reg - P1_PHSA].phs = value;
+        cog->mem[reg] = value;
+        break;
+    case P1_OUTA:
+    case P1_DIRA:
+        cog->mem[reg] = value;
+        UpdatePins(p);
+        break;
+    default:
+        cog->mem[reg] = value;
+        break;
+    }
+}
+
+/* UpdateCounter - bring the phase of a counter up to the cog's time */
+static uint32_t UpdateCounter(P1Cog *cog, int n)
+{
+    P1Counter *ctr = &cog->ctr[n];
+    int mode = (cog->mem[P1_CTRA + n] >> CTR_MODE_SHIFT) & CTR_MODE_MASK;
+    if (cog->time > ctr->updated) {
+        if ((mode != 0 && mode <= CTR_MODE_DUTY) || mode == CTR_MODE_ALWAYS)
+            ctr->phs += cog->mem[P1_FRQA + n] * (uint32_t)(cog->time - ctr->updated);
+        ctr->updated = cog->time;
+    }
+    return ctr->phs;
+}
+
+/* UpdatePins - combine the outputs of the cogs and tell the devices about changes */
+static void UpdatePins(P1 *p)
+{
+    uint32_t before = P1Pins(p), outputs = 0, dirs = 0, after;
+    P1Device *dev;
+    P1Cog *cog;
+
+    for (cog = p->cogs; cog < &p->cogs[P1_COG_COUNT]; ++cog)
+        if (cog->running) {
+            outputs |= cog->mem[P1_OUTA] & cog->mem[P1_DIRA];
+            dirs |= cog->mem[P1_DIRA];
+        }
+    p->outputs = outputs;
+    p->dirs = dirs;
+
+    if ((after = P1Pins(p)) != before)
+        for (dev = p->devices; dev != NULL; dev = dev->next)
+            (*dev->update)(dev, after, after ^ before);
+}
+
+/* PinWait - let the other cogs run until one of them changes the pins a cog is waiting for */
+static int PinWait(P1 *p, P1Cog *cog)
+{
+    P1Cog *other, *next = NULL;
+    for (other = p->cogs; other < &p->cogs[P1_COG_COUNT]; ++other)
+        if (other != cog && other->running && !other->pinWait && (!next || other->time < next->time))
+            next = other;
+    if (!next) {
+        sprintf(p->error, "cog %d waits for pins that no cog will change", cog->id);
+        return FALSE;
+    }
+    if (next->time >= cog->time) {
+        cog->pinCycles += next->time + 1 - cog->time;
+        cog->time = next->time + 1;
+    }
+    cog->pinWait = TRUE;
+    return TRUE;
+}
@@ -0,0 +1,119 @@
+/* db_p1.h - definitions for the propeller emulator
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_P1_H__
+#define __DB_P1_H__
+
+#include "db_config.h"
+
+/* number of cogs */
+#define P1_COG_COUNT    8
+
+/* longs of cog memory and the longs COGINIT loads from the hub */
+#define P1_COG_SIZE     512
+#define P1_COG_LOAD     496
+
+/* hub addresses are sixteen bits and the upper half is ROM */
+#define P1_HUB_SIZE     (32 * 1024)
+#define P1_HUB_MASK     0xffff
+
+/* hardware locks */
+#define P1_LOCK_COUNT   8
+
+/* special registers */
+#define P1_PAR          0x1f0
+#define P1_CNT          0x1f1
+#define P1_INA          0x1f2
+#define P1_INB          0x1f3
+#define P1_OUTA         0x1f4
+#define P1_OUTB         0x1f5
+#define P1_DIRA         0x1f6
+#define P1_DIRB         0x1f7
+#define P1_CTRA         0x1f8
+#define P1_CTRB         0x1f9
+#define P1_FRQA         0x1fa
+#define P1_FRQB         0x1fb
+#define P1_PHSA         0x1fc
+#define P1_PHSB         0x1fd
+
+/* forward type declarations */
+typedef struct P1 P1;
+typedef struct P1Cog P1Cog;
+typedef struct P1Device P1Device;
+
+/* function called before a cog executes an instruction it watches */
+typedef void P1WatchFcn(P1 *p, P1Cog *cog, int addr, void *data);
+
+/* device connected to the pins */
+struct P1Device {
+    P1Device *next;
+    void (*update)(P1Device *dev, uint32_t pins, uint32_t changed); /* the cogs changed the pins */
+    uint32_t drive;             /* pins driven by the device */
+    uint32_t value;             /* state of the pins driven by the device */
+};
+
+/* counter */
+typedef struct {
+    uint32_t phs;               /* phase accumulated up to the update time */
+    uint64_t updated;           /* cycle of the last update */
+} P1Counter;
+
+/* cog */
+struct P1Cog {
+    int id;
+    int running;
+    uint32_t mem[P1_COG_SIZE];  /* cog memory including the shadow registers */
+    uint32_t par;
+    int pc;
+    int c, z;
+    uint32_t fetched;           /* instruction fetched while the last one executed */
+    int fetchedAddr;            /* address of the fetched instruction or -1 */
+    uint64_t time;              /* cycle on which the next instruction starts */
+    int pinWait;                /* waiting in WAITPEQ or WAITPNE */
+    P1Counter ctr[2];
+    uint8_t watch[P1_COG_SIZE]; /* instructions that call the watch function */
+
+    /* statistics */
+    unsigned long starts;       /* number of times the cog was started */
+    uint64_t start;             /* cycle on which the cog was last started */
+    uint64_t cycles;            /* cycles run */
+    uint64_t instructions;      /* instructions executed */
+    uint64_t hubOps;            /* hub accesses */
+    uint64_t hubWait;           /* cycles spent waiting for the hub */
+    uint64_t pinCycles;         /* cycles spent waiting for the pins */
+};
+
+/* propeller */
+struct P1 {
+    uint8_t hub[P1_HUB_SIZE];
+    P1Cog cogs[P1_COG_COUNT];
+    int locksUsed;              /* locks allocated by LOCKNEW */
+    int lockState;              /* locks set by LOCKSET */
+    uint32_t outputs;           /* pins driven high by the cogs */
+    uint32_t dirs;              /* pins that are outputs of a cog */
+    P1Device *devices;
+    P1WatchFcn *watchFcn;
+    void *watchData;
+    char error[128];            /* reason the emulator stopped */
+};
+
+/* db_p1.c */
+void P1Init(P1 *p, uint32_t clkfreq, uint8_t clkmode);
+void P1AddDevice(P1 *p, P1Device *dev);
+int P1CogInit(P1 *p, int id, uint32_t code, uint32_t par);
+void P1CogStop(P1 *p, int id);
+int P1Step(P1 *p);
+uint64_t P1Time(P1 *p);
+uint32_t P1ReadLong(P1 *p, uint32_t addr);
+void P1WriteLong(P1 *p, uint32_t addr, uint32_t value);
+uint32_t P1Pins(P1 *p);
+
+/* db_p1spi.c */
+P1Device *P1C3Memory(System *sys, uint32_t flashSize);
+int P1C3Load(P1Device *dev, uint32_t addr, const uint8_t *data, uint32_t size);
+void P1C3Stats(P1Device *dev, FILE *fp);
+
+#endif
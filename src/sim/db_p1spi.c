@@ -0,0 +1,305 @@
+/* db_p1spi.c - SPI SRAM and flash on the pins of the emulated propeller
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The C3 has two 32K SPI SRAMs and a SPI flash that share a clock, MOSI and
+ * MISO (see c3_cache.spin).  A counter selects the chip: CLR low resets it
+ * to zero, which deselects all of them, and each rising edge of INC counts
+ * up to the first SRAM, the second SRAM and then the flash.  The chips
+ * sample MOSI on the rising edge of the clock and shift the next bit out on
+ * MISO on the falling edge.  The SRAMs are always in sequential mode and
+ * the flash programs and erases instantly.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "db_p1.h"
+
+/* pins (see c3_cache.spin) */
+#define CLR_PIN         (1 << 25)
+#define INC_PIN         (1 << 8)
+#define CLK_PIN         (1 << 11)
+#define MOSI_PIN        (1 << 9)
+#define MISO_PIN        (1 << 10)
+
+/* values of the chip select counter */
+#define SELECT_SRAM1    1
+#define SELECT_SRAM2    2
+#define SELECT_FLASH    3
+#define SELECT_MASK     0xf
+
+/* chips */
+#define SRAM_SIZE       (32 * 1024)
+#define SRAM_BIT        0x8000      /* selects the second SRAM */
+#define FLASH_MASK      0x10000000  /* selects the flash instead of the SRAMs */
+#define CHIP_COUNT      3
+
+/* commands */
+#define CMD_WRSR        0x01
+#define CMD_WRITE       0x02        /* SRAM write or flash page program */
+#define CMD_READ        0x03
+#define CMD_WRDI        0x04
+#define CMD_RDSR        0x05
+#define CMD_WREN        0x06
+#define CMD_FAST_READ   0x0b
+#define CMD_ERASE_4K    0x20
+#define CMD_ERASE_CHIP  0x60
+#define CMD_ERASE_CHIP2 0xc7
+
+/* flash geometry */
+#define FLASH_PAGE      256
+#define FLASH_BLOCK     4096
+
+/* chip on the bus */
+typedef struct {
+    const char *name;
+    uint8_t *data;
+    uint32_t size;
+    int flash;                  /* the chip is the flash */
+    int writeEnabled;           /* WREN has enabled an erase or a program */
+    int count;                  /* bytes received since the chip was selected */
+    int cmd;                    /* command being executed */
+    int addrBytes;              /* bytes of address after the command */
+    int dummyBytes;             /* bytes to ignore after the address */
+    uint32_t addr;              /* address of the next data byte */
+    int in, inBits;             /* byte being received */
+    int out, outBits;           /* byte being sent */
+    int sending;                /* the chip is driving MISO */
+    unsigned long selects;      /* number of commands */
+    unsigned long bytesRead;    /* data bytes sent on MISO */
+    unsigned long bytesWritten; /* data bytes received on MOSI */
+} SpiChip;
+
+/* memory on the C3 bus */
+typedef struct {
+    P1Device dev;
+    int select;                 /* chip select counter */
+    SpiChip chips[CHIP_COUNT];
+} C3Memory;
+
+static void Update(P1Device *dev, uint32_t pins, uint32_t changed);
+static SpiChip *SelectedChip(C3Memory *mem);
+static void Deselect(SpiChip *chip);
+static void ReceiveByte(SpiChip *chip, int byte);
+static void SendBit(SpiChip *chip);
+static int InitChip(System *sys, SpiChip *chip, const char *name, uint32_t size, int flash);
+
+/* P1C3Memory - create the SRAMs and flash of a C3 */
+P1Device *P1C3Memory(System *sys, uint32_t flashSize)
+{
+    C3Memory *mem;
+    if (!(mem = (C3Memory *)xbGlobalAlloc(sys, sizeof(C3Memory))))
+        return NULL;
+    memset(mem, 0, sizeof(C3Memory));
+    if (!InitChip(sys, &mem->chips[SELECT_SRAM1 - 1], "sram1", SRAM_SIZE, FALSE)
+    ||  !InitChip(sys, &mem->chips[SELECT_SRAM2 - 1], "sram2", SRAM_SIZE, FALSE)
+    ||  !InitChip(sys, &mem->chips[SELECT_FLASH - 1], "flash", flashSize, TRUE))
+        return NULL;
+    mem->dev.update = Update;
+    return &mem->dev;
+}
+
+/* P1C3Load - write data at a vm address in external memory directly into the chips */
+int P1C3Load(P1Device *dev, uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    C3Memory *mem = (C3Memory *)dev;
+    SpiChip *chip;
+    uint32_t offset;
+    while (size > 0) {
+        if (addr & FLASH_MASK) {
+            chip = &mem->chips[SELECT_FLASH - 1];
+            offset = addr & (FLASH_MASK - 1);
+        }
+        else {
+            chip = &mem->chips[(addr & SRAM_BIT) ? SELECT_SRAM2 - 1 : SELECT_SRAM1 - 1];
+            offset = addr & (SRAM_BIT - 1);
+        }
+        if (offset >= chip->size)
+            return FALSE;
+        chip->data[offset] = *data++;
+        ++addr;
+        --size;
+    }
+    return TRUE;
+}
+
+/* P1C3Stats - write the commands and data transferred by each chip */
+void P1C3Stats(P1Device *dev, FILE *fp)
+{
+    C3Memory *mem = (C3Memory *)dev;
+    SpiChip *chip;
+    fprintf(fp, "chip    commands  bytes read   bytes written\n");
+    for (chip = mem->chips; chip < &mem->chips[CHIP_COUNT]; ++chip)
+        fprintf(fp, "%-6s %9lu %11lu %15lu\n", chip->name, chip->selects, chip->bytesRead, chip->bytesWritten);
+}
+
+/* Update - follow the chip select counter and clock bits in and out of the selected chip */
+static void Update(P1Device *dev, uint32_t pins, uint32_t changed)
+{
+    C3Memory *mem = (C3Memory *)dev;
+    SpiChip *chip = SelectedChip(mem);
+    int select = mem->select;
+
+    /* update the chip select counter */
+    if (!(pins & CLR_PIN))
+        select = 0;
+    else if ((changed & INC_PIN) && (pins & INC_PIN))
+        select = (select + 1) & SELECT_MASK;
+    if (select != mem->select) {
+        if (chip)
+            Deselect(chip);
+        mem->select = select;
+        if ((chip = SelectedChip(mem)) != NULL)
+            ++chip->selects;
+    }
+
+    /* clock a bit in on the rising edge and out on the falling edge */
+    if (chip && (changed & CLK_PIN)) {
+        if (pins & CLK_PIN) {
+            chip->in = (chip->in << 1) | ((pins & MOSI_PIN) != 0);
+            if (++chip->inBits == 8) {
+                ReceiveByte(chip, chip->in & 0xff);
+                chip->inBits = 0;
+            }
+        }
+        else if (chip->sending)
+            SendBit(chip);
+    }
+
+    /* only the selected chip drives MISO */
+    if (chip && chip->sending) {
+        dev->drive = MISO_PIN;
+        dev->value = (chip->out >> (8 - chip->outBits)) & 1 ? MISO_PIN : 0;
+    }
+    else
+        dev->drive = dev->value = 0;
+}
+
+/* SelectedChip - get the chip selected by the counter */
+static SpiChip *SelectedChip(C3Memory *mem)
+{
+    return mem->select >= SELECT_SRAM1 && mem->select <= SELECT_FLASH ? &mem->chips[mem->select - 1] : NULL;
+}
+
+/* Deselect - finish the command of a chip when it is deselected */
+static void Deselect(SpiChip *chip)
+{
+    if (chip->flash && chip->writeEnabled) {
+        switch (chip->cmd) {
+        case CMD_ERASE_4K:
+            if (chip->count == 1 + chip->addrBytes) {
+                memset(&chip->data[chip->addr & (chip->size - 1) & ~(FLASH_BLOCK - 1)], 0xff, FLASH_BLOCK);
+                chip->writeEnabled = FALSE;
+            }
+            break;
+        case CMD_ERASE_CHIP:
+        case CMD_ERASE_CHIP2:
+            memset(chip->data, 0xff, chip->size);
+            chip->writeEnabled = FALSE;
+            break;
+        case CMD_WRITE:
+            chip->writeEnabled = FALSE;
+            break;
+        }
+    }
+    chip->count = 0;
+    chip->inBits = 0;
+    chip->sending = FALSE;
+}
+
+/* ReceiveByte - handle a byte received by a chip */
+static void ReceiveByte(SpiChip *chip, int byte)
+{
+    int index = chip->count++ - 1;
+
+    /* the first byte is the command */
+    if (index < 0) {
+        chip->cmd = byte;
+        chip->addr = 0;
+        chip->addrBytes = 0;
+        chip->dummyBytes = 0;
+        switch (byte) {
+        case CMD_FAST_READ:
+            if (chip->flash)
+                chip->dummyBytes = 1;
+            // fall through
+        case CMD_READ:
+        case CMD_WRITE:
+        case CMD_ERASE_4K:
+            chip->addrBytes = chip->flash ? 3 : 2;
+            break;
+        case CMD_RDSR:
+            /* the status shows that the chip is never busy */
+            chip->sending = TRUE;
+            chip->outBits = 8;
+            break;
+        case CMD_WREN:
+            chip->writeEnabled = TRUE;
+            break;
+        case CMD_WRDI:
+            chip->writeEnabled = FALSE;
+            break;
+        }
+        return;
+    }
+
+    /* collect the address and skip the dummy bytes */
+    if (index < chip->addrBytes) {
+        chip->addr = (chip->addr << 8) | byte;
+        if (index < chip->addrBytes - 1 || chip->dummyBytes > 0)
+            return;
+    }
+    else if (index < chip->addrBytes + chip->dummyBytes) {
+        if (index < chip->addrBytes + chip->dummyBytes - 1)
+            return;
+    }
+
+    /* the data follows */
+    else if (chip->cmd == CMD_WRITE) {
+        if (!chip->flash) {
+            chip->data[chip->addr++ & (chip->size - 1)] = byte;
+            ++chip->bytesWritten;
+        }
+        else if (chip->writeEnabled) {
+            chip->data[chip->addr & (chip->size - 1)] &= byte;
+            chip->addr = (chip->addr & ~(FLASH_PAGE - 1)) | ((chip->addr + 1) & (FLASH_PAGE - 1));
+            ++chip->bytesWritten;
+        }
+        return;
+    }
+    else
+        return;
+
+    /* the first bit of a read goes out on the next falling edge */
+    if (chip->cmd == CMD_READ || chip->cmd == CMD_FAST_READ) {
+        chip->sending = TRUE;
+        chip->outBits = 8;
+    }
+}
+
+/* SendBit - put the next bit of the byte being sent on MISO */
+static void SendBit(SpiChip *chip)
+{
+    if (chip->outBits == 8) {
+        if (chip->cmd == CMD_RDSR)
+            chip->out = 0;
+        else {
+            chip->out = chip->data[chip->addr++ & (chip->size - 1)];
+            ++chip->bytesRead;
+        }
+        chip->outBits = 0;
+    }
+    ++chip->outBits;
+}
+
+/* InitChip - allocate the memory of a chip and erase it */
+static int InitChip(System *sys, SpiChip *chip, const char *name, uint32_t size, int flash)
+{
+    if (!(chip->data = (uint8_t *)xbGlobalAlloc(sys, size)))
+        return FALSE;
+    memset(chip->data, flash ? 0xff : 0, size);
+    chip->name = name;
+    chip->size = size;
+    chip->flash = flash;
+    return TRUE;
+}
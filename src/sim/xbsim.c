@@ -0,0 +1,1049 @@
+/* xbsim.c - run an image on an emulated propeller and report where the cycles go
+ *
+ * Copyright (c) 2011 by David Michael Betz.  All rights reserved.
+ *
+ * The vm and the cache driver run on emulated cogs exactly as they would on
+ * the chip.  This program plays the part of the Spin code in serial_helper
+ * and vm_runtime: it lays out the hub, starts the cogs, loads the image
+ * through the vm's mailbox and services the traps.  The Spin code takes no
+ * cycles here so the counts are for the vm and the cache driver alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>
+#include "db_system.h"
+#include "mem_malloc.h"
+#include "db_image.h"
+#include "db_fixed.h"
+#include "db_vmdebug.h"
+#include "db_vm.h"
+#include "db_p1.h"
+
+/* default board type */
+#define DEF_BOARD       "hub"
+
+/* vm initialization parameters (see vm_interface.spin) */
+#define INIT_BASE       0
+#define INIT_STATE      1
+#define INIT_MBOX       2
+#define INIT_CODE       3
+#define INIT_CACHE_MBOX 4
+#define INIT_CACHE_MASK 5
+#define INIT_SIZE       6
+
+/* vm mailbox */
+#define MBOX_CMD        0
+#define MBOX_ARG_STS    1
+#define MBOX_ARG2_FCN   2
+#define MBOX_SIZE       3
+
+/* vm state vector */
+#define STATE_FP        0
+#define STATE_SP        1
+#define STATE_TOS       2
+#define STATE_PC        3
+#define STATE_STEPPING  4
+#define STATE_STACK     5
+#define STATE_STACK_SIZE 6
+#define STATE_SIZE      7
+
+/* vm commands */
+#define VM_Continue     1
+#define VM_ReadLong     2
+#define VM_WriteLong    3
+#define VM_ReadByte     4
+
+/* vm status codes */
+#define STS_Fail        0
+#define STS_Halt        1
+#define STS_Step        2
+#define STS_Trap        3
+#define STS_Success     4
+#define STS_StackOver   5
+#define STS_DivideZero  6
+#define STS_IllegalOpcode 7
+
+/* cache driver initialization parameters and mailbox (see cache_interface.spin) */
+#define CACHE_INIT_MBOX     0
+#define CACHE_INIT_CACHE    1
+#define CACHE_INIT_CONFIG_1 2
+#define CACHE_INIT_CONFIG_2 3
+#define CACHE_INIT_SIZE     4
+#define CACHE_MBOX_SIZE     2
+
+/* hub layout (see serial_helper.spin) */
+#define VM_CODE_ADDR    0x0010      /* the vm image stays below the data like in hub_loader */
+#define VM_CODE_MAX     (8 * 1024)
+#define DEF_FLASH_SIZE  (1024 * 1024)
+
+/* cogs started the way the loaders start them with the spin interpreter on cog 0 */
+#define CACHE_COG       1
+
+/* instruction patterns of the vm's opcode dispatch (see _start in xbasic_vm.spin) */
+#define INST_MASK       0xfffc0000  /* opcode, effects, immediate and condition */
+#define DST_OF(i)       (((i) >> 9) & 0x1ff)
+#define SRC_OF(i)       ((i) & 0x1ff)
+#define CALL_IMM        0x5cfc0000  /* call #s */
+#define CMP_WCZ_IMM     0x877c0000  /* cmp d,#s wc,wz */
+#define JMP_IF_A_IMM    0x5c440000  /* if_a jmp #s */
+#define ADD_IMM         0x80fc0000  /* add d,#s */
+#define JMP_REG         0x5c3c0000  /* jmp s */
+
+/* opcode statistics */
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+} OpStats;
+
+/* emulated system */
+typedef struct {
+    System *sys;
+    jmp_buf errorTarget;        /* where the emulator stops on an error or at the cycle limit */
+    P1 p;
+    P1Device *memory;           /* external memory on the pins or NULL */
+    VMIO *io;
+    uint64_t limit;             /* cycle limit or zero */
+    int vmCog;
+    uint32_t vmCode;            /* hub address of the vm image */
+    uint32_t data;              /* hub address of vm address zero */
+    uint32_t dataEnd;           /* end of the data area and the top of the stack */
+    uint32_t mbox;              /* vm mailbox */
+    uint32_t state;             /* vm state vector */
+    uint32_t cacheMbox;         /* cache driver mailbox or zero */
+    uint32_t cacheMask;         /* cache line mask returned by the cache driver */
+
+    /* terminal input */
+    char inputLine[INPUT_MAX];
+    char *inputPtr;
+
+    /* cooperative tasks (see vm_runtime.spin) */
+    uint32_t taskRegs[TASK_MAX][STATE_SIZE];
+    int taskState[TASK_MAX];
+    int taskCount;
+    int task;
+
+    /* profile */
+    int dispatch;               /* cog address of the opcode dispatch or -1 */
+    int opcodeReg;              /* cog register that holds the opcode */
+    int opcode;                 /* opcode being executed or -1 */
+    uint64_t opStart;           /* cycle on which the opcode started */
+    int running;                /* the vm is running the program */
+    uint64_t runStart;          /* cycle on which the vm was last continued */
+    uint64_t runCycles;         /* cycles the vm spent running the program */
+    uint64_t opCycles;          /* cycles of the run attributed to opcodes */
+    uint64_t ops;               /* opcodes executed */
+    OpStats opStats[256];
+} Sim;
+
+static Sim sim;
+
+static void Usage(void);
+static void LoadVM(Sim *s, const char *name, uint8_t *buf, uint32_t *pSize);
+static void StartCache(Sim *s, BoardConfig *config, uint32_t scratch);
+static void StartVM(Sim *s, uint32_t scratch);
+static void LoadProgram(Sim *s, const char *name);
+static int Run(Sim *s);
+static void DoTrap(Sim *s, int op);
+static int FindDispatch(P1Cog *cog, int *pReg);
+static void Watch(P1 *p, P1Cog *cog, int addr, void *data);
+static void EndOpcode(Sim *s, uint64_t now);
+static void EndRun(Sim *s);
+static void WriteReport(Sim *s, FILE *fp);
+static const char *OpcodeName(int code);
+static void Step(Sim *s);
+static uint32_t Command(Sim *s, int cmd, uint32_t arg, uint32_t arg2);
+static uint32_t ReadLong(Sim *s, uint32_t addr);
+static void WriteLong(Sim *s, uint32_t addr, uint32_t value);
+static int ReadByte(Sim *s, uint32_t addr);
+static void WriteByte(Sim *s, uint32_t addr, int value);
+static uint32_t GetState(Sim *s, int reg);
+static void SetState(Sim *s, int reg, uint32_t value);
+static void PushTos(Sim *s);
+static void PopTos(Sim *s);
+static void PrintC(Sim *s, int ch);
+static void PrintS(Sim *s, const char *str);
+static void PrintFixed(Sim *s, VMVALUE value);
+static int InputLine(Sim *s);
+static char *InputField(Sim *s);
+static void EndInputField(Sim *s, char *p);
+static VMVALUE InputInt(Sim *s);
+static VMVALUE InputStr(Sim *s, uint32_t addr);
+static VMVALUE TaskRun(Sim *s, uint32_t fcn, VMVALUE arg, VMVALUE size);
+static int NextTask(Sim *s, int waiting);
+static void SwitchTask(Sim *s, int next);
+static void YieldTask(Sim *s);
+static int WaitTask(Sim *s);
+static void EndTask(Sim *s);
+static int IsC3Driver(const char *name);
+static void MyInfo(System *sys, const char *fmt, va_list ap);
+static void MyError(System *sys, const char *fmt, va_list ap);
+static SystemOps myOps = {
+    MyInfo,
+    MyError
+};
+
+extern uint8_t xbasic_vm_array[];
+extern int xbasic_vm_size;
+
+int main(int argc, char *argv[])
+{
+    char *infile = NULL, *vmfile = NULL, *input = NULL, *output = NULL, *report = NULL, *board, *p;
+    FILE *in = stdin, *out = stdout, *fp = stderr;
+    static uint8_t vmImage[VM_CODE_MAX];
+    uint32_t vmSize, scratch;
+    BoardConfig *config;
+    Sim *s = &sim;
+    int result, n;
+
+    /* get the default board type */
+    if (!(board = getenv("BOARD")))
+        board = DEF_BOARD;
+
+    s->dispatch = -1;
+
+    for (n = 1; n < argc; ++n) {
+        if (argv[n][0] == '-') {
+            if (argv[n][2] != '\0' || n + 1 >= argc)
+                Usage();
+            switch (argv[n][1]) {
+            case 'b':
+                board = argv[++n];
+                break;
+            case 'v':
+                vmfile = argv[++n];
+                break;
+            case 'i':
+                input = argv[++n];
+                break;
+            case 'o':
+                output = argv[++n];
+                break;
+            case 'r':
+                report = argv[++n];
+                break;
+            case 'x':
+                s->dispatch = (int)strtoul(argv[++n], &p, 0);
+                if (*p != '\0' || s->dispatch <= 0 || s->dispatch >= P1_COG_LOAD - 3)
+                    Usage();
+                break;
+            case 'l':
+                s->limit = strtoull(argv[++n], &p, 10);
+                if (*p != '\0' || s->limit == 0)
+                    Usage();
+                break;
+            case 'I':
+                xbAddToPath(argv[++n]);
+                break;
+            default:
+                Usage();
+                break;
+            }
+        }
+        else if (!infile)
+            infile = argv[n];
+        else
+            Usage();
+    }
+    if (!infile)
+        Usage();
+
+    if (!(s->sys = MemInit()))
+        return 1;
+    s->sys->ops = &myOps;
+
+    /* find the board configuration and the cache driver */
+    xbAddEnvironmentPath();
+    ParseConfigurationFile(s->sys, "xbasic.cfg");
+    if (!(config = GetBoardConfig(board)))
+        Fatal(s->sys, "no board type: %s", board);
+
+    /* redirect the terminal */
+    if (input && !(in = fopen(input, "r")))
+        Fatal(s->sys, "can't open input file '%s'", input);
+    if (output && !(out = fopen(output, "w")))
+        Fatal(s->sys, "can't create output file '%s'", output);
+    if (!(s->io = InitFileIO(s->sys, in, out)))
+        Fatal(s->sys, "insufficient memory");
+
+    /* put the vm image below the data area */
+    LoadVM(s, vmfile, vmImage, &vmSize);
+    P1Init(&s->p, config->clkfreq, config->clkmode);
+    s->vmCode = VM_CODE_ADDR;
+    memcpy(&s->p.hub[s->vmCode], vmImage, vmSize);
+    s->data = ROUND_TO_WORDS(s->vmCode + vmSize);
+
+    /* the cache, the mailboxes and the state vector are at the top of the hub */
+    s->dataEnd = P1_HUB_SIZE;
+    if (config->cacheDriver)
+        s->dataEnd -= config->cacheSize + CACHE_MBOX_SIZE * sizeof(uint32_t);
+    s->mbox = s->dataEnd - MBOX_SIZE * sizeof(uint32_t);
+    s->state = s->mbox - STATE_SIZE * sizeof(uint32_t);
+    s->dataEnd = s->state;
+    if (s->data + P1_COG_LOAD * sizeof(uint32_t) >= s->dataEnd)
+        Fatal(s->sys, "no room for the data area");
+
+    /* the report is still written when the emulator stops early */
+    if (setjmp(s->errorTarget)) {
+        if (s->running)
+            EndRun(s);
+        result = FALSE;
+    }
+    else {
+        /* the cache driver and the initialization parameters are loaded into the data area while the cogs start */
+        scratch = s->data;
+        if (config->cacheDriver)
+            StartCache(s, config, scratch);
+        StartVM(s, scratch);
+        LoadProgram(s, infile);
+        result = Run(s);
+    }
+    FlushIO(s->io);
+
+    if (in != stdin)
+        fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    if (report && !(fp = fopen(report, "w")))
+        Fatal(s->sys, "can't create report file '%s'", report);
+    WriteReport(s, fp);
+    if (fp != stderr)
+        fclose(fp);
+
+    return result ? 0 : 1;
+}
+
+/* Usage - display a usage message and exit */
+static void Usage(void)
+{
+    fprintf(stderr, "\
+usage: xbsim\n\
+         [ -b <type> ]   select the target board (default is $BOARD or 'hub')\n\
+         [ -v <file> ]   run the vm in a .dat file instead of the built in one\n\
+         [ -i <file> ]   read terminal input from a file\n\
+         [ -o <file> ]   write terminal output to a file\n\
+         [ -r <file> ]   write the cycle report to a file instead of stderr\n\
+         [ -x <addr> ]   cog address of the vm's opcode dispatch if it can't be found\n\
+         [ -l <cycles> ] stop after <cycles> clock cycles\n\
+         [ -I <path> ]   add a directory to the include path\n\
+         <name>          image to run\n\
+");
+    exit(1);
+}
+
+/* LoadVM - get the vm image from a file or the one built in */
+static void LoadVM(Sim *s, const char *name, uint8_t *buf, uint32_t *pSize)
+{
+    void *file;
+    if (!name) {
+        if (xbasic_vm_size > VM_CODE_MAX)
+            Fatal(s->sys, "vm image too large");
+        memcpy(buf, xbasic_vm_array, xbasic_vm_size);
+        *pSize = xbasic_vm_size;
+        return;
+    }
+    if (!(file = xbOpenFile(s->sys, name, "rb")))
+        Fatal(s->sys, "can't open vm image '%s'", name);
+    *pSize = (uint32_t)xbReadFile(file, buf, VM_CODE_MAX);
+    xbCloseFile(file);
+    if (*pSize == 0)
+        Fatal(s->sys, "can't read vm image '%s'", name);
+}
+
+/* StartCache - start the cache driver and wait for it to return the cache line mask */
+static void StartCache(Sim *s, BoardConfig *config, uint32_t scratch)
+{
+    uint32_t params, cache, size, i;
+    uint8_t buf[P1_COG_LOAD * sizeof(uint32_t)];
+    void *file;
+    Section *flash;
+
+    /* only the c3 bus has a model of its memory chips */
+    if (!IsC3Driver(config->cacheDriver))
+        Fatal(s->sys, "no memory model for cache driver: %s", config->cacheDriver);
+    flash = GetSection(config, "flash");
+    if (!(s->memory = P1C3Memory(s->sys, flash && flash->size ? flash->size : DEF_FLASH_SIZE)))
+        Fatal(s->sys, "insufficient memory");
+    P1AddDevice(&s->p, s->memory);
+
+    if (!(file = xbOpenFileInPath(s->sys, config->cacheDriver, "rb")))
+        Fatal(s->sys, "can't open cache driver: %s", config->cacheDriver);
+    size = (uint32_t)xbReadFile(file, buf, sizeof(buf));
+    xbCloseFile(file);
+    if (size == 0)
+        Fatal(s->sys, "can't read cache driver: %s", config->cacheDriver);
+    memcpy(&s->p.hub[scratch], buf, size);
+
+    cache = P1_HUB_SIZE - config->cacheSize;
+    s->cacheMbox = cache - CACHE_MBOX_SIZE * sizeof(uint32_t);
+    params = scratch + ROUND_TO_WORDS(size);
+    P1WriteLong(&s->p, params + CACHE_INIT_MBOX * 4, s->cacheMbox);
+    P1WriteLong(&s->p, params + CACHE_INIT_CACHE * 4, cache);
+    P1WriteLong(&s->p, params + CACHE_INIT_CONFIG_1 * 4, config->cacheParam1);
+    P1WriteLong(&s->p, params + CACHE_INIT_CONFIG_2 * 4, config->cacheParam2);
+    P1WriteLong(&s->p, s->cacheMbox, 0xffffffff);
+    if (P1CogInit(&s->p, CACHE_COG, scratch, params) < 0)
+        Fatal(s->sys, "can't start the cache driver");
+    while (P1ReadLong(&s->p, s->cacheMbox) != 0)
+        Step(s);
+    s->cacheMask = P1ReadLong(&s->p, params + CACHE_INIT_MBOX * 4);
+
+    /* clear the scratch area so the data area starts out as it would after a load */
+    for (i = scratch; i < params + CACHE_INIT_SIZE * 4; ++i)
+        s->p.hub[i] = 0;
+}
+
+/* StartVM - start the vm on the next cog and wait for it to return its initial state */
+static void StartVM(Sim *s, uint32_t scratch)
+{
+    uint32_t params = scratch;
+    int i;
+    P1WriteLong(&s->p, params + INIT_BASE * 4, s->data);
+    P1WriteLong(&s->p, params + INIT_STATE * 4, s->state);
+    P1WriteLong(&s->p, params + INIT_MBOX * 4, s->mbox);
+    P1WriteLong(&s->p, params + INIT_CODE * 4, s->vmCode);
+    P1WriteLong(&s->p, params + INIT_CACHE_MBOX * 4, s->cacheMbox);
+    P1WriteLong(&s->p, params + INIT_CACHE_MASK * 4, s->cacheMask);
+    P1WriteLong(&s->p, s->mbox + MBOX_CMD * 4, 1);
+    s->vmCog = s->memory ? CACHE_COG + 1 : CACHE_COG;
+    if (P1CogInit(&s->p, s->vmCog, s->vmCode, params) < 0)
+        Fatal(s->sys, "can't start the vm");
+    while (P1ReadLong(&s->p, s->mbox + MBOX_CMD * 4) != 0)
+        Step(s);
+    for (i = 0; i < INIT_SIZE; ++i)
+        P1WriteLong(&s->p, params + i * 4, 0);
+
+    /* find the opcode dispatch to attribute cycles to opcodes */
+    if (s->dispatch < 0)
+        s->dispatch = FindDispatch(&s->p.cogs[s->vmCog], &s->opcodeReg);
+    else
+        s->opcodeReg = DST_OF(s->p.cogs[s->vmCog].mem[s->dispatch]);
+    if (s->dispatch > 0) {
+        s->p.cogs[s->vmCog].watch[s->dispatch - 1] = TRUE;
+        s->p.cogs[s->vmCog].watch[s->dispatch] = TRUE;
+        s->p.watchFcn = Watch;
+        s->p.watchData = s;
+    }
+    s->opcode = -1;
+}
+
+/* LoadProgram - put the image where the loader would and copy its sections as vm_runtime does */
+static void LoadProgram(Sim *s, const char *name)
+{
+    uint32_t image, main, stackSize, stack, count, p, base, offset, size, zeroSize, i;
+    ImageFileHdr *hdr;
+    uint8_t *buf;
+    long fileSize;
+    FILE *fp;
+
+    if (!(fp = fopen(name, "rb")))
+        Fatal(s->sys, "can't open image '%s'", name);
+    fseek(fp, 0, SEEK_END);
+    fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fileSize < (long)sizeof(ImageFileHdr) || !(buf = (uint8_t *)xbGlobalAlloc(s->sys, fileSize)))
+        Fatal(s->sys, "bad image file '%s'", name);
+    if (fread(buf, 1, fileSize, fp) != (size_t)fileSize)
+        Fatal(s->sys, "can't read image '%s'", name);
+    fclose(fp);
+
+    hdr = (ImageFileHdr *)buf;
+    if (memcmp(hdr->tag, IMAGE_TAG, sizeof(hdr->tag)) != 0)
+        Fatal(s->sys, "invalid image file '%s'", name);
+    if (hdr->version != IMAGE_VERSION)
+        Fatal(s->sys, "wrong image file version: expected %04x, found %04x", IMAGE_VERSION, hdr->version);
+
+    /* write the image to the memory the first section is in */
+    image = hdr->sections[0].base;
+    switch (image) {
+    case HUB_BASE:
+        if (s->data + fileSize > s->dataEnd)
+            Fatal(s->sys, "image too large for the hub");
+        memcpy(&s->p.hub[s->data], buf, fileSize);
+        break;
+    case RAM_BASE:
+    case FLASH_BASE:
+        if (!s->memory)
+            Fatal(s->sys, "the board has no external memory for this image");
+        if (!P1C3Load(s->memory, image, buf, (uint32_t)fileSize))
+            Fatal(s->sys, "image too large for external memory");
+        break;
+    default:
+        Fatal(s->sys, "unknown image type");
+        break;
+    }
+
+    /* set up the stack */
+    main = ReadLong(s, image + offsetof(ImageFileHdr, mainCode));
+    stackSize = ReadLong(s, image + offsetof(ImageFileHdr, stackSize));
+    stack = s->dataEnd - stackSize;
+    SetState(s, STATE_PC, main);
+    SetState(s, STATE_STACK, stack);
+    SetState(s, STATE_SP, stack + stackSize);
+    SetState(s, STATE_FP, stack + stackSize);
+    SetState(s, STATE_STACK_SIZE, stackSize);
+
+    /* copy the sections after the first and clear the space after each */
+    count = ReadLong(s, image + offsetof(ImageFileHdr, sectionCount));
+    p = image + offsetof(ImageFileHdr, sections);
+    for (i = 0; i < count; ++i, p += sizeof(ImageFileSection)) {
+        base = ReadLong(s, p + offsetof(ImageFileSection, base));
+        offset = ReadLong(s, p + offsetof(ImageFileSection, offset));
+        size = ReadLong(s, p + offsetof(ImageFileSection, size));
+        zeroSize = ReadLong(s, p + offsetof(ImageFileSection, zeroSize));
+        if (i > 0) {
+            for (; (int32_t)size > 0; base += 4, offset += 4, size -= 4)
+                WriteLong(s, base, ReadLong(s, image + offset));
+        }
+        else
+            base += size;
+        for (; (int32_t)zeroSize > 0; base += 4, zeroSize -= 4)
+            WriteLong(s, base, 0);
+    }
+}
+
+/* Run - run the program until the main code halts and return FALSE if the vm stopped with an error */
+static int Run(Sim *s)
+{
+    P1Cog *vm = &s->p.cogs[s->vmCog];
+    int sts;
+
+    s->inputLine[0] = '\0';
+    s->inputPtr = s->inputLine;
+    SetState(s, STATE_STEPPING, 0);
+
+    for (;;) {
+
+        /* only the cycles between a continue and the next status belong to the program */
+        s->runStart = s->opStart = vm->time;
+        s->running = TRUE;
+        sts = (int)Command(s, VM_Continue, 0, 0);
+        EndRun(s);
+
+        switch (sts) {
+        case STS_Trap:
+            DoTrap(s, (int)P1ReadLong(&s->p, s->mbox + MBOX_ARG2_FCN * 4));
+            break;
+        case STS_Halt:
+            /* a task other than the first ends when its function returns */
+            if (s->task == 0)
+                return TRUE;
+            EndTask(s);
+            break;
+        case STS_StackOver:
+            xbError(s->sys, "STACK OVERFLOW at %08x\n", GetState(s, STATE_PC));
+            return FALSE;
+        case STS_DivideZero:
+            xbError(s->sys, "DIVIDE BY ZERO at %08x\n", GetState(s, STATE_PC));
+            return FALSE;
+        case STS_IllegalOpcode:
+            xbError(s->sys, "ILLEGAL OPCODE at %08x\n", GetState(s, STATE_PC));
+            return FALSE;
+        default:
+            xbError(s->sys, "unexpected vm status %d\n", sts);
+            return FALSE;
+        }
+    }
+}
+
+/* DoTrap - service a trap as vm_runtime does */
+static void DoTrap(Sim *s, int op)
+{
+    VMVALUE length, arg;
+    uint32_t p;
+    char buf[32];
+    int ch;
+
+    switch (op) {
+    case TRAP_GETCHAR:
+        /* the other tasks run while a task waits for input */
+        if (!IOReady(s->io) && WaitTask(s))
+            break;
+        if (s->taskCount > 0)
+            s->taskState[s->task] = TASK_READY;
+        PushTos(s);
+        SetState(s, STATE_TOS, IOGetC(s->io));
+        break;
+    case TRAP_PUTCHAR:
+        PrintC(s, GetState(s, STATE_TOS));
+        PopTos(s);
+        break;
+    case TRAP_PRINTSTR:
+        p = GetState(s, STATE_TOS);
+        while ((ch = ReadByte(s, p++)) != 0)
+            PrintC(s, ch);
+        PopTos(s);
+        break;
+    case TRAP_PRINTINT:
+        sprintf(buf, "%ld", (long)(VMVALUE)GetState(s, STATE_TOS));
+        PrintS(s, buf);
+        PopTos(s);
+        break;
+    case TRAP_PRINTHEX:
+        sprintf(buf, "%lX", (unsigned long)GetState(s, STATE_TOS));
+        PrintS(s, buf);
+        PopTos(s);
+        break;
+    case TRAP_PRINTFIXED:
+        PrintFixed(s, (VMVALUE)GetState(s, STATE_TOS));
+        PopTos(s);
+        break;
+    case TRAP_PRINTTAB:
+        PrintC(s, '\t');
+        break;
+    case TRAP_PRINTNL:
+        PrintC(s, '\r');
+        PrintC(s, '\n');
+        break;
+    case TRAP_INPUTLINE:
+        InputLine(s);
+        break;
+    case TRAP_INPUTINT:
+        PushTos(s);
+        SetState(s, STATE_TOS, InputInt(s));
+        break;
+    case TRAP_INPUTSTR:
+        SetState(s, STATE_TOS, InputStr(s, GetState(s, STATE_TOS)));
+        break;
+    case TRAP_COGRUN:
+        /* the runtime serves a single vm so there is no cog to run the function */
+        PopTos(s);
+        SetState(s, STATE_TOS, (uint32_t)-1);
+        break;
+    case TRAP_TASKRUN:
+        length = GetState(s, STATE_TOS);
+        PopTos(s);
+        arg = GetState(s, STATE_TOS);
+        PopTos(s);
+        SetState(s, STATE_TOS, TaskRun(s, GetState(s, STATE_TOS), arg, length));
+        break;
+    case TRAP_YIELD:
+        YieldTask(s);
+        break;
+    default:
+        Fatal(s->sys, "undefined trap 0x%02x", op);
+        break;
+    }
+}
+
+/* FindDispatch - find the compare after the opcode fetch that starts the dispatch and the register holding the opcode */
+static int FindDispatch(P1Cog *cog, int *pReg)
+{
+    uint32_t *mem = cog->mem;
+    int addr;
+    for (addr = 1; addr < P1_COG_LOAD - 3; ++addr) {
+        if ((mem[addr - 1] & INST_MASK) == CALL_IMM
+        &&  (mem[addr] & INST_MASK) == CMP_WCZ_IMM
+        &&  (mem[addr + 1] & INST_MASK) == JMP_IF_A_IMM
+        &&  (mem[addr + 2] & INST_MASK) == ADD_IMM
+        &&  DST_OF(mem[addr + 2]) == DST_OF(mem[addr])
+        &&  (mem[addr + 3] & INST_MASK) == JMP_REG
+        &&  SRC_OF(mem[addr + 3]) == DST_OF(mem[addr])) {
+            *pReg = DST_OF(mem[addr]);
+            return addr;
+        }
+    }
+    return -1;
+}
+
+/* Watch - start timing an opcode when the vm fetches it and count it when it is dispatched */
+static void Watch(P1 *p, P1Cog *cog, int addr, void *data)
+{
+    Sim *s = (Sim *)data;
+    if (addr == s->dispatch) {
+        s->opcode = cog->mem[s->opcodeReg] & 0xff;
+        ++s->opStats[s->opcode].count;
+        ++s->ops;
+    }
+    else
+        EndOpcode(s, cog->time);
+}
+
+/* EndOpcode - charge the cycles since the last opcode started to it */
+static void EndOpcode(Sim *s, uint64_t now)
+{
+    if (s->opcode >= 0) {
+        s->opStats[s->opcode].cycles += now - s->opStart;
+        s->opCycles += now - s->opStart;
+    }
+    s->opcode = -1;
+    s->opStart = now;
+}
+
+/* EndRun - add the cycles since the vm was continued to the program */
+static void EndRun(Sim *s)
+{
+    uint64_t now = s->p.cogs[s->vmCog].time;
+    EndOpcode(s, now);
+    s->runCycles += now - s->runStart;
+    s->running = FALSE;
+}
+
+/* WriteReport - write the cycles used by the program, each opcode and each cog */
+static void WriteReport(Sim *s, FILE *fp)
+{
+    uint32_t clkfreq = P1ReadLong(&s->p, 0);
+    OpStats *stats;
+    P1Cog *cog;
+    int op;
+
+    fprintf(fp, "program cycles: %llu (%.3f ms at %lu Hz)\n",
+            (unsigned long long)s->runCycles,
+            clkfreq ? s->runCycles * 1000.0 / clkfreq : 0.0,
+            (unsigned long)clkfreq);
+
+    if (s->dispatch > 0) {
+        fprintf(fp, "opcodes executed: %llu\n", (unsigned long long)s->ops);
+        fprintf(fp, "vm overhead: %llu cycles\n\n", (unsigned long long)(s->runCycles - s->opCycles));
+        fprintf(fp, "opcode         count         cycles  cycles/op      %%\n");
+        for (op = 0, stats = s->opStats; op < 256; ++op, ++stats)
+            if (stats->count > 0)
+                fprintf(fp, "%-9s %10llu %14llu %10.1f %6.2f\n",
+                        OpcodeName(op),
+                        (unsigned long long)stats->count,
+                        (unsigned long long)stats->cycles,
+                        (double)stats->cycles / stats->count,
+                        s->runCycles ? stats->cycles * 100.0 / s->runCycles : 0.0);
+    }
+    else
+        fprintf(fp, "can't find the opcode dispatch of the vm (use -x to give its address)\n");
+
+    fprintf(fp, "\ncog  starts         cycles   instructions     hub ops       hub wait\n");
+    for (cog = s->p.cogs; cog < &s->p.cogs[P1_COG_COUNT]; ++cog)
+        if (cog->starts > 0)
+            fprintf(fp, "%3d %7lu %14llu %14llu %11llu %14llu\n",
+                    cog->id,
+                    cog->starts,
+                    (unsigned long long)(cog->cycles + (cog->running ? cog->time - cog->start : 0)),
+                    (unsigned long long)cog->instructions,
+                    (unsigned long long)cog->hubOps,
+                    (unsigned long long)cog->hubWait);
+
+    if (s->memory) {
+        fprintf(fp, "\n");
+        P1C3Stats(s->memory, fp);
+    }
+}
+
+/* OpcodeName - get the name of an opcode */
+static const char *OpcodeName(int code)
+{
+    static char buf[8];
+    const OTDEF *op;
+    for (op = OpcodeTable; op->name; ++op)
+        if (op->code == code)
+            return op->name;
+    sprintf(buf, "0x%02x", code);
+    return buf;
+}
+
+/* Step - execute an instruction on the emulated propeller */
+static void Step(Sim *s)
+{
+    if (!P1Step(&s->p)) {
+        xbError(s->sys, "error: %s\n", s->p.error);
+        longjmp(s->errorTarget, 1);
+    }
+    if (s->limit && P1Time(&s->p) >= s->limit) {
+        xbError(s->sys, "stopped after %llu cycles\n", (unsigned long long)s->limit);
+        longjmp(s->errorTarget, 1);
+    }
+}
+
+/* Command - send a command to the vm and wait for it to finish */
+static uint32_t Command(Sim *s, int cmd, uint32_t arg, uint32_t arg2)
+{
+    if (cmd != VM_Continue) {
+        P1WriteLong(&s->p, s->mbox + MBOX_ARG_STS * 4, arg);
+        P1WriteLong(&s->p, s->mbox + MBOX_ARG2_FCN * 4, arg2);
+    }
+    P1WriteLong(&s->p, s->mbox + MBOX_CMD * 4, cmd);
+    while (P1ReadLong(&s->p, s->mbox + MBOX_CMD * 4) != 0)
+        Step(s);
+    return P1ReadLong(&s->p, s->mbox + MBOX_ARG_STS * 4);
+}
+
+/* ReadLong - read a long at a vm address */
+static uint32_t ReadLong(Sim *s, uint32_t addr)
+{
+    Command(s, VM_ReadLong, addr, 0);
+    return P1ReadLong(&s->p, s->mbox + MBOX_ARG2_FCN * 4);
+}
+
+/* WriteLong - write a long at a vm address */
+static void WriteLong(Sim *s, uint32_t addr, uint32_t value)
+{
+    Command(s, VM_WriteLong, addr, value);
+}
+
+/* ReadByte - read a byte at a vm address */
+static int ReadByte(Sim *s, uint32_t addr)
+{
+    Command(s, VM_ReadByte, addr, 0);
+    return (int)(P1ReadLong(&s->p, s->mbox + MBOX_ARG2_FCN * 4) & 0xff);
+}
+
+/* WriteByte - write a byte at a vm address (the vm only writes longs) */
+static void WriteByte(Sim *s, uint32_t addr, int value)
+{
+    int shift = (addr & 3) << 3;
+    addr &= ~3;
+    WriteLong(s, addr, (ReadLong(s, addr) & ~(0xff << shift)) | ((value & 0xff) << shift));
+}
+
+/* GetState - get a register from the vm state vector */
+static uint32_t GetState(Sim *s, int reg)
+{
+    return P1ReadLong(&s->p, s->state + reg * 4);
+}
+
+/* SetState - set a register in the vm state vector */
+static void SetState(Sim *s, int reg, uint32_t value)
+{
+    P1WriteLong(&s->p, s->state + reg * 4, value);
+}
+
+/* PushTos - push the top of stack register onto the stack */
+static void PushTos(Sim *s)
+{
+    uint32_t sp = GetState(s, STATE_SP) - 4;
+    P1WriteLong(&s->p, sp, GetState(s, STATE_TOS));
+    SetState(s, STATE_SP, sp);
+}
+
+/* PopTos - pop the stack into the top of stack register */
+static void PopTos(Sim *s)
+{
+    uint32_t sp = GetState(s, STATE_SP);
+    SetState(s, STATE_TOS, P1ReadLong(&s->p, sp));
+    SetState(s, STATE_SP, sp + 4);
+}
+
+/* PrintC - print a character */
+static void PrintC(Sim *s, int ch)
+{
+    IOPutC(s->io, ch & 0xff);
+}
+
+/* PrintS - print a string */
+static void PrintS(Sim *s, const char *str)
+{
+    while (*str != '\0')
+        PrintC(s, *str++);
+}
+
+/* PrintFixed - print a fixed point value rounded to four decimal places */
+static void PrintFixed(Sim *s, VMVALUE value)
+{
+    unsigned long whole, frac;
+    char buf[32];
+    if (value < 0) {
+        PrintC(s, '-');
+        value = -value;
+    }
+    whole = (VMUVALUE)value >> FIXED_SHIFT;
+    frac = ((unsigned long)(value & 0xffff) * 10000 + 0x8000) >> FIXED_SHIFT;
+    if (frac == 10000) {
+        ++whole;
+        frac = 0;
+    }
+    sprintf(buf, "%lu.%04lu", whole, frac);
+    PrintS(s, buf);
+}
+
+/* InputLine - read a new input line */
+static int InputLine(Sim *s)
+{
+    int result = IOGetLine(s->io, s->inputLine, sizeof(s->inputLine));
+    s->inputPtr = s->inputLine;
+    return result;
+}
+
+/* InputField - find the next input field reading new lines until one is found */
+static char *InputField(Sim *s)
+{
+    char *p = s->inputPtr;
+    for (;;) {
+        while (*p != '\0' && isspace((unsigned char)*p))
+            ++p;
+        if (*p != '\0' || !InputLine(s))
+            break;
+        p = s->inputPtr;
+    }
+    return p;
+}
+
+/* EndInputField - skip past the comma that ends an input field */
+static void EndInputField(Sim *s, char *p)
+{
+    while (*p != '\0' && *p != ',')
+        ++p;
+    s->inputPtr = (*p == ',' ? p + 1 : p);
+}
+
+/* InputInt - get the next integer field of the input line */
+static VMVALUE InputInt(Sim *s)
+{
+    char *p = InputField(s);
+    VMVALUE value = 0, sign = 1;
+    if (*p == '-') {
+        sign = -1;
+        ++p;
+    }
+    while (isdigit((unsigned char)*p))
+        value = value * 10 + *p++ - '0';
+    EndInputField(s, p);
+    return value * sign;
+}
+
+/* InputStr - copy the next field of the input line into a byte array and return its length */
+static VMVALUE InputStr(Sim *s, uint32_t addr)
+{
+    char *p = InputField(s);
+    VMVALUE length = 0;
+    while (*p != '\0' && *p != ',')
+        WriteByte(s, addr + length++, *p++);
+    WriteByte(s, addr + length, 0);
+    EndInputField(s, p);
+    return length;
+}
+
+/* TaskRun - start a function as a task on a slice of the stack and return its id or -1 */
+static VMVALUE TaskRun(Sim *s, uint32_t fcn, VMVALUE arg, VMVALUE size)
+{
+    uint32_t *r, stack, sp;
+    int id;
+
+    /* the code that starts the first task becomes task 0 */
+    if (s->taskCount == 0) {
+        s->taskState[0] = TASK_READY;
+        s->task = 0;
+        s->taskCount = 1;
+    }
+
+    if (size < TASK_MIN_STACK)
+        return -1;
+    size <<= 2;
+
+    /* reuse the stack of a task that has ended or take a slice from the bottom of the current task's stack */
+    for (id = 1; id < s->taskCount; ++id)
+        if (s->taskState[id] == TASK_FREE && s->taskRegs[id][STATE_STACK_SIZE] >= (uint32_t)size)
+            break;
+    r = s->taskRegs[id];
+    if (id == s->taskCount) {
+        stack = GetState(s, STATE_STACK);
+        if (id >= TASK_MAX || GetState(s, STATE_SP) - stack < (uint32_t)size + 4)
+            return -1;
+
+        /* the long below the slice holds the OP_HALT that the function returns to */
+        P1WriteLong(&s->p, stack, 0);
+        r[STATE_STACK] = stack + 4;
+        r[STATE_STACK_SIZE] = size;
+        SetState(s, STATE_STACK, stack + size + 4);
+        SetState(s, STATE_STACK_SIZE, GetState(s, STATE_STACK_SIZE) - size - 4);
+        ++s->taskCount;
+    }
+
+    /* call the function as OP_CALL would with a return to the OP_HALT */
+    sp = r[STATE_STACK] + r[STATE_STACK_SIZE] - 8;
+    P1WriteLong(&s->p, sp + 4, 0);
+    P1WriteLong(&s->p, sp, arg);
+    r[STATE_FP] = sp;
+    r[STATE_SP] = sp;
+    r[STATE_TOS] = r[STATE_STACK] - 4 - s->data;
+    r[STATE_PC] = fcn;
+    s->taskState[id] = TASK_READY;
+
+    return id;
+}
+
+/* NextTask - find the next task in turn that is ready or also waiting for input or return -1 */
+static int NextTask(Sim *s, int waiting)
+{
+    int id, n;
+    for (n = 1; n < s->taskCount; ++n) {
+        id = (s->task + n) % s->taskCount;
+        if (s->taskState[id] == TASK_READY || (waiting && s->taskState[id] == TASK_WAITING))
+            return id;
+    }
+    return -1;
+}
+
+/* SwitchTask - save the registers of the current task and load those of another */
+static void SwitchTask(Sim *s, int next)
+{
+    uint32_t stepping = GetState(s, STATE_STEPPING);
+    int i;
+    for (i = 0; i < STATE_SIZE; ++i)
+        s->taskRegs[s->task][i] = GetState(s, i);
+    s->task = next;
+    for (i = 0; i < STATE_SIZE; ++i)
+        SetState(s, i, s->taskRegs[s->task][i]);
+    SetState(s, STATE_STEPPING, stepping);
+}
+
+/* YieldTask - let the next task run */
+static void YieldTask(Sim *s)
+{
+    int next;
+    if (s->taskCount > 0) {
+        s->taskState[s->task] = TASK_READY;
+        if ((next = NextTask(s, TRUE)) >= 0)
+            SwitchTask(s, next);
+    }
+}
+
+/* WaitTask - let a task that isn't waiting for input run and retry the trap on this task's next turn */
+static int WaitTask(Sim *s)
+{
+    int next;
+    if (s->taskCount == 0 || (next = NextTask(s, FALSE)) < 0)
+        return FALSE;
+    s->taskState[s->task] = TASK_WAITING;
+    SetState(s, STATE_PC, GetState(s, STATE_PC) - 2);
+    SwitchTask(s, next);
+    return TRUE;
+}
+
+/* EndTask - end a task whose function has returned and let the next task run */
+static void EndTask(Sim *s)
+{
+    s->taskState[s->task] = TASK_FREE;
+    SwitchTask(s, NextTask(s, TRUE));
+}
+
+/* IsC3Driver - check for the cache driver of the c3 whose memory chips are modeled */
+static int IsC3Driver(const char *name)
+{
+    char buf[32];
+    int i;
+    for (i = 0; name[i] != '\0' && i < (int)sizeof(buf) - 1; ++i)
+        buf[i] = tolower((unsigned char)name[i]);
+    buf[i] = '\0';
+    return strstr(buf, "c3_cache") != NULL;
+}
+
+static void MyInfo(System *sys, const char *fmt, va_list ap)
+{
+    vfprintf(stdout, fmt, ap);
+}
+
+static void MyError(System *sys, const char *fmt, va_list ap)
+{
+    vfprintf(stderr, fmt, ap);
+}
+
+void Fatal(System *sys, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    xbError(sys, "error: ");
+    xbErrorV(sys, fmt, ap);
+    xbError(sys, "\n");
+    va_end(ap);
+    exit(1);
+}
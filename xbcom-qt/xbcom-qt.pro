@@ -25,13 +25,22 @@ SOURCES += \
     ../src/common/db_system.c \
     ../src/common/db_platform.c \
     ../src/common/db_config.c \
+    ../src/common/db_fixed.c \
+    ../src/common/db_bits.c \
     ../src/compiler/xbcom.c \
     ../src/compiler/db_wrimage.c \
     ../src/compiler/db_types.c \
     ../src/compiler/db_symbols.c \
     ../src/compiler/db_statement.c \
+    ../src/compiler/db_stack.c \
     ../src/compiler/db_scan.c \
+    ../src/compiler/db_profile.c \
+    ../src/compiler/db_placement.c \
+    ../src/compiler/db_passes.c \
     ../src/compiler/db_generate.c \
+    ../src/compiler/db_layout.c \
+    ../src/compiler/db_ir.c \
+    ../src/compiler/db_optimize.c \
     ../src/compiler/db_expr.c \
     ../src/compiler/db_compiler.c \
     ../src/loader/PLoadLib.c \
@@ -52,6 +61,8 @@ HEADERS += \
     ../src/common/db_system.h \
     ../src/common/db_image.h \
     ../src/common/db_config.h \
+    ../src/common/db_fixed.h \
+    ../src/common/db_bits.h \
     ../src/compiler/db_compiler.h \
     ../src/loader/PLoadLib.h \
     ../src/loader/db_packet.h \